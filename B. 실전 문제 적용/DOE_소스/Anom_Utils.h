@@ -8,6 +8,8 @@
 #include <sstream>
 #include <fstream>
 
+#include "doe_trace.hpp"
+
 namespace stat_util {
 
 // -----------------------------------------------------------------------------
@@ -15,6 +17,7 @@ namespace stat_util {
 // Based on a Moro/Wichura-style rational approximation.
 // -----------------------------------------------------------------------------
 inline double normal_quantile_approx(double p) {
+    DOE_TRACE_COUNT("quantile_calls", 1);
     if (p <= 0.0 || p >= 1.0)
         throw std::runtime_error("normal_quantile_approx: p must be in (0,1)");
 
@@ -63,6 +66,13 @@ inline double normal_quantile_approx(double p) {
     }
 }
 
+// -----------------------------------------------------------------------------
+// Standard normal CDF Phi(x)
+// -----------------------------------------------------------------------------
+inline double normal_cdf(double x) {
+    return 0.5 * std::erfc(-x / std::sqrt(2.0));
+}
+
 // -----------------------------------------------------------------------------
 // Student t quantile t_p(df) approximation
 // p in (0,1), df > 0.
@@ -77,6 +87,129 @@ inline double student_t_quantile_approx(double p, double df) {
     return z + (z3 + z) / (4.0 * df); // simple small-df correction
 }
 
+// -----------------------------------------------------------------------------
+// Student t quantile t_p(df), accurate for small and non-integer df
+// Hill (1970), ACM Algorithm 396; exact for df = 1 and 2.
+// Used where df is tiny (e.g. Lenth's d = m / 3) and the approximation above
+// is too coarse.
+// -----------------------------------------------------------------------------
+inline double student_t_quantile(double p, double df) {
+    if (p <= 0.0 || p >= 1.0)
+        throw std::runtime_error("student_t_quantile: p must be in (0,1)");
+    if (df <= 0.0)
+        throw std::runtime_error("student_t_quantile: df must be > 0");
+    if (p < 0.5) return -student_t_quantile(1.0 - p, df);
+    if (p == 0.5) return 0.0;
+
+    const double pi = 3.14159265358979323846;
+    const double n = df;
+    const double P = 2.0 * (1.0 - p);     // two-tailed probability
+    if (n == 1.0) return 1.0 / std::tan(0.5 * pi * P);
+    if (n == 2.0) return std::sqrt(2.0 / (P * (2.0 - P)) - 2.0);
+
+    double a = 1.0 / (n - 0.5);
+    double b = 48.0 / (a * a);
+    double c = ((20700.0 * a / b - 98.0) * a - 16.0) * a + 96.36;
+    double d = ((94.5 / (b + c) - 3.0) / b + 1.0) * std::sqrt(a * pi / 2.0) * n;
+    double x = d * P;
+    double y = std::pow(x, 2.0 / n);
+    if (y > 0.05 + a) {
+        // asymptotic inverse expansion about the normal
+        x = normal_quantile_approx(0.5 * P);
+        y = x * x;
+        if (n < 5.0) c += 0.3 * (n - 4.5) * (x + 0.6);
+        c = (((0.05 * d * x - 5.0) * x - 7.0) * x - 2.0) * x + b + c;
+        y = (((((0.4 * y + 6.3) * y + 36.0) * y + 94.5) / c - y - 3.0) / b + 1.0) * x;
+        y = a * y * y;
+        y = (y > 0.002) ? std::exp(y) - 1.0 : 0.5 * y * y + y;
+    } else {
+        y = ((1.0 / (((n + 6.0) / (n * y) - 0.089 * d - 0.822) * (n + 2.0) * 3.0) + 0.5 / (n + 4.0)) * y - 1.0)
+            * (n + 1.0) / (n + 2.0) + 1.0 / y;
+    }
+    return std::sqrt(n * y);
+}
+
+// -----------------------------------------------------------------------------
+// Regularized incomplete beta I_x(a, b), continued fraction (modified Lentz)
+// -----------------------------------------------------------------------------
+inline double regularized_incomplete_beta(double x, double a, double b) {
+    if (a <= 0.0 || b <= 0.0)
+        throw std::runtime_error("regularized_incomplete_beta: a and b must be > 0");
+    if (x <= 0.0) return 0.0;
+    if (x >= 1.0) return 1.0;
+    if (x > (a + 1.0) / (a + b + 2.0))
+        return 1.0 - regularized_incomplete_beta(1.0 - x, b, a);
+
+    const double front = std::exp(a * std::log(x) + b * std::log1p(-x)
+                                  + std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b)) / a;
+    const double tiny = 1e-300;
+    double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0);
+    if (std::fabs(d) < tiny) d = tiny;
+    d = 1.0 / d;
+    double f = d;
+    for (int m = 1; m <= 500; ++m) {
+        // even step
+        double num = m * (b - m) * x / ((a + 2.0 * m - 1.0) * (a + 2.0 * m));
+        d = 1.0 + num * d; if (std::fabs(d) < tiny) d = tiny; d = 1.0 / d;
+        c = 1.0 + num / c; if (std::fabs(c) < tiny) c = tiny;
+        f *= c * d;
+        // odd step
+        num = -(a + m) * (a + b + m) * x / ((a + 2.0 * m) * (a + 2.0 * m + 1.0));
+        d = 1.0 + num * d; if (std::fabs(d) < tiny) d = tiny; d = 1.0 / d;
+        c = 1.0 + num / c; if (std::fabs(c) < tiny) c = tiny;
+        const double delta = c * d;
+        f *= delta;
+        if (std::fabs(delta - 1.0) < 1e-15) break;
+    }
+    return front * f;
+}
+
+// -----------------------------------------------------------------------------
+// Noncentral t CDF P(T <= t; df, delta), Lenth (1989), AS 243
+// delta = 0 gives the central Student t CDF.
+// -----------------------------------------------------------------------------
+inline double noncentral_t_cdf(double t, double df, double delta) {
+    if (df <= 0.0)
+        throw std::runtime_error("noncentral_t_cdf: df must be > 0");
+    const bool negative = t < 0.0;
+    const double tt  = negative ? -t : t;
+    const double del = negative ? -delta : delta;
+
+    double tnc = 0.0;
+    const double x = tt * tt / (tt * tt + df);
+    if (x > 0.0) {
+        const double lambda = del * del;
+        double p = 0.5 * std::exp(-0.5 * lambda);
+        double q = std::sqrt(2.0 / 3.14159265358979323846) * p * del;
+        double s = 0.5 - p;
+        if (s < 1e-7) s = -0.5 * std::expm1(-0.5 * lambda);
+        double a = 0.5;
+        const double b = 0.5 * df;
+        const double rxb = std::pow(1.0 - x, b);
+        const double albeta = std::lgamma(0.5) + std::lgamma(b) - std::lgamma(0.5 + b);
+        double xodd = regularized_incomplete_beta(x, a, b);
+        double godd = 2.0 * rxb * std::exp(a * std::log(x) - albeta);
+        double xeven = (b * x < 1e-12) ? b * x : 1.0 - rxb;
+        double geven = b * x * rxb;
+        tnc = p * xodd + q * xeven;
+        for (int it = 1; it <= 2000; ++it) {
+            a += 1.0;
+            xodd  -= godd;
+            xeven -= geven;
+            godd  *= x * (a + b - 1.0) / a;
+            geven *= x * (a + b - 0.5) / (a + 0.5);
+            p *= lambda / (2.0 * it);
+            q *= lambda / (2.0 * it + 1.0);
+            s -= p;
+            tnc += p * xodd + q * xeven;
+            if (std::fabs(2.0 * s * (xodd - godd)) < 1e-12) break;
+        }
+    }
+    tnc += normal_cdf(-del);
+    if (negative) tnc = 1.0 - tnc;
+    return std::clamp(tnc, 0.0, 1.0);
+}
+
 // -----------------------------------------------------------------------------
 // Bonferroni-based ANOM h for equal-n case
 // a  : number of groups
@@ -116,11 +249,20 @@ inline double anom_tcrit_bonferroni(double alpha, int a, int df) {
 // ANOM main structures
 // ============================================================================
 
+// Group center / scale estimator
+// Mean   : group means, pooled within-group standard deviation (classic ANOM)
+// Median : group medians, pooled MAD scale (1.4826 * median |x - median_i|)
+// Huber  : Huber M-estimates of the group centers, pooled MAD scale
+enum class AnomEstimator { Mean, Median, Huber };
+
 struct AnomOptions {
     double alpha = 0.05;        // global significance level
     bool assume_equal_n = true; // if true and all groups have same n, use equal-n ANOM h
     bool bonferroni = true;     // if true, apply Bonferroni correction across groups
 
+    AnomEstimator estimator = AnomEstimator::Mean;
+    double huber_k = 1.345;     // Huber tuning constant, in units of the MAD scale
+
     // SVG drawing options
     double svg_width  = 900.0;
     double svg_height = 500.0;
@@ -130,7 +272,7 @@ struct AnomOptions {
 struct AnomGroupResult {
     std::string name;
     int n = 0;
-    double mean   = std::numeric_limits<double>::quiet_NaN();
+    double mean   = std::numeric_limits<double>::quiet_NaN(); // group center (see AnomEstimator)
     double margin = std::numeric_limits<double>::quiet_NaN();
     double UDL    = std::numeric_limits<double>::quiet_NaN();
     double LDL    = std::numeric_limits<double>::quiet_NaN();
@@ -170,6 +312,7 @@ public:
     // Fit ANOM: compute group means, pooled variance, grand mean, decision limits
     // -------------------------------------------------------------------------
     void fit() {
+        DOE_TRACE_SCOPE("Anom::fit");
         if (groups_.empty())
             throw std::runtime_error("Anom::fit: no groups to fit");
 
@@ -187,6 +330,8 @@ public:
             means[i] = s / ns[i];
         }
 
+        DOE_TRACE_COUNT("rows_scanned", N);
+
         // Grand mean (weighted by group sizes)
         double grand_sum = 0.0;
         for (int i = 0; i < a; ++i) grand_sum += means[i] * ns[i];
@@ -210,6 +355,19 @@ public:
         mse_      = ss_within / static_cast<double>(df_within);
         s_within_ = std::sqrt(mse_);
 
+        // Standard error of a group center relative to s / sqrt(n)
+        double se_factor = 1.0;
+        if (opt_.estimator != AnomEstimator::Mean) {
+            robust_centers_and_scale(means);
+            grand_sum = 0.0;
+            for (int i = 0; i < a; ++i) grand_sum += means[i] * ns[i];
+            grand_mean_ = grand_sum / static_cast<double>(N);
+            // asymptotic efficiency at the normal: median 2/pi, Huber(1.345) 0.95
+            se_factor = (opt_.estimator == AnomEstimator::Median)
+                      ? std::sqrt(std::acos(-1.0) / 2.0)
+                      : 1.0 / std::sqrt(0.95);
+        }
+
         // Decide margins per group
         results_.clear();
         results_.reserve(a);
@@ -242,11 +400,11 @@ public:
             if (equal_n && !std::isnan(h)) {
                 // equal-n ANOM:
                 // margin_i = h * s * sqrt(1 / n_i)
-                margin_i = h * s_within_ * std::sqrt(1.0 / ns[i]);
+                margin_i = h * s_within_ * se_factor * std::sqrt(1.0 / ns[i]);
             } else {
                 // general t-based margin:
                 // margin_i = tcrit * s * sqrt(1 / n_i)
-                margin_i = tcrit * s_within_ * std::sqrt(1.0 / ns[i]);
+                margin_i = tcrit * s_within_ * se_factor * std::sqrt(1.0 / ns[i]);
             }
 
             r.margin = margin_i;
@@ -270,8 +428,29 @@ public:
     // All group results
     const std::vector<AnomGroupResult>& results() const { ensure_computed(); return results_; }
 
+    // Pooled variance used for the limits (s_within^2)
+    double mse() const { ensure_computed(); return mse_; }
+
+    // Raw groups and options (serialization, e.g. doe_result_cache.hpp)
+    const AnomOptions& options() const { return opt_; }
+    int num_groups() const { return static_cast<int>(groups_.size()); }
+    const std::string& group_name(int i) const { return groups_.at(i).name; }
+    const std::vector<double>& group_values(int i) const { return groups_.at(i).values; }
+
+    // Restore a previously computed fit for the groups already added (no recomputation)
+    void restore_fit(std::vector<AnomGroupResult> results, double grand_mean, double mse) {
+        if (results.size() != groups_.size())
+            throw std::runtime_error("Anom::restore_fit: result count must match group count");
+        results_    = std::move(results);
+        grand_mean_ = grand_mean;
+        mse_        = mse;
+        s_within_   = std::sqrt(mse);
+        computed_   = true;
+    }
+
     // Save ANOM results to CSV
     void save_csv(const std::string& path) const {
+        DOE_TRACE_SCOPE("Anom::save_csv");
         ensure_computed();
         std::ofstream ofs(path);
         if (!ofs)
@@ -291,6 +470,7 @@ public:
 
     // Render ANOM chart as simple SVG
     std::string render_svg() const {
+        DOE_TRACE_SCOPE("Anom::render_svg");
         ensure_computed();
         const double W = opt_.svg_width;
         const double H = opt_.svg_height;
@@ -386,6 +566,19 @@ public:
         return ss.str();
     }
 
+    // Median of a non-empty sample (mean of the two middle values for even n); reorders v
+    static double median_in_place(std::vector<double>& v) {
+        size_t n = v.size();
+        size_t h = n / 2;
+        std::nth_element(v.begin(), v.begin() + h, v.end());
+        double hi = v[h];
+        if (n % 2 == 1) return hi;
+        double lo = *std::max_element(v.begin(), v.begin() + h);
+        return 0.5 * (lo + hi);
+    }
+
+    static double median_of(std::vector<double> v) { return median_in_place(v); }
+
 private:
     struct Group {
         std::string name;
@@ -398,6 +591,44 @@ private:
         return true;
     }
 
+    // Replace group means by medians / Huber centers and s_within_ by the pooled
+    // MAD scale. Falls back to the classic pooled s when the MAD is zero.
+    void robust_centers_and_scale(std::vector<double>& centers) {
+        const int a = static_cast<int>(groups_.size());
+        std::vector<double> abs_dev;
+        for (int i = 0; i < a; ++i) {
+            const auto& v = groups_[i].values;
+            centers[i] = median_of(v);
+            for (double x : v) abs_dev.push_back(std::fabs(x - centers[i]));
+        }
+        double s = 1.4826 * median_of(abs_dev);
+        if (s > 0.0) {
+            s_within_ = s;
+            mse_      = s * s;
+        }
+        if (opt_.estimator != AnomEstimator::Huber) return;
+
+        const double c = opt_.huber_k * s_within_;
+        for (int i = 0; i < a; ++i) {
+            const auto& v = groups_[i].values;
+            double mu = centers[i];
+            for (int it = 0; it < 50 && c > 0.0; ++it) {
+                double sw = 0.0, swx = 0.0;
+                for (double x : v) {
+                    double d = std::fabs(x - mu);
+                    double w = (d <= c) ? 1.0 : c / d;
+                    sw  += w;
+                    swx += w * x;
+                }
+                double next = swx / sw;
+                bool done = std::fabs(next - mu) <= 1e-10 * (1.0 + std::fabs(mu));
+                mu = next;
+                if (done) break;
+            }
+            centers[i] = mu;
+        }
+    }
+
     static double round2(double x) {
         return std::round(x * 100.0) / 100.0;
     }
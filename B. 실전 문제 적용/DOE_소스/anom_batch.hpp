@@ -0,0 +1,332 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_run_mask.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Batched ANOM: one factor grouping, many response channels
+//
+// Input is a column-major N x R block (response r = column r, contiguous runs).
+// SIMD lanes run across responses: a block of W responses is walked run by run,
+// and the W values of each active run are added to the accumulators of its level.
+// Masked runs are skipped outright, so their values (NaN, Inf) never enter a sum.
+//   AVX-512 : W = 8, the 8 values of a run are gathered with one index vector
+//   AVX2    : W = 4, 4 x 4 tiles (4 runs of 4 columns) are transposed in registers
+//   scalar  : the leftover responses and the fallback, one column at a time
+// The path is chosen at compile time (-mavx2, -mavx512f, -march=native,
+// MSVC /arch:AVX2). Critical values depend only on the group sizes, so they are
+// computed once per factor instead of once per response.
+// Results match Anom::fit (AnomEstimator::Mean) for every column.
+// -----------------------------------------------------------------------------
+
+// Structure-of-arrays ANOM output; per-group arrays are indexed [g * responses + r]
+struct AnomBatchResult {
+    int groups = 0;
+    int responses = 0;
+    std::vector<int> level;                 // OA level index of group g (empty levels dropped)
+    std::vector<int> n;                     // runs per group (shared by all responses)
+    int df_within = 0;
+    double h     = std::numeric_limits<double>::quiet_NaN();  // equal-n ANOM factor, or
+    double tcrit = std::numeric_limits<double>::quiet_NaN();  // t critical value (unequal n)
+
+    std::vector<double> grand_mean;         // [r]
+    std::vector<double> s_within;           // [r]
+    std::vector<double> mean;               // [g * responses + r]
+    std::vector<double> margin;
+    std::vector<double> UDL;
+    std::vector<double> LDL;
+    std::vector<std::uint8_t> significant_high;
+    std::vector<std::uint8_t> significant_low;
+
+    size_t index(int g, int r) const { return static_cast<size_t>(g) * responses + r; }
+};
+
+namespace anom_batch_detail {
+
+constexpr int kMaxGroups = 16;
+
+#if defined(__AVX512F__)
+constexpr int kLanes = 8;
+#elif defined(__AVX2__)
+constexpr int kLanes = 4;
+#else
+constexpr int kLanes = 1;
+#endif
+
+inline const char* simd_path()
+{
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+// Level of each run (-1 = masked) and the run count of each level
+struct GroupLayout {
+    int runs = 0;
+    int L = 0;
+    std::vector<int> level;
+    std::vector<int> n;
+    int first_active = -1;
+};
+
+inline GroupLayout make_layout(const OrthogonalArray& oa, int factor_idx, const RunMask& mask)
+{
+    GroupLayout G;
+    G.runs = oa.runs;
+    G.L = oa.levels;
+    if (G.L <= 0 || G.L > kMaxGroups)
+        throw std::runtime_error("build_anom_batch_for_factor: levels must be in [1, "
+                                 + std::to_string(kMaxGroups) + "]");
+    G.level.assign(oa.runs, -1);
+    G.n.assign(G.L, 0);
+    for (int r = 0; r < oa.runs; ++r) {
+        if (!mask.empty() && !mask.test(r)) continue;
+        int lev = oa.at(r, factor_idx);
+        if (lev < 0 || lev >= G.L)
+            throw std::runtime_error("build_anom_batch_for_factor: level index out of range");
+        G.level[r] = lev;
+        ++G.n[lev];
+        if (G.first_active < 0) G.first_active = r;
+    }
+    return G;
+}
+
+// One column: S[g] = sum (y - shift), Q[g] = sum (y - shift)^2 over the runs of group g
+inline void accumulate_column(const GroupLayout& G, const double* y, double shift, double* S, double* Q)
+{
+    for (int g = 0; g < G.L; ++g) S[g] = Q[g] = 0.0;
+    for (int i = 0; i < G.runs; ++i) {
+        int lev = G.level[i];
+        if (lev < 0) continue;
+        double d = y[i] - shift;
+        S[lev] += d;
+        Q[lev] += d * d;
+    }
+}
+
+// kLanes columns starting at Y (stride ldy): S/Q[g * kLanes + lane], shift[lane]
+inline void accumulate_block(const GroupLayout& G, const double* Y, int ldy, const double* shift,
+                             double* S, double* Q)
+{
+    const int N = G.runs;
+    const int L = G.L;
+#if defined(__AVX512F__)
+    __m512d s[kMaxGroups], q[kMaxGroups];
+    for (int g = 0; g < L; ++g) { s[g] = _mm512_setzero_pd(); q[g] = _mm512_setzero_pd(); }
+    const __m512d c = _mm512_loadu_pd(shift);
+    const long long ld = ldy;
+    const __m512i idx = _mm512_set_epi64(7 * ld, 6 * ld, 5 * ld, 4 * ld, 3 * ld, 2 * ld, ld, 0);
+    for (int i = 0; i < N; ++i) {
+        int lev = G.level[i];
+        if (lev < 0) continue;
+        __m512d d = _mm512_sub_pd(_mm512_i64gather_pd(idx, Y + i, 8), c);
+        s[lev] = _mm512_add_pd(s[lev], d);
+        q[lev] = _mm512_add_pd(q[lev], _mm512_mul_pd(d, d));
+    }
+    for (int g = 0; g < L; ++g) {
+        _mm512_storeu_pd(S + g * kLanes, s[g]);
+        _mm512_storeu_pd(Q + g * kLanes, q[g]);
+    }
+#elif defined(__AVX2__)
+    __m256d s[kMaxGroups], q[kMaxGroups];
+    for (int g = 0; g < L; ++g) { s[g] = _mm256_setzero_pd(); q[g] = _mm256_setzero_pd(); }
+    const __m256d c = _mm256_loadu_pd(shift);
+    const double* y0 = Y;
+    const double* y1 = Y + ldy;
+    const double* y2 = Y + 2 * static_cast<size_t>(ldy);
+    const double* y3 = Y + 3 * static_cast<size_t>(ldy);
+    auto add = [&](int lev, __m256d v) {
+        if (lev < 0) return;
+        __m256d d = _mm256_sub_pd(v, c);
+        s[lev] = _mm256_add_pd(s[lev], d);
+        q[lev] = _mm256_add_pd(q[lev], _mm256_mul_pd(d, d));
+    };
+    int i = 0;
+    for (; i + 4 <= N; i += 4) {
+        // rows of the tile are columns; after the transpose row j holds run i + j
+        __m256d a0 = _mm256_loadu_pd(y0 + i), a1 = _mm256_loadu_pd(y1 + i);
+        __m256d a2 = _mm256_loadu_pd(y2 + i), a3 = _mm256_loadu_pd(y3 + i);
+        __m256d t0 = _mm256_unpacklo_pd(a0, a1), t1 = _mm256_unpackhi_pd(a0, a1);
+        __m256d t2 = _mm256_unpacklo_pd(a2, a3), t3 = _mm256_unpackhi_pd(a2, a3);
+        add(G.level[i],     _mm256_permute2f128_pd(t0, t2, 0x20));
+        add(G.level[i + 1], _mm256_permute2f128_pd(t1, t3, 0x20));
+        add(G.level[i + 2], _mm256_permute2f128_pd(t0, t2, 0x31));
+        add(G.level[i + 3], _mm256_permute2f128_pd(t1, t3, 0x31));
+    }
+    for (; i < N; ++i)
+        add(G.level[i], _mm256_set_pd(y3[i], y2[i], y1[i], y0[i]));
+    for (int g = 0; g < L; ++g) {
+        _mm256_storeu_pd(S + g * kLanes, s[g]);
+        _mm256_storeu_pd(Q + g * kLanes, q[g]);
+    }
+#else
+    (void)ldy;
+    (void)N;
+    (void)L;
+    accumulate_column(G, Y, shift[0], S, Q);
+#endif
+}
+
+} // namespace anom_batch_detail
+
+// -----------------------------------------------------------------------------
+// Batched ANOM for one factor
+// Y      : column-major block, response r starts at Y + r * ldy (ldy >= oa.runs)
+// mask   : runs to use (shared by all responses); values of masked runs are never read
+//          into a sum, but NaN in an active run propagates to that response
+// threads: responses are split into contiguous blocks across threads
+// -----------------------------------------------------------------------------
+inline AnomBatchResult build_anom_batch_for_factor(
+    const OrthogonalArray& oa,
+    int factor_idx,
+    const double* Y,
+    int responses,
+    int ldy,
+    const AnomOptions& opt = AnomOptions{},
+    const RunMask& mask = RunMask{},
+    int threads = 1)
+{
+    DOE_TRACE_SCOPE("build_anom_batch_for_factor");
+    if (factor_idx < 0 || factor_idx >= oa.factors)
+        throw std::runtime_error("build_anom_batch_for_factor: factor_idx out of range");
+    if (responses <= 0 || ldy < oa.runs)
+        throw std::runtime_error("build_anom_batch_for_factor: need responses > 0 and ldy >= oa.runs");
+    if (!mask.empty() && mask.runs != oa.runs)
+        throw std::runtime_error("build_anom_batch_for_factor: mask size must match oa.runs");
+    if (opt.estimator != AnomEstimator::Mean)
+        throw std::runtime_error("build_anom_batch_for_factor: only AnomEstimator::Mean is batched");
+
+    using namespace anom_batch_detail;
+    GroupLayout G = make_layout(oa, factor_idx, mask);
+    if (G.first_active < 0)
+        throw std::runtime_error("build_anom_batch_for_factor: no active runs");
+
+    AnomBatchResult out;
+    out.responses = responses;
+    int used = 0;
+    for (int g = 0; g < G.L; ++g) {
+        if (G.n[g] == 0) continue;
+        out.level.push_back(g);
+        out.n.push_back(G.n[g]);
+        used += G.n[g];
+    }
+    const int a = static_cast<int>(out.level.size());
+    out.groups = a;
+    out.df_within = used - a;
+    if (out.df_within <= 0)
+        throw std::runtime_error("build_anom_batch_for_factor: insufficient degrees of freedom");
+
+    // Same critical values as Anom::fit, once for all responses
+    bool equal_n = opt.assume_equal_n && std::all_of(out.n.begin(), out.n.end(),
+                                                     [&](int v) { return v == out.n[0]; });
+    if (opt.bonferroni) {
+        if (equal_n) out.h = stat_util::anom_h_bonferroni_equal_n(opt.alpha, a, out.n[0], out.df_within);
+        else         out.tcrit = stat_util::anom_tcrit_bonferroni(opt.alpha, a, out.df_within);
+    } else {
+        out.tcrit = stat_util::student_t_quantile_approx(1.0 - opt.alpha / 2.0,
+                                                         static_cast<double>(out.df_within));
+        equal_n = false;
+    }
+    const double crit = equal_n ? out.h : out.tcrit;
+
+    const size_t cells = static_cast<size_t>(a) * responses;
+    out.grand_mean.resize(responses);
+    out.s_within.resize(responses);
+    out.mean.resize(cells);
+    out.margin.resize(cells);
+    out.UDL.resize(cells);
+    out.LDL.resize(cells);
+    out.significant_high.resize(cells);
+    out.significant_low.resize(cells);
+
+    // Limits of response r from its group sums S[g * stride], Q[g * stride]
+    auto finish = [&](int r, double shift, const double* S, const double* Q, int stride) {
+        double total = 0.0, ss_within = 0.0;
+        for (int j = 0; j < a; ++j) {
+            const int g = out.level[j] * stride;
+            total += S[g];
+            ss_within += std::max(Q[g] - S[g] * S[g] / out.n[j], 0.0);
+        }
+        const double grand = shift + total / used;
+        const double s = std::sqrt(ss_within / out.df_within);
+        out.grand_mean[r] = grand;
+        out.s_within[r] = s;
+        for (int j = 0; j < a; ++j) {
+            size_t k = out.index(j, r);
+            double mean = shift + S[out.level[j] * stride] / out.n[j];
+            double margin = crit * s * std::sqrt(1.0 / out.n[j]);
+            out.mean[k]   = mean;
+            out.margin[k] = margin;
+            out.UDL[k]    = grand + margin;
+            out.LDL[k]    = grand - margin;
+            out.significant_high[k] = mean > grand + margin;
+            out.significant_low[k]  = mean < grand - margin;
+        }
+    };
+
+    doe_parallel::parallel_chunks(responses, threads, [&](int, int begin, int end) {
+        double S[kMaxGroups * kLanes], Q[kMaxGroups * kLanes], shift[kLanes];
+        int r = begin;
+        for (; r + kLanes <= end; r += kLanes) {
+            const double* y = Y + static_cast<size_t>(r) * ldy;
+            for (int l = 0; l < kLanes; ++l)   // shift keeps sums of squares well conditioned
+                shift[l] = y[static_cast<size_t>(l) * ldy + G.first_active];
+            accumulate_block(G, y, ldy, shift, S, Q);
+            for (int l = 0; l < kLanes; ++l) finish(r + l, shift[l], S + l, Q + l, kLanes);
+        }
+        for (; r < end; ++r) {
+            const double* y = Y + static_cast<size_t>(r) * ldy;
+            accumulate_column(G, y, y[G.first_active], S, Q);
+            finish(r, y[G.first_active], S, Q, 1);
+        }
+    });
+    DOE_TRACE_COUNT("rows_scanned", static_cast<double>(oa.runs) * responses);
+    return out;
+}
+
+inline AnomBatchResult build_anom_batch_for_factor(
+    const OrthogonalArray& oa,
+    int factor_idx,
+    const Eigen::MatrixXd& Y,
+    const AnomOptions& opt = AnomOptions{},
+    const RunMask& mask = RunMask{},
+    int threads = 1)
+{
+    if (Y.rows() != oa.runs)
+        throw std::runtime_error("build_anom_batch_for_factor: Y rows must match oa.runs");
+    return build_anom_batch_for_factor(oa, factor_idx, Y.data(), static_cast<int>(Y.cols()),
+                                       static_cast<int>(Y.rows()), opt, mask, threads);
+}
+
+// All factors of the OA; result[j] belongs to factor j
+inline std::vector<AnomBatchResult> build_anom_batch_for_all_factors(
+    const OrthogonalArray& oa,
+    const Eigen::MatrixXd& Y,
+    const AnomOptions& opt = AnomOptions{},
+    const RunMask& mask = RunMask{},
+    int threads = 1)
+{
+    std::vector<AnomBatchResult> out(oa.factors);
+    for (int j = 0; j < oa.factors; ++j)
+        out[j] = build_anom_batch_for_factor(oa, j, Y, opt, mask, threads);
+    return out;
+}
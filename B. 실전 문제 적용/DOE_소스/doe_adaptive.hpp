@@ -0,0 +1,281 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "Anom_Utils.h"
+#include "response_surface_quadratic.hpp"
+#include "doe_optimal_design.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Sequential (adaptive) experimentation on a candidate set
+//
+// The quadratic model of ResponseSurfaceQuadratic is kept in coded units
+// (each factor mapped to [-1, 1] as in build_d_optimal_design) as the triangular
+// factor R of the QR decomposition of [sqrt(ridge) I; Phi] and z = Q'y. A new
+// result is a Givens row update of R and z in O(m^2); nothing is refactored.
+//   beta = R^-1 z,   var(x) = sigma^2 |R^-T phi(x)|^2
+// Acquisition criteria, scored in parallel over fixed blocks of candidates with
+// one triangular solve per block (PredictionVariance keeps the solved blocks for
+// its second pass):
+//   ExpectedImprovement : EI over the best observed response (maximize / minimize)
+//   PredictionVariance  : largest drop of the average prediction variance over the
+//                         candidates (I-optimal augmentation)
+//   DOptimal            : largest det(R'R) increase, log(1 + |R^-T phi|^2)
+// propose_batch picks several runs greedily; each pick is added to a copy of R
+// with its predicted response ("kriging believer") before the next pick.
+// -----------------------------------------------------------------------------
+
+enum class AcquisitionKind { ExpectedImprovement, PredictionVariance, DOptimal };
+
+struct AdaptiveOptions {
+    AcquisitionKind acquisition = AcquisitionKind::ExpectedImprovement;
+    bool maximize = true;          // optimization direction for ExpectedImprovement
+    double xi = 0.0;               // EI margin: improvement must exceed xi
+    double ridge = 1e-6;           // prior rows sqrt(ridge) I, so R is invertible from the first run
+    double noise_sd = 0.0;         // used for sigma until n > m (0: spread of the observed y)
+    bool allow_repeats = false;    // a candidate may be run more than once
+    int threads = 0;               // <= 0: hardware concurrency
+};
+
+class AdaptiveDesign {
+public:
+    explicit AdaptiveDesign(CandidateSet candidates, const AdaptiveOptions& opt = AdaptiveOptions{})
+        : cs_(std::move(candidates)), opt_(opt)
+    {
+        if (cs_.size() == 0)
+            throw std::runtime_error("AdaptiveDesign: empty candidate set");
+        if (!(opt_.ridge > 0.0))
+            throw std::runtime_error("AdaptiveDesign: ridge must be > 0");
+        F_ = doe_detail::coded_candidate_features(cs_);
+        m_ = static_cast<int>(F_.cols());
+        state_.R = std::sqrt(opt_.ridge) * Eigen::MatrixXd::Identity(m_, m_);
+        state_.z = Eigen::VectorXd::Zero(m_);
+        runs_.assign(cs_.size(), 0);
+    }
+
+    // Record the result of running candidate c; refits in O(m^2)
+    void add_result(int c, double y) {
+        check(c, "add_result");
+        if (!std::isfinite(y))
+            throw std::runtime_error("AdaptiveDesign::add_result: response must be finite");
+        DOE_TRACE_SCOPE("AdaptiveDesign::add_result");
+        givens_update(state_, F_.row(c).transpose(), y);
+        ++runs_[c];
+        history_.push_back(c);
+        y_.push_back(y);
+        if (best_ < 0 || better(y, y_[best_])) best_ = static_cast<int>(y_.size()) - 1;
+        beta_valid_ = false;
+    }
+
+    // Next candidate to run (-1 if none is left)
+    int propose() const { return propose_batch(1).front(); }
+
+    // q runs chosen greedily (kriging believer); -1 entries when candidates run out
+    std::vector<int> propose_batch(int q) const {
+        DOE_TRACE_SCOPE("AdaptiveDesign::propose_batch");
+        if (q < 1)
+            throw std::runtime_error("AdaptiveDesign::propose_batch: q must be >= 1");
+        State s = state_;
+        std::vector<int> taken(runs_);
+        double best = y_.empty() ? std::numeric_limits<double>::quiet_NaN() : y_[best_];
+        const double s2 = sigma2();
+        std::vector<int> out;
+        std::vector<double> score;
+        for (int t = 0; t < q; ++t) {
+            const Eigen::VectorXd beta = solve_beta(s);
+            score_candidates(s, beta, s2, best, score);
+            int pick = -1;
+            for (int c = 0; c < cs_.size(); ++c) {
+                if (!opt_.allow_repeats && taken[c]) continue;
+                if (pick < 0 || score[c] > score[pick]) pick = c;
+            }
+            out.push_back(pick);
+            if (pick < 0) continue;
+            ++taken[pick];
+            const double mu = F_.row(pick).dot(beta);
+            if (std::isnan(best) || better(mu, best)) best = mu;
+            givens_update(s, F_.row(pick).transpose(), mu);
+        }
+        return out;
+    }
+
+    // Acquisition value of every candidate for the current model
+    std::vector<double> acquisition() const {
+        std::vector<double> score;
+        score_candidates(state_, coefficients(), sigma2(),
+                         y_.empty() ? std::numeric_limits<double>::quiet_NaN() : y_[best_], score);
+        return score;
+    }
+
+    double predict(int c) const { check(c, "predict"); return F_.row(c).dot(coefficients()); }
+
+    double prediction_sd(int c) const {
+        check(c, "prediction_sd");
+        Eigen::VectorXd w = state_.R.transpose().triangularView<Eigen::Lower>().solve(F_.row(c).transpose());
+        return std::sqrt(sigma2()) * w.norm();
+    }
+
+    // Residual variance: RSS / (n - m) once n > m, else noise_sd^2 or the spread of y
+    double sigma2() const {
+        const int n = runs();
+        if (n > m_) return std::max(state_.rss / (n - m_), 1e-300);
+        if (opt_.noise_sd > 0.0) return opt_.noise_sd * opt_.noise_sd;
+        if (n >= 2) {
+            double mean = 0.0, ss = 0.0;
+            for (double v : y_) mean += v;
+            mean /= n;
+            for (double v : y_) ss += (v - mean) * (v - mean);
+            if (ss > 0.0) return ss / (n - 1);
+        }
+        return 1.0;
+    }
+
+    // Coefficients in coded units (ResponseSurfaceQuadratic term order)
+    const Eigen::VectorXd& coefficients() const {
+        if (!beta_valid_) {
+            beta_ = solve_beta(state_);
+            beta_valid_ = true;
+        }
+        return beta_;
+    }
+
+    // Physical-unit ResponseSurfaceQuadratic fitted to the runs so far (QR refit)
+    bool surface(ResponseSurfaceQuadratic& rs) const {
+        std::vector<std::vector<double>> design;
+        design.reserve(history_.size());
+        for (int c : history_) design.push_back(cs_.points[c]);
+        return rs.fit(design, y_);
+    }
+
+    int runs() const { return static_cast<int>(y_.size()); }
+    int num_terms() const { return m_; }
+    const std::vector<int>& history() const { return history_; }      // candidate of each run
+    const std::vector<double>& responses() const { return y_; }
+    int best_run() const { return best_; }                            // index into history (-1: none)
+    double best_value() const {
+        return best_ < 0 ? std::numeric_limits<double>::quiet_NaN() : y_[best_];
+    }
+    const CandidateSet& candidates() const { return cs_; }
+
+private:
+    struct State {
+        Eigen::MatrixXd R;          // m x m upper triangular
+        Eigen::VectorXd z;          // Q'y
+        double rss = 0.0;           // residual sum of squares
+    };
+
+    static constexpr int kBlock = 256;   // candidates per scoring block
+
+    void check(int c, const char* fn) const {
+        if (c < 0 || c >= cs_.size())
+            throw std::runtime_error(std::string("AdaptiveDesign::") + fn + ": candidate out of range");
+    }
+
+    bool better(double a, double b) const { return opt_.maximize ? a > b : a < b; }
+
+    static void givens_update(State& s, Eigen::VectorXd phi, double y) {
+        const int m = static_cast<int>(phi.size());
+        for (int j = 0; j < m; ++j) {
+            if (phi(j) == 0.0) continue;
+            const double r = std::hypot(s.R(j, j), phi(j));
+            const double c = s.R(j, j) / r, sn = phi(j) / r;
+            s.R(j, j) = r;
+            for (int k = j + 1; k < m; ++k) {
+                const double a = s.R(j, k), b = phi(k);
+                s.R(j, k) = c * a + sn * b;
+                phi(k)    = -sn * a + c * b;
+            }
+            const double a = s.z(j);
+            s.z(j) = c * a + sn * y;
+            y      = -sn * a + c * y;
+        }
+        s.rss += y * y;
+    }
+
+    static Eigen::VectorXd solve_beta(const State& s) {
+        return s.R.triangularView<Eigen::Upper>().solve(s.z);
+    }
+
+    // score[c] for every candidate; blocks of kBlock candidates in parallel
+    void score_candidates(const State& s, const Eigen::VectorXd& beta, double s2, double best,
+                          std::vector<double>& score) const
+    {
+        const int M = cs_.size();
+        const int blocks = (M + kBlock - 1) / kBlock;
+        score.assign(M, 0.0);
+        auto solve_block = [&](int b) {
+            const int c0 = b * kBlock, len = std::min(kBlock, M - c0);
+            Eigen::MatrixXd W = F_.middleRows(c0, len).transpose();
+            s.R.transpose().triangularView<Eigen::Lower>().solveInPlace(W);
+            return W;   // m x len, column j = R^-T phi(c0 + j)
+        };
+
+        if (opt_.acquisition == AcquisitionKind::PredictionVariance) {
+            // Sum of squared covariances: sum_c (w_c . w_x)^2 = w_x' (sum_c w_c w_c') w_x
+            // The solved blocks are kept for the second pass (M x m doubles, as F_),
+            // so each candidate costs one triangular solve
+            std::vector<Eigen::MatrixXd> Ws(blocks), part(blocks);
+            doe_parallel::parallel_for(blocks, opt_.threads, [&](int b) {
+                Ws[b] = solve_block(b);
+                part[b] = Ws[b] * Ws[b].transpose();
+            });
+            Eigen::MatrixXd G = Eigen::MatrixXd::Zero(m_, m_);
+            for (const auto& p : part) G += p;   // block order: same sum for any thread count
+            doe_parallel::parallel_for(blocks, opt_.threads, [&](int b) {
+                const Eigen::MatrixXd& W = Ws[b];
+                const Eigen::MatrixXd GW = G * W;
+                for (Eigen::Index j = 0; j < W.cols(); ++j)
+                    score[b * kBlock + j] = W.col(j).dot(GW.col(j)) / (M * (1.0 + W.col(j).squaredNorm()));
+            });
+            return;
+        }
+
+        const double sd = std::sqrt(s2);
+        doe_parallel::parallel_for(blocks, opt_.threads, [&](int b) {
+            Eigen::MatrixXd W = solve_block(b);
+            const int c0 = b * kBlock;
+            for (Eigen::Index j = 0; j < W.cols(); ++j) {
+                const double d = W.col(j).squaredNorm();
+                double v;
+                if (opt_.acquisition == AcquisitionKind::DOptimal) {
+                    v = std::log1p(d);
+                } else {
+                    const double mu = F_.row(c0 + j).dot(beta);
+                    const double sx = sd * std::sqrt(d);
+                    if (std::isnan(best)) {
+                        v = sx;   // nothing observed yet: explore
+                    } else {
+                        const double imp = (opt_.maximize ? mu - best : best - mu) - opt_.xi;
+                        if (sx <= 0.0) {
+                            v = std::max(imp, 0.0);
+                        } else {
+                            const double u = imp / sx;
+                            const double pdf = std::exp(-0.5 * u * u) / std::sqrt(2.0 * 3.14159265358979323846);
+                            v = imp * stat_util::normal_cdf(u) + sx * pdf;
+                        }
+                    }
+                }
+                score[c0 + j] = v;
+            }
+        });
+    }
+
+    CandidateSet cs_;
+    AdaptiveOptions opt_;
+    Eigen::MatrixXd F_;             // coded features of the candidates, M x m
+    int m_ = 0;
+    State state_;
+    std::vector<int> runs_;         // times each candidate was run
+    std::vector<int> history_;
+    std::vector<double> y_;
+    int best_ = -1;
+    mutable Eigen::VectorXd beta_;
+    mutable bool beta_valid_ = false;
+};
@@ -0,0 +1,434 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <utility>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <bit>
+#include <sstream>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Alias and word-length analysis of an orthogonal array, before any run is made
+//
+// Alias matrix: for a primary model X1 (the terms to be estimated) and a set of
+// potentially active terms X2,
+//   E[b1] = beta1 + A beta2,   A = (X1'X1)^-1 X1'X2
+// Primary terms that are linear combinations of earlier primary terms are not
+// estimable; they are reported with that combination and left out of A.
+// Term columns are products of per-factor level lookups on the packed level data.
+//
+// Generalized word-length pattern (Xu & Wu 2001) of a set of columns, for any
+// mixed-level array: with orthonormal contrasts,
+//   A_j = N^-2 sum_{r,s} [t^j] prod_k g_k(t),
+//   g_k = 1 + (s_k - 1) t  if runs r, s share the level of column k, else 1 - t.
+// Run pairs are compared on bit-packed levels (one bit plane per level bit), so
+// only the number of matching columns per level class is needed. Resolution is
+// the smallest j >= 1 with A_j > 0; generalized minimum aberration compares
+// (A_1, A_2, ...) lexicographically.
+// -----------------------------------------------------------------------------
+
+// Product of factor powers; factor = position in factor_indices. Empty: intercept
+struct ModelTerm {
+    std::vector<std::pair<int, int>> powers;   // (factor, exponent >= 1)
+
+    std::string name(const std::vector<std::string>& names = {}) const {
+        if (powers.empty()) return "1";
+        std::string s;
+        for (const auto& [f, e] : powers) {
+            if (!s.empty()) s += "*";
+            s += f < (int)names.size() ? names[f] : "x" + std::to_string(f);
+            if (e > 1) s += "^" + std::to_string(e);
+        }
+        return s;
+    }
+};
+
+// Terms of ResponseSurfaceQuadratic in coefficient order
+inline std::vector<ModelTerm> quadratic_model_terms(int k)
+{
+    std::vector<ModelTerm> t(ResponseSurfaceQuadratic::num_terms(k));
+    for (int i = 0; i < k; ++i) {
+        t[ResponseSurfaceQuadratic::linear_index(i)].powers = {{i, 1}};
+        t[ResponseSurfaceQuadratic::squared_index(k, i)].powers = {{i, 2}};
+        for (int j = i + 1; j < k; ++j)
+            t[ResponseSurfaceQuadratic::interaction_index(k, i, j)].powers = {{i, 1}, {j, 1}};
+    }
+    return t;
+}
+
+// Intercept and linear main effects
+inline std::vector<ModelTerm> main_effect_terms(int k)
+{
+    std::vector<ModelTerm> t(1 + k);
+    for (int i = 0; i < k; ++i) t[1 + i].powers = {{i, 1}};
+    return t;
+}
+
+// All products of `order` distinct factors (linear in each), lexicographic
+inline std::vector<ModelTerm> interaction_terms(int k, int order)
+{
+    std::vector<ModelTerm> out;
+    if (order < 1 || order > k) return out;
+    std::vector<int> idx(order);
+    std::iota(idx.begin(), idx.end(), 0);
+    for (;;) {
+        ModelTerm t;
+        for (int f : idx) t.powers.emplace_back(f, 1);
+        out.push_back(std::move(t));
+        int p = order - 1;
+        while (p >= 0 && idx[p] == k - order + p) --p;
+        if (p < 0) break;
+        ++idx[p];
+        for (int q = p + 1; q < order; ++q) idx[q] = idx[q - 1] + 1;
+    }
+    return out;
+}
+
+struct AliasAnalysis {
+    int runs = 0;
+    int rank = 0;                              // rank of X1
+    std::vector<ModelTerm> primary, potential;
+    std::vector<int> estimable;                // primary terms kept, in order (rows of alias)
+    std::vector<int> inestimable;              // primary terms in the span of earlier ones
+    Eigen::MatrixXd alias;                     // estimable.size() x potential.size()
+    Eigen::MatrixXd dependence;                // [inestimable i] = sum_j dependence(i, j) * estimable[j]
+
+    // "x0 ~ x0 - 1 x1*x2" for estimable terms, "x0^2 = 1 (not estimable)" for the rest
+    std::vector<std::string> describe(const std::vector<std::string>& names = {}, double tol = 1e-9) const {
+        std::vector<std::string> out;
+        auto coef = [](std::ostringstream& os, double v) {
+            os << (v < 0 ? " - " : " + ") << std::fabs(v) << " ";
+        };
+        for (size_t r = 0; r < estimable.size(); ++r) {
+            std::ostringstream os;
+            os << primary[estimable[r]].name(names) << " ~ " << primary[estimable[r]].name(names);
+            for (Eigen::Index c = 0; c < alias.cols(); ++c)
+                if (std::fabs(alias(r, c)) > tol) { coef(os, alias(r, c)); os << potential[c].name(names); }
+            out.push_back(os.str());
+        }
+        for (size_t i = 0; i < inestimable.size(); ++i) {
+            std::ostringstream os;
+            os << primary[inestimable[i]].name(names) << " =";
+            bool any = false;
+            for (size_t j = 0; j < estimable.size(); ++j)
+                if (std::fabs(dependence(i, j)) > tol) { coef(os, dependence(i, j)); os << primary[estimable[j]].name(names); any = true; }
+            if (!any) os << " 0";
+            os << " (not estimable)";
+            out.push_back(os.str());
+        }
+        return out;
+    }
+};
+
+namespace alias_detail {
+
+// value[f][level * (max_exp + 1) + e] = x^e of factor f at that level
+inline std::vector<std::vector<double>> level_powers(
+    const OrthogonalArray& oa, const std::vector<int>& factor_indices,
+    const std::vector<FactorLevels>& all_levels, int max_exp)
+{
+    std::vector<std::vector<double>> tab(factor_indices.size());
+    for (size_t i = 0; i < factor_indices.size(); ++i) {
+        const int f = factor_indices[i];
+        if (f < 0 || f >= oa.factors)
+            throw std::runtime_error("alias_matrix: factor index out of OA range");
+        int L = 0;
+        for (int r = 0; r < oa.runs; ++r) L = std::max(L, oa.at(r, f) + 1);
+        std::vector<double> x(L);
+        if (all_levels.empty()) {
+            for (int l = 0; l < L; ++l) x[l] = L == 1 ? 0.0 : -1.0 + 2.0 * l / (L - 1);   // coded [-1, 1]
+        } else {
+            if (f >= (int)all_levels.size() || (int)all_levels[f].levels.size() < L)
+                throw std::runtime_error("alias_matrix: missing level values");
+            for (int l = 0; l < L; ++l) x[l] = all_levels[f].levels[l];
+        }
+        tab[i].resize(static_cast<size_t>(L) * (max_exp + 1));
+        for (int l = 0; l < L; ++l)
+            for (int e = 0; e <= max_exp; ++e) tab[i][l * (max_exp + 1) + e] = std::pow(x[l], e);
+    }
+    return tab;
+}
+
+inline Eigen::MatrixXd term_columns(const OrthogonalArray& oa, const std::vector<int>& factor_indices,
+                                    const std::vector<std::vector<double>>& tab, int max_exp,
+                                    const std::vector<ModelTerm>& terms)
+{
+    const int N = oa.runs, k = static_cast<int>(factor_indices.size());
+    Eigen::MatrixXd X(N, terms.size());
+    for (size_t t = 0; t < terms.size(); ++t) {
+        double* col = X.col(t).data();
+        std::fill(col, col + N, 1.0);
+        for (const auto& [f, e] : terms[t].powers) {
+            if (f < 0 || f >= k || e < 1 || e > max_exp)
+                throw std::runtime_error("alias_matrix: bad term " + terms[t].name());
+            const int c = factor_indices[f];
+            const double* v = tab[f].data() + e;
+            for (int r = 0; r < N; ++r) col[r] *= v[oa.data[static_cast<size_t>(r) * oa.factors + c] * (max_exp + 1)];
+        }
+    }
+    return X;
+}
+
+} // namespace alias_detail
+
+// -----------------------------------------------------------------------------
+// Alias matrix of `primary` against `potential` on the selected OA columns.
+// all_levels empty: each factor is coded equally spaced on [-1, 1]; otherwise the
+// level values of all_levels[factor] are used (as the fit would see them).
+// -----------------------------------------------------------------------------
+inline AliasAnalysis alias_matrix(
+    const OrthogonalArray& oa,
+    const std::vector<int>& factor_indices,
+    const std::vector<ModelTerm>& primary,
+    const std::vector<ModelTerm>& potential,
+    const std::vector<FactorLevels>& all_levels = {},
+    double tol = 1e-9)
+{
+    DOE_TRACE_SCOPE("alias_matrix");
+    using namespace alias_detail;
+    if (factor_indices.empty() || primary.empty())
+        throw std::runtime_error("alias_matrix: need factors and primary terms");
+    int max_exp = 1;
+    for (const auto* set : {&primary, &potential})
+        for (const auto& t : *set)
+            for (const auto& pe : t.powers) max_exp = std::max(max_exp, pe.second);
+
+    const auto tab = level_powers(oa, factor_indices, all_levels, max_exp);
+    const Eigen::MatrixXd X1 = term_columns(oa, factor_indices, tab, max_exp, primary);
+    const Eigen::MatrixXd X2 = term_columns(oa, factor_indices, tab, max_exp, potential);
+
+    AliasAnalysis out;
+    out.runs = oa.runs;
+    out.primary = primary;
+    out.potential = potential;
+
+    // Modified Gram-Schmidt in term order (with one reorthogonalization pass):
+    // a term is inestimable when its residual is tiny relative to its norm
+    const int N = oa.runs, p1 = static_cast<int>(primary.size());
+    Eigen::MatrixXd Q(N, std::min(N, p1));
+    for (int j = 0; j < p1; ++j) {
+        Eigen::VectorXd v = X1.col(j);
+        const double norm0 = v.norm();
+        for (int pass = 0; pass < 2; ++pass)
+            for (int i = 0; i < out.rank; ++i) v -= Q.col(i).dot(v) * Q.col(i);
+        const double nv = v.norm();
+        if (out.rank < Q.cols() && norm0 > 0.0 && nv > tol * std::max(1.0, norm0)) {
+            Q.col(out.rank++) = v / nv;
+            out.estimable.push_back(j);
+        } else {
+            out.inestimable.push_back(j);
+        }
+    }
+
+    const int r = out.rank;
+    Eigen::MatrixXd X1e(N, r);
+    for (int i = 0; i < r; ++i) X1e.col(i) = X1.col(out.estimable[i]);
+    Eigen::LDLT<Eigen::MatrixXd> G(X1e.transpose() * X1e);
+    out.alias = G.solve(X1e.transpose() * X2);
+    Eigen::MatrixXd Xd(N, out.inestimable.size());
+    for (size_t i = 0; i < out.inestimable.size(); ++i) Xd.col(i) = X1.col(out.inestimable[i]);
+    out.dependence = G.solve(X1e.transpose() * Xd).transpose();
+    DOE_TRACE_COUNT("rows_scanned", N);
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// Generalized word-length pattern
+// -----------------------------------------------------------------------------
+struct WordLengthPattern {
+    std::vector<double> A;        // A[0] = 1, A[1] .. A[n]
+    int resolution = 0;           // smallest j >= 1 with A_j > 0; n + 1 if none (full factorial)
+};
+
+namespace alias_detail {
+
+// Exact integer arithmetic for N^2 A_j: residues mod 2^64 (wrap-around) and mod
+// a 32-bit prime, combined by CRT (exact below 2^64 * P)
+constexpr std::uint64_t kPrime = 4294967291ull;   // largest prime < 2^32
+
+inline std::uint64_t mod_pow(std::uint64_t b, std::uint64_t e, std::uint64_t m)
+{
+    std::uint64_t r = 1 % m;
+    b %= m;
+    for (; e; e >>= 1, b = b * b % m)
+        if (e & 1) r = r * b % m;
+    return r;
+}
+
+} // namespace alias_detail
+
+// columns empty: all columns of the array
+inline WordLengthPattern generalized_word_length_pattern(const OrthogonalArray& oa,
+                                                         const std::vector<int>& columns = {})
+{
+    using namespace alias_detail;
+    std::vector<int> cols = columns;
+    if (cols.empty()) {
+        cols.resize(oa.factors);
+        std::iota(cols.begin(), cols.end(), 0);
+    }
+    const int N = oa.runs, n = static_cast<int>(cols.size());
+
+    // Level classes (columns with the same number of levels) and bit-packing
+    std::vector<int> s_of(n);
+    for (int i = 0; i < n; ++i) {
+        if (cols[i] < 0 || cols[i] >= oa.factors)
+            throw std::runtime_error("generalized_word_length_pattern: column out of range");
+        int L = 0;
+        for (int r = 0; r < N; ++r) L = std::max(L, oa.at(r, cols[i]) + 1);
+        s_of[i] = std::max(L, 1);
+    }
+    double bits = std::log2(static_cast<double>(N));
+    for (int s : s_of) bits += std::log2(static_cast<double>(s));
+    if (bits > 95.0)
+        throw std::runtime_error("generalized_word_length_pattern: too many columns for exact computation");
+
+    std::vector<int> class_s;
+    std::vector<std::vector<int>> class_cols;
+    for (int i = 0; i < n; ++i) {
+        auto it = std::find(class_s.begin(), class_s.end(), s_of[i]);
+        if (it == class_s.end()) { class_s.push_back(s_of[i]); class_cols.push_back({i}); }
+        else class_cols[it - class_s.begin()].push_back(i);
+    }
+    const int G = static_cast<int>(class_s.size());
+
+    // Per class: words of 64 columns, bit planes of the level index
+    struct Packing { int words, planes, size; };
+    std::vector<Packing> pk(G);
+    std::vector<size_t> offset(G + 1, 0);
+    for (int g = 0; g < G; ++g) {
+        pk[g].size = static_cast<int>(class_cols[g].size());
+        pk[g].words = (pk[g].size + 63) / 64;
+        pk[g].planes = std::max(1, static_cast<int>(std::bit_width(static_cast<unsigned>(class_s[g] - 1))));
+        offset[g + 1] = offset[g] + static_cast<size_t>(pk[g].words) * pk[g].planes;
+    }
+    const size_t stride = offset[G];
+    std::vector<std::uint64_t> packed(static_cast<size_t>(N) * stride, 0);
+    for (int r = 0; r < N; ++r)
+        for (int g = 0; g < G; ++g)
+            for (int q = 0; q < pk[g].size; ++q) {
+                const unsigned l = static_cast<unsigned>(oa.at(r, cols[class_cols[g][q]]));
+                for (int p = 0; p < pk[g].planes; ++p)
+                    if (l >> p & 1)
+                        packed[r * stride + offset[g] + static_cast<size_t>(p) * pk[g].words + q / 64] |= std::uint64_t{1} << (q % 64);
+            }
+
+    // Histogram of match-count vectors over ordered run pairs
+    std::vector<size_t> radix(G + 1, 1);
+    for (int g = 0; g < G; ++g) radix[g + 1] = radix[g] * (pk[g].size + 1);
+    std::vector<std::uint64_t> hist(radix[G], 0);
+    for (int r = 0; r < N; ++r) {
+        const std::uint64_t* a = packed.data() + r * stride;
+        hist[radix[G] - 1] += 1;   // r == s: all columns match
+        for (int s = r + 1; s < N; ++s) {
+            const std::uint64_t* b = packed.data() + s * stride;
+            size_t key = 0;
+            for (int g = 0; g < G; ++g) {
+                int mismatch = 0;
+                for (int w = 0; w < pk[g].words; ++w) {
+                    std::uint64_t diff = 0;
+                    for (int p = 0; p < pk[g].planes; ++p) {
+                        const size_t o = offset[g] + static_cast<size_t>(p) * pk[g].words + w;
+                        diff |= a[o] ^ b[o];
+                    }
+                    mismatch += std::popcount(diff);
+                }
+                key += radix[g] * (pk[g].size - mismatch);
+            }
+            hist[key] += 2;
+        }
+    }
+
+    // N^2 A_j = sum_key hist[key] [t^j] prod_g (1 + (s_g - 1) t)^m_g (1 - t)^(n_g - m_g)
+    std::vector<std::uint64_t> acc64(n + 1, 0), accP(n + 1, 0);
+    std::vector<std::uint64_t> c64(n + 1), cP(n + 1);
+    for (size_t key = 0; key < hist.size(); ++key) {
+        if (hist[key] == 0) continue;
+        std::fill(c64.begin(), c64.end(), 0);
+        std::fill(cP.begin(), cP.end(), 0);
+        c64[0] = cP[0] = 1;
+        int deg = 0;
+        auto mul = [&](std::uint64_t a64, std::uint64_t aP) {   // times (1 + a t)
+            ++deg;
+            for (int j = deg; j >= 1; --j) {
+                c64[j] += a64 * c64[j - 1];
+                cP[j] = (cP[j] + aP * cP[j - 1]) % kPrime;
+            }
+        };
+        size_t rest = key;
+        for (int g = 0; g < G; ++g) {
+            const int m = static_cast<int>(rest % (pk[g].size + 1));
+            rest /= (pk[g].size + 1);
+            const std::uint64_t s1 = static_cast<std::uint64_t>(class_s[g] - 1);
+            for (int i = 0; i < m; ++i) mul(s1, s1 % kPrime);
+            for (int i = m; i < pk[g].size; ++i) mul(~std::uint64_t{0}, kPrime - 1);   // -1
+        }
+        const std::uint64_t h = hist[key];
+        for (int j = 0; j <= n; ++j) {
+            acc64[j] += h * c64[j];
+            accP[j] = (accP[j] + (h % kPrime) * cP[j]) % kPrime;
+        }
+    }
+
+    // CRT: X = a + 2^64 q with q = (b - a) * (2^64)^-1 mod P
+    const std::uint64_t two64 = mod_pow(2, 64, kPrime);
+    const std::uint64_t inv = mod_pow(two64, kPrime - 2, kPrime);
+    WordLengthPattern out;
+    out.A.resize(n + 1);
+    const double N2 = static_cast<double>(N) * N;
+    for (int j = 0; j <= n; ++j) {
+        const std::uint64_t a = acc64[j];
+        const std::uint64_t q = (accP[j] + kPrime - a % kPrime) % kPrime * inv % kPrime;
+        out.A[j] = (static_cast<double>(q) * 18446744073709551616.0 + static_cast<double>(a)) / N2;
+    }
+    out.resolution = n + 1;
+    for (int j = 1; j <= n; ++j)
+        if (out.A[j] > 1e-9) { out.resolution = j; break; }
+    DOE_TRACE_COUNT("rows_scanned", N);
+    return out;
+}
+
+// < 0: a has less aberration than b (better), 0: tie, > 0: worse
+inline int compare_aberration(const WordLengthPattern& a, const WordLengthPattern& b, double tol = 1e-9)
+{
+    const size_t n = std::max(a.A.size(), b.A.size());
+    for (size_t j = 1; j < n; ++j) {
+        const double x = j < a.A.size() ? a.A[j] : 0.0;
+        const double y = j < b.A.size() ? b.A[j] : 0.0;
+        if (x < y - tol) return -1;
+        if (x > y + tol) return 1;
+    }
+    return 0;
+}
+
+// Rank column sets (e.g. candidate assignments) by generalized minimum aberration.
+// Returns indices into column_sets, best first; ties keep their input order.
+inline std::vector<int> rank_by_aberration(const OrthogonalArray& oa,
+                                           const std::vector<std::vector<int>>& column_sets,
+                                           int threads = 0,
+                                           std::vector<WordLengthPattern>* patterns = nullptr)
+{
+    DOE_TRACE_SCOPE("rank_by_aberration");
+    const int n = static_cast<int>(column_sets.size());
+    std::vector<WordLengthPattern> wlp(n);
+    doe_parallel::parallel_for(n, threads, [&](int i) {
+        wlp[i] = generalized_word_length_pattern(oa, column_sets[i]);
+    });
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return compare_aberration(wlp[a], wlp[b]) < 0;
+    });
+    if (patterns) *patterns = std::move(wlp);
+    return order;
+}
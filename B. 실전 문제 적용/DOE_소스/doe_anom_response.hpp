@@ -2,18 +2,25 @@
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <functional>
 
 #include "orthogonal_array.hpp"
 #include "Anom_Utils.h"
+#include "doe_trace.hpp"
+#include "doe_run_mask.hpp"
 
 // Build ANOM for a single factor from OA + responses
+// Runs with a NaN response or cleared in `mask` are skipped; levels then have
+// unequal n and Anom::fit uses the unequal-n limits with the reduced pooled df.
 inline Anom build_anom_for_factor(
     const OrthogonalArray& oa,
     const std::vector<double>& y,
     int factor_idx,
     const std::string& factor_name,
-    const AnomOptions& opt = AnomOptions{})
+    const AnomOptions& opt = AnomOptions{},
+    const RunMask& mask = RunMask{})
 {
+    DOE_TRACE_SCOPE("build_anom_for_factor");
     if (factor_idx < 0 || factor_idx >= oa.factors)
         throw std::runtime_error("build_anom_for_factor: factor_idx out of range");
     if ((int)y.size() != oa.runs)
@@ -22,12 +29,19 @@ inline Anom build_anom_for_factor(
     int L = oa.levels;
 
     std::vector<std::vector<double>> level_values(L);
-    for (int r = 0; r < oa.runs; ++r) {
+    auto add_run = [&](int r) {
         int lev = oa.at(r, factor_idx);
         if (lev < 0 || lev >= L)
             throw std::runtime_error("build_anom_for_factor: level index out of range");
         level_values[lev].push_back(y[r]);
+    };
+    RunMask active = effective_run_mask(y, mask);
+    if (active.empty()) {
+        for (int r = 0; r < oa.runs; ++r) add_run(r);
+    } else {
+        active.for_each(add_run);
     }
+    DOE_TRACE_COUNT("rows_scanned", oa.runs);
 
     Anom anom(opt);
     for (int lev = 0; lev < L; ++lev) {
@@ -47,14 +61,18 @@ struct FactorAnomResult {
     Anom anom;
 };
 
+// on_factor(j) runs after factor j (progress / cancellation hook; may throw)
 inline std::vector<FactorAnomResult> build_anom_for_all_factors(
     const OrthogonalArray& oa,
     const std::vector<double>& y,
     const std::vector<std::string>& factor_names = {},
-    const AnomOptions& opt = AnomOptions{})
+    const AnomOptions& opt = AnomOptions{},
+    const RunMask& mask = RunMask{},
+    const std::function<void(int)>& on_factor = {})
 {
     if ((int)y.size() != oa.runs)
         throw std::runtime_error("build_anom_for_all_factors: y size must match oa.runs");
+    RunMask active = effective_run_mask(y, mask);
 
     std::vector<std::string> names;
     names.reserve(oa.factors);
@@ -72,8 +90,9 @@ inline std::vector<FactorAnomResult> build_anom_for_all_factors(
     std::vector<FactorAnomResult> out;
     out.reserve(oa.factors);
     for (int j = 0; j < oa.factors; ++j) {
-        Anom anom_j = build_anom_for_factor(oa, y, j, names[j], opt);
+        Anom anom_j = build_anom_for_factor(oa, y, j, names[j], opt, active);
         out.push_back(FactorAnomResult{names[j], std::move(anom_j)});
+        if (on_factor) on_factor(j);
     }
     return out;
 }
@@ -0,0 +1,508 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <coroutine>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_anom_response.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_full_analysis.hpp"
+#include "doe_run_mask.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// C++20 coroutine interface for the DOE pipeline
+//
+// Every async_* function returns a lazy doe_async::Task<T>. Awaiting it moves
+// the work onto the supplied executor (anything with post(std::function<void()>))
+// and resumes the awaiting coroutine on that executor once the result is ready.
+// Use co_await schedule_on(loop) to get back onto the caller's own executor.
+//
+//   doe_async::ThreadPoolExecutor pool(4);
+//   doe_async::Task<DoeFullAnalysis> t =
+//       doe_async::async_full_analysis(pool, oa, levels, {1, 2}, y);
+//   DoeFullAnalysis a = co_await t;            // inside a coroutine, or
+//   DoeFullAnalysis b = doe_async::sync_wait(doe_async::async_full_analysis(pool, ...));
+//
+// The work itself is the synchronous API (build_design_*, ResponseSurfaceQuadratic::fit,
+// build_anom_for_factor, run_doe_full_analysis), which is unchanged.
+// Cancellation is cooperative: a CancellationToken is checked between steps
+// (design, fit, each factor, each response) and raises OperationCancelled.
+// Progress callbacks run on executor threads and must be thread safe.
+// -----------------------------------------------------------------------------
+
+namespace doe_async {
+
+// ---- executors ----
+template <class E>
+concept Executor = requires(E& e, std::function<void()> fn) { e.post(std::move(fn)); };
+
+// Fixed pool of worker threads; queued work is finished before destruction
+class ThreadPoolExecutor {
+public:
+    explicit ThreadPoolExecutor(int threads = 0) {
+        int T = threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int t = 0; t < T; ++t) {
+            threads_.emplace_back([this] {
+                std::unique_lock<std::mutex> lock(mutex_);
+                for (;;) {
+                    cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+                    if (queue_.empty()) return;
+                    std::function<void()> fn = std::move(queue_.front());
+                    queue_.pop_front();
+                    lock.unlock();
+                    fn();
+                    lock.lock();
+                }
+            });
+        }
+    }
+    ~ThreadPoolExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+    ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+    ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(fn));
+        }
+        cv_.notify_one();
+    }
+
+    int size() const { return static_cast<int>(threads_.size()); }
+
+private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_ = false;
+};
+
+// Work queue drained by the owner's thread (e.g. an application event loop)
+class RunLoopExecutor {
+public:
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(fn));
+        }
+        cv_.notify_one();
+    }
+
+    // Run everything queued so far; returns the number of items run
+    int run_pending() {
+        std::deque<std::function<void()>> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch.swap(queue_);
+        }
+        for (auto& fn : batch) fn();
+        return static_cast<int>(batch.size());
+    }
+
+    // Block until an item is queued (or the timeout passes), then run the queue
+    int run_one_wait(std::chrono::milliseconds timeout) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, timeout, [&] { return !queue_.empty(); });
+        }
+        return run_pending();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+};
+
+// Runs work immediately on the posting thread
+struct InlineExecutor {
+    void post(std::function<void()> fn) { fn(); }
+};
+
+// ---- cancellation / progress ----
+struct OperationCancelled : std::runtime_error {
+    OperationCancelled() : std::runtime_error("doe_async: operation cancelled") {}
+};
+
+// Shared flag; copies observe the same state
+class CancellationToken {
+public:
+    CancellationToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+    void cancel() const { flag_->store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return flag_->load(std::memory_order_relaxed); }
+    void throw_if_cancelled() const { if (cancelled()) throw OperationCancelled(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// progress(done, total)
+using ProgressFn = std::function<void(int, int)>;
+
+// ---- Task<T> ----
+template <class T> class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> c = h.promise().continuation;
+            return c ? c : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <class T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T take() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+// Lazy, move-only, single-await task
+template <class T>
+class Task {
+public:
+    using promise_type = detail::Promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(handle_type h) : h_(h) {}
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { if (h_) h_.destroy(); }
+
+    bool valid() const { return static_cast<bool>(h_); }
+
+    // Awaiting an empty (default-constructed or moved-from) task throws
+    auto operator co_await() && { return Awaiter{checked()}; }
+    auto operator co_await() & { return Awaiter{checked()}; }
+
+private:
+    handle_type checked() const {
+        if (!h_)
+            throw std::logic_error("doe_async::Task: awaiting an empty task");
+        return h_;
+    }
+
+    struct Awaiter {
+        handle_type h;
+        bool await_ready() const noexcept { return h.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept {
+            h.promise().continuation = cont;
+            return h;
+        }
+        T await_resume() { return h.promise().take(); }
+    };
+    handle_type h_;
+};
+
+template <class T>
+Task<T> detail::Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+inline Task<void> detail::Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Continue the current coroutine on `ex`
+template <Executor E>
+auto schedule_on(E& ex) {
+    struct Awaiter {
+        E& ex;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { ex.post([h] { h.resume(); }); }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{ex};
+}
+
+namespace detail {
+
+// Eagerly started coroutine that owns the task and reports into a std::promise
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+template <class T>
+Detached drive(Task<T> task, std::shared_ptr<std::promise<T>> out) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            out->set_value();
+        } else {
+            out->set_value(co_await std::move(task));
+        }
+    } catch (...) {
+        out->set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+// Start a task without blocking; the future becomes ready on completion
+template <class T>
+std::future<T> start(Task<T> task) {
+    auto p = std::make_shared<std::promise<T>>();
+    std::future<T> f = p->get_future();
+    detail::drive(std::move(task), std::move(p));
+    return f;
+}
+
+// Block the calling thread until the task completes (synchronous callers, tests)
+template <class T>
+T sync_wait(Task<T> task) {
+    return start(std::move(task)).get();
+}
+
+// ---- pipeline steps ----
+// Tasks are lazy: every argument is taken by value so that it lives in the
+// coroutine frame until the work runs, whatever the caller does in between.
+template <Executor E>
+Task<std::vector<std::vector<double>>> async_build_design(
+    E& ex,
+    OrthogonalArray oa,
+    std::vector<FactorLevels> all_levels,
+    std::vector<int> factor_indices,
+    CancellationToken token = {})
+{
+    co_await schedule_on(ex);
+    token.throw_if_cancelled();
+    co_return build_design_from_orthogonal_array_for_factors(oa, all_levels, factor_indices);
+}
+
+template <Executor E>
+Task<ResponseSurfaceQuadratic> async_fit_response_surface(
+    E& ex,
+    std::vector<std::vector<double>> design,
+    std::vector<double> y,
+    RunMask mask = RunMask{},
+    CancellationToken token = {})
+{
+    co_await schedule_on(ex);
+    token.throw_if_cancelled();
+    ResponseSurfaceQuadratic rs;
+    if (!rs.fit(design, y, mask))
+        throw std::runtime_error("async_fit_response_surface: ResponseSurfaceQuadratic::fit failed");
+    co_return rs;
+}
+
+template <Executor E>
+Task<Anom> async_anom_for_factor(
+    E& ex,
+    OrthogonalArray oa,
+    std::vector<double> y,
+    int factor_idx,
+    std::string factor_name,
+    AnomOptions opt = AnomOptions{},
+    RunMask mask = RunMask{},
+    CancellationToken token = {})
+{
+    co_await schedule_on(ex);
+    token.throw_if_cancelled();
+    co_return build_anom_for_factor(oa, y, factor_idx, factor_name, opt, mask);
+}
+
+// run_doe_full_analysis on the executor; progress counts the RS fit and each factor
+template <Executor E>
+Task<DoeFullAnalysis> async_full_analysis(
+    E& ex,
+    OrthogonalArray oa,
+    std::vector<FactorLevels> all_levels,
+    std::vector<int> factor_indices_for_rs,
+    std::vector<double> y,
+    std::vector<std::string> factor_names = {},
+    AnomOptions anom_opt = AnomOptions{},
+    RunMask mask = RunMask{},
+    CancellationToken token = {},
+    ProgressFn progress = {})
+{
+    co_await schedule_on(ex);
+    DOE_TRACE_SCOPE("async_full_analysis");
+    token.throw_if_cancelled();
+    co_return run_doe_full_analysis(oa, all_levels, factor_indices_for_rs, y, factor_names, anom_opt, mask,
+                                    [&](int done, int total) {
+                                        if (progress) progress(done, total);
+                                        if (done < total) token.throw_if_cancelled();
+                                    });
+}
+
+// -----------------------------------------------------------------------------
+// Many responses on one design: each response is a separate job on the executor.
+// The awaiting coroutine resumes (on the thread finishing the last job) when all
+// are done. Responses not yet started when the token is cancelled are skipped and
+// the task throws OperationCancelled. The first failing response stops the others
+// through a batch-local flag (the caller's token is left alone) and its exception
+// is rethrown. progress(done, responses) after each response.
+// -----------------------------------------------------------------------------
+template <Executor E>
+Task<std::vector<DoeFullAnalysis>> async_full_analysis_batch(
+    E& ex,
+    OrthogonalArray oa,
+    std::vector<FactorLevels> all_levels,
+    std::vector<int> factor_indices_for_rs,
+    std::vector<std::vector<double>> responses,
+    std::vector<std::string> factor_names = {},
+    AnomOptions anom_opt = AnomOptions{},
+    CancellationToken token = {},
+    ProgressFn progress = {})
+{
+    struct State {
+        std::vector<DoeFullAnalysis> results;
+        std::atomic<int> remaining{0};
+        std::atomic<int> done{0};
+        std::atomic<bool> failed{false};   // stops the remaining jobs of this batch only
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+    };
+    auto state = std::make_shared<State>();
+    const int R = static_cast<int>(responses.size());
+    state->results.resize(R);
+    if (R == 0) co_return std::vector<DoeFullAnalysis>{};
+
+    struct AllDone {
+        E& ex;
+        std::shared_ptr<State> st;
+        std::function<void(int)> job;
+        int count;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            // Locals only from here: the last job may resume h before the loop ends
+            auto s = st;
+            auto fn = job;
+            E& e = ex;
+            const int n = count;
+            s->continuation = h;
+            s->remaining.store(n);
+            for (int i = 0; i < n; ++i) {
+                e.post([s, fn, i] {
+                    fn(i);
+                    if (s->remaining.fetch_sub(1) == 1) s->continuation.resume();
+                });
+            }
+        }
+        void await_resume() const noexcept {}
+    };
+
+    // One closed-form plan for the array, shared read-only by every job
+    const OrthogonalQuadraticPlan plan(oa, all_levels, factor_indices_for_rs);
+
+    // References point into this coroutine frame, which is suspended until the last job ends
+    auto job = [&, state, R](int i) {
+        if (token.cancelled() || state->failed.load()) return;
+        try {
+            state->results[i] = run_doe_full_analysis(oa, all_levels, factor_indices_for_rs,
+                                                      responses[i], factor_names, anom_opt,
+                                                      RunMask{}, {}, &plan);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(state->error_mutex);
+            if (!state->error) state->error = std::current_exception();
+            state->failed.store(true);
+            return;
+        }
+        int d = state->done.fetch_add(1) + 1;
+        if (progress) progress(d, R);
+    };
+    AllDone all{ex, state, job, R};   // named: GCC 12 mishandles temporary awaiters
+    co_await all;
+
+    if (state->error) std::rethrow_exception(state->error);
+    token.throw_if_cancelled();
+    co_return std::move(state->results);
+}
+
+// Write <directory>/<factor>.csv and <factor>.svg for every factor
+template <Executor E>
+Task<void> async_export_anom(
+    E& ex,
+    std::vector<FactorAnomResult> factor_anoms,
+    std::string directory,
+    CancellationToken token = {},
+    ProgressFn progress = {})
+{
+    co_await schedule_on(ex);
+    std::filesystem::create_directories(directory);
+    const int total = static_cast<int>(factor_anoms.size());
+    for (int j = 0; j < total; ++j) {
+        token.throw_if_cancelled();
+        const auto& fa = factor_anoms[j];
+        std::filesystem::path base = std::filesystem::path(directory) / fa.factor_name;
+        fa.anom.save_csv(base.string() + ".csv");
+        std::string svg_path = base.string() + ".svg";
+        std::ofstream ofs(svg_path);
+        if (!ofs)
+            throw std::runtime_error("async_export_anom: cannot open file: " + svg_path);
+        ofs << fa.anom.render_svg();
+        if (progress) progress(j + 1, total);
+    }
+}
+
+} // namespace doe_async
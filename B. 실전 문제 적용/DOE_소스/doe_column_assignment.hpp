@@ -0,0 +1,369 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <utility>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+#include "orthogonal_array.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Column assignment for orthogonal arrays (Taguchi linear graphs, done by search)
+//
+// Interaction table: each column is stored as bit planes over the runs (one plane
+// per level). The interaction of two 2-level columns is their XOR; two 3-level
+// columns a, b interact on the two columns a + b and a + 2b (mod 3), computed
+// plane-wise with GF(3) logic. A result is matched to an array column up to a
+// relabelling of levels. Pairs whose interaction is not a column (mixed levels,
+// or the 3-level part of L18) get an empty entry: it is spread over several columns.
+//
+// Assignment: factors are placed on columns of matching level count so that every
+// required interaction falls on columns holding neither a factor nor another
+// required interaction. Depth-first search with pruning; the branches of the first
+// factor are searched in parallel and the lowest feasible branch wins, so the result
+// does not depend on the thread count.
+// -----------------------------------------------------------------------------
+
+struct InteractionTable {
+    int columns = 0;
+    std::vector<int> levels;                  // [c] 2 or 3 (0: other level count)
+    std::vector<std::vector<int>> entries;    // [a * columns + b] columns carrying a x b
+
+    const std::vector<int>& at(int a, int b) const { return entries[static_cast<size_t>(a) * columns + b]; }
+};
+
+namespace column_assignment_detail {
+
+using Planes = std::vector<std::uint64_t>;    // levels * words, plane l at [l * words]
+
+// GF(3) sum of two columns given as planes (p1, p2); plane 0 is implied
+inline void gf3_add(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* out,
+                    int words, const std::uint64_t* valid)
+{
+    for (int w = 0; w < words; ++w) {
+        const std::uint64_t a1 = a[w], a2 = a[words + w], b1 = b[w], b2 = b[words + w];
+        const std::uint64_t a0 = ~(a1 | a2) & valid[w], b0 = ~(b1 | b2) & valid[w];
+        out[w]         = (a0 & b1) | (a1 & b0) | (a2 & b2);
+        out[words + w] = (a0 & b2) | (a2 & b0) | (a1 & b1);
+    }
+}
+
+// Key of a column up to level relabelling: level of run 0 becomes 0, the next
+// level to appear becomes 1
+inline Planes canonical_key(const Planes& planes, int levels, int words, const Planes& valid)
+{
+    if (levels == 2) {
+        // the plane holds level 1; complement it when run 0 is at level 1
+        Planes key(planes.begin(), planes.begin() + words);
+        if (key[0] & 1)
+            for (int w = 0; w < words; ++w) key[w] = ~key[w] & valid[w];
+        return key;
+    }
+    Planes full(static_cast<size_t>(3) * words);
+    for (int w = 0; w < words; ++w) {
+        full[w]             = ~(planes[w] | planes[words + w]) & valid[w];
+        full[words + w]     = planes[w];
+        full[2 * words + w] = planes[words + w];
+    }
+    auto level_of = [&](int run) {
+        for (int l = 1; l < 3; ++l)
+            if (full[static_cast<size_t>(l) * words + run / 64] >> (run % 64) & 1) return l;
+        return 0;
+    };
+    const int l0 = level_of(0);
+    int l1 = -1;
+    for (int run = 1; l1 < 0 && run < 64 * words; ++run) {
+        int l = level_of(run);
+        if (l != l0) l1 = l;
+    }
+    if (l1 < 0) l1 = (l0 + 1) % 3;
+    const int l2 = 3 - l0 - l1;
+    Planes key(static_cast<size_t>(2) * words);
+    for (int w = 0; w < words; ++w) {
+        key[w]         = full[static_cast<size_t>(l1) * words + w];
+        key[words + w] = full[static_cast<size_t>(l2) * words + w];
+    }
+    return key;
+}
+
+} // namespace column_assignment_detail
+
+// Interaction table of any array (L4, L8, L9, make_two_level_oa, make_three_level_oa ...)
+inline InteractionTable make_interaction_table(const OrthogonalArray& oa)
+{
+    DOE_TRACE_SCOPE("make_interaction_table");
+    using namespace column_assignment_detail;
+    const int N = oa.runs, C = oa.factors;
+    const int words = (N + 63) / 64;
+    Planes valid(words, 0);
+    for (int r = 0; r < N; ++r) valid[r / 64] |= std::uint64_t{1} << (r % 64);
+
+    InteractionTable t;
+    t.columns = C;
+    t.levels.assign(C, 0);
+    t.entries.assign(static_cast<size_t>(C) * C, {});
+    std::vector<Planes> planes(C);
+    std::map<std::pair<int, Planes>, int> lookup;
+    for (int c = 0; c < C; ++c) {
+        int L = 0;
+        for (int r = 0; r < N; ++r) L = std::max(L, oa.at(r, c) + 1);
+        if (L != 2 && L != 3) continue;
+        t.levels[c] = L;
+        planes[c].assign(static_cast<size_t>(L - 1) * words, 0);
+        for (int r = 0; r < N; ++r) {
+            int l = oa.at(r, c);
+            if (l > 0) planes[c][static_cast<size_t>(l - 1) * words + r / 64] |= std::uint64_t{1} << (r % 64);
+        }
+        lookup.emplace(std::make_pair(L, canonical_key(planes[c], L, words, valid)), c);
+    }
+
+    Planes sum(static_cast<size_t>(2) * words), twice(static_cast<size_t>(2) * words);
+    auto find = [&](int L, const Planes& p) {
+        auto it = lookup.find(std::make_pair(L, canonical_key(p, L, words, valid)));
+        return it == lookup.end() ? -1 : it->second;
+    };
+    for (int a = 0; a < C; ++a)
+        for (int b = a + 1; b < C; ++b) {
+            const int L = t.levels[a];
+            if (L == 0 || t.levels[b] != L) continue;
+            std::vector<int> cols;
+            if (L == 2) {
+                Planes x(words);
+                for (int w = 0; w < words; ++w) x[w] = planes[a][w] ^ planes[b][w];
+                cols.push_back(find(2, x));
+            } else {
+                gf3_add(planes[a].data(), planes[b].data(), sum.data(), words, valid.data());
+                cols.push_back(find(3, sum));
+                // 2b: swap the planes of b
+                for (int w = 0; w < words; ++w) {
+                    twice[w] = planes[b][words + w];
+                    twice[words + w] = planes[b][w];
+                }
+                gf3_add(planes[a].data(), twice.data(), sum.data(), words, valid.data());
+                cols.push_back(find(3, sum));
+            }
+            if (std::find(cols.begin(), cols.end(), -1) != cols.end()) continue;   // spread
+            t.entries[static_cast<size_t>(a) * C + b] = cols;
+            t.entries[static_cast<size_t>(b) * C + a] = cols;
+        }
+    return t;
+}
+
+struct AssignmentFactor {
+    std::string name;
+    int levels = 2;
+};
+
+struct ColumnAssignmentOptions {
+    int threads = 0;                          // <= 0: hardware concurrency
+    long long max_nodes = 20'000'000;         // search nodes over all branches
+};
+
+// An unrequested two-factor interaction that lands on an occupied column
+struct AliasEntry {
+    int factor_a = -1, factor_b = -1;
+    int column = -1;
+    int factor = -1;                          // factor on that column, or -1
+    int interaction = -1;                     // required interaction on that column, or -1
+};
+
+struct ColumnAssignment {
+    bool feasible = false;
+    bool node_limit_hit = false;              // search stopped early; infeasibility not proven
+    long long nodes = 0;
+    std::vector<int> factor_column;                    // [factor]
+    std::vector<std::vector<int>> interaction_columns; // [required interaction]
+    std::vector<std::string> column_use;               // [column] "A", "AxB" or "" (error column)
+    std::vector<AliasEntry> confounding;
+};
+
+// -----------------------------------------------------------------------------
+// Place factors and the required two-factor interactions on the columns of `oa`
+// -----------------------------------------------------------------------------
+inline ColumnAssignment assign_columns(
+    const OrthogonalArray& oa,
+    const std::vector<AssignmentFactor>& factors,
+    const std::vector<std::pair<int, int>>& required,
+    const ColumnAssignmentOptions& opt = ColumnAssignmentOptions{})
+{
+    DOE_TRACE_SCOPE("assign_columns");
+    const int F = static_cast<int>(factors.size());
+    const int I = static_cast<int>(required.size());
+    if (F == 0)
+        throw std::runtime_error("assign_columns: no factors");
+    for (const auto& f : factors)
+        if (f.levels != 2 && f.levels != 3)
+            throw std::runtime_error("assign_columns: factors must have 2 or 3 levels");
+    for (const auto& [a, b] : required)
+        if (a < 0 || b < 0 || a >= F || b >= F || a == b)
+            throw std::runtime_error("assign_columns: bad required interaction");
+
+    const InteractionTable table = make_interaction_table(oa);
+    const int C = table.columns;
+
+    // Search order: most required interactions first, then 3-level factors
+    std::vector<int> degree(F, 0);
+    for (const auto& [a, b] : required) { ++degree[a]; ++degree[b]; }
+    std::vector<int> order(F);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (degree[a] != degree[b]) return degree[a] > degree[b];
+        return factors[a].levels > factors[b].levels;
+    });
+    std::vector<int> position(F);
+    for (int t = 0; t < F; ++t) position[order[t]] = t;
+    // Interactions checked at step t: those whose later factor is order[t]
+    std::vector<std::vector<int>> closes(F);
+    for (int i = 0; i < I; ++i)
+        closes[std::max(position[required[i].first], position[required[i].second])].push_back(i);
+
+    // Columns still needed per level class from step t on
+    std::vector<int> need2(F + 1, 0), need3(F + 1, 0);
+    for (int t = F - 1; t >= 0; --t) {
+        need2[t] = need2[t + 1];
+        need3[t] = need3[t + 1];
+        (factors[order[t]].levels == 2 ? need2[t] : need3[t]) += 1;
+        for (int i : closes[t]) {
+            if (factors[required[i].first].levels != factors[required[i].second].levels)
+                throw std::runtime_error("assign_columns: interactions of mixed-level factors are spread, not assignable");
+            if (factors[order[t]].levels == 2) need2[t] += 1; else need3[t] += 2;
+        }
+    }
+    int free2 = 0, free3 = 0;
+    for (int c = 0; c < C; ++c) {
+        if (table.levels[c] == 2) ++free2;
+        if (table.levels[c] == 3) ++free3;
+    }
+
+    ColumnAssignment out;
+    if (need2[0] > free2 || need3[0] > free3) {
+        out.column_use.assign(C, "");
+        return out;   // not enough columns
+    }
+
+    const int first = order[0];
+    std::vector<int> branches;
+    for (int c = 0; c < C; ++c)
+        if (table.levels[c] == factors[first].levels) branches.push_back(c);
+    const int nb = static_cast<int>(branches.size());
+
+    std::atomic<int> best_branch{std::numeric_limits<int>::max()};
+    std::atomic<long long> nodes{0};
+    std::atomic<bool> limit_hit{false};
+    std::vector<std::vector<int>> branch_cols(nb);
+    std::vector<std::vector<std::vector<int>>> branch_inter(nb);
+
+    doe_parallel::parallel_for(nb, opt.threads, [&](int br) {
+        std::vector<int> owner(C, -1);           // -1 free, f factor, F + i interaction
+        std::vector<int> fcol(F, -1);
+        std::vector<std::vector<int>> icols(I);
+        int f2 = free2, f3 = free3;
+        long long local = 0;
+        auto take = [&](int c, int who) {
+            owner[c] = who;
+            (table.levels[c] == 2 ? f2 : f3) -= 1;
+        };
+        auto release = [&](int c) {
+            owner[c] = -1;
+            (table.levels[c] == 2 ? f2 : f3) += 1;
+        };
+
+        // place order[t] on column c; on success reserve its closing interactions
+        auto place = [&](int t, int c) {
+            const int f = order[t];
+            take(c, f);
+            fcol[f] = c;
+            size_t done = 0;
+            bool ok = true;
+            for (int i : closes[t]) {
+                const int g = required[i].first == f ? required[i].second : required[i].first;
+                const std::vector<int>& cols = table.at(c, fcol[g]);
+                if (cols.empty()) { ok = false; break; }
+                for (int x : cols) if (owner[x] != -1) { ok = false; break; }
+                if (!ok) break;
+                for (int x : cols) take(x, F + i);
+                icols[i] = cols;
+                ++done;
+            }
+            if (ok && f2 >= need2[t + 1] && f3 >= need3[t + 1]) return true;
+            for (size_t j = 0; j < done; ++j)
+                for (int x : icols[closes[t][j]]) release(x);
+            fcol[f] = -1;
+            release(c);
+            return false;
+        };
+        auto unplace = [&](int t) {
+            for (int i : closes[t]) for (int x : icols[i]) release(x);
+            release(fcol[order[t]]);
+            fcol[order[t]] = -1;
+        };
+
+        auto stop = [&]() {
+            return best_branch.load(std::memory_order_relaxed) < br || limit_hit.load(std::memory_order_relaxed);
+        };
+        auto dfs = [&](auto&& self, int t) -> bool {
+            if (t == F) return true;
+            if ((++local & 1023) == 0) {
+                if (nodes.fetch_add(1024, std::memory_order_relaxed) + 1024 > opt.max_nodes) limit_hit = true;
+                if (stop()) return false;
+            }
+            const int L = factors[order[t]].levels;
+            for (int c = 0; c < C; ++c) {
+                if (owner[c] != -1 || table.levels[c] != L) continue;
+                if (!place(t, c)) continue;
+                if (self(self, t + 1)) return true;
+                unplace(t);
+                if (stop()) return false;
+            }
+            return false;
+        };
+
+        if (stop()) return;
+        bool found = place(0, branches[br]) && dfs(dfs, 1);
+        nodes.fetch_add(local & 1023, std::memory_order_relaxed);
+        if (!found) return;
+        branch_cols[br] = fcol;
+        branch_inter[br] = icols;
+        int cur = best_branch.load();
+        while (br < cur && !best_branch.compare_exchange_weak(cur, br)) {}
+    });
+
+    out.nodes = nodes.load();
+    const int best = best_branch.load();
+    out.feasible = best < nb;
+    out.node_limit_hit = !out.feasible && limit_hit.load();
+    out.column_use.assign(C, "");
+    if (!out.feasible) return out;
+
+    out.factor_column = branch_cols[best];
+    out.interaction_columns = branch_inter[best];
+    std::vector<int> col_factor(C, -1), col_inter(C, -1);
+    for (int f = 0; f < F; ++f) {
+        col_factor[out.factor_column[f]] = f;
+        out.column_use[out.factor_column[f]] = factors[f].name;
+    }
+    for (int i = 0; i < I; ++i)
+        for (int c : out.interaction_columns[i]) {
+            col_inter[c] = i;
+            out.column_use[c] = factors[required[i].first].name + "x" + factors[required[i].second].name;
+        }
+
+    // Confounding of the unrequested two-factor interactions
+    std::vector<std::uint8_t> is_required(static_cast<size_t>(F) * F, 0);
+    for (const auto& [a, b] : required) is_required[a * F + b] = is_required[b * F + a] = 1;
+    for (int a = 0; a < F; ++a)
+        for (int b = a + 1; b < F; ++b) {
+            if (is_required[a * F + b]) continue;
+            for (int c : table.at(out.factor_column[a], out.factor_column[b]))
+                if (col_factor[c] >= 0 || col_inter[c] >= 0)
+                    out.confounding.push_back({a, b, c, col_factor[c], col_inter[c]});
+        }
+    return out;
+}
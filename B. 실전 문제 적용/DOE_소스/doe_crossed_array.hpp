@@ -0,0 +1,207 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_anom_response.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Taguchi crossed (inner x outer) array experiments
+//
+// Every run of the inner (control) array is repeated under every condition of
+// the outer (noise) array, e.g. L18 x L4 = 18 x 4 = 72 responses. Responses are
+// one contiguous row-major block y[run * noise + j], so each inner run's noise
+// replicates are adjacent and are summarized in a single pass:
+//   mean, variance, ln variance and the S/N ratios
+//   larger-the-better   SN_L  = -10 log10( mean(1 / y^2) )
+//   smaller-the-better  SN_S  = -10 log10( mean(y^2) )
+//   nominal-the-best    SN_N  =  10 log10( mean^2 / s^2 )
+//   nominal (variance)  SN_N2 = -10 log10( s^2 )
+// A non-finite response is a failed condition and is left out of its run.
+// Per-run summaries feed ANOM over the inner factors and a dual response
+// surface (quadratic models of the mean and of ln variance).
+// -----------------------------------------------------------------------------
+
+enum class CrossedResponse {
+    Mean,
+    LogVariance,
+    SNLargerIsBetter,
+    SNSmallerIsBetter,
+    SNNominalIsBest,
+    SNNominalVariance
+};
+
+struct CrossedArrayStats {
+    std::vector<int> n;                  // usable noise conditions per inner run
+    std::vector<double> mean;
+    std::vector<double> variance;        // sample variance (n - 1); NaN if n < 2
+    std::vector<double> log_variance;    // ln variance; NaN if variance <= 0
+    std::vector<double> sn_larger;
+    std::vector<double> sn_smaller;
+    std::vector<double> sn_nominal;
+    std::vector<double> sn_nominal_variance;
+
+    const std::vector<double>& column(CrossedResponse which) const {
+        switch (which) {
+        case CrossedResponse::Mean:              return mean;
+        case CrossedResponse::LogVariance:       return log_variance;
+        case CrossedResponse::SNLargerIsBetter:  return sn_larger;
+        case CrossedResponse::SNSmallerIsBetter: return sn_smaller;
+        case CrossedResponse::SNNominalIsBest:   return sn_nominal;
+        default:                                 return sn_nominal_variance;
+        }
+    }
+};
+
+class CrossedArrayExperiment {
+public:
+    CrossedArrayExperiment(const OrthogonalArray& inner, const OrthogonalArray& outer)
+        : inner_(inner), outer_(outer),
+          y_(static_cast<size_t>(inner.runs) * outer.runs, std::numeric_limits<double>::quiet_NaN())
+    {
+        if (inner.runs <= 0 || outer.runs <= 0)
+            throw std::runtime_error("CrossedArrayExperiment: empty array");
+    }
+
+    const OrthogonalArray& inner() const { return inner_; }
+    const OrthogonalArray& outer() const { return outer_; }
+    int runs() const { return inner_.runs; }
+    int noise_conditions() const { return outer_.runs; }
+
+    // Response of inner run i under outer condition j
+    double  at(int i, int j) const { return y_[static_cast<size_t>(i) * outer_.runs + j]; }
+    double& at(int i, int j)       { return y_[static_cast<size_t>(i) * outer_.runs + j]; }
+
+    // Row-major runs x noise block
+    const std::vector<double>& responses() const { return y_; }
+    void set_responses(const std::vector<double>& y) {
+        if (y.size() != y_.size())
+            throw std::runtime_error("CrossedArrayExperiment::set_responses: size must be runs * noise conditions");
+        y_ = y;
+    }
+    void set_run(int i, const std::vector<double>& values) {
+        if (i < 0 || i >= inner_.runs || (int)values.size() != outer_.runs)
+            throw std::runtime_error("CrossedArrayExperiment::set_run: run index or size mismatch");
+        std::copy(values.begin(), values.end(), y_.begin() + static_cast<size_t>(i) * outer_.runs);
+    }
+
+    // One pass over each row (sums of y, (y - shift)^2, y^2 and 1 / y^2)
+    CrossedArrayStats statistics() const {
+        DOE_TRACE_SCOPE("CrossedArrayExperiment::statistics");
+        const int R = inner_.runs;
+        const int M = outer_.runs;
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        CrossedArrayStats s;
+        s.n.assign(R, 0);
+        s.mean.assign(R, nan);
+        s.variance.assign(R, nan);
+        s.log_variance.assign(R, nan);
+        s.sn_larger.assign(R, nan);
+        s.sn_smaller.assign(R, nan);
+        s.sn_nominal.assign(R, nan);
+        s.sn_nominal_variance.assign(R, nan);
+
+        for (int i = 0; i < R; ++i) {
+            const double* row = y_.data() + static_cast<size_t>(i) * M;
+            double shift = nan;
+            for (int j = 0; j < M && std::isnan(shift); ++j)
+                if (std::isfinite(row[j])) shift = row[j];
+            if (std::isnan(shift)) continue;
+
+            bool complete = true;
+            for (int j = 0; j < M; ++j) complete &= std::isfinite(row[j]);
+
+            int n = 0;
+            double sd = 0.0, sd2 = 0.0, sq = 0.0, inv = 0.0;
+            auto add = [&](double v) {
+                double d = v - shift;
+                sd += d;
+                sd2 += d * d;
+                sq += v * v;
+                inv += 1.0 / (v * v);
+            };
+            if (complete) {
+                // branch-free loop over the contiguous row
+                for (int j = 0; j < M; ++j) add(row[j]);
+                n = M;
+            } else {
+                for (int j = 0; j < M; ++j) {
+                    if (!std::isfinite(row[j])) continue;
+                    add(row[j]);
+                    ++n;
+                }
+            }
+            s.n[i] = n;
+            double md = sd / n;
+            double mean = shift + md;
+            s.mean[i] = mean;
+            s.sn_smaller[i] = -10.0 * std::log10(sq / n);
+            if (std::isfinite(inv)) s.sn_larger[i] = -10.0 * std::log10(inv / n);
+            if (n >= 2) {
+                double var = std::max(0.0, (sd2 - n * md * md) / (n - 1));
+                s.variance[i] = var;
+                if (var > 0.0) {
+                    s.log_variance[i] = std::log(var);
+                    s.sn_nominal[i] = 10.0 * std::log10(mean * mean / var);
+                    s.sn_nominal_variance[i] = -10.0 * std::log10(var);
+                }
+            }
+        }
+        return s;
+    }
+
+private:
+    OrthogonalArray inner_;
+    OrthogonalArray outer_;
+    std::vector<double> y_;
+};
+
+// ANOM of one per-run summary over all inner factors (runs with a NaN summary are skipped)
+inline std::vector<FactorAnomResult> build_crossed_anom_for_all_factors(
+    const CrossedArrayExperiment& exp,
+    CrossedResponse which,
+    const std::vector<std::string>& factor_names = {},
+    const AnomOptions& opt = AnomOptions{})
+{
+    CrossedArrayStats s = exp.statistics();
+    return build_anom_for_all_factors(exp.inner(), s.column(which), factor_names, opt);
+}
+
+// -----------------------------------------------------------------------------
+// Dual response surface: quadratic models of the run mean and of ln variance
+// (the log keeps the predicted variance positive). Runs without a variance
+// (n < 2 or zero spread) are left out of the variance model.
+// -----------------------------------------------------------------------------
+struct DualResponseModel {
+    ResponseSurfaceQuadratic mean_model;
+    ResponseSurfaceQuadratic log_variance_model;
+
+    double predict_mean(const std::vector<double>& x) const { return mean_model.predict(x); }
+    double predict_variance(const std::vector<double>& x) const {
+        return std::exp(log_variance_model.predict(x));
+    }
+    double predict_sd(const std::vector<double>& x) const { return std::sqrt(predict_variance(x)); }
+};
+
+inline DualResponseModel fit_dual_response(
+    const CrossedArrayExperiment& exp,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices)
+{
+    DOE_TRACE_SCOPE("fit_dual_response");
+    auto design = build_design_from_orthogonal_array_for_factors(exp.inner(), all_levels, factor_indices);
+    CrossedArrayStats s = exp.statistics();
+    DualResponseModel m;
+    if (!m.mean_model.fit(design, s.mean))
+        throw std::runtime_error("fit_dual_response: mean model fit failed");
+    if (!m.log_variance_model.fit(design, s.log_variance))
+        throw std::runtime_error("fit_dual_response: variance model fit failed");
+    return m;
+}
@@ -0,0 +1,276 @@
+#pragma once
+#include <vector>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <bit>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Effect screening for unreplicated 2-level arrays (L4, L8, L16 ... L256)
+//
+// Every column of a 2^m-run 2-level array is a Walsh function of the run index
+// (up to a sign), so one fast Walsh-Hadamard transform of the response gives all
+// N - 1 column contrasts in O(N log N) instead of one grouping pass per column:
+//   W[c] = sum_r (-1)^popcount(r & c) y[r],   effect = mean(level 1) - mean(level 0) = -+2 W[c] / N
+// Active effects are flagged with Lenth's method (no replicates needed):
+//   s0  = 1.5 median |e|,   PSE = 1.5 median { |e| : |e| < 2.5 s0 }
+//   ME  = t_{1-alpha/2, d} PSE,   SME = t_{gamma, d} PSE,   d = m / 3,
+//   gamma = (1 + (1 - alpha)^(1/m)) / 2
+// and half-normal plotting positions Phi^-1(0.5 + 0.5 (i + 0.5) / m) by rank.
+// Many responses are transformed together: a tile of responses is stored
+// row-major so every butterfly is a contiguous (vectorizable) row operation.
+// -----------------------------------------------------------------------------
+
+// In-place unnormalized fast Walsh-Hadamard transform of n rows (n a power of
+// two), each row `width` contiguous values: x[i] <- sum_j (-1)^popcount(i & j) x[j]
+inline void fwht_inplace(double* x, int n, int width = 1)
+{
+    if (n <= 0 || (n & (n - 1)) != 0)
+        throw std::runtime_error("fwht_inplace: n must be a power of two");
+    if (width < 1)
+        throw std::runtime_error("fwht_inplace: width must be >= 1");
+
+    if (width == 1) {
+        for (int h = 1; h < n; h <<= 1)
+            for (int i = 0; i < n; i += 2 * h)
+                for (int j = i; j < i + h; ++j) {
+                    double a = x[j], b = x[j + h];
+                    x[j] = a + b;
+                    x[j + h] = a - b;
+                }
+        return;
+    }
+    const size_t w = static_cast<size_t>(width);
+    for (int h = 1; h < n; h <<= 1)
+        for (int i = 0; i < n; i += 2 * h)
+            for (int j = i; j < i + h; ++j) {
+                double* a = x + j * w;
+                double* b = x + (j + h) * w;
+                for (size_t k = 0; k < w; ++k) {
+                    double u = a[k], v = b[k];
+                    a[k] = u + v;
+                    b[k] = u - v;
+                }
+            }
+}
+
+// Walsh index of each OA column and the factor turning W[index] into an effect
+struct WalshColumnMap {
+    int runs = 0;
+    std::vector<int> index;       // column f is (-1)^popcount(run & index[f]) up to sign
+    std::vector<double> scale;    // effect_f = scale[f] * W[index[f]]
+};
+
+// Throws if the array is not a 2-level array whose columns are Walsh functions
+// of the run order (true for L4, L8 and make_two_level_oa)
+inline WalshColumnMap make_walsh_column_map(const OrthogonalArray& oa)
+{
+    const int N = oa.runs;
+    if (N < 4 || (N & (N - 1)) != 0)
+        throw std::runtime_error("make_walsh_column_map: runs must be a power of two >= 4");
+
+    WalshColumnMap map;
+    map.runs = N;
+    map.index.resize(oa.factors);
+    map.scale.resize(oa.factors);
+    for (int f = 0; f < oa.factors; ++f) {
+        const int base = oa.at(0, f);
+        int c = 0;
+        for (int bit = 1; bit < N; bit <<= 1) {
+            int v = oa.at(bit, f);
+            if (v != 0 && v != 1)
+                throw std::runtime_error("make_walsh_column_map: array must be 2-level (0,1)");
+            if (v != base) c |= bit;
+        }
+        if (c == 0 || (base != 0 && base != 1))
+            throw std::runtime_error("make_walsh_column_map: constant or non 2-level column");
+        for (int r = 0; r < N; ++r)
+            if (oa.at(r, f) != (base ^ (std::popcount(static_cast<unsigned>(r & c)) & 1)))
+                throw std::runtime_error("make_walsh_column_map: column is not a Walsh function of the run order");
+        map.index[f] = c;
+        // base 0: level 0 where the Walsh sign is +1, so W = S0 - S1
+        map.scale[f] = (base == 0 ? -2.0 : 2.0) / N;
+    }
+    return map;
+}
+
+struct EffectScreeningOptions {
+    double alpha = 0.05;    // ME: per-effect level, SME: experimentwise level
+};
+
+// Per-effect arrays are indexed [f * responses + r]
+struct EffectScreeningResult {
+    int effects = 0;                        // screened columns (oa.factors)
+    int responses = 0;
+    double df    = 0.0;                     // Lenth's d = m / 3
+    double t_me  = std::numeric_limits<double>::quiet_NaN();
+    double t_sme = std::numeric_limits<double>::quiet_NaN();
+    std::vector<double> half_normal_q;      // plotting position of rank i (0 = smallest |effect|)
+
+    std::vector<double> grand_mean;         // [r]
+    std::vector<double> pse;                // [r] Lenth pseudo standard error
+    std::vector<double> me;                 // [r] margin of error
+    std::vector<double> sme;                // [r] simultaneous margin of error
+    std::vector<double> effect;             // mean(level 1) - mean(level 0)
+    std::vector<int> rank;                  // rank of |effect| among the m effects
+    std::vector<std::uint8_t> active;       // |effect| > ME
+    std::vector<std::uint8_t> active_sme;   // |effect| > SME
+
+    size_t index(int f, int r) const { return static_cast<size_t>(f) * responses + r; }
+};
+
+namespace effect_screening_detail {
+
+constexpr int kTile = 32;   // responses per row-major transform tile
+
+inline double median_inplace(std::vector<double>& v)
+{
+    const size_t n = v.size();
+    auto mid = v.begin() + n / 2;
+    std::nth_element(v.begin(), mid, v.end());
+    double hi = *mid;
+    if (n % 2) return hi;
+    double lo = *std::max_element(v.begin(), mid);
+    return 0.5 * (lo + hi);
+}
+
+// Lenth's PSE of the effects e[0..m)
+inline double lenth_pse(const double* e, int m, std::vector<double>& scratch)
+{
+    scratch.resize(m);
+    for (int f = 0; f < m; ++f) scratch[f] = std::fabs(e[f]);
+    const double s0 = 1.5 * median_inplace(scratch);
+    size_t kept = 0;
+    for (int f = 0; f < m; ++f) {
+        double a = std::fabs(e[f]);
+        if (a < 2.5 * s0) scratch[kept++] = a;
+    }
+    if (kept == 0) return 0.0;   // all effects zero
+    scratch.resize(kept);
+    return 1.5 * median_inplace(scratch);
+}
+
+} // namespace effect_screening_detail
+
+// -----------------------------------------------------------------------------
+// Screen all columns of a 2-level array for many responses
+// Y      : column-major block, response r starts at Y + r * ldy (ldy >= oa.runs);
+//          responses must be complete (use ANOM with a RunMask for failed runs)
+// threads: responses are split into contiguous blocks across threads
+// -----------------------------------------------------------------------------
+inline EffectScreeningResult screen_effects_batch(
+    const OrthogonalArray& oa,
+    const double* Y,
+    int responses,
+    int ldy,
+    const EffectScreeningOptions& opt = EffectScreeningOptions{},
+    int threads = 1)
+{
+    DOE_TRACE_SCOPE("screen_effects_batch");
+    if (responses <= 0 || ldy < oa.runs)
+        throw std::runtime_error("screen_effects_batch: need responses > 0 and ldy >= oa.runs");
+    if (oa.factors < 3)
+        throw std::runtime_error("screen_effects_batch: Lenth's method needs at least 3 effects");
+    if (!(opt.alpha > 0.0 && opt.alpha < 1.0))
+        throw std::runtime_error("screen_effects_batch: alpha must be in (0,1)");
+
+    using namespace effect_screening_detail;
+    const WalshColumnMap map = make_walsh_column_map(oa);
+    const int N = oa.runs;
+    const int m = oa.factors;
+
+    EffectScreeningResult out;
+    out.effects = m;
+    out.responses = responses;
+    out.df = m / 3.0;
+    out.t_me = stat_util::student_t_quantile(1.0 - opt.alpha / 2.0, out.df);
+    out.t_sme = stat_util::student_t_quantile(0.5 * (1.0 + std::pow(1.0 - opt.alpha, 1.0 / m)), out.df);
+    out.half_normal_q.resize(m);
+    for (int i = 0; i < m; ++i)
+        out.half_normal_q[i] = stat_util::normal_quantile_approx(0.5 + 0.5 * (i + 0.5) / m);
+
+    const size_t cells = static_cast<size_t>(m) * responses;
+    out.grand_mean.resize(responses);
+    out.pse.resize(responses);
+    out.me.resize(responses);
+    out.sme.resize(responses);
+    out.effect.resize(cells);
+    out.rank.resize(cells);
+    out.active.resize(cells);
+    out.active_sme.resize(cells);
+
+    doe_parallel::parallel_chunks(responses, threads, [&](int, int begin, int end) {
+        std::vector<double> buf(static_cast<size_t>(N) * kTile);
+        std::vector<double> e(m), scratch;
+        std::vector<int> order(m);
+        for (int t0 = begin; t0 < end; t0 += kTile) {
+            const int w = std::min(kTile, end - t0);
+            for (int k = 0; k < w; ++k) {
+                const double* y = Y + static_cast<size_t>(t0 + k) * ldy;
+                for (int i = 0; i < N; ++i) {
+                    if (!std::isfinite(y[i]))
+                        throw std::runtime_error("screen_effects_batch: responses must be finite");
+                    buf[static_cast<size_t>(i) * w + k] = y[i];
+                }
+            }
+            fwht_inplace(buf.data(), N, w);
+
+            for (int k = 0; k < w; ++k) {
+                const int r = t0 + k;
+                for (int f = 0; f < m; ++f)
+                    e[f] = map.scale[f] * buf[static_cast<size_t>(map.index[f]) * w + k];
+                const double pse = lenth_pse(e.data(), m, scratch);
+                out.grand_mean[r] = buf[k] / N;
+                out.pse[r] = pse;
+                out.me[r] = out.t_me * pse;
+                out.sme[r] = out.t_sme * pse;
+
+                std::iota(order.begin(), order.end(), 0);
+                std::sort(order.begin(), order.end(),
+                          [&](int a, int b) { return std::fabs(e[a]) < std::fabs(e[b]); });
+                for (int i = 0; i < m; ++i) out.rank[out.index(order[i], r)] = i;
+                for (int f = 0; f < m; ++f) {
+                    size_t j = out.index(f, r);
+                    double a = std::fabs(e[f]);
+                    out.effect[j] = e[f];
+                    out.active[j] = a > out.me[r];
+                    out.active_sme[j] = a > out.sme[r];
+                }
+            }
+        }
+    });
+    DOE_TRACE_COUNT("rows_scanned", static_cast<double>(N) * responses);
+    return out;
+}
+
+inline EffectScreeningResult screen_effects_batch(
+    const OrthogonalArray& oa,
+    const Eigen::MatrixXd& Y,
+    const EffectScreeningOptions& opt = EffectScreeningOptions{},
+    int threads = 1)
+{
+    if (Y.rows() != oa.runs)
+        throw std::runtime_error("screen_effects_batch: Y rows must match oa.runs");
+    return screen_effects_batch(oa, Y.data(), static_cast<int>(Y.cols()),
+                                static_cast<int>(Y.rows()), opt, threads);
+}
+
+// Single response
+inline EffectScreeningResult screen_effects(
+    const OrthogonalArray& oa,
+    const std::vector<double>& y,
+    const EffectScreeningOptions& opt = EffectScreeningOptions{})
+{
+    if ((int)y.size() != oa.runs)
+        throw std::runtime_error("screen_effects: y size must match oa.runs");
+    return screen_effects_batch(oa, y.data(), 1, oa.runs, opt, 1);
+}
@@ -1,11 +1,14 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <functional>
 
 #include "orthogonal_array.hpp"
 #include "Anom_Utils.h"
 #include "doe_anom_response.hpp"
 #include "response_surface_quadratic.hpp"
+#include "response_surface_orthogonal.hpp"
+#include "doe_trace.hpp"
 
 // Combined analysis: quadratic response surface + factor-wise ANOM
 struct DoeFullAnalysis {
@@ -16,29 +19,41 @@ struct DoeFullAnalysis {
 // Run full DOE analysis:
 // - ResponseSurfaceQuadratic on selected factors
 // - ANOM on all factors
+// Failed runs (NaN in y, or cleared in mask) are left out of both.
+// on_step(done, total) runs after the RS fit and after each factor,
+// total = 1 + oa.factors (progress / cancellation hook; may throw).
+// rs_plan: optional plan of (oa, all_levels, factor_indices_for_rs), shared by
+// callers that analyse many responses on the same array.
 inline DoeFullAnalysis run_doe_full_analysis(
     const OrthogonalArray& oa,
     const std::vector<FactorLevels>& all_levels,
     const std::vector<int>& factor_indices_for_rs,
     const std::vector<double>& y,
     const std::vector<std::string>& factor_names = {},
-    const AnomOptions& anom_opt = AnomOptions{})
+    const AnomOptions& anom_opt = AnomOptions{},
+    const RunMask& mask = RunMask{},
+    const std::function<void(int, int)>& on_step = {},
+    const OrthogonalQuadraticPlan* rs_plan = nullptr)
 {
+    DOE_TRACE_SCOPE("run_doe_full_analysis");
     if ((int)y.size() != oa.runs)
         throw std::runtime_error("run_doe_full_analysis: y size must match oa.runs");
 
-    // Build design matrix for selected factors
-    auto design = build_design_from_orthogonal_array_for_factors(
-        oa, all_levels, factor_indices_for_rs);
-
-    // Fit quadratic response surface
+    // Fit quadratic response surface (closed form on balanced arrays, QR otherwise)
     ResponseSurfaceQuadratic rs;
-    if (!rs.fit(design, y))
+    const bool fitted = rs_plan
+        ? fit_response_surface_oa(rs, *rs_plan, oa, all_levels, factor_indices_for_rs, y, mask)
+        : fit_response_surface_oa(rs, oa, all_levels, factor_indices_for_rs, y, mask);
+    if (!fitted)
         throw std::runtime_error("run_doe_full_analysis: ResponseSurfaceQuadratic::fit failed");
+    const int total = 1 + oa.factors;
+    if (on_step) on_step(1, total);
 
     // Factor-wise ANOM (all factors)
+    std::function<void(int)> on_factor;
+    if (on_step) on_factor = [&](int j) { on_step(2 + j, total); };
     auto all_factor_anoms = build_anom_for_all_factors(
-        oa, y, factor_names, anom_opt);
+        oa, y, factor_names, anom_opt, mask, on_factor);
 
     DoeFullAnalysis out;
     out.rs_model     = rs;
@@ -0,0 +1,312 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <functional>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_parallel.hpp"
+
+// -----------------------------------------------------------------------------
+// Candidate set for optimal design search
+// points[c]      : physical factor values of candidate c
+// level_index    : row-major (candidate * factors + factor) level indices,
+//                  filled only when the candidates come from a FactorLevels grid
+// -----------------------------------------------------------------------------
+struct CandidateSet {
+    int factors = 0;
+    std::vector<std::vector<double>> points;
+    std::vector<int> level_index;
+    int max_levels = 0;           // largest level count (grid candidates only)
+
+    int size() const { return static_cast<int>(points.size()); }
+    bool has_levels() const { return !level_index.empty(); }
+};
+
+// Full factorial grid over FactorLevels. Optional predicate removes infeasible points.
+inline CandidateSet build_candidate_grid(
+    const std::vector<FactorLevels>& levels,
+    const std::function<bool(const std::vector<double>&)>& feasible = {})
+{
+    if (levels.empty())
+        throw std::runtime_error("build_candidate_grid: no factors");
+    for (const auto& fl : levels) {
+        if (fl.levels.empty())
+            throw std::runtime_error("build_candidate_grid: factor has no levels");
+    }
+
+    CandidateSet cs;
+    cs.factors = static_cast<int>(levels.size());
+    for (const auto& fl : levels)
+        cs.max_levels = std::max(cs.max_levels, static_cast<int>(fl.levels.size()));
+
+    std::vector<int> idx(cs.factors, 0);
+    std::vector<double> x(cs.factors);
+    for (;;) {
+        for (int f = 0; f < cs.factors; ++f)
+            x[f] = levels[f].levels[idx[f]];
+
+        if (!feasible || feasible(x)) {
+            cs.points.push_back(x);
+            cs.level_index.insert(cs.level_index.end(), idx.begin(), idx.end());
+        }
+
+        // odometer increment (last factor fastest)
+        int f = cs.factors - 1;
+        while (f >= 0 && ++idx[f] == (int)levels[f].levels.size()) {
+            idx[f] = 0;
+            --f;
+        }
+        if (f < 0) break;
+    }
+
+    if (cs.points.empty())
+        throw std::runtime_error("build_candidate_grid: no feasible candidate");
+    return cs;
+}
+
+// User-supplied candidate points (e.g., a list of feasible settings)
+inline CandidateSet make_candidate_set(const std::vector<std::vector<double>>& points)
+{
+    if (points.empty())
+        throw std::runtime_error("make_candidate_set: no points");
+    CandidateSet cs;
+    cs.factors = static_cast<int>(points[0].size());
+    for (const auto& p : points) {
+        if ((int)p.size() != cs.factors)
+            throw std::runtime_error("make_candidate_set: dimension mismatch");
+    }
+    cs.points = points;
+    return cs;
+}
+
+// -----------------------------------------------------------------------------
+// D-optimal design (quadratic model of ResponseSurfaceQuadratic)
+// -----------------------------------------------------------------------------
+struct DOptimalOptions {
+    int runs = 0;                  // number of runs to select (>= number of model terms)
+    int restarts = 8;              // independent random starts
+    int threads = 0;               // 0 = hardware concurrency
+    int max_passes = 50;           // exchange passes per start
+    std::uint64_t seed = 12345;    // restart r uses seed + r
+    bool allow_repeats = true;     // a candidate may be selected more than once
+    double ridge = 1e-6;           // keeps the initial information matrix invertible
+};
+
+struct OptimalDesignResult {
+    std::vector<std::vector<double>> design; // runs x k physical values (feeds ResponseSurfaceQuadratic::fit)
+    std::vector<int> candidate_index;        // candidate row used by each run
+    OrthogonalArray level_table;             // level indices per run (grid candidates only)
+    double log_det = -std::numeric_limits<double>::infinity(); // log det(Phi^T Phi), coded [-1,1] units
+    double d_efficiency = 0.0;               // det(Phi^T Phi / N)^(1/m), coded units
+    int best_restart = -1;
+};
+
+namespace doe_detail {
+
+// Coded feature matrix of all candidates: each factor mapped to [-1, 1]
+inline Eigen::MatrixXd coded_candidate_features(const CandidateSet& cs)
+{
+    int k = cs.factors;
+    int M = cs.size();
+    std::vector<double> lo(k, std::numeric_limits<double>::infinity());
+    std::vector<double> hi(k, -std::numeric_limits<double>::infinity());
+    for (const auto& p : cs.points) {
+        for (int f = 0; f < k; ++f) {
+            lo[f] = std::min(lo[f], p[f]);
+            hi[f] = std::max(hi[f], p[f]);
+        }
+    }
+
+    int m = ResponseSurfaceQuadratic::num_terms(k);
+    Eigen::MatrixXd F(M, m);
+    std::vector<double> z(k);
+    Eigen::VectorXd phi(m);
+    for (int c = 0; c < M; ++c) {
+        for (int f = 0; f < k; ++f) {
+            double half = 0.5 * (hi[f] - lo[f]);
+            z[f] = (half > 0.0) ? (cs.points[c][f] - 0.5 * (hi[f] + lo[f])) / half : 0.0;
+        }
+        ResponseSurfaceQuadratic::expand_terms(z.data(), k, phi.data());
+        F.row(c) = phi.transpose();
+    }
+    return F;
+}
+
+struct ExchangeResult {
+    std::vector<int> rows;
+    double log_det = -std::numeric_limits<double>::infinity();
+};
+
+// Information matrix X^T X (+ ridge I) of the selected candidate rows
+inline Eigen::MatrixXd information_matrix(const Eigen::MatrixXd& F,
+                                          const std::vector<int>& rows,
+                                          double ridge)
+{
+    const int m = static_cast<int>(F.cols());
+    Eigen::MatrixXd info = ridge * Eigen::MatrixXd::Identity(m, m);
+    for (int r : rows) info.noalias() += F.row(r).transpose() * F.row(r);
+    return info;
+}
+
+// Modified Fedorov exchange from one random start.
+// Within a pass, Minv = (X^T X)^-1 and the candidate variances d_j = f_j^T Minv f_j
+// are kept current with rank-1 (Sherman-Morrison) updates; a swap of run i for
+// candidate j multiplies det(X^T X) by (1 + delta). Minv is refactored once per
+// pass to stop round-off from accumulating.
+inline ExchangeResult fedorov_exchange(const Eigen::MatrixXd& F,
+                                       const DOptimalOptions& opt,
+                                       std::uint64_t seed)
+{
+    const int M = static_cast<int>(F.rows());
+    const int m = static_cast<int>(F.cols());
+    const int N = opt.runs;
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> pick(0, M - 1);
+
+    ExchangeResult res;
+    res.rows.resize(N);
+    std::vector<int> use_count(M, 0);
+    if (opt.allow_repeats) {
+        for (int i = 0; i < N; ++i) res.rows[i] = pick(rng);
+    } else {
+        std::vector<int> perm(M);
+        for (int c = 0; c < M; ++c) perm[c] = c;
+        std::shuffle(perm.begin(), perm.end(), rng);
+        for (int i = 0; i < N; ++i) res.rows[i] = perm[i];
+    }
+    for (int r : res.rows) ++use_count[r];
+
+    Eigen::MatrixXd Minv(m, m);
+    Eigen::VectorXd d(M), u(m), Fu(M), v(m), Fv(M);
+    const Eigen::MatrixXd I = Eigen::MatrixXd::Identity(m, m);
+    const double tol = 1e-10;
+
+    for (int pass = 0; pass < opt.max_passes; ++pass) {
+        Eigen::LLT<Eigen::MatrixXd> llt(information_matrix(F, res.rows, opt.ridge));
+        if (llt.info() != Eigen::Success)
+            break;
+        Minv = llt.solve(I);
+        d = (F * Minv).cwiseProduct(F).rowwise().sum();
+
+        bool improved = false;
+        for (int i = 0; i < N; ++i) {
+            int ri = res.rows[i];
+            u.noalias() = Minv * F.row(ri).transpose();
+            Fu.noalias() = F * u;                      // d_ij for all candidates j
+            double di = Fu(ri);
+
+            int best_j = -1;
+            double best_delta = tol;
+            for (int j = 0; j < M; ++j) {
+                if (j == ri) continue;
+                if (!opt.allow_repeats && use_count[j] > 0) continue;
+                double dij = Fu(j);
+                double delta = (1.0 + d(j)) * (1.0 - di) + dij * dij - 1.0;
+                if (delta > best_delta) {
+                    best_delta = delta;
+                    best_j = j;
+                }
+            }
+            if (best_j < 0) continue;
+
+            // add candidate best_j: Minv -= (Minv f)(Minv f)^T / (1 + f^T Minv f)
+            v.noalias() = Minv * F.row(best_j).transpose();
+            Fv.noalias() = F * v;
+            double denom_add = 1.0 + Fv(best_j);
+            Minv.noalias() -= (v * v.transpose()) / denom_add;
+            d.array() -= Fv.array().square() / denom_add;
+
+            // remove run ri: Minv += (Minv f)(Minv f)^T / (1 - f^T Minv f)
+            u.noalias() = Minv * F.row(ri).transpose();
+            Fu.noalias() = F * u;
+            double denom_rm = 1.0 - Fu(ri); // equals (1 + delta) / (1 + d_j) > 0
+            Minv.noalias() += (u * u.transpose()) / denom_rm;
+            d.array() += Fu.array().square() / denom_rm;
+
+            --use_count[ri];
+            ++use_count[best_j];
+            res.rows[i] = best_j;
+            improved = true;
+        }
+
+        if (!improved) break;
+    }
+
+    // Exact log det of the final design (no ridge)
+    Eigen::LLT<Eigen::MatrixXd> llt(information_matrix(F, res.rows, 0.0));
+    if (llt.info() == Eigen::Success)
+        res.log_det = 2.0 * llt.matrixLLT().diagonal().array().log().sum();
+    return res;
+}
+
+} // namespace doe_detail
+
+// -----------------------------------------------------------------------------
+// Select opt.runs rows from the candidate set that maximize det(Phi^T Phi)
+// for the full quadratic model. Restarts run in parallel and the best one wins;
+// ties go to the lowest restart index so results do not depend on thread count.
+// -----------------------------------------------------------------------------
+inline OptimalDesignResult build_d_optimal_design(
+    const CandidateSet& candidates,
+    const DOptimalOptions& opt)
+{
+    if (candidates.size() == 0)
+        throw std::runtime_error("build_d_optimal_design: empty candidate set");
+    if (opt.restarts <= 0)
+        throw std::runtime_error("build_d_optimal_design: restarts must be > 0");
+
+    int k = candidates.factors;
+    int m = ResponseSurfaceQuadratic::num_terms(k);
+    if (opt.runs < m)
+        throw std::runtime_error("build_d_optimal_design: runs must be >= number of model terms ("
+                                 + std::to_string(m) + ")");
+    if (!opt.allow_repeats && opt.runs > candidates.size())
+        throw std::runtime_error("build_d_optimal_design: runs exceed candidate count without repeats");
+
+    Eigen::MatrixXd F = doe_detail::coded_candidate_features(candidates);
+
+    std::vector<doe_detail::ExchangeResult> starts(opt.restarts);
+    doe_parallel::parallel_for(opt.restarts, opt.threads, [&](int r) {
+        starts[r] = doe_detail::fedorov_exchange(F, opt, opt.seed + static_cast<std::uint64_t>(r));
+    });
+
+    int best = -1;
+    for (int r = 0; r < opt.restarts; ++r) {
+        if (!std::isfinite(starts[r].log_det)) continue;
+        if (best < 0 || starts[r].log_det > starts[best].log_det)
+            best = r;
+    }
+    if (best < 0)
+        throw std::runtime_error("build_d_optimal_design: no nonsingular design found");
+
+    OptimalDesignResult out;
+    out.best_restart    = best;
+    out.candidate_index = starts[best].rows;
+    out.log_det         = starts[best].log_det;
+    out.d_efficiency    = std::exp(out.log_det / m) / static_cast<double>(opt.runs);
+
+    out.design.reserve(opt.runs);
+    for (int c : out.candidate_index)
+        out.design.push_back(candidates.points[c]);
+
+    if (candidates.has_levels()) {
+        out.level_table.runs    = opt.runs;
+        out.level_table.factors = k;
+        out.level_table.levels  = candidates.max_levels;
+        out.level_table.data.reserve(static_cast<size_t>(opt.runs) * k);
+        for (int c : out.candidate_index) {
+            auto first = candidates.level_index.begin() + static_cast<std::ptrdiff_t>(c) * k;
+            out.level_table.data.insert(out.level_table.data.end(), first, first + k);
+        }
+    }
+    return out;
+}
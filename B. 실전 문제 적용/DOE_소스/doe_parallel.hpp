@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+namespace doe_parallel {
+
+// -----------------------------------------------------------------------------
+// Resolve the number of worker threads
+// requested <= 0 : use std::thread::hardware_concurrency()
+// never more threads than work items
+// -----------------------------------------------------------------------------
+inline int resolve_threads(int requested, int work_items) {
+    int t = requested;
+    if (t <= 0) {
+        unsigned hc = std::thread::hardware_concurrency();
+        t = (hc == 0) ? 1 : static_cast<int>(hc);
+    }
+    t = std::min(t, work_items);
+    return std::max(t, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Run fn(i) for i in [0, n) with dynamic scheduling on up to `threads` threads.
+// The first exception thrown by any worker is rethrown in the caller.
+// -----------------------------------------------------------------------------
+template <class Fn>
+inline void parallel_for(int n, int threads, Fn&& fn) {
+    if (n <= 0) return;
+    int T = resolve_threads(threads, n);
+    if (T == 1) {
+        for (int i = 0; i < n; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<int> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        for (;;) {
+            int i = next.fetch_add(1);
+            if (i >= n) break;
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                next.store(n);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(T - 1);
+    for (int t = 1; t < T; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+
+    if (error) std::rethrow_exception(error);
+}
+
+// -----------------------------------------------------------------------------
+// Split [0, n) into `threads` contiguous chunks and run fn(chunk, begin, end).
+// Useful when each worker keeps its own accumulator indexed by chunk.
+// Returns the number of chunks actually used.
+// -----------------------------------------------------------------------------
+template <class Fn>
+inline int parallel_chunks(int n, int threads, Fn&& fn) {
+    if (n <= 0) return 0;
+    int T = resolve_threads(threads, n);
+    parallel_for(T, T, [&](int c) {
+        long long begin = static_cast<long long>(n) * c / T;
+        long long end   = static_cast<long long>(n) * (c + 1) / T;
+        fn(c, static_cast<int>(begin), static_cast<int>(end));
+    });
+    return T;
+}
+
+} // namespace doe_parallel
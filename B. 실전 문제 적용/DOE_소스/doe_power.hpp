@@ -0,0 +1,270 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "anom_batch.hpp"
+#include "doe_tolerance_sim.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Power and run-count planning for factor-wise ANOM on an orthogonal array
+//
+// Scenario: one level g of factor f has its mean shifted by `effect`, all other
+// means equal, noise sd `sigma`, every OA run repeated `replicates` times.
+// Power is the probability that level g falls outside its ANOM decision limits
+// (same critical values as Anom::fit / build_anom_batch_for_factor).
+//
+// Analytical: with n_g observations at level g out of N, a levels, df = N - a,
+//   T = (ybar_g - ybar) / (s sqrt(1/n_g - 1/N)) ~ noncentral t(df, delta),
+//   delta = effect (1 - n_g/N) / (sigma sqrt(1/n_g - 1/N)),
+// and g is flagged when |T| > c sqrt(1/n_g) / sqrt(1/n_g - 1/N) (c = ANOM h or t).
+// Monte Carlo: responses are simulated on the replicated array in blocks and run
+// through build_anom_batch_for_factor. Response j draws from its own xoshiro
+// stream (seed, j), so estimates do not depend on the thread count. It also
+// reports the chance that any level is flagged.
+// -----------------------------------------------------------------------------
+
+enum class PowerMethod { Analytical, MonteCarlo };
+
+struct PowerScenario {
+    int factor = 0;               // OA column of the factor
+    int shifted_level = 0;        // level whose mean moves
+    double effect = 1.0;          // size of the shift (response units)
+    double sigma = 1.0;           // run-to-run noise sd
+    int replicates = 1;           // repeats of every OA run
+};
+
+struct PowerOptions {
+    AnomOptions anom;             // alpha, Bonferroni, equal-n h (Mean estimator)
+    PowerMethod method = PowerMethod::Analytical;
+    int simulations = 20000;      // Monte Carlo responses
+    std::uint64_t seed = 20240601;
+    int threads = 0;              // <= 0: hardware concurrency
+};
+
+struct PowerResult {
+    double power = std::numeric_limits<double>::quiet_NaN();
+    double power_any = std::numeric_limits<double>::quiet_NaN();   // Monte Carlo: any level flagged
+    double std_error = 0.0;        // Monte Carlo standard error of `power`
+    double noncentrality = std::numeric_limits<double>::quiet_NaN();
+    double critical = std::numeric_limits<double>::quiet_NaN();    // ANOM h (equal n) or t
+    int df = 0;
+    int observations = 0;          // runs * replicates
+};
+
+namespace power_detail {
+
+struct Layout {
+    std::vector<int> n;            // observations per present level (OA level order)
+    std::vector<int> level;        // OA level of each present group
+    int group = -1;                // position of the shifted level
+    int N = 0;
+};
+
+inline Layout make_layout(const OrthogonalArray& oa, const PowerScenario& sc)
+{
+    if (sc.factor < 0 || sc.factor >= oa.factors)
+        throw std::runtime_error("anom_power: factor out of range");
+    if (sc.replicates < 1 || !(sc.sigma > 0.0))
+        throw std::runtime_error("anom_power: need replicates >= 1 and sigma > 0");
+    int L = 0;
+    for (int r = 0; r < oa.runs; ++r) L = std::max(L, oa.at(r, sc.factor) + 1);
+    std::vector<int> count(L, 0);
+    for (int r = 0; r < oa.runs; ++r) ++count[oa.at(r, sc.factor)];
+    if (sc.shifted_level < 0 || sc.shifted_level >= L || count[sc.shifted_level] == 0)
+        throw std::runtime_error("anom_power: shifted level not present in the factor column");
+    Layout lay;
+    for (int l = 0; l < L; ++l) {
+        if (count[l] == 0) continue;
+        if (l == sc.shifted_level) lay.group = static_cast<int>(lay.n.size());
+        lay.level.push_back(l);
+        lay.n.push_back(count[l] * sc.replicates);
+    }
+    lay.N = oa.runs * sc.replicates;
+    return lay;
+}
+
+// Decision-limit factor c (margin = c s sqrt(1/n_g)), as in Anom::fit
+inline double anom_critical(const AnomOptions& opt, const std::vector<int>& n, int df)
+{
+    const int a = static_cast<int>(n.size());
+    const bool equal_n = opt.assume_equal_n && std::all_of(n.begin(), n.end(), [&](int v) { return v == n[0]; });
+    if (opt.bonferroni)
+        return equal_n ? stat_util::anom_h_bonferroni_equal_n(opt.alpha, a, n[0], df)
+                       : stat_util::anom_tcrit_bonferroni(opt.alpha, a, df);
+    return stat_util::student_t_quantile_approx(1.0 - opt.alpha / 2.0, static_cast<double>(df));
+}
+
+} // namespace power_detail
+
+// -----------------------------------------------------------------------------
+// Power to detect the level shift of `sc` on `oa`
+// -----------------------------------------------------------------------------
+inline PowerResult anom_power(const OrthogonalArray& oa, const PowerScenario& sc,
+                              const PowerOptions& opt = PowerOptions{})
+{
+    DOE_TRACE_SCOPE("anom_power");
+    using namespace power_detail;
+    if (opt.anom.estimator != AnomEstimator::Mean)
+        throw std::runtime_error("anom_power: only AnomEstimator::Mean is supported");
+    const Layout lay = make_layout(oa, sc);
+    const int a = static_cast<int>(lay.n.size());
+    if (a < 2)
+        throw std::runtime_error("anom_power: factor needs at least two levels");
+
+    PowerResult out;
+    out.observations = lay.N;
+    out.df = lay.N - a;
+    if (out.df <= 0)
+        throw std::runtime_error("anom_power: insufficient degrees of freedom (add replicates)");
+    out.critical = anom_critical(opt.anom, lay.n, out.df);
+
+    const double ng = lay.n[lay.group], N = lay.N;
+    const double se = std::sqrt(1.0 / ng - 1.0 / N);
+    out.noncentrality = sc.effect * (1.0 - ng / N) / (sc.sigma * se);
+
+    if (opt.method == PowerMethod::Analytical) {
+        const double c = out.critical * std::sqrt(1.0 / ng) / se;
+        const double df = out.df, d = out.noncentrality;
+        out.power = 1.0 - stat_util::noncentral_t_cdf(c, df, d) + stat_util::noncentral_t_cdf(-c, df, d);
+        return out;
+    }
+
+    // Monte Carlo on the replicated array
+    if (opt.simulations < 1)
+        throw std::runtime_error("anom_power: simulations must be >= 1");
+    OrthogonalArray rep;
+    rep.runs = lay.N;
+    rep.factors = 1;
+    rep.levels = oa.levels;
+    rep.data.resize(lay.N);
+    for (int k = 0; k < sc.replicates; ++k)
+        for (int r = 0; r < oa.runs; ++r) rep.data[static_cast<size_t>(k) * oa.runs + r] = oa.at(r, sc.factor);
+
+    const int block = 4096;
+    long long hit = 0, any = 0;
+    Eigen::MatrixXd Y(lay.N, std::min(block, opt.simulations));
+    for (int j0 = 0; j0 < opt.simulations; j0 += block) {
+        const int w = std::min(block, opt.simulations - j0);
+        doe_parallel::parallel_chunks(w, opt.threads, [&](int, int begin, int end) {
+            for (int j = begin; j < end; ++j) {
+                tolerance_detail::Xoshiro256 rng(opt.seed, static_cast<std::uint64_t>(j0 + j));
+                double* y = Y.col(j).data();
+                for (int r = 0; r < lay.N; ++r)
+                    y[r] = sc.sigma * rng.normal() + (rep.data[r] == sc.shifted_level ? sc.effect : 0.0);
+            }
+        });
+        AnomBatchResult res = build_anom_batch_for_factor(rep, 0, Y.data(), w, lay.N, opt.anom,
+                                                          RunMask{}, opt.threads);
+        for (int j = 0; j < w; ++j) {
+            const size_t k = res.index(lay.group, j);
+            hit += res.significant_high[k] | res.significant_low[k];
+            bool flagged = false;
+            for (int g = 0; g < res.groups && !flagged; ++g) {
+                const size_t i = res.index(g, j);
+                flagged = res.significant_high[i] | res.significant_low[i];
+            }
+            any += flagged;
+        }
+    }
+    const double S = opt.simulations;
+    out.power = hit / S;
+    out.power_any = any / S;
+    out.std_error = std::sqrt(out.power * (1.0 - out.power) / S);
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// Cheapest array / replication count that reaches a target power
+// -----------------------------------------------------------------------------
+struct PowerPlanCandidate {
+    std::string name;
+    const OrthogonalArray* oa = nullptr;
+    int factor = 0;               // column the factor would be assigned to
+    double cost_per_run = 1.0;    // cost of one experimental run
+};
+
+struct PowerPlanEntry {
+    int candidate = -1;
+    int replicates = 0;           // smallest count reaching the target (0: none up to the cap)
+    double power = 0.0;           // at `replicates` (at the cap when not reached)
+    double cost = 0.0;
+};
+
+struct PowerPlan {
+    bool found = false;
+    PowerPlanEntry best;
+    std::vector<PowerPlanEntry> evaluated;   // one per candidate
+};
+
+// sc.factor and sc.replicates are taken from each candidate / the search.
+// Power grows with the replicate count, so each candidate is a binary search
+// over [1, max_replicates]. Cheapest plan wins; ties go to the higher power.
+inline PowerPlan plan_for_power(const std::vector<PowerPlanCandidate>& candidates,
+                                PowerScenario sc,
+                                double target_power,
+                                int max_replicates = 20,
+                                const PowerOptions& opt = PowerOptions{})
+{
+    DOE_TRACE_SCOPE("plan_for_power");
+    if (!(target_power > 0.0 && target_power < 1.0))
+        throw std::runtime_error("plan_for_power: target_power must be in (0,1)");
+    if (max_replicates < 1)
+        throw std::runtime_error("plan_for_power: max_replicates must be >= 1");
+
+    PowerPlan plan;
+    for (int c = 0; c < (int)candidates.size(); ++c) {
+        const PowerPlanCandidate& cand = candidates[c];
+        if (!cand.oa)
+            throw std::runtime_error("plan_for_power: candidate without an array");
+        sc.factor = cand.factor;
+        // smallest replicate count with df > 0
+        PowerScenario probe = sc;
+        probe.replicates = 1;
+        const int levels = static_cast<int>(power_detail::make_layout(*cand.oa, probe).n.size());
+        int lo = 1;
+        while (cand.oa->runs * lo <= levels) ++lo;
+        int hi = max_replicates;
+        auto power_at = [&](int R) {
+            sc.replicates = R;
+            return anom_power(*cand.oa, sc, opt).power;
+        };
+
+        PowerPlanEntry e;
+        e.candidate = c;
+        if (lo > hi) { plan.evaluated.push_back(e); continue; }
+        const double top = power_at(hi);
+        if (top < target_power) {
+            e.power = top;
+            plan.evaluated.push_back(e);
+            continue;
+        }
+        double p_hi = top;
+        while (lo < hi) {
+            const int mid = lo + (hi - lo) / 2;
+            const double p = power_at(mid);
+            if (p >= target_power) { hi = mid; p_hi = p; }
+            else lo = mid + 1;
+        }
+        e.replicates = hi;
+        e.power = p_hi;
+        e.cost = cand.cost_per_run * cand.oa->runs * hi;
+        plan.evaluated.push_back(e);
+
+        if (!plan.found || e.cost < plan.best.cost ||
+            (e.cost == plan.best.cost && e.power > plan.best.power)) {
+            plan.best = e;
+            plan.found = true;
+        }
+    }
+    return plan;
+}
@@ -0,0 +1,563 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <bit>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <Eigen/Dense>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_full_analysis.hpp"
+#include "doe_run_mask.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Content-addressed cache of run_doe_full_analysis results
+//
+// Key   : 128-bit hash of every input (OA, FactorLevels, RS factor selection,
+//         y, factor names, AnomOptions, RunMask). Any change gives a new key,
+//         so entries never need explicit invalidation.
+// Tiers : in-memory LRU of shared, immutable results, then an optional
+//         directory of <key>.doec files. The file is a flat little-endian
+//         layout of 8-byte fields that is read through mmap (ifstream on Windows).
+// -----------------------------------------------------------------------------
+
+struct DoeCacheKey {
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    bool operator==(const DoeCacheKey& o) const { return hi == o.hi && lo == o.lo; }
+
+    std::string hex() const {
+        static const char* digits = "0123456789abcdef";
+        std::string s(32, '0');
+        for (int i = 0; i < 16; ++i) {
+            s[15 - i] = digits[(hi >> (4 * i)) & 15];
+            s[31 - i] = digits[(lo >> (4 * i)) & 15];
+        }
+        return s;
+    }
+};
+
+struct DoeCacheKeyHash {
+    size_t operator()(const DoeCacheKey& k) const { return static_cast<size_t>(k.lo ^ (k.hi * 0x9E3779B97F4A7C15ull)); }
+};
+
+namespace doe_cache_detail {
+
+constexpr std::uint64_t kMagic   = 0x43454F44ull;     // "DOEC" little-endian
+constexpr std::uint64_t kVersion = 1;
+
+inline std::uint64_t mix64(std::uint64_t x)
+{
+    x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27; x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Two independent 64-bit lanes over 8-byte words
+class Hasher {
+public:
+    void word(std::uint64_t w) {
+        a_ = mix64(a_ ^ (w + 0x9E3779B97F4A7C15ull));
+        std::uint64_t t = b_ ^ mix64(w ^ 0xD6E8FEB86659FD93ull);
+        b_ = std::rotl(t, 23) * 0x100000001B3ull + 0x52DCE729ull;
+    }
+    void i64(long long v) { word(static_cast<std::uint64_t>(v)); }
+    void f64(double v) {
+        if (std::isnan(v)) v = std::numeric_limits<double>::quiet_NaN();  // one NaN pattern
+        std::uint64_t w;
+        std::memcpy(&w, &v, 8);
+        word(w);
+    }
+    void str(const std::string& s) {
+        i64(static_cast<long long>(s.size()));
+        for (size_t i = 0; i < s.size(); i += 8) {
+            std::uint64_t w = 0;
+            std::memcpy(&w, s.data() + i, std::min<size_t>(8, s.size() - i));
+            word(w);
+        }
+    }
+    DoeCacheKey key() const { return {mix64(a_ ^ b_), mix64(b_ + 0x632BE59BD9B4E019ull)}; }
+
+private:
+    std::uint64_t a_ = 0x243F6A8885A308D3ull;
+    std::uint64_t b_ = 0x13198A2E03707344ull;
+};
+
+// ---- flat binary layout ----
+class Writer {
+public:
+    void u64(std::uint64_t v) { put(&v, 8); }
+    void i64(long long v) { put(&v, 8); }
+    void f64(double v) { put(&v, 8); }
+    void f64s(const double* v, size_t n) { u64(n); put(v, 8 * n); }
+    void str(const std::string& s) {
+        u64(s.size());
+        put(s.data(), s.size());
+        buf_.resize((buf_.size() + 7) & ~size_t(7), 0);
+    }
+    std::vector<unsigned char>& buffer() { return buf_; }
+
+private:
+    void put(const void* p, size_t n) {
+        const unsigned char* c = static_cast<const unsigned char*>(p);
+        buf_.insert(buf_.end(), c, c + n);
+    }
+    std::vector<unsigned char> buf_;
+};
+
+class Reader {
+public:
+    Reader(const unsigned char* p, size_t n) : p_(p), end_(p + n) {}
+    std::uint64_t u64() { std::uint64_t v; get(&v, 8); return v; }
+    long long i64() { long long v; get(&v, 8); return v; }
+    double f64() { double v; get(&v, 8); return v; }
+    std::vector<double> f64s() {
+        std::uint64_t n = u64();
+        need(8 * n);
+        std::vector<double> v(n);
+        get(v.data(), 8 * n);
+        return v;
+    }
+    std::string str() {
+        std::uint64_t n = u64();
+        need(n);
+        std::string s(reinterpret_cast<const char*>(p_), n);
+        p_ += (n + 7) & ~std::uint64_t(7);
+        if (p_ > end_) throw std::runtime_error("doe cache: truncated string");
+        return s;
+    }
+    size_t remaining() const { return static_cast<size_t>(end_ - p_); }
+
+private:
+    void need(std::uint64_t n) const {
+        if (n > static_cast<std::uint64_t>(end_ - p_))
+            throw std::runtime_error("doe cache: truncated record");
+    }
+    void get(void* dst, size_t n) {
+        need(n);
+        std::memcpy(dst, p_, n);
+        p_ += n;
+    }
+    const unsigned char* p_;
+    const unsigned char* end_;
+};
+
+inline std::uint64_t checksum(const unsigned char* p, size_t n)
+{
+    Hasher h;
+    for (size_t i = 0; i + 8 <= n; i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h.word(w);
+    }
+    return h.key().lo;
+}
+
+// Read-only view of a whole file: mmap on POSIX, buffered read elsewhere
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#if !defined(_WIN32)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                map_ = p;
+                size_ = static_cast<size_t>(st.st_size);
+                data_ = static_cast<const unsigned char*>(p);
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) return;
+        buf_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        data_ = reinterpret_cast<const unsigned char*>(buf_.data());
+        size_ = buf_.size();
+#endif
+    }
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (map_) ::munmap(map_, size_);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#if !defined(_WIN32)
+    void* map_ = nullptr;
+#else
+    std::vector<char> buf_;
+#endif
+};
+
+inline void write_options(Writer& w, const AnomOptions& o)
+{
+    w.f64(o.alpha);
+    w.i64(o.assume_equal_n);
+    w.i64(o.bonferroni);
+    w.i64(static_cast<long long>(o.estimator));
+    w.f64(o.huber_k);
+    w.f64(o.svg_width);
+    w.f64(o.svg_height);
+    w.f64(o.svg_margin);
+}
+
+inline AnomOptions read_options(Reader& r)
+{
+    AnomOptions o;
+    o.alpha          = r.f64();
+    o.assume_equal_n = r.i64() != 0;
+    o.bonferroni     = r.i64() != 0;
+    o.estimator      = static_cast<AnomEstimator>(r.i64());
+    o.huber_k        = r.f64();
+    o.svg_width      = r.f64();
+    o.svg_height     = r.f64();
+    o.svg_margin     = r.f64();
+    return o;
+}
+
+} // namespace doe_cache_detail
+
+// -----------------------------------------------------------------------------
+// Cache key of one run_doe_full_analysis call
+// -----------------------------------------------------------------------------
+inline DoeCacheKey make_doe_cache_key(
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices_for_rs,
+    const std::vector<double>& y,
+    const std::vector<std::string>& factor_names = {},
+    const AnomOptions& anom_opt = AnomOptions{},
+    const RunMask& mask = RunMask{})
+{
+    doe_cache_detail::Hasher h;
+    h.word(doe_cache_detail::kMagic);
+    h.word(doe_cache_detail::kVersion);
+
+    h.i64(oa.runs); h.i64(oa.factors); h.i64(oa.levels);
+    h.i64(static_cast<long long>(oa.data.size()));
+    for (size_t i = 0; i < oa.data.size(); i += 2) {
+        std::uint64_t lo = static_cast<std::uint32_t>(oa.data[i]);
+        std::uint64_t hi = (i + 1 < oa.data.size()) ? static_cast<std::uint32_t>(oa.data[i + 1]) : 0u;
+        h.word(lo | (hi << 32));
+    }
+
+    h.i64(static_cast<long long>(all_levels.size()));
+    for (const auto& fl : all_levels) {
+        h.i64(static_cast<long long>(fl.levels.size()));
+        for (double v : fl.levels) h.f64(v);
+    }
+
+    h.i64(static_cast<long long>(factor_indices_for_rs.size()));
+    for (int f : factor_indices_for_rs) h.i64(f);
+
+    h.i64(static_cast<long long>(y.size()));
+    for (double v : y) h.f64(v);
+
+    h.i64(static_cast<long long>(factor_names.size()));
+    for (const auto& s : factor_names) h.str(s);
+
+    doe_cache_detail::Writer ow;
+    doe_cache_detail::write_options(ow, anom_opt);
+    const auto& ob = ow.buffer();
+    for (size_t i = 0; i < ob.size(); i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, ob.data() + i, 8);
+        h.word(w);
+    }
+
+    h.i64(mask.runs);
+    for (std::uint64_t w : mask.words) h.word(w);
+    return h.key();
+}
+
+// -----------------------------------------------------------------------------
+// On-disk tier: one file per key
+// Layout (8-byte fields): magic, version, key.hi, key.lo, payload bytes, payload,
+// checksum(payload). Payload: RS (k, rank, beta), then per factor the name,
+// AnomOptions, grand mean, mse and per group (name, values, result fields).
+// -----------------------------------------------------------------------------
+inline void save_doe_analysis(const std::string& path, const DoeCacheKey& key, const DoeFullAnalysis& a)
+{
+    using namespace doe_cache_detail;
+    Writer p;
+    const ResponseSurfaceQuadratic& rs = a.rs_model;
+    p.i64(rs.num_factors());
+    p.i64(rs.rank());
+    p.f64s(rs.coefficients().data(), static_cast<size_t>(rs.coefficients().size()));
+
+    p.u64(a.factor_anoms.size());
+    for (const auto& fa : a.factor_anoms) {
+        const Anom& an = fa.anom;
+        p.str(fa.factor_name);
+        write_options(p, an.options());
+        p.f64(an.grand_mean());
+        p.f64(an.mse());
+        p.u64(static_cast<std::uint64_t>(an.num_groups()));
+        for (int g = 0; g < an.num_groups(); ++g) {
+            const AnomGroupResult& r = an.results()[g];
+            p.str(an.group_name(g));
+            p.f64s(an.group_values(g).data(), an.group_values(g).size());
+            p.i64(r.n);
+            p.f64(r.mean); p.f64(r.margin); p.f64(r.UDL); p.f64(r.LDL);
+            p.i64(r.significant_high); p.i64(r.significant_low);
+        }
+    }
+
+    const auto& payload = p.buffer();
+    Writer f;
+    f.u64(kMagic);
+    f.u64(kVersion);
+    f.u64(key.hi);
+    f.u64(key.lo);
+    f.u64(payload.size());
+    auto& out = f.buffer();
+    out.insert(out.end(), payload.begin(), payload.end());
+    f.u64(checksum(payload.data(), payload.size()));
+
+    // write-then-rename so readers never see a partial file; the temporary name is
+    // unique per process, thread and call, so concurrent writers of one key do not meet
+    static std::atomic<std::uint64_t> serial{0};
+#if defined(_WIN32)
+    const long long pid = _getpid();
+#else
+    const long long pid = ::getpid();
+#endif
+    const std::string tmp = path + ".tmp." + std::to_string(pid) + "."
+                          + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()) & 0xffffffu) + "."
+                          + std::to_string(serial.fetch_add(1));
+    std::error_code ec;
+    {
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        if (!ofs)
+            throw std::runtime_error("save_doe_analysis: cannot open file: " + tmp);
+        ofs.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+        ofs.close();
+        if (!ofs) {
+            std::filesystem::remove(tmp, ec);
+            throw std::runtime_error("save_doe_analysis: write failed: " + tmp);
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        throw std::runtime_error("save_doe_analysis: cannot rename " + tmp + " to " + path);
+    }
+}
+
+// Returns nullopt if the file is missing, truncated, corrupt or belongs to another key
+inline std::optional<DoeFullAnalysis> load_doe_analysis(const std::string& path, const DoeCacheKey& key)
+{
+    using namespace doe_cache_detail;
+    MappedFile file(path);
+    if (!file.data() || file.size() < 48) return std::nullopt;
+    try {
+        Reader h(file.data(), file.size());
+        if (h.u64() != kMagic || h.u64() != kVersion) return std::nullopt;
+        if (h.u64() != key.hi || h.u64() != key.lo) return std::nullopt;
+        std::uint64_t n = h.u64();
+        if (n + 48 != file.size() || n % 8 != 0) return std::nullopt;
+        const unsigned char* payload = file.data() + 40;
+        std::uint64_t stored;
+        std::memcpy(&stored, payload + n, 8);
+        if (stored != checksum(payload, n)) return std::nullopt;
+
+        Reader r(payload, n);
+        DoeFullAnalysis a;
+        int k = static_cast<int>(r.i64());
+        int rank = static_cast<int>(r.i64());
+        std::vector<double> beta = r.f64s();
+        a.rs_model.restore_fit(k, Eigen::Map<const Eigen::VectorXd>(beta.data(), beta.size()), rank);
+
+        std::uint64_t factors = r.u64();
+        a.factor_anoms.reserve(factors);
+        for (std::uint64_t j = 0; j < factors; ++j) {
+            std::string name = r.str();
+            Anom anom(read_options(r));
+            double grand = r.f64();
+            double mse = r.f64();
+            std::uint64_t groups = r.u64();
+            std::vector<AnomGroupResult> results(groups);
+            for (std::uint64_t g = 0; g < groups; ++g) {
+                AnomGroupResult& res = results[g];
+                res.name = r.str();
+                anom.add_group(res.name, r.f64s());
+                res.n = static_cast<int>(r.i64());
+                res.mean = r.f64(); res.margin = r.f64(); res.UDL = r.f64(); res.LDL = r.f64();
+                res.significant_high = r.i64() != 0;
+                res.significant_low  = r.i64() != 0;
+            }
+            anom.restore_fit(std::move(results), grand, mse);
+            a.factor_anoms.push_back(FactorAnomResult{std::move(name), std::move(anom)});
+        }
+        if (r.remaining() != 0) return std::nullopt;
+        return a;
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Two-tier cache
+// -----------------------------------------------------------------------------
+struct DoeCacheOptions {
+    size_t memory_capacity = 64;   // results kept in memory (LRU)
+    std::string directory;         // on-disk tier; empty = memory only
+};
+
+struct DoeCacheStats {
+    long long memory_hits = 0;
+    long long disk_hits = 0;
+    long long misses = 0;
+    long long evictions = 0;
+    long long write_errors = 0;         // results that could not be stored on disk
+};
+
+class DoeResultCache {
+public:
+    explicit DoeResultCache(DoeCacheOptions opt = {}) : opt_(std::move(opt)) {
+        if (!opt_.directory.empty())
+            std::filesystem::create_directories(opt_.directory);
+    }
+
+    // Result of run_doe_full_analysis for these inputs: memory, then disk, then compute
+    std::shared_ptr<const DoeFullAnalysis> get_or_compute(
+        const OrthogonalArray& oa,
+        const std::vector<FactorLevels>& all_levels,
+        const std::vector<int>& factor_indices_for_rs,
+        const std::vector<double>& y,
+        const std::vector<std::string>& factor_names = {},
+        const AnomOptions& anom_opt = AnomOptions{},
+        const RunMask& mask = RunMask{})
+    {
+        DOE_TRACE_SCOPE("DoeResultCache::get_or_compute");
+        DoeCacheKey key = make_doe_cache_key(oa, all_levels, factor_indices_for_rs, y,
+                                             factor_names, anom_opt, mask);
+        if (auto hit = find(key)) return hit;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.misses;
+        }
+        auto result = std::make_shared<const DoeFullAnalysis>(run_doe_full_analysis(
+            oa, all_levels, factor_indices_for_rs, y, factor_names, anom_opt, mask));
+        if (!opt_.directory.empty()) {
+            try {
+                save_doe_analysis(file_path(key), key, *result);
+            } catch (const std::exception&) {
+                // not cached on disk; the computed result is still returned
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++stats_.write_errors;
+            }
+        }
+        insert(key, result);
+        return result;
+    }
+
+    // Memory tier, then disk tier (a disk hit is promoted to memory); nullptr if absent
+    std::shared_ptr<const DoeFullAnalysis> find(const DoeCacheKey& key) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key);
+            if (it != index_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                ++stats_.memory_hits;
+                return it->second->second;
+            }
+        }
+        if (opt_.directory.empty()) return nullptr;
+        auto loaded = load_doe_analysis(file_path(key), key);
+        if (!loaded) return nullptr;
+        auto result = std::make_shared<const DoeFullAnalysis>(std::move(*loaded));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.disk_hits;
+        }
+        insert(key, result);
+        return result;
+    }
+
+    void clear_memory() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+    }
+
+    size_t memory_size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+
+    DoeCacheStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    std::string file_path(const DoeCacheKey& key) const {
+        return (std::filesystem::path(opt_.directory) / (key.hex() + ".doec")).string();
+    }
+
+private:
+    using Entry = std::pair<DoeCacheKey, std::shared_ptr<const DoeFullAnalysis>>;
+
+    void insert(const DoeCacheKey& key, std::shared_ptr<const DoeFullAnalysis> value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (opt_.memory_capacity == 0) return;
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->second = std::move(value);
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return;
+        }
+        lru_.emplace_front(key, std::move(value));
+        index_[key] = lru_.begin();
+        while (lru_.size() > opt_.memory_capacity) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+            ++stats_.evictions;
+        }
+    }
+
+    DoeCacheOptions opt_;
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_;
+    std::unordered_map<DoeCacheKey, std::list<Entry>::iterator, DoeCacheKeyHash> index_;
+    DoeCacheStats stats_;
+};
@@ -0,0 +1,341 @@
+#pragma once
+#include <vector>
+#include <stdexcept>
+#include <cmath>
+#include <cstdint>
+#include <bit>
+#include <algorithm>
+#include <utility>
+
+#include "orthogonal_array.hpp"
+#include "doe_space_filling.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Response-surface designs for the quadratic model (ResponseSurfaceQuadratic)
+//
+// Two-level arrays cannot estimate x_i^2. These designs put every factor on at
+// least three levels (coded units, factorial points at +-1):
+//   Central composite : 2^(k-p) factorial core + 2k axial points at +-alpha + centers
+//   Box-Behnken       : 2^g factorial on each group of factors (others at 0) + centers;
+//                       pairs for k <= 5, the tabulated groups of three for k = 6, 7
+// Rows are written directly into one contiguous row-major DesignMatrix.
+// decode_to_ranges maps coded units onto physical ranges (-1 -> lo, +1 -> hi).
+// -----------------------------------------------------------------------------
+
+enum class CcdAlpha {
+    FaceCentered,       // alpha = 1 (three levels, stays inside the cube)
+    Rotatable,          // alpha = F^(1/4), F = factorial runs
+    Orthogonal,         // pure quadratic columns mutually orthogonal
+    OrthogonalBlocks,   // block effects orthogonal to the model (use with blocked)
+    Custom              // CentralCompositeOptions::alpha
+};
+
+struct CentralCompositeOptions {
+    CcdAlpha alpha_type = CcdAlpha::Rotatable;
+    double alpha = 1.0;             // used with CcdAlpha::Custom
+    bool fractional = true;         // smallest resolution V fraction found (full 2^k for k <= 4)
+    int center_factorial = 4;       // center runs in each factorial block
+    int center_axial = 2;           // center runs in the axial block
+    bool blocked = false;           // factorial block(s) and a separate axial block
+    int factorial_blocks = 1;       // power of two; the core is split on high-order interactions
+};
+
+struct BoxBehnkenOptions {
+    int center_points = 3;          // total, or per block when blocked
+    bool blocked = false;           // pairs: one block per round of disjoint pairs; k = 6, 7: two blocks
+    bool all_pairs = false;         // every pair for any k (not a tabulated BBD; required for k >= 8)
+};
+
+struct RsmDesign {
+    DesignMatrix design;            // runs x k, coded units
+    std::vector<int> block;         // [run] block index (all 0 when unblocked)
+    int blocks = 1;
+    int factorial_runs = 0;
+    int axial_runs = 0;
+    int center_runs = 0;
+    double alpha = 0.0;             // CCD axial distance (0 for Box-Behnken)
+    std::vector<std::uint32_t> core_columns;   // CCD: run-index mask of each factor in the 2^r core
+};
+
+namespace rsm_design_detail {
+
+// Generators of a resolution V 2^(k-p) design on r base bits. Column j is the
+// run-index mask c_j: level = prod over bits b of c_j of (bit b of run ? +1 : -1).
+// Resolution V <=> no sum (xor) of 4 or fewer columns is zero. Greedy search over
+// candidate masks by increasing weight; returns false when r bits are not enough.
+inline bool resolution_v_columns(int k, int r, std::vector<std::uint32_t>& cols,
+                                 std::vector<std::uint8_t>& in_s2)
+{
+    const std::uint32_t size = 1u << r;
+    cols.clear();
+    std::vector<std::uint8_t> in_s3(size, 0);
+    in_s2.assign(size, 0);
+    std::vector<std::uint32_t> s1{0}, s2{0};   // sums of <= 1 and <= 2 columns
+    in_s2[0] = in_s3[0] = 1;
+
+    auto add = [&](std::uint32_t c) {
+        for (std::uint32_t v : s2) in_s3[v ^ c] = 1;
+        for (std::uint32_t v : s1)
+            if (!in_s2[v ^ c]) { in_s2[v ^ c] = 1; s2.push_back(v ^ c); }
+        s1.push_back(c);
+        cols.push_back(c);
+    };
+    for (int j = 0; j < r && (int)cols.size() < k; ++j) add(1u << j);
+    for (int w = 4; w <= r && (int)cols.size() < k; ++w)
+        for (std::uint32_t c = 1; c < size && (int)cols.size() < k; ++c)
+            if (std::popcount(c) == w && !in_s3[c]) add(c);
+    return (int)cols.size() == k;
+}
+
+inline void fill_center(int& row, int count, int block_id, std::vector<int>& block)
+{
+    for (int i = 0; i < count; ++i) block[row++] = block_id;   // rows are already zero
+}
+
+// Factor groups of the Box-Behnken (1960) tables beyond pairs, 0-based:
+// k = 6 partially balanced (each factor in 3 groups), k = 7 balanced (each pair once).
+// nullptr when no table is built in.
+inline const std::vector<std::vector<int>>* box_behnken_groups(int k)
+{
+    static const std::vector<std::vector<int>> g6 = {
+        {0, 1, 3}, {1, 2, 4}, {2, 3, 5}, {0, 3, 4}, {1, 4, 5}, {0, 2, 5}};
+    static const std::vector<std::vector<int>> g7 = {
+        {3, 4, 5}, {0, 5, 6}, {1, 4, 6}, {0, 1, 3}, {2, 3, 6}, {0, 2, 4}, {1, 2, 5}};
+    if (k == 6) return &g6;
+    if (k == 7) return &g7;
+    return nullptr;
+}
+
+} // namespace rsm_design_detail
+
+// -----------------------------------------------------------------------------
+// Central composite design, k >= 2 factors
+// Runs, in order: for each factorial block its core points then its centers,
+// then the 2k axial points (+-alpha on one factor) and the axial centers.
+// -----------------------------------------------------------------------------
+inline RsmDesign central_composite_design(int k, const CentralCompositeOptions& opt = CentralCompositeOptions{})
+{
+    DOE_TRACE_SCOPE("central_composite_design");
+    using namespace rsm_design_detail;
+    if (k < 2 || k > 1000)
+        throw std::runtime_error("central_composite_design: need 2 <= k <= 1000");
+    if (opt.center_factorial < 0 || opt.center_axial < 0)
+        throw std::runtime_error("central_composite_design: center counts must be >= 0");
+    const int B = opt.blocked ? opt.factorial_blocks : 1;
+    if (B < 1 || (B & (B - 1)) != 0)
+        throw std::runtime_error("central_composite_design: factorial_blocks must be a power of two");
+
+    // Factorial core: 2^r runs
+    std::vector<std::uint32_t> cols;
+    std::vector<std::uint8_t> in_s2;
+    // Resolution V needs 2^r >= 1 + k + k(k-1)/2 (main effects and 2FIs all estimable)
+    int r = 1;
+    while ((1.0 + k + 0.5 * k * (k - 1)) > std::ldexp(1.0, r)) ++r;
+    if (!opt.fractional) {
+        r = k;
+        if (k > 24)
+            throw std::runtime_error("central_composite_design: full 2^k core limited to k <= 24");
+        resolution_v_columns(k, k, cols, in_s2);
+    } else {
+        while (!resolution_v_columns(k, r, cols, in_s2)) {
+            if (++r > 24)
+                throw std::runtime_error("central_composite_design: no resolution V core within 2^24 runs");
+        }
+    }
+    const std::uint32_t F = 1u << r;
+
+    // Block generators: no nonzero element of their span may alias a main effect
+    // or two-factor interaction (a sum of <= 2 columns)
+    std::vector<std::uint32_t> span{0}, block_masks;
+    for (std::uint32_t c = 1; c < F && (int)span.size() < B; ++c) {
+        bool ok = true;
+        for (std::uint32_t v : span)
+            if (in_s2[v ^ c]) { ok = false; break; }
+        if (!ok) continue;
+        const size_t n = span.size();
+        for (size_t i = 0; i < n; ++i) span.push_back(span[i] ^ c);
+        block_masks.push_back(c);
+    }
+    if ((int)span.size() < B)
+        throw std::runtime_error("central_composite_design: too many factorial blocks for this core");
+    if (F % B != 0 || F / B < 2)
+        throw std::runtime_error("central_composite_design: factorial blocks too small");
+
+    const double Fd = static_cast<double>(F);
+    const int center_total = B * opt.center_factorial + opt.center_axial;
+    double alpha = 1.0;
+    switch (opt.alpha_type) {
+    case CcdAlpha::FaceCentered: alpha = 1.0; break;
+    case CcdAlpha::Rotatable:    alpha = std::pow(Fd, 0.25); break;
+    case CcdAlpha::Orthogonal: {
+        const double T = 2.0 * k + center_total;
+        const double s = std::sqrt(Fd + T) - std::sqrt(Fd);
+        alpha = std::pow(s * s * Fd / 4.0, 0.25);
+        break;
+    }
+    case CcdAlpha::OrthogonalBlocks:
+        // sum x_i^2 / block size equal in factorial and axial blocks
+        alpha = std::sqrt(Fd * (2.0 * k + opt.center_axial) / (2.0 * (Fd + B * opt.center_factorial)));
+        break;
+    case CcdAlpha::Custom:
+        if (!(opt.alpha > 0.0))
+            throw std::runtime_error("central_composite_design: custom alpha must be > 0");
+        alpha = opt.alpha;
+        break;
+    }
+
+    RsmDesign out;
+    out.alpha = alpha;
+    out.blocks = opt.blocked ? B + 1 : 1;
+    out.factorial_runs = static_cast<int>(F);
+    out.axial_runs = 2 * k;
+    out.center_runs = center_total;
+    out.core_columns = cols;
+    const int N = static_cast<int>(F) + 2 * k + center_total;
+    out.design = DesignMatrix(N, k);
+    out.block.assign(N, 0);
+
+    std::vector<int> weight(k);
+    for (int j = 0; j < k; ++j) weight[j] = std::popcount(cols[j]);
+    auto block_of = [&](std::uint32_t run) {
+        int b = 0;
+        for (size_t t = 0; t < block_masks.size(); ++t)
+            b |= (std::popcount(run & block_masks[t]) & 1) << t;
+        return b;
+    };
+
+    int row = 0;
+    for (int b = 0; b < B; ++b) {
+        for (std::uint32_t i = 0; i < F; ++i) {
+            if (B > 1 && block_of(i) != b) continue;
+            double* x = out.design.row(row);
+            for (int j = 0; j < k; ++j)
+                x[j] = ((weight[j] + std::popcount(i & cols[j])) & 1) ? -1.0 : 1.0;
+            out.block[row++] = b;
+        }
+        fill_center(row, opt.center_factorial, b, out.block);
+    }
+    const int axial_block = opt.blocked ? B : 0;
+    for (int j = 0; j < k; ++j)
+        for (double s : {-alpha, alpha}) {
+            out.design.at(row, j) = s;
+            out.block[row++] = axial_block;
+        }
+    fill_center(row, opt.center_axial, axial_block, out.block);
+
+    DOE_TRACE_COUNT("rows_scanned", N);
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// Box-Behnken design, k >= 3 factors
+// k = 3, 4, 5: every pair (i, j) gets the four points (+-1, +-1) with the other
+// factors at 0, 4 k(k-1)/2 edge midpoints (12, 24, 40 runs as tabulated).
+// k = 6, 7: the 2^3 factorial on each of the k tabulated groups of three factors
+// (48 and 56 runs). Blocked, each group is split on the sign of its three-factor
+// product, giving the two orthogonal blocks of the tables.
+// k >= 8 has no built-in table and is refused unless all_pairs is set. all_pairs
+// uses the pair construction for any k: 2k(k-1) runs, more than the tabulated
+// designs, and not a standard BBD for k >= 6. Blocked pairs are grouped into
+// rounds of disjoint pairs (round-robin); for even k each factor appears once per
+// round, which makes the blocks orthogonal.
+// At least one center run is needed: without it sum_i x_i^2 is the same on every
+// run and the squared terms are aliased with the intercept.
+// -----------------------------------------------------------------------------
+inline RsmDesign box_behnken_design(int k, const BoxBehnkenOptions& opt = BoxBehnkenOptions{})
+{
+    DOE_TRACE_SCOPE("box_behnken_design");
+    using namespace rsm_design_detail;
+    if (k < 3 || k > 1000)
+        throw std::runtime_error("box_behnken_design: need 3 <= k <= 1000");
+    if (opt.center_points < 0)
+        throw std::runtime_error("box_behnken_design: center_points must be >= 0");
+
+    if (const auto* groups = opt.all_pairs ? nullptr : box_behnken_groups(k)) {
+        const int g = static_cast<int>(groups->front().size());
+        const int corner = 1 << g;
+        const int blocks = opt.blocked ? 2 : 1;
+        const int centers = opt.center_points * blocks;
+        const int F = static_cast<int>(groups->size()) * corner;
+
+        RsmDesign out;
+        out.blocks = blocks;
+        out.factorial_runs = F;
+        out.center_runs = centers;
+        out.design = DesignMatrix(F + centers, k);
+        out.block.assign(F + centers, 0);
+
+        int row = 0;
+        for (int b = 0; b < blocks; ++b) {
+            for (const auto& grp : *groups)
+                for (int s = 0; s < corner; ++s) {
+                    if (opt.blocked && (std::popcount(static_cast<unsigned>(s)) & 1) != b) continue;
+                    double* x = out.design.row(row);
+                    for (int t = 0; t < g; ++t) x[grp[t]] = (s >> t & 1) ? 1.0 : -1.0;
+                    out.block[row++] = b;
+                }
+            fill_center(row, opt.center_points, b, out.block);
+        }
+        DOE_TRACE_COUNT("rows_scanned", F + centers);
+        return out;
+    }
+    if (k >= 8 && !opt.all_pairs)
+        throw std::runtime_error("box_behnken_design: no tabulated design for k >= 8 (set all_pairs for the pair construction)");
+
+    // Round-robin (circle method) pairing: n = k rounded up to even, n - 1 rounds;
+    // the phantom factor k (odd k) sits out one factor per round
+    const int n = k + (k & 1);
+    const int rounds = n - 1;
+    std::vector<std::vector<std::pair<int, int>>> round_pairs(rounds);
+    for (int t = 0; t < rounds; ++t) {
+        auto slot = [&](int p) { return p == 0 ? 0 : 1 + (p - 1 + t) % (n - 1); };
+        for (int p = 0; p < n / 2; ++p) {
+            int a = slot(p), b = slot(n - 1 - p);
+            if (a >= k || b >= k) continue;
+            round_pairs[t].emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+
+    const int pairs = k * (k - 1) / 2;
+    const int blocks = opt.blocked ? rounds : 1;
+    const int centers = opt.blocked ? opt.center_points * blocks : opt.center_points;
+    const int N = 4 * pairs + centers;
+
+    RsmDesign out;
+    out.blocks = blocks;
+    out.factorial_runs = 4 * pairs;
+    out.center_runs = centers;
+    out.design = DesignMatrix(N, k);
+    out.block.assign(N, 0);
+
+    int row = 0;
+    for (int t = 0; t < rounds; ++t) {
+        const int b = opt.blocked ? t : 0;
+        for (const auto& [i, j] : round_pairs[t])
+            for (double si : {-1.0, 1.0})
+                for (double sj : {-1.0, 1.0}) {
+                    double* x = out.design.row(row);
+                    x[i] = si;
+                    x[j] = sj;
+                    out.block[row++] = b;
+                }
+        if (opt.blocked) fill_center(row, opt.center_points, b, out.block);
+    }
+    if (!opt.blocked) fill_center(row, opt.center_points, 0, out.block);
+
+    DOE_TRACE_COUNT("rows_scanned", N);
+    return out;
+}
+
+// In-place coded -> physical: x = mid + x_coded * (hi - lo) / 2
+inline void decode_to_ranges(DesignMatrix& d, const std::vector<FactorRange>& ranges)
+{
+    if ((int)ranges.size() != d.factors)
+        throw std::runtime_error("decode_to_ranges: one range per factor required");
+    for (int r = 0; r < d.runs; ++r) {
+        double* x = d.row(r);
+        for (int j = 0; j < d.factors; ++j)
+            x[j] = 0.5 * (ranges[j].lo + ranges[j].hi) + x[j] * 0.5 * (ranges[j].hi - ranges[j].lo);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <bit>
+#include <stdexcept>
+
+// -----------------------------------------------------------------------------
+// Bitset of active runs (bit r set = run r is used)
+// Failed or excluded runs are cleared. An empty mask (runs == 0) means
+// "all runs active", so unmasked calls stay on the original fast path.
+// Active runs are visited word by word, skipping 64 inactive runs at a time.
+// -----------------------------------------------------------------------------
+struct RunMask {
+    int runs = 0;
+    std::vector<std::uint64_t> words;
+
+    RunMask() = default;
+    explicit RunMask(int n, bool active = true)
+        : runs(n), words((static_cast<size_t>(n) + 63) / 64, active ? ~std::uint64_t(0) : 0)
+    {
+        if (n < 0)
+            throw std::runtime_error("RunMask: negative run count");
+        trim();
+    }
+
+    bool empty() const { return runs == 0; }
+
+    bool test(int r) const { return (words[r >> 6] >> (r & 63)) & 1u; }
+
+    void set(int r, bool active = true) {
+        if (r < 0 || r >= runs)
+            throw std::runtime_error("RunMask::set: run index out of range");
+        std::uint64_t bit = std::uint64_t(1) << (r & 63);
+        if (active) words[r >> 6] |= bit;
+        else        words[r >> 6] &= ~bit;
+    }
+    void reset(int r) { set(r, false); }
+
+    int count() const {
+        int c = 0;
+        for (std::uint64_t w : words) c += std::popcount(w);
+        return c;
+    }
+    bool all() const { return count() == runs; }
+
+    RunMask& operator&=(const RunMask& o) {
+        if (o.runs != runs)
+            throw std::runtime_error("RunMask: size mismatch");
+        for (size_t i = 0; i < words.size(); ++i) words[i] &= o.words[i];
+        return *this;
+    }
+
+    // fn(r) for every active run, ascending
+    template <class Fn>
+    void for_each(Fn&& fn) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            std::uint64_t w = words[i];
+            while (w) {
+                fn(static_cast<int>(i * 64) + std::countr_zero(w));
+                w &= w - 1;
+            }
+        }
+    }
+
+    // Runs with a finite response
+    static RunMask from_responses(const std::vector<double>& y) {
+        RunMask m(static_cast<int>(y.size()));
+        for (size_t r = 0; r < y.size(); ++r) {
+            if (!std::isfinite(y[r])) m.reset(static_cast<int>(r));
+        }
+        return m;
+    }
+
+private:
+    void trim() {
+        if (runs % 64 != 0 && !words.empty())
+            words.back() &= (std::uint64_t(1) << (runs % 64)) - 1;
+    }
+};
+
+// Combine a user mask with the finite responses of y.
+// Returns an empty mask when every run is usable (caller keeps its fast path).
+inline RunMask effective_run_mask(const std::vector<double>& y, const RunMask& mask = RunMask{})
+{
+    if (!mask.empty() && mask.runs != (int)y.size())
+        throw std::runtime_error("effective_run_mask: mask size must match y size");
+
+    bool all_finite = true;
+    for (double v : y) {
+        if (!std::isfinite(v)) { all_finite = false; break; }
+    }
+    if (all_finite && (mask.empty() || mask.all()))
+        return RunMask{};
+
+    RunMask m = RunMask::from_responses(y);
+    if (!mask.empty()) m &= mask;
+    return m;
+}
@@ -0,0 +1,923 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <Eigen/Dense>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_full_analysis.hpp"
+#include "anom_batch.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Local analysis service around run_doe_full_analysis
+//
+// DoeAnalysisServer listens on a Unix domain socket. Each connection sends one
+// request per line and reads one reply line per request (protocol below).
+// Requests that share an OA, factor levels, RS factor selection, names and alpha
+// are batched: one QR of the quadratic design solves all their responses and
+// the ANOM limits come from build_anom_batch_for_all_factors. A fixed pool of
+// workers runs the batches. A request waits at most batch_window_us for
+// partners; a full batch (max_batch) starts at once.
+//
+// Request line (';' separated key=value, lists ',' separated):
+//   oa=L18;levels=0,1|-1,0,1|...;rs=1,2;names=A,B,...;alpha=0.05;y=v1,v2,...
+//   levels : one entry per OA factor, separated by '|' (default: 0..L-1)
+//   names, alpha : optional (defaults of run_doe_full_analysis / AnomOptions)
+//   STATS  : server counters and latency percentiles instead of an analysis
+// Reply line:
+//   ok;batch=B;rank=R;beta=b0,b1,...;anom=<factor>|<factor>...
+//   <factor> = name,grand_mean,s_within then per group name,n,mean,UDL,LDL,flag
+//   (flag: 1 high, -1 low, 0 inside the limits)
+//   error;<message>
+// Doubles are written with 17 significant digits, so results survive the wire.
+// POSIX only; on Windows start() and the load generator throw.
+// -----------------------------------------------------------------------------
+
+struct DoeServiceRequest {
+    std::string oa = "L18";                 // L4, L8, L9, L18
+    std::vector<FactorLevels> levels;       // empty = level index values
+    std::vector<int> rs_factors;
+    std::vector<std::string> factor_names;  // empty = A, B, C, ...
+    double alpha = 0.05;
+    std::vector<double> y;
+};
+
+struct DoeServiceGroup {
+    std::string name;
+    int n = 0;
+    double mean = 0.0;
+    double UDL = 0.0;
+    double LDL = 0.0;
+    bool significant_high = false;
+    bool significant_low = false;
+};
+
+struct DoeServiceFactor {
+    std::string name;
+    double grand_mean = 0.0;
+    double s_within = 0.0;
+    std::vector<DoeServiceGroup> groups;
+};
+
+struct DoeServiceReply {
+    bool ok = false;
+    std::string error;
+    int batch_size = 0;                     // requests solved together with this one
+    int rank = 0;
+    std::vector<double> beta;               // ResponseSurfaceQuadratic term order
+    std::vector<DoeServiceFactor> anom;
+};
+
+struct DoeLatencyStats {
+    long long count = 0;
+    double mean_us = 0.0;
+    double p50_us = 0.0;
+    double p90_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+struct DoeServiceOptions {
+    std::string socket_path;                // Unix socket path (start() only)
+    int workers = 4;                        // 0 = hardware concurrency
+    int max_batch = 64;
+    int batch_window_us = 2000;
+    int latency_window = 4096;              // latest requests kept for the latency percentiles
+};
+
+struct DoeServiceStats {
+    long long requests = 0;
+    long long batches = 0;
+    long long errors = 0;
+    DoeLatencyStats latency;                // enqueue to reply, per request
+};
+
+// Nearest-rank percentiles of a latency sample (microseconds)
+inline DoeLatencyStats latency_stats(std::vector<double> us)
+{
+    DoeLatencyStats s;
+    s.count = static_cast<long long>(us.size());
+    if (us.empty()) return s;
+    std::sort(us.begin(), us.end());
+    double sum = 0.0;
+    for (double v : us) sum += v;
+    s.mean_us = sum / us.size();
+    auto pct = [&](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * us.size()));
+        return us[std::min(us.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+    s.p50_us = pct(0.50);
+    s.p90_us = pct(0.90);
+    s.p99_us = pct(0.99);
+    s.max_us = us.back();
+    return s;
+}
+
+namespace doe_service_detail {
+
+inline const OrthogonalArray& find_array(const std::string& id)
+{
+    if (id == "L4")  return OA_L4_2_3();
+    if (id == "L8")  return OA_L8_2_7();
+    if (id == "L9")  return OA_L9_3_4();
+    if (id == "L18") return OA_L18_2_1_3_7();
+    throw std::runtime_error("doe_service: unknown OA id: " + id);
+}
+
+inline std::vector<std::string> split(const std::string& s, char sep)
+{
+    std::vector<std::string> out;
+    size_t start = 0;
+    for (;;) {
+        size_t p = s.find(sep, start);
+        out.push_back(s.substr(start, p == std::string::npos ? std::string::npos : p - start));
+        if (p == std::string::npos) break;
+        start = p + 1;
+    }
+    return out;
+}
+
+inline double parse_double(const std::string& s)
+{
+    if (s.empty())
+        throw std::runtime_error("doe_service: empty number");
+    if (s == "nan") return std::numeric_limits<double>::quiet_NaN();
+    char* end = nullptr;
+    double v = std::strtod(s.c_str(), &end);
+    if (end != s.c_str() + s.size())
+        throw std::runtime_error("doe_service: bad number: " + s);
+    return v;
+}
+
+inline std::vector<double> parse_doubles(const std::string& s)
+{
+    std::vector<double> v;
+    if (s.empty()) return v;
+    for (const auto& t : split(s, ',')) v.push_back(parse_double(t));
+    return v;
+}
+
+inline void append_double(std::string& out, double v)
+{
+    if (std::isnan(v)) { out += "nan"; return; }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.17g", v);
+    out += buf;
+}
+
+inline void append_doubles(std::string& out, const std::vector<double>& v)
+{
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (i) out += ',';
+        append_double(out, v[i]);
+    }
+}
+
+inline void check_name(const std::string& s)
+{
+    if (s.empty() || s.find_first_of(";|,=\n") != std::string::npos)
+        throw std::runtime_error("doe_service: invalid factor name: " + s);
+}
+
+// Fields shared by a batch: everything except y
+inline std::string batch_key(const DoeServiceRequest& q)
+{
+    std::string k = "oa=" + q.oa + ";levels=";
+    for (size_t f = 0; f < q.levels.size(); ++f) {
+        if (f) k += '|';
+        append_doubles(k, q.levels[f].levels);
+    }
+    k += ";rs=";
+    for (size_t i = 0; i < q.rs_factors.size(); ++i) {
+        if (i) k += ',';
+        k += std::to_string(q.rs_factors[i]);
+    }
+    if (!q.factor_names.empty()) {
+        k += ";names=";
+        for (size_t i = 0; i < q.factor_names.size(); ++i) {
+            if (i) k += ',';
+            k += q.factor_names[i];
+        }
+    }
+    k += ";alpha=";
+    append_double(k, q.alpha);
+    return k;
+}
+
+// Fill defaults and validate against the OA (throws on bad input)
+inline void normalize(DoeServiceRequest& q)
+{
+    const OrthogonalArray& oa = find_array(q.oa);
+    if (q.levels.empty()) {
+        q.levels.resize(oa.factors);
+        for (auto& fl : q.levels)
+            for (int l = 0; l < oa.levels; ++l) fl.levels.push_back(l);
+    }
+    if ((int)q.levels.size() != oa.factors)
+        throw std::runtime_error("doe_service: levels must list every OA factor");
+    if (q.rs_factors.empty())
+        throw std::runtime_error("doe_service: rs factor list is empty");
+    for (int f : q.rs_factors)
+        if (f < 0 || f >= oa.factors)
+            throw std::runtime_error("doe_service: rs factor out of range");
+    if (!q.factor_names.empty() && (int)q.factor_names.size() != oa.factors)
+        throw std::runtime_error("doe_service: names must list every OA factor");
+    for (const auto& s : q.factor_names) check_name(s);
+    if (!(q.alpha > 0.0 && q.alpha < 1.0))
+        throw std::runtime_error("doe_service: alpha must be in (0, 1)");
+    if ((int)q.y.size() != oa.runs)
+        throw std::runtime_error("doe_service: y size must match oa runs");
+}
+
+} // namespace doe_service_detail
+
+// ---- wire format ----
+inline std::string format_request(const DoeServiceRequest& q)
+{
+    std::string s = doe_service_detail::batch_key(q) + ";y=";
+    doe_service_detail::append_doubles(s, q.y);
+    return s;
+}
+
+inline DoeServiceRequest parse_request(const std::string& line)
+{
+    using namespace doe_service_detail;
+    DoeServiceRequest q;
+    for (const auto& field : split(line, ';')) {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("doe_service: expected key=value: " + field);
+        std::string key = field.substr(0, eq);
+        std::string val = field.substr(eq + 1);
+        if (key == "oa") {
+            q.oa = val;
+        } else if (key == "levels") {
+            if (!val.empty())
+                for (const auto& f : split(val, '|')) q.levels.push_back(FactorLevels{parse_doubles(f), {}});
+        } else if (key == "rs") {
+            for (const auto& t : split(val, ',')) q.rs_factors.push_back(static_cast<int>(parse_double(t)));
+        } else if (key == "names") {
+            q.factor_names = split(val, ',');
+        } else if (key == "alpha") {
+            q.alpha = parse_double(val);
+        } else if (key == "y") {
+            q.y = parse_doubles(val);
+        } else {
+            throw std::runtime_error("doe_service: unknown field: " + key);
+        }
+    }
+    normalize(q);
+    return q;
+}
+
+inline std::string format_reply(const DoeServiceReply& r)
+{
+    using namespace doe_service_detail;
+    if (!r.ok) {
+        std::string msg = r.error;
+        std::replace(msg.begin(), msg.end(), '\n', ' ');
+        return "error;" + msg;
+    }
+    std::string s = "ok;batch=" + std::to_string(r.batch_size) + ";rank=" + std::to_string(r.rank) + ";beta=";
+    append_doubles(s, r.beta);
+    s += ";anom=";
+    for (size_t f = 0; f < r.anom.size(); ++f) {
+        const DoeServiceFactor& F = r.anom[f];
+        if (f) s += '|';
+        s += F.name + ',';
+        append_double(s, F.grand_mean); s += ',';
+        append_double(s, F.s_within);
+        for (const auto& g : F.groups) {
+            s += ',' + g.name + ',' + std::to_string(g.n) + ',';
+            append_double(s, g.mean); s += ',';
+            append_double(s, g.UDL); s += ',';
+            append_double(s, g.LDL);
+            s += g.significant_high ? ",1" : (g.significant_low ? ",-1" : ",0");
+        }
+    }
+    return s;
+}
+
+inline DoeServiceReply parse_reply(const std::string& line)
+{
+    using namespace doe_service_detail;
+    DoeServiceReply r;
+    if (line.rfind("error;", 0) == 0) {
+        r.error = line.substr(6);
+        return r;
+    }
+    auto fields = split(line, ';');
+    if (fields.empty() || fields[0] != "ok")
+        throw std::runtime_error("doe_service: malformed reply");
+    for (size_t i = 1; i < fields.size(); ++i) {
+        size_t eq = fields[i].find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("doe_service: malformed reply field");
+        std::string key = fields[i].substr(0, eq);
+        std::string val = fields[i].substr(eq + 1);
+        if (key == "batch") {
+            r.batch_size = static_cast<int>(parse_double(val));
+        } else if (key == "rank") {
+            r.rank = static_cast<int>(parse_double(val));
+        } else if (key == "beta") {
+            r.beta = parse_doubles(val);
+        } else if (key == "anom") {
+            for (const auto& ftxt : split(val, '|')) {
+                auto t = split(ftxt, ',');
+                if (t.size() < 3 || (t.size() - 3) % 6 != 0)
+                    throw std::runtime_error("doe_service: malformed anom entry");
+                DoeServiceFactor F;
+                F.name = t[0];
+                F.grand_mean = parse_double(t[1]);
+                F.s_within = parse_double(t[2]);
+                for (size_t j = 3; j < t.size(); j += 6) {
+                    DoeServiceGroup g;
+                    g.name = t[j];
+                    g.n = static_cast<int>(parse_double(t[j + 1]));
+                    g.mean = parse_double(t[j + 2]);
+                    g.UDL = parse_double(t[j + 3]);
+                    g.LDL = parse_double(t[j + 4]);
+                    g.significant_high = t[j + 5] == "1";
+                    g.significant_low = t[j + 5] == "-1";
+                    F.groups.push_back(std::move(g));
+                }
+                r.anom.push_back(std::move(F));
+            }
+        }
+    }
+    r.ok = true;
+    return r;
+}
+
+// -----------------------------------------------------------------------------
+// Analysis of one batch (all requests share batch_key). Requests with a
+// non-finite response need per-request masks and go through run_doe_full_analysis.
+// -----------------------------------------------------------------------------
+inline std::vector<DoeServiceReply> analyze_doe_batch(const std::vector<const DoeServiceRequest*>& batch)
+{
+    DOE_TRACE_SCOPE("analyze_doe_batch");
+    std::vector<DoeServiceReply> out(batch.size());
+    if (batch.empty()) return out;
+    const DoeServiceRequest& head = *batch.front();
+    const OrthogonalArray& oa = doe_service_detail::find_array(head.oa);
+    AnomOptions aopt;
+    aopt.alpha = head.alpha;
+
+    std::vector<std::string> names = head.factor_names;
+    if (names.empty())
+        for (int j = 0; j < oa.factors; ++j) names.push_back(std::string(1, static_cast<char>('A' + j)));
+
+    std::vector<size_t> dense, single;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        bool finite = std::all_of(batch[i]->y.begin(), batch[i]->y.end(), [](double v) { return std::isfinite(v); });
+        (finite ? dense : single).push_back(i);
+    }
+
+    for (size_t i : single) {
+        DoeFullAnalysis a = run_doe_full_analysis(oa, head.levels, head.rs_factors, batch[i]->y, names, aopt);
+        DoeServiceReply& r = out[i];
+        r.rank = a.rs_model.rank();
+        const auto& b = a.rs_model.coefficients();
+        r.beta.assign(b.data(), b.data() + b.size());
+        for (const auto& fa : a.factor_anoms) {
+            DoeServiceFactor F{fa.factor_name, fa.anom.grand_mean(), fa.anom.s_within(), {}};
+            for (const auto& g : fa.anom.results())
+                F.groups.push_back({g.name, g.n, g.mean, g.UDL, g.LDL, g.significant_high, g.significant_low});
+            r.anom.push_back(std::move(F));
+        }
+        r.batch_size = 1;
+        r.ok = true;
+    }
+    if (dense.empty()) return out;
+
+    // Shared design: one QR, one column per response
+    const int N = oa.runs;
+    const int B = static_cast<int>(dense.size());
+    auto design = build_design_from_orthogonal_array_for_factors(oa, head.levels, head.rs_factors);
+    const int k = static_cast<int>(head.rs_factors.size());
+    const int m = ResponseSurfaceQuadratic::num_terms(k);
+    Eigen::MatrixXd Phi(N, m);
+    Eigen::VectorXd phi(m);
+    for (int r = 0; r < N; ++r) {
+        ResponseSurfaceQuadratic::expand_terms(design[r].data(), k, phi.data());
+        Phi.row(r) = phi.transpose();
+    }
+    Eigen::MatrixXd Y(N, B);
+    for (int c = 0; c < B; ++c)
+        Y.col(c) = Eigen::Map<const Eigen::VectorXd>(batch[dense[c]]->y.data(), N);
+
+    Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
+    Eigen::MatrixXd beta = qr.solve(Y);
+    const int rank = static_cast<int>(qr.rank());
+    std::vector<AnomBatchResult> anom = build_anom_batch_for_all_factors(oa, Y, aopt);
+
+    for (int c = 0; c < B; ++c) {
+        DoeServiceReply& r = out[dense[c]];
+        r.rank = rank;
+        r.beta.assign(beta.col(c).data(), beta.col(c).data() + m);
+        for (int j = 0; j < oa.factors; ++j) {
+            const AnomBatchResult& A = anom[j];
+            DoeServiceFactor F{names[j], A.grand_mean[c], A.s_within[c], {}};
+            for (int g = 0; g < A.groups; ++g) {
+                size_t q = A.index(g, c);
+                F.groups.push_back({names[j] + "_L" + std::to_string(A.level[g] + 1), A.n[g],
+                                    A.mean[q], A.UDL[q], A.LDL[q],
+                                    A.significant_high[q] != 0, A.significant_low[q] != 0});
+            }
+            r.anom.push_back(std::move(F));
+        }
+        r.batch_size = B;
+        r.ok = true;
+    }
+    return out;
+}
+
+#if !defined(_WIN32)
+namespace doe_service_detail {
+
+inline sockaddr_un unix_address(const std::string& path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("doe_service: invalid socket path: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+inline int connect_unix(const std::string& path)
+{
+    sockaddr_un addr = unix_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error("doe_service: socket() failed");
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        throw std::runtime_error("doe_service: cannot connect to " + path);
+    }
+    return fd;
+}
+
+inline bool write_line(int fd, std::string s)
+{
+    s += '\n';
+    size_t off = 0;
+    while (off < s.size()) {
+        ssize_t n = ::send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Buffered line reader over a stream socket
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd_(fd) {}
+    bool next(std::string& line) {
+        for (;;) {
+            size_t p = buf_.find('\n', pos_);
+            if (p != std::string::npos) {
+                line.assign(buf_, pos_, p - pos_);
+                pos_ = p + 1;
+                return true;
+            }
+            buf_.erase(0, pos_);
+            pos_ = 0;
+            char chunk[65536];
+            ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            buf_.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+private:
+    int fd_;
+    std::string buf_;
+    size_t pos_ = 0;
+};
+
+} // namespace doe_service_detail
+#endif
+
+// -----------------------------------------------------------------------------
+// Server: batching queue + fixed worker pool (+ socket front end)
+// -----------------------------------------------------------------------------
+class DoeAnalysisServer {
+public:
+    explicit DoeAnalysisServer(DoeServiceOptions opt = {}) : opt_(std::move(opt)) {
+        if (opt_.max_batch < 1 || opt_.latency_window < 1)
+            throw std::runtime_error("DoeAnalysisServer: max_batch and latency_window must be >= 1");
+        latencies_us_.reserve(opt_.latency_window);
+        int T = opt_.workers > 0 ? opt_.workers : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int t = 0; t < T; ++t) workers_.emplace_back([this] { worker_loop(); });
+    }
+
+    ~DoeAnalysisServer() { stop(); }
+    DoeAnalysisServer(const DoeAnalysisServer&) = delete;
+    DoeAnalysisServer& operator=(const DoeAnalysisServer&) = delete;
+
+    // In-process entry point (the socket front end uses the same path)
+    std::future<DoeServiceReply> submit(DoeServiceRequest request) {
+        auto job = std::make_shared<Job>();
+        job->request = std::move(request);
+        job->arrival = std::chrono::steady_clock::now();
+        std::future<DoeServiceReply> f = job->promise.get_future();
+        try {
+            doe_service_detail::normalize(job->request);
+            job->key = doe_service_detail::batch_key(job->request);
+        } catch (const std::exception& ex) {
+            finish(*job, error_reply(ex.what()));
+            return f;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                job->promise.set_value(error_reply("DoeAnalysisServer: stopped"));
+                return f;
+            }
+            queue_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+        return f;
+    }
+
+    // One protocol line in, one reply line out
+    std::string handle_line(const std::string& line) {
+        if (line == "STATS") return format_stats(stats());
+        DoeServiceRequest q;
+        try {
+            q = parse_request(line);
+        } catch (const std::exception& ex) {
+            record_latency(0.0, true);
+            return format_reply(error_reply(ex.what()));
+        }
+        return format_reply(submit(std::move(q)).get());
+    }
+
+    // Listen on opt.socket_path; one thread per connection
+    void start() {
+#if defined(_WIN32)
+        throw std::runtime_error("DoeAnalysisServer::start: Unix domain sockets are not supported on this platform");
+#else
+        if (listen_fd_ >= 0)
+            throw std::runtime_error("DoeAnalysisServer::start: already listening");
+        sockaddr_un addr = doe_service_detail::unix_address(opt_.socket_path);
+        ::unlink(opt_.socket_path.c_str());
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error("DoeAnalysisServer::start: socket() failed");
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0) {
+            ::close(fd);
+            throw std::runtime_error("DoeAnalysisServer::start: cannot listen on " + opt_.socket_path);
+        }
+        listen_fd_ = fd;
+        acceptor_ = std::thread([this, fd] { accept_loop(fd); });
+#endif
+    }
+
+    // Stop accepting, close connections, finish queued work, join all threads
+    void stop() {
+#if !defined(_WIN32)
+        if (listen_fd_ >= 0) {
+            ::shutdown(listen_fd_, SHUT_RDWR);   // wakes accept()
+            if (acceptor_.joinable()) acceptor_.join();
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            ::unlink(opt_.socket_path.c_str());
+        }
+        std::list<Connection> conns;
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex_);
+            for (const Connection& c : conns_)
+                if (!c.done) ::shutdown(c.fd, SHUT_RDWR);
+            conns.swap(conns_);
+        }
+        for (auto& c : conns) c.thread.join();
+#endif
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_)
+            if (t.joinable()) t.join();
+        workers_.clear();
+    }
+
+    DoeServiceStats stats() const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        DoeServiceStats s;
+        s.requests = requests_;
+        s.batches = batches_;
+        s.errors = errors_;
+        s.latency = latency_stats(latencies_us_);
+        return s;
+    }
+
+    void reset_stats() {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        requests_ = batches_ = errors_ = 0;
+        latencies_us_.clear();
+        latency_next_ = 0;
+    }
+
+    // Connection threads not yet joined (open ones plus finished ones awaiting the next accept)
+    size_t connection_threads() const {
+#if defined(_WIN32)
+        return 0;
+#else
+        std::lock_guard<std::mutex> lock(conn_mutex_);
+        return conns_.size();
+#endif
+    }
+
+    static std::string format_stats(const DoeServiceStats& s) {
+        std::string out = "ok;requests=" + std::to_string(s.requests) + ";batches=" + std::to_string(s.batches)
+                        + ";errors=" + std::to_string(s.errors) + ";p50_us=";
+        doe_service_detail::append_double(out, s.latency.p50_us);
+        out += ";p90_us=";
+        doe_service_detail::append_double(out, s.latency.p90_us);
+        out += ";p99_us=";
+        doe_service_detail::append_double(out, s.latency.p99_us);
+        out += ";max_us=";
+        doe_service_detail::append_double(out, s.latency.max_us);
+        return out;
+    }
+
+private:
+    struct Job {
+        DoeServiceRequest request;
+        std::string key;
+        std::chrono::steady_clock::time_point arrival;
+        std::promise<DoeServiceReply> promise;
+    };
+
+    static DoeServiceReply error_reply(const std::string& msg) {
+        DoeServiceReply r;
+        r.error = msg;
+        return r;
+    }
+
+    void record_latency(double us, bool error) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        ++requests_;
+        if (error) ++errors_;
+        // ring of the latest latency_window samples: bounded memory and STATS cost
+        if ((int)latencies_us_.size() < opt_.latency_window) {
+            latencies_us_.push_back(us);
+        } else {
+            latencies_us_[latency_next_] = us;
+            latency_next_ = (latency_next_ + 1) % latencies_us_.size();
+        }
+    }
+
+    void finish(Job& job, DoeServiceReply reply) {
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - job.arrival).count();
+        record_latency(us, !reply.ok);
+        job.promise.set_value(std::move(reply));
+    }
+
+    // Take the oldest request and every queued partner once the batch is full or
+    // the oldest request has waited batch_window_us
+    void worker_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return;   // stopping with nothing left
+
+            const std::string key = queue_.front()->key;
+            auto deadline = queue_.front()->arrival + std::chrono::microseconds(opt_.batch_window_us);
+            int partners = 0;
+            for (const auto& j : queue_) partners += (j->key == key);
+            if (partners < opt_.max_batch && !stopping_ && std::chrono::steady_clock::now() < deadline) {
+                cv_.wait_until(lock, deadline);
+                continue;
+            }
+
+            std::vector<std::shared_ptr<Job>> batch;
+            for (auto it = queue_.begin(); it != queue_.end() && (int)batch.size() < opt_.max_batch;) {
+                if ((*it)->key == key) {
+                    batch.push_back(std::move(*it));
+                    it = queue_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (!queue_.empty()) cv_.notify_one();
+            lock.unlock();
+            run_batch(batch);
+            lock.lock();
+        }
+    }
+
+    void run_batch(const std::vector<std::shared_ptr<Job>>& batch) {
+        std::vector<const DoeServiceRequest*> reqs;
+        for (const auto& j : batch) reqs.push_back(&j->request);
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            ++batches_;
+        }
+        std::vector<DoeServiceReply> replies;
+        try {
+            replies = analyze_doe_batch(reqs);
+        } catch (const std::exception& ex) {
+            replies.assign(batch.size(), error_reply(ex.what()));
+        }
+        for (size_t i = 0; i < batch.size(); ++i) finish(*batch[i], std::move(replies[i]));
+    }
+
+#if !defined(_WIN32)
+    struct Connection {
+        int fd = -1;
+        bool done = false;              // set by the connection thread as its last step
+        std::thread thread;
+    };
+
+    void accept_loop(int listen_fd) {
+        for (;;) {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) return;   // listening socket shut down
+            std::list<Connection> finished;
+            {
+                std::lock_guard<std::mutex> lock(conn_mutex_);
+                for (auto it = conns_.begin(); it != conns_.end();) {
+                    auto next = std::next(it);
+                    if (it->done) finished.splice(finished.end(), conns_, it);
+                    it = next;
+                }
+                Connection& c = conns_.emplace_back();
+                c.fd = fd;
+                c.thread = std::thread([this, &c] { serve_connection(c); });
+            }
+            for (auto& c : finished) c.thread.join();   // reap threads of closed connections
+        }
+    }
+
+    void serve_connection(Connection& conn) {
+        const int fd = conn.fd;
+        doe_service_detail::LineReader reader(fd);
+        std::string line;
+        while (reader.next(line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            if (!doe_service_detail::write_line(fd, handle_line(line))) break;
+        }
+        std::lock_guard<std::mutex> lock(conn_mutex_);
+        ::close(fd);
+        conn.done = true;
+    }
+
+    int listen_fd_ = -1;
+    std::thread acceptor_;
+    mutable std::mutex conn_mutex_;
+    std::list<Connection> conns_;       // list: elements stay put while their threads run
+#endif
+
+    DoeServiceOptions opt_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Job>> queue_;
+    bool stopping_ = false;
+
+    mutable std::mutex stats_mutex_;
+    long long requests_ = 0;
+    long long batches_ = 0;
+    long long errors_ = 0;
+    std::vector<double> latencies_us_;  // ring buffer, latency_window entries
+    size_t latency_next_ = 0;           // oldest entry once the ring is full
+};
+
+// -----------------------------------------------------------------------------
+// Load generator: `clients` connections, each sending `requests_per_client`
+// requests back to back. Responses follow y = 10 + x_a - 0.5 x_b + 0.3 x_a^2 + noise
+// on the first two RS factors, so every reply can be checked by the caller.
+// -----------------------------------------------------------------------------
+struct DoeLoadOptions {
+    std::string socket_path;
+    int clients = 8;
+    int requests_per_client = 100;
+    std::string oa = "L18";
+    std::vector<int> rs_factors = {1, 2};
+    double noise = 0.1;
+    std::uint64_t seed = 2024;
+};
+
+struct DoeLoadReport {
+    long long requests = 0;
+    long long errors = 0;
+    double wall_seconds = 0.0;
+    double requests_per_second = 0.0;
+    double mean_batch = 0.0;            // mean batch size reported by the server
+    DoeLatencyStats latency;            // client round trip
+};
+
+inline DoeServiceRequest make_load_request(const DoeLoadOptions& opt, std::mt19937_64& rng)
+{
+    DoeServiceRequest q;
+    q.oa = opt.oa;
+    q.rs_factors = opt.rs_factors;
+    const OrthogonalArray& oa = doe_service_detail::find_array(q.oa);
+    q.levels.resize(oa.factors);
+    for (int f = 0; f < oa.factors; ++f) {
+        int L = 0;
+        for (int r = 0; r < oa.runs; ++r) L = std::max(L, oa.at(r, f) + 1);
+        for (int l = 0; l < L; ++l) q.levels[f].levels.push_back(L == 1 ? 0.0 : -1.0 + 2.0 * l / (L - 1));
+    }
+    std::normal_distribution<double> eps(0.0, opt.noise);
+    auto design = build_design_from_orthogonal_array_for_factors(oa, q.levels, q.rs_factors);
+    for (int r = 0; r < oa.runs; ++r) {
+        double a = design[r][0];
+        double b = design[r].size() > 1 ? design[r][1] : 0.0;
+        q.y.push_back(10.0 + a - 0.5 * b + 0.3 * a * a + eps(rng));
+    }
+    return q;
+}
+
+inline DoeLoadReport run_doe_load_generator(const DoeLoadOptions& opt)
+{
+#if defined(_WIN32)
+    (void)opt;
+    throw std::runtime_error("run_doe_load_generator: Unix domain sockets are not supported on this platform");
+#else
+    if (opt.clients < 1 || opt.requests_per_client < 0)
+        throw std::runtime_error("run_doe_load_generator: need clients >= 1");
+    std::vector<std::vector<double>> lat(opt.clients);
+    std::vector<long long> errors(opt.clients, 0), batch_sum(opt.clients, 0);
+    std::vector<std::string> failure(opt.clients);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int c = 0; c < opt.clients; ++c) {
+        pool.emplace_back([&, c] {
+            try {
+                std::mt19937_64 rng(opt.seed + 7919u * c);
+                int fd = doe_service_detail::connect_unix(opt.socket_path);
+                doe_service_detail::LineReader reader(fd);
+                std::string line;
+                for (int i = 0; i < opt.requests_per_client; ++i) {
+                    std::string req = format_request(make_load_request(opt, rng));
+                    auto s = std::chrono::steady_clock::now();
+                    if (!doe_service_detail::write_line(fd, req) || !reader.next(line)) {
+                        ++errors[c];
+                        break;
+                    }
+                    lat[c].push_back(std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - s).count());
+                    DoeServiceReply r = parse_reply(line);
+                    if (!r.ok) ++errors[c];
+                    batch_sum[c] += r.batch_size;
+                }
+                ::close(fd);
+            } catch (const std::exception& ex) {
+                failure[c] = ex.what();
+                ++errors[c];
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    for (const auto& f : failure)
+        if (!f.empty()) throw std::runtime_error("run_doe_load_generator: " + f);
+
+    DoeLoadReport rep;
+    rep.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::vector<double> all;
+    long long bsum = 0;
+    for (int c = 0; c < opt.clients; ++c) {
+        all.insert(all.end(), lat[c].begin(), lat[c].end());
+        rep.errors += errors[c];
+        bsum += batch_sum[c];
+    }
+    rep.requests = static_cast<long long>(all.size());
+    rep.latency = latency_stats(std::move(all));
+    rep.requests_per_second = rep.wall_seconds > 0.0 ? rep.requests / rep.wall_seconds : 0.0;
+    rep.mean_batch = rep.requests > 0 ? static_cast<double>(bsum) / rep.requests : 0.0;
+    return rep;
+#endif
+}
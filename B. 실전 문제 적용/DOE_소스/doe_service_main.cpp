@@ -0,0 +1,80 @@
+// DOE analysis daemon and load generator (doe_service.hpp)
+//
+//   doe_service serve <socket> [workers] [batch_window_us]
+//   doe_service load  <socket> [clients] [requests_per_client]
+//   doe_service stats <socket>
+#include <iostream>
+#include <string>
+#include <csignal>
+#include <cstdlib>
+
+#include "doe_service.hpp"
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void on_signal(int) { g_stop = 1; }
+
+static int usage() {
+    std::cerr << "usage:\n"
+              << "  doe_service serve <socket> [workers] [batch_window_us]\n"
+              << "  doe_service load  <socket> [clients] [requests_per_client]\n"
+              << "  doe_service stats <socket>\n";
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+    std::string mode = argv[1];
+    std::string socket_path = argv[2];
+
+    try {
+        if (mode == "serve") {
+            DoeServiceOptions opt;
+            opt.socket_path = socket_path;
+            if (argc > 3) opt.workers = std::atoi(argv[3]);
+            if (argc > 4) opt.batch_window_us = std::atoi(argv[4]);
+            DoeAnalysisServer server(opt);
+            server.start();
+            std::signal(SIGINT, on_signal);
+            std::signal(SIGTERM, on_signal);
+            std::cout << "listening on " << socket_path << "\n";
+            while (!g_stop) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            server.stop();
+            std::cout << DoeAnalysisServer::format_stats(server.stats()) << "\n";
+        }
+        else if (mode == "load") {
+            DoeLoadOptions opt;
+            opt.socket_path = socket_path;
+            if (argc > 3) opt.clients = std::atoi(argv[3]);
+            if (argc > 4) opt.requests_per_client = std::atoi(argv[4]);
+            DoeLoadReport rep = run_doe_load_generator(opt);
+            std::cout << "requests     " << rep.requests << " (" << rep.errors << " errors)\n"
+                      << "throughput   " << rep.requests_per_second << " req/s\n"
+                      << "mean batch   " << rep.mean_batch << "\n"
+                      << "latency us   p50 " << rep.latency.p50_us << "  p90 " << rep.latency.p90_us
+                      << "  p99 " << rep.latency.p99_us << "  max " << rep.latency.max_us << "\n";
+            return rep.errors == 0 ? 0 : 1;
+        }
+        else if (mode == "stats") {
+#if defined(_WIN32)
+            throw std::runtime_error("stats: Unix domain sockets are not supported on this platform");
+#else
+            int fd = doe_service_detail::connect_unix(socket_path);
+            doe_service_detail::LineReader reader(fd);
+            std::string line;
+            if (!doe_service_detail::write_line(fd, "STATS") || !reader.next(line))
+                throw std::runtime_error("stats: no reply");
+            ::close(fd);
+            std::cout << line << "\n";
+#endif
+        }
+        else {
+            return usage();
+        }
+    }
+    catch (const std::exception& ex) {
+        std::cerr << "doe_service: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,414 @@
+#pragma once
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#include "orthogonal_array.hpp"
+
+// -----------------------------------------------------------------------------
+// Space-filling samplers for computer experiments
+// All samplers write unit-cube points u in [0,1)^k into contiguous row-major
+// buffers; scale_to_ranges maps them onto the FactorLevels ranges.
+// -----------------------------------------------------------------------------
+
+struct FactorRange {
+    double lo = 0.0;
+    double hi = 1.0;
+};
+
+// [min, max] of each factor's physical levels
+inline std::vector<FactorRange> factor_ranges(const std::vector<FactorLevels>& levels)
+{
+    std::vector<FactorRange> out;
+    out.reserve(levels.size());
+    for (const auto& fl : levels) {
+        if (fl.levels.empty())
+            throw std::runtime_error("factor_ranges: factor has no levels");
+        auto mm = std::minmax_element(fl.levels.begin(), fl.levels.end());
+        out.push_back({*mm.first, *mm.second});
+    }
+    return out;
+}
+
+// In-place u -> lo + u * (hi - lo) on a row-major (rows x k) block
+inline void scale_to_ranges(double* u, int rows, const std::vector<FactorRange>& ranges)
+{
+    const int k = static_cast<int>(ranges.size());
+    std::vector<double> lo(k), width(k);
+    for (int j = 0; j < k; ++j) {
+        lo[j]    = ranges[j].lo;
+        width[j] = ranges[j].hi - ranges[j].lo;
+    }
+    const double* plo = lo.data();
+    const double* pw  = width.data();
+    for (int r = 0; r < rows; ++r) {
+        double* ur = u + static_cast<size_t>(r) * k;
+        for (int j = 0; j < k; ++j)
+            ur[j] = plo[j] + ur[j] * pw[j];
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Latin hypercube with maximin (Morris-Mitchell phi_p) optimization
+// Each column holds exactly one point per stratum [i/N, (i+1)/N).
+// Optimization swaps two entries of one column and keeps the swap when
+// phi_p = (sum_{i<j} d_ij^-p)^(1/p) decreases. Pairwise distances are kept in an
+// N x N table and updated in O(N k) per swap, so this is meant for N up to a
+// few thousand runs; use the Sobol/Halton streams for larger designs.
+// -----------------------------------------------------------------------------
+struct LatinHypercubeOptions {
+    int runs = 0;
+    int iterations = 2000;        // attempted column swaps (0 = plain random LHS)
+    int phi_p = 15;               // Morris-Mitchell exponent
+    bool centered = false;        // true: stratum midpoints instead of random jitter
+    std::uint64_t seed = 12345;
+};
+
+struct LatinHypercubeResult {
+    DesignMatrix design;          // runs x k, already scaled to the ranges
+    double min_distance_initial = 0.0; // in unit-cube coordinates
+    double min_distance = 0.0;
+    double phi_criterion = 0.0;   // final Morris-Mitchell phi_p (smaller is better)
+    int accepted_swaps = 0;
+};
+
+inline LatinHypercubeResult latin_hypercube(const std::vector<FactorRange>& ranges,
+                                            const LatinHypercubeOptions& opt)
+{
+    const int N = opt.runs;
+    const int k = static_cast<int>(ranges.size());
+    if (N < 2)
+        throw std::runtime_error("latin_hypercube: runs must be >= 2");
+    if (k == 0)
+        throw std::runtime_error("latin_hypercube: no factors");
+
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+
+    LatinHypercubeResult res;
+    DesignMatrix U(N, k);
+    std::vector<int> perm(N);
+    for (int j = 0; j < k; ++j) {
+        std::iota(perm.begin(), perm.end(), 0);
+        std::shuffle(perm.begin(), perm.end(), rng);
+        for (int r = 0; r < N; ++r) {
+            double jitter = opt.centered ? 0.5 : unif(rng);
+            U.at(r, j) = (perm[r] + jitter) / N;
+        }
+    }
+
+    // Pairwise squared distances and per-pair phi contributions
+    const double p = static_cast<double>(opt.phi_p);
+    auto dist2 = [&](int a, int b) {
+        const double* xa = U.row(a);
+        const double* xb = U.row(b);
+        double s = 0.0;
+        for (int j = 0; j < k; ++j) {
+            double d = xa[j] - xb[j];
+            s += d * d;
+        }
+        return s;
+    };
+    auto term = [&](double d2) { return std::pow(d2, -0.5 * p); };
+
+    std::vector<double> D(static_cast<size_t>(N) * N, 0.0);
+    double phi_sum = 0.0;
+    double dmin2 = std::numeric_limits<double>::infinity();
+    for (int a = 0; a < N; ++a) {
+        for (int b = a + 1; b < N; ++b) {
+            double d2 = dist2(a, b);
+            D[(size_t)a * N + b] = D[(size_t)b * N + a] = d2;
+            phi_sum += term(d2);
+            dmin2 = std::min(dmin2, d2);
+        }
+    }
+    res.min_distance_initial = std::sqrt(dmin2);
+
+    std::uniform_int_distribution<int> pick_row(0, N - 1);
+    std::uniform_int_distribution<int> pick_col(0, k - 1);
+    std::vector<double> new_a(N), new_b(N);
+
+    for (int it = 0; it < opt.iterations; ++it) {
+        int a = pick_row(rng);
+        int b = pick_row(rng);
+        if (a == b) continue;
+        int c = pick_col(rng);
+
+        double ua = U.at(a, c), ub = U.at(b, c);
+        double delta = 0.0;
+        for (int r = 0; r < N; ++r) {
+            if (r == a || r == b) continue;
+            double ur = U.at(r, c);
+            // only column c changes: d2 += (ub - ur)^2 - (ua - ur)^2 for row a
+            double da = D[(size_t)a * N + r] + (ub - ur) * (ub - ur) - (ua - ur) * (ua - ur);
+            double db = D[(size_t)b * N + r] + (ua - ur) * (ua - ur) - (ub - ur) * (ub - ur);
+            new_a[r] = da;
+            new_b[r] = db;
+            delta += term(da) + term(db)
+                   - term(D[(size_t)a * N + r]) - term(D[(size_t)b * N + r]);
+        }
+        // d(a,b) is unchanged by swapping within one column
+
+        if (delta < 0.0) {
+            std::swap(U.at(a, c), U.at(b, c));
+            for (int r = 0; r < N; ++r) {
+                if (r == a || r == b) continue;
+                D[(size_t)a * N + r] = D[(size_t)r * N + a] = new_a[r];
+                D[(size_t)b * N + r] = D[(size_t)r * N + b] = new_b[r];
+            }
+            phi_sum += delta;
+            ++res.accepted_swaps;
+        }
+    }
+
+    dmin2 = std::numeric_limits<double>::infinity();
+    for (int a = 0; a < N; ++a)
+        for (int b = a + 1; b < N; ++b)
+            dmin2 = std::min(dmin2, D[(size_t)a * N + b]);
+    res.min_distance = std::sqrt(dmin2);
+    res.phi_criterion = std::pow(std::max(phi_sum, 0.0), 1.0 / p);
+
+    scale_to_ranges(U.data.data(), N, ranges);
+    res.design = std::move(U);
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+// Sobol sequence (Joe-Kuo direction numbers, up to 21 dimensions)
+// Gray-code construction: x_{n+1} = x_n XOR v[c], c = lowest zero bit of n.
+// State is one uint32 per dimension; direction numbers are stored bit-major
+// (v[bit * dims + d]) so the per-point XOR runs over contiguous memory.
+// -----------------------------------------------------------------------------
+class SobolSequence {
+public:
+    static constexpr int max_dims = 21;
+
+    explicit SobolSequence(int dims) : dims_(dims) {
+        if (dims < 1 || dims > max_dims)
+            throw std::runtime_error("SobolSequence: dims must be in [1, 21]");
+        init_direction_numbers();
+        x_.assign(dims_, 0u);
+    }
+
+    int dims() const { return dims_; }
+    std::uint64_t index() const { return index_; }
+
+    // Jump to point n (direct Gray-code evaluation)
+    void seek(std::uint64_t n) {
+        if (n > 0xFFFFFFFFull)
+            throw std::runtime_error("SobolSequence::seek: index exceeds 2^32");
+        std::uint32_t g = static_cast<std::uint32_t>(n ^ (n >> 1));
+        std::fill(x_.begin(), x_.end(), 0u);
+        for (int bit = 0; bit < 32; ++bit) {
+            if (g & (1u << bit)) {
+                const std::uint32_t* v = &v_[static_cast<size_t>(bit) * dims_];
+                for (int d = 0; d < dims_; ++d) x_[d] ^= v[d];
+            }
+        }
+        index_ = n;
+    }
+
+    // Write `rows` consecutive points (row-major, rows x dims) in [0,1)
+    void next_block(double* out, int rows) {
+        const double scale = 1.0 / 4294967296.0; // 2^-32
+        std::uint32_t* x = x_.data();
+        for (int r = 0; r < rows; ++r) {
+            if (index_ > 0xFFFFFFFFull)
+                throw std::runtime_error("SobolSequence::next_block: sequence exhausted (2^32 points)");
+
+            double* o = out + static_cast<size_t>(r) * dims_;
+            for (int d = 0; d < dims_; ++d)
+                o[d] = x[d] * scale;
+
+            if (index_ < 0xFFFFFFFFull) {
+                int c = lowest_zero_bit(index_);
+                const std::uint32_t* v = &v_[static_cast<size_t>(c) * dims_];
+                for (int d = 0; d < dims_; ++d)
+                    x[d] ^= v[d];
+            }
+            ++index_;
+        }
+    }
+
+private:
+    struct DirectionInit {
+        int s;                    // degree of the primitive polynomial
+        int a;                    // interior coefficients
+        std::uint32_t m[7];       // initial odd m_1..m_s
+    };
+
+    static int lowest_zero_bit(std::uint64_t n) {
+        int c = 0;
+        while (n & 1u) { n >>= 1; ++c; }
+        return c;
+    }
+
+    void init_direction_numbers() {
+        // new-joe-kuo-6.21201, dimensions 2..21
+        static const DirectionInit table[max_dims - 1] = {
+            {1,  0, {1}},
+            {2,  1, {1, 3}},
+            {3,  1, {1, 3, 1}},
+            {3,  2, {1, 1, 1}},
+            {4,  1, {1, 1, 3, 3}},
+            {4,  4, {1, 3, 5, 13}},
+            {5,  2, {1, 1, 5, 5, 17}},
+            {5,  4, {1, 1, 5, 5, 5}},
+            {5,  7, {1, 1, 7, 11, 19}},
+            {5, 11, {1, 1, 5, 1, 1}},
+            {5, 13, {1, 1, 1, 3, 11}},
+            {5, 14, {1, 3, 5, 5, 31}},
+            {6,  1, {1, 3, 3, 9, 7, 49}},
+            {6, 13, {1, 1, 1, 15, 21, 21}},
+            {6, 16, {1, 3, 1, 13, 27, 49}},
+            {6, 19, {1, 1, 1, 15, 7, 5}},
+            {6, 22, {1, 3, 1, 15, 13, 25}},
+            {6, 25, {1, 1, 5, 5, 19, 61}},
+            {7,  1, {1, 3, 7, 11, 23, 15, 103}},
+            {7,  4, {1, 3, 7, 13, 13, 15, 69}},
+        };
+
+        v_.assign(static_cast<size_t>(32) * dims_, 0u);
+        auto V = [&](int bit, int d) -> std::uint32_t& { return v_[static_cast<size_t>(bit) * dims_ + d]; };
+
+        // first dimension: van der Corput in base 2
+        for (int bit = 0; bit < 32; ++bit)
+            V(bit, 0) = 1u << (31 - bit);
+
+        for (int d = 1; d < dims_; ++d) {
+            const DirectionInit& t = table[d - 1];
+            const int s = t.s;
+            for (int i = 0; i < s; ++i)
+                V(i, d) = t.m[i] << (31 - i);
+            for (int i = s; i < 32; ++i) {
+                std::uint32_t v = V(i - s, d) ^ (V(i - s, d) >> s);
+                for (int q = 1; q < s; ++q) {
+                    if ((t.a >> (s - 1 - q)) & 1)
+                        v ^= V(i - q, d);
+                }
+                V(i, d) = v;
+            }
+        }
+    }
+
+    int dims_ = 0;
+    std::uint64_t index_ = 0;
+    std::vector<std::uint32_t> v_;   // 32 x dims, bit-major
+    std::vector<std::uint32_t> x_;   // current point
+};
+
+// -----------------------------------------------------------------------------
+// Halton sequence with optional random digit scrambling
+// Dimension d uses the d-th prime base. Scrambling applies a random permutation
+// of the nonzero digits per (dimension, digit position); 0 stays 0 so the
+// stratification of the original sequence is preserved.
+// -----------------------------------------------------------------------------
+class HaltonSequence {
+public:
+    explicit HaltonSequence(int dims, bool scramble = false, std::uint64_t seed = 12345)
+        : dims_(dims)
+    {
+        if (dims < 1)
+            throw std::runtime_error("HaltonSequence: dims must be >= 1");
+
+        // first `dims` primes
+        for (int c = 2; (int)bases_.size() < dims_; ++c) {
+            bool prime = true;
+            for (int b : bases_) {
+                if (b * b > c) break;
+                if (c % b == 0) { prime = false; break; }
+            }
+            if (prime) bases_.push_back(c);
+        }
+
+        // digits needed so that base^digits >= 2^53
+        digits_.resize(dims_);
+        perm_offset_.resize(dims_);
+        int offset = 0;
+        for (int d = 0; d < dims_; ++d) {
+            int b = bases_[d];
+            digits_[d] = static_cast<int>(std::ceil(53.0 * std::log(2.0) / std::log(static_cast<double>(b))));
+            perm_offset_[d] = offset;
+            offset += digits_[d] * b;
+        }
+
+        perm_.resize(offset);
+        std::mt19937_64 rng(seed);
+        for (int d = 0; d < dims_; ++d) {
+            int b = bases_[d];
+            for (int pos = 0; pos < digits_[d]; ++pos) {
+                int* p = &perm_[perm_offset_[d] + pos * b];
+                std::iota(p, p + b, 0);
+                if (scramble) std::shuffle(p + 1, p + b, rng);
+            }
+        }
+    }
+
+    int dims() const { return dims_; }
+    std::uint64_t index() const { return index_; }
+    void seek(std::uint64_t n) { index_ = n; }
+
+    // Write `rows` consecutive points (row-major, rows x dims) in [0,1)
+    void next_block(double* out, int rows) {
+        for (int r = 0; r < rows; ++r) {
+            double* o = out + static_cast<size_t>(r) * dims_;
+            for (int d = 0; d < dims_; ++d)
+                o[d] = radical_inverse(d, index_);
+            ++index_;
+        }
+    }
+
+private:
+    double radical_inverse(int d, std::uint64_t n) const {
+        const std::uint64_t b = static_cast<std::uint64_t>(bases_[d]);
+        const int* p = &perm_[perm_offset_[d]];
+        const double inv_b = 1.0 / static_cast<double>(b);
+        double f = inv_b, v = 0.0;
+        for (int pos = 0; n > 0 && pos < digits_[d]; ++pos) {
+            v += p[pos * b + static_cast<int>(n % b)] * f;
+            n /= b;
+            f *= inv_b;
+        }
+        return v;
+    }
+
+    int dims_ = 0;
+    std::uint64_t index_ = 0;
+    std::vector<int> bases_;
+    std::vector<int> digits_;
+    std::vector<int> perm_offset_;
+    std::vector<int> perm_;          // per (dimension, digit position): permutation of 0..b-1
+};
+
+// -----------------------------------------------------------------------------
+// Streaming generation: `total` points in chunks of at most `chunk_rows`.
+// One chunk buffer is reused, so memory stays O(chunk_rows * k) for any total.
+// consume(const DesignMatrix& chunk, long long first_row) sees scaled points.
+// -----------------------------------------------------------------------------
+template <class Sequence, class Consumer>
+inline void generate_in_chunks(Sequence& seq,
+                               const std::vector<FactorRange>& ranges,
+                               long long total,
+                               int chunk_rows,
+                               Consumer&& consume)
+{
+    if ((int)ranges.size() != seq.dims())
+        throw std::runtime_error("generate_in_chunks: ranges size must match sequence dims");
+    if (chunk_rows <= 0)
+        throw std::runtime_error("generate_in_chunks: chunk_rows must be > 0");
+
+    DesignMatrix chunk(chunk_rows, seq.dims());
+    for (long long first = 0; first < total; first += chunk_rows) {
+        int rows = static_cast<int>(std::min<long long>(chunk_rows, total - first));
+        chunk.runs = rows;
+        chunk.data.resize(static_cast<size_t>(rows) * seq.dims()); // shrinks only on the last chunk
+        seq.next_block(chunk.data.data(), rows);
+        scale_to_ranges(chunk.data.data(), rows, ranges);
+        consume(static_cast<const DesignMatrix&>(chunk), first);
+    }
+}
@@ -0,0 +1,412 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <mutex>
+
+#include "Anom_Utils.h"
+#include "response_surface_quadratic.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Monte Carlo tolerance simulation over a fitted ResponseSurfaceQuadratic
+//
+// Each factor varies around its setpoint (normal, uniform or truncated normal).
+// Samples are drawn and evaluated in batches (predict_batch on a row-major
+// buffer), and only streaming summaries are kept: mean / sd, min / max, spec
+// violations and a KLL quantile sketch, so memory does not grow with the
+// sample count.
+//
+// Work is split into fixed chunks of 2^16 samples (16 for the default 10^6), taken
+// by the threads in increasing order. Chunk c draws from its own xoshiro256** stream
+// seeded by splitmix64(seed, c). A finished chunk is merged into the result as soon
+// as every earlier chunk is merged, so only chunks that finish out of order wait
+// with their sketch. The merge order is the chunk order, so results are
+// bit-identical for any thread count.
+// -----------------------------------------------------------------------------
+
+// ---- KLL quantile sketch ----
+// Mergeable streaming quantiles with rank error about 1.7 / k (Karnin, Lang, Liberty 2016).
+// Level h holds items of weight 2^h; a full level is sorted and every other item
+// (random offset) is promoted, so memory stays O(k).
+class KllQuantileSketch {
+public:
+    explicit KllQuantileSketch(int k = 2048, std::uint64_t seed = 0x9E3779B97F4A7C15ull)
+        : k_(k), rng_(seed | 1)
+    {
+        if (k < 8)
+            throw std::runtime_error("KllQuantileSketch: k must be >= 8");
+        levels_.emplace_back();
+        refresh_capacity();
+    }
+
+    void update(double v) {
+        if (std::isnan(v)) return;
+        if (n_ == 0) min_ = max_ = v;
+        min_ = std::min(min_, v);
+        max_ = std::max(max_, v);
+        ++n_;
+        levels_[0].push_back(v);
+        if (++retained_ >= total_capacity_) compress();
+    }
+
+    void merge(const KllQuantileSketch& o) {
+        if (o.n_ == 0) return;
+        if (n_ == 0) { min_ = o.min_; max_ = o.max_; }
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+        n_ += o.n_;
+        while (levels_.size() < o.levels_.size()) levels_.emplace_back();
+        for (size_t h = 0; h < o.levels_.size(); ++h) {
+            levels_[h].insert(levels_[h].end(), o.levels_[h].begin(), o.levels_[h].end());
+            retained_ += o.levels_[h].size();
+        }
+        refresh_capacity();
+        while (retained_ >= total_capacity_) compress();
+    }
+
+    long long count() const { return n_; }
+    double min() const { return min_; }
+    double max() const { return max_; }
+    size_t retained() const { return retained_; }
+
+    // Value at normalized rank q in [0, 1] (q = 0: min, q = 1: max)
+    double quantile(double q) const {
+        if (n_ == 0) return std::numeric_limits<double>::quiet_NaN();
+        if (q <= 0.0) return min_;
+        if (q >= 1.0) return max_;
+        std::vector<std::pair<double, std::uint64_t>> items;
+        items.reserve(retained_);
+        std::uint64_t total = 0;
+        for (size_t h = 0; h < levels_.size(); ++h) {
+            for (double v : levels_[h]) items.emplace_back(v, std::uint64_t(1) << h);
+            total += levels_[h].size() << h;
+        }
+        std::sort(items.begin(), items.end());
+        double target = q * static_cast<double>(total);
+        std::uint64_t cum = 0;
+        for (const auto& [v, w] : items) {
+            cum += w;
+            if (static_cast<double>(cum) >= target) return v;
+        }
+        return max_;
+    }
+
+    // Fraction of the stream <= v
+    double rank(double v) const {
+        if (n_ == 0) return 0.0;
+        std::uint64_t below = 0, total = 0;
+        for (size_t h = 0; h < levels_.size(); ++h) {
+            for (double x : levels_[h]) if (x <= v) below += std::uint64_t(1) << h;
+            total += levels_[h].size() << h;
+        }
+        return static_cast<double>(below) / static_cast<double>(total);
+    }
+
+private:
+    // Capacity of level h shrinks by 2/3 per level below the top
+    size_t capacity(size_t h) const {
+        size_t depth = levels_.size() - 1 - h;
+        return std::max<size_t>(2, static_cast<size_t>(std::ceil(k_ * std::pow(2.0 / 3.0, static_cast<double>(depth)))));
+    }
+
+    void refresh_capacity() {
+        total_capacity_ = 0;
+        for (size_t h = 0; h < levels_.size(); ++h) total_capacity_ += capacity(h);
+    }
+
+    void compress() {
+        for (size_t h = 0; h < levels_.size(); ++h) {
+            if (levels_[h].size() < capacity(h)) continue;
+            if (h + 1 == levels_.size()) {
+                levels_.emplace_back();
+                refresh_capacity();
+            }
+            std::vector<double>& cur = levels_[h];
+            std::sort(cur.begin(), cur.end());
+            rng_ ^= rng_ << 13; rng_ ^= rng_ >> 7; rng_ ^= rng_ << 17;
+            size_t offset = rng_ & 1u;
+            // odd size: the last item stays at this level
+            size_t even = cur.size() & ~size_t(1);
+            std::vector<double>& up = levels_[h + 1];
+            for (size_t i = offset; i < even; i += 2) up.push_back(cur[i]);
+            retained_ -= even / 2;
+            if (cur.size() > even) {
+                cur[0] = cur.back();
+                cur.resize(1);
+            } else {
+                cur.clear();
+            }
+            return;
+        }
+    }
+
+    int k_;
+    std::uint64_t rng_;
+    std::vector<std::vector<double>> levels_;
+    long long n_ = 0;
+    size_t retained_ = 0;
+    size_t total_capacity_ = 0;
+    double min_ = std::numeric_limits<double>::quiet_NaN();
+    double max_ = std::numeric_limits<double>::quiet_NaN();
+};
+
+// ---- factor perturbations ----
+enum class PerturbationKind { Normal, Uniform, TruncatedNormal };
+
+struct FactorTolerance {
+    double setpoint = 0.0;
+    PerturbationKind kind = PerturbationKind::Normal;
+    double scale = 0.0;         // sd (Normal, TruncatedNormal) or half-width (Uniform)
+    double lower = -std::numeric_limits<double>::infinity();  // deviation bounds
+    double upper =  std::numeric_limits<double>::infinity();  // (TruncatedNormal)
+
+    static FactorTolerance normal(double setpoint, double sd) {
+        return {setpoint, PerturbationKind::Normal, sd};
+    }
+    static FactorTolerance uniform(double setpoint, double half_width) {
+        return {setpoint, PerturbationKind::Uniform, half_width};
+    }
+    // Normal deviation restricted to [lower, upper] (e.g. parts outside are scrapped)
+    static FactorTolerance truncated_normal(double setpoint, double sd, double lower, double upper) {
+        return {setpoint, PerturbationKind::TruncatedNormal, sd, lower, upper};
+    }
+};
+
+struct ToleranceSimOptions {
+    long long samples = 1000000;
+    int threads = 0;                    // 0 = hardware concurrency
+    std::uint64_t seed = 20240601;
+    double lsl = -std::numeric_limits<double>::infinity();    // spec limits of the response
+    double usl =  std::numeric_limits<double>::infinity();
+    int sketch_k = 2048;
+    int batch = 4096;                   // samples per predict_batch call
+};
+
+struct ToleranceSimResult {
+    long long samples = 0;
+    double mean = 0.0;
+    double sd = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    long long below_lsl = 0;
+    long long above_usl = 0;
+    double defect_rate = 0.0;           // (below + above) / samples
+    double ppm = 0.0;
+    double cp = std::numeric_limits<double>::quiet_NaN();     // (USL - LSL) / 6 sd
+    double cpk = std::numeric_limits<double>::quiet_NaN();    // min(USL - mean, mean - LSL) / 3 sd
+    double cpk_percentile = std::numeric_limits<double>::quiet_NaN();  // ISO 22514 percentile method
+    long long chunks = 0;               // work units the samples were split into
+    KllQuantileSketch sketch;
+
+    double quantile(double p) const { return sketch.quantile(p); }
+};
+
+namespace tolerance_detail {
+
+constexpr long long kChunk = 1 << 16;
+
+inline std::uint64_t splitmix64(std::uint64_t& s)
+{
+    std::uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** (Blackman, Vigna)
+class Xoshiro256 {
+public:
+    Xoshiro256(std::uint64_t seed, std::uint64_t stream) {
+        std::uint64_t sm = seed ^ (0xD1B54A32D192ED03ull * (stream + 1));
+        for (auto& w : s_) w = splitmix64(sm);
+    }
+    std::uint64_t next() {
+        const std::uint64_t r = rotl(s_[1] * 5, 7) * 9;
+        const std::uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0]; s_[3] ^= s_[1]; s_[1] ^= s_[2]; s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return r;
+    }
+    // (0, 1)
+    double uniform() { return (static_cast<double>(next() >> 11) + 0.5) * 0x1.0p-53; }
+    // Box-Muller, second value cached
+    double normal() {
+        if (has_spare_) { has_spare_ = false; return spare_; }
+        double u = uniform(), v = uniform();
+        double r = std::sqrt(-2.0 * std::log(u));
+        double a = 6.283185307179586 * v;
+        spare_ = r * std::sin(a);
+        has_spare_ = true;
+        return r * std::cos(a);
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    std::uint64_t s_[4];
+    double spare_ = 0.0;
+    bool has_spare_ = false;
+};
+
+struct ChunkSummary {
+    long long n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;                    // sum of squared deviations from mean
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    long long below = 0;
+    long long above = 0;
+    KllQuantileSketch sketch;
+};
+
+} // namespace tolerance_detail
+
+inline ToleranceSimResult simulate_tolerance(const ResponseSurfaceQuadratic& rs,
+                                             const std::vector<FactorTolerance>& factors,
+                                             const ToleranceSimOptions& opt = {})
+{
+    DOE_TRACE_SCOPE("simulate_tolerance");
+    using namespace tolerance_detail;
+    const int k = rs.num_factors();
+    if ((int)factors.size() != k)
+        throw std::runtime_error("simulate_tolerance: one FactorTolerance per model factor required");
+    if (opt.samples <= 0 || opt.batch <= 0)
+        throw std::runtime_error("simulate_tolerance: samples and batch must be positive");
+
+    // Truncated normal: rejection while the interval keeps >= 20% of the mass,
+    // otherwise inversion u ~ U(Phi(a), Phi(b)), d = sd * Phi^-1(u)
+    std::vector<double> pa(k, 0.0), pb(k, 1.0);
+    for (int i = 0; i < k; ++i) {
+        const FactorTolerance& f = factors[i];
+        if (f.scale < 0.0)
+            throw std::runtime_error("simulate_tolerance: negative tolerance scale");
+        if (f.kind == PerturbationKind::TruncatedNormal) {
+            if (!(f.lower < f.upper) || f.scale == 0.0)
+                throw std::runtime_error("simulate_tolerance: truncated normal needs sd > 0 and lower < upper");
+            pa[i] = stat_util::normal_cdf(f.lower / f.scale);
+            pb[i] = stat_util::normal_cdf(f.upper / f.scale);
+            if (!(pb[i] > pa[i]))
+                throw std::runtime_error("simulate_tolerance: truncation interval has no probability mass");
+        }
+    }
+
+    const long long chunks = (opt.samples + kChunk - 1) / kChunk;
+    if (chunks > std::numeric_limits<int>::max())
+        throw std::runtime_error("simulate_tolerance: too many samples");
+
+    // Running merge in chunk order (Chan et al. for mean / M2)
+    ToleranceSimResult out;
+    out.sketch = KllQuantileSketch(opt.sketch_k);
+    out.chunks = chunks;
+    out.min = std::numeric_limits<double>::infinity();
+    out.max = -std::numeric_limits<double>::infinity();
+    double mean = 0.0, m2 = 0.0;
+    long long n = 0;
+    std::mutex merge_mutex;
+    std::map<long long, ChunkSummary> pending;   // finished ahead of the merge frontier
+    long long frontier = 0;                      // next chunk to merge
+    auto merge = [&](const ChunkSummary& S) {
+        long long nn = n + S.n;
+        double delta = S.mean - mean;
+        mean += delta * S.n / nn;
+        m2 += S.m2 + delta * delta * (static_cast<double>(n) * S.n / nn);
+        n = nn;
+        out.min = std::min(out.min, S.min);
+        out.max = std::max(out.max, S.max);
+        out.below_lsl += S.below;
+        out.above_usl += S.above;
+        out.sketch.merge(S.sketch);
+    };
+
+    doe_parallel::parallel_for(static_cast<int>(chunks), opt.threads, [&](int c) {
+        Xoshiro256 rng(opt.seed, static_cast<std::uint64_t>(c));
+        ChunkSummary S{0, 0.0, 0.0,
+                       std::numeric_limits<double>::infinity(),
+                       -std::numeric_limits<double>::infinity(),
+                       0, 0, KllQuantileSketch(opt.sketch_k)};
+        const long long begin = c * kChunk;
+        const long long cn = std::min(kChunk, opt.samples - begin);
+        std::vector<double> X(static_cast<size_t>(opt.batch) * k), Y(opt.batch);
+        double sum = 0.0, sum2 = 0.0, shift = std::numeric_limits<double>::quiet_NaN();
+
+        for (long long done = 0; done < cn; done += opt.batch) {
+            const int B = static_cast<int>(std::min<long long>(opt.batch, cn - done));
+            for (int r = 0; r < B; ++r) {
+                double* x = X.data() + static_cast<size_t>(r) * k;
+                for (int i = 0; i < k; ++i) {
+                    const FactorTolerance& f = factors[i];
+                    double d;
+                    switch (f.kind) {
+                    case PerturbationKind::Normal:  d = f.scale * rng.normal(); break;
+                    case PerturbationKind::Uniform: d = f.scale * (2.0 * rng.uniform() - 1.0); break;
+                    default:
+                        if (pb[i] - pa[i] >= 0.2) {
+                            do { d = f.scale * rng.normal(); } while (d < f.lower || d > f.upper);
+                        } else {
+                            double u = pa[i] + (pb[i] - pa[i]) * rng.uniform();
+                            d = std::clamp(f.scale * stat_util::normal_quantile_approx(u), f.lower, f.upper);
+                        }
+                    }
+                    x[i] = f.setpoint + d;
+                }
+            }
+            rs.predict_batch(X.data(), B, Y.data());
+            if (std::isnan(shift)) shift = Y[0];
+            for (int r = 0; r < B; ++r) {
+                double y = Y[r];
+                double dy = y - shift;
+                sum += dy;
+                sum2 += dy * dy;
+                S.min = std::min(S.min, y);
+                S.max = std::max(S.max, y);
+                S.below += (y < opt.lsl);
+                S.above += (y > opt.usl);
+                S.sketch.update(y);
+            }
+        }
+        S.n = cn;
+        double md = sum / cn;
+        S.mean = shift + md;
+        S.m2 = std::max(0.0, sum2 - cn * md * md);
+
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        if (c != frontier) {
+            pending.emplace(c, std::move(S));
+            return;
+        }
+        merge(S);
+        for (++frontier; !pending.empty() && pending.begin()->first == frontier; ++frontier) {
+            merge(pending.begin()->second);
+            pending.erase(pending.begin());
+        }
+    });
+
+    out.samples = n;
+    out.mean = mean;
+    out.sd = n > 1 ? std::sqrt(m2 / (n - 1)) : 0.0;
+    out.defect_rate = static_cast<double>(out.below_lsl + out.above_usl) / n;
+    out.ppm = out.defect_rate * 1e6;
+
+    const bool has_lsl = std::isfinite(opt.lsl), has_usl = std::isfinite(opt.usl);
+    if ((has_lsl || has_usl) && out.sd > 0.0) {
+        double cu = has_usl ? (opt.usl - mean) / (3.0 * out.sd) : std::numeric_limits<double>::infinity();
+        double cl = has_lsl ? (mean - opt.lsl) / (3.0 * out.sd) : std::numeric_limits<double>::infinity();
+        out.cpk = std::min(cu, cl);
+        if (has_lsl && has_usl) out.cp = (opt.usl - opt.lsl) / (6.0 * out.sd);
+
+        // Percentile method: 0.135% / 50% / 99.865% points replace mean -+ 3 sd
+        double med = out.quantile(0.5), lo = out.quantile(0.00135), hi = out.quantile(0.99865);
+        double pu = (has_usl && hi > med) ? (opt.usl - med) / (hi - med) : std::numeric_limits<double>::infinity();
+        double pl = (has_lsl && med > lo) ? (med - opt.lsl) / (med - lo) : std::numeric_limits<double>::infinity();
+        out.cpk_percentile = std::min(pu, pl);
+    }
+    return out;
+}
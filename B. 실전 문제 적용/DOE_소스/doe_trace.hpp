@@ -0,0 +1,279 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+
+// -----------------------------------------------------------------------------
+// Lightweight tracing for the DOE pipeline
+//
+// Instrumentation sites use the macros below. They compile to nothing unless
+// DOE_TRACE_ENABLED is 1 (CMake: -DDOE_ENABLE_TRACE=ON), so release builds pay
+// nothing. The recorder itself is always available for explicit use.
+//
+//   DOE_TRACE_SCOPE("Anom::fit");              // timed span until end of scope
+//   DOE_TRACE_COUNTER("qr_rank", rank);        // sampled value on the timeline
+//   DOE_TRACE_COUNT("quantile_calls", 1);      // summed into the summary only
+//
+// Events go to a per-thread buffer (no locking on the hot path). Export with
+// doe_trace::write_chrome_trace(path) (chrome://tracing / Perfetto) and
+// doe_trace::summary(); call them when no traced work is running.
+// -----------------------------------------------------------------------------
+
+#ifndef DOE_TRACE_ENABLED
+#define DOE_TRACE_ENABLED 0
+#endif
+
+namespace doe_trace {
+
+struct Event {
+    const char* name;     // string literal
+    char phase;           // 'X' complete span, 'C' counter sample, 'N' count (summary only)
+    double ts_us;
+    double value;         // duration (us) for 'X', value for 'C' / 'N'
+};
+
+// One trace lane; a thread leases it while alive and returns it on exit
+struct ThreadBuffer {
+    int tid = 0;
+    bool leased = false;
+    std::vector<Event> events;
+};
+
+struct SpanStats {
+    long long count = 0;
+    double total_us = 0.0;
+    double min_us = std::numeric_limits<double>::infinity();
+    double max_us = 0.0;
+};
+
+struct CounterStats {
+    long long samples = 0;
+    double sum = 0.0;
+    double last = 0.0;
+    double max = -std::numeric_limits<double>::infinity();
+};
+
+class Recorder {
+public:
+    static Recorder& instance() {
+        static Recorder r;
+        return r;
+    }
+
+    // Runtime switch on top of the compile-time one (default on)
+    void set_enabled(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    double now_us() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    void record(const char* name, char phase, double ts_us, double value) {
+        local_buffer().events.push_back({name, phase, ts_us, value});
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& b : buffers_) b->events.clear();
+    }
+
+    // Visit all buffered events (caller must ensure no concurrent recording)
+    void for_each(const std::function<void(int tid, const Event&)>& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& b : buffers_)
+            for (const auto& e : b->events) fn(b->tid, e);
+    }
+
+    // Buffers allocated so far: the peak number of threads that recorded at once
+    size_t buffer_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return buffers_.size();
+    }
+
+private:
+    Recorder() : epoch_(std::chrono::steady_clock::now()) {}
+
+    // A thread leases a buffer on its first event and hands it back when it exits.
+    // The events stay for export; the next new thread appends to the same buffer
+    // (same tid lane), so short-lived pool threads do not grow buffers_.
+    ThreadBuffer& local_buffer() {
+        struct Lease {
+            Recorder* owner = nullptr;
+            ThreadBuffer* buf = nullptr;
+            ~Lease() {
+                if (!buf) return;
+                std::lock_guard<std::mutex> lock(owner->mutex_);
+                buf->leased = false;
+            }
+        };
+        thread_local Lease lease;
+        if (!lease.buf) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& b : buffers_)
+                if (!b->leased) { lease.buf = b.get(); break; }
+            if (!lease.buf) {
+                auto owned = std::make_shared<ThreadBuffer>();
+                owned->tid = static_cast<int>(buffers_.size()) + 1;
+                owned->events.reserve(1024);
+                buffers_.push_back(owned);
+                lease.buf = owned.get();
+            }
+            lease.buf->leased = true;
+            lease.owner = this;
+        }
+        return *lease.buf;
+    }
+
+    std::atomic<bool> enabled_{true};
+    std::chrono::steady_clock::time_point epoch_;
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+};
+
+// RAII span: records one complete ('X') event on destruction
+class ScopedSpan {
+public:
+    explicit ScopedSpan(const char* name)
+        : name_(name), active_(Recorder::instance().enabled())
+    {
+        if (active_) start_ = Recorder::instance().now_us();
+    }
+    ~ScopedSpan() {
+        if (!active_) return;
+        Recorder& r = Recorder::instance();
+        r.record(name_, 'X', start_, r.now_us() - start_);
+    }
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    const char* name_;
+    bool active_;
+    double start_ = 0.0;
+};
+
+inline void counter(const char* name, double value) {
+    Recorder& r = Recorder::instance();
+    if (r.enabled()) r.record(name, 'C', r.now_us(), value);
+}
+
+inline void count(const char* name, double delta) {
+    Recorder& r = Recorder::instance();
+    if (r.enabled()) r.record(name, 'N', 0.0, delta);
+}
+
+inline void reset() { Recorder::instance().clear(); }
+
+// ---- aggregation ----
+inline std::map<std::string, SpanStats> span_stats() {
+    std::map<std::string, SpanStats> out;
+    Recorder::instance().for_each([&](int, const Event& e) {
+        if (e.phase != 'X') return;
+        SpanStats& s = out[e.name];
+        ++s.count;
+        s.total_us += e.value;
+        s.min_us = std::min(s.min_us, e.value);
+        s.max_us = std::max(s.max_us, e.value);
+    });
+    return out;
+}
+
+inline std::map<std::string, CounterStats> counter_stats() {
+    std::map<std::string, CounterStats> out;
+    Recorder::instance().for_each([&](int, const Event& e) {
+        if (e.phase != 'C' && e.phase != 'N') return;
+        CounterStats& s = out[e.name];
+        ++s.samples;
+        s.sum += e.value;
+        s.last = e.value;
+        s.max = std::max(s.max, e.value);
+    });
+    return out;
+}
+
+// Plain-text table: spans sorted by total time, then counters
+inline std::string summary() {
+    auto spans = span_stats();
+    std::vector<std::pair<std::string, SpanStats>> rows(spans.begin(), spans.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.total_us > b.second.total_us;
+    });
+
+    std::ostringstream ss;
+    ss << "span                                              count    total_ms     mean_us      max_us\n";
+    for (const auto& [name, s] : rows) {
+        ss << name;
+        for (size_t i = name.size(); i < 48; ++i) ss << ' ';
+        char line[96];
+        std::snprintf(line, sizeof(line), " %6lld %11.3f %11.2f %11.2f\n",
+                      s.count, s.total_us / 1000.0, s.total_us / s.count, s.max_us);
+        ss << line;
+    }
+    auto counters = counter_stats();
+    if (!counters.empty()) {
+        ss << "counter                                         samples          sum         max\n";
+        for (const auto& [name, c] : counters) {
+            ss << name;
+            for (size_t i = name.size(); i < 48; ++i) ss << ' ';
+            char line[96];
+            std::snprintf(line, sizeof(line), " %6lld %12.6g %11.6g\n", c.samples, c.sum, c.max);
+            ss << line;
+        }
+    }
+    return ss.str();
+}
+
+// Chrome trace-event JSON ("X" spans and "C" counters; summary-only counts are skipped)
+inline std::string chrome_trace_json() {
+    std::ostringstream ss;
+    ss.precision(15);
+    ss << "{\"traceEvents\":[";
+    bool first = true;
+    Recorder::instance().for_each([&](int tid, const Event& e) {
+        if (e.phase == 'N') return;
+        if (!first) ss << ",";
+        first = false;
+        ss << "\n{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+           << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << e.ts_us;
+        if (e.phase == 'X')
+            ss << ",\"dur\":" << e.value << ",\"cat\":\"doe\"}";
+        else
+            ss << ",\"args\":{\"value\":" << e.value << "}}";
+    });
+    ss << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return ss.str();
+}
+
+inline void write_chrome_trace(const std::string& path) {
+    std::ofstream ofs(path);
+    if (!ofs)
+        throw std::runtime_error("doe_trace::write_chrome_trace: cannot open file: " + path);
+    ofs << chrome_trace_json();
+}
+
+} // namespace doe_trace
+
+#define DOE_TRACE_CONCAT_INNER(a, b) a##b
+#define DOE_TRACE_CONCAT(a, b) DOE_TRACE_CONCAT_INNER(a, b)
+
+#if DOE_TRACE_ENABLED
+#define DOE_TRACE_SCOPE(name) ::doe_trace::ScopedSpan DOE_TRACE_CONCAT(doe_trace_span_, __LINE__)(name)
+#define DOE_TRACE_COUNTER(name, value) ::doe_trace::counter(name, static_cast<double>(value))
+#define DOE_TRACE_COUNT(name, delta) ::doe_trace::count(name, static_cast<double>(delta))
+#else
+#define DOE_TRACE_SCOPE(name) ((void)0)
+#define DOE_TRACE_COUNTER(name, value) ((void)0)
+#define DOE_TRACE_COUNT(name, delta) ((void)0)
+#endif
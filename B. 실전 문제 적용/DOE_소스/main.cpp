@@ -306,12 +306,38 @@
 #include <random>
 #include <string>
 #include <cassert>
+#include <chrono>
+#include <filesystem>
 
 #include "orthogonal_array.hpp"
 #include "Anom_Utils.h"
 #include "doe_anom_response.hpp"
 #include "response_surface_quadratic.hpp"
 #include "doe_full_analysis.hpp"
+#include "doe_optimal_design.hpp"
+#include "doe_space_filling.hpp"
+#include "polynomial_response_surface.hpp"
+#include "response_surface_selection.hpp"
+#include "response_surface_validation.hpp"
+#include "doe_trace.hpp"
+#include "doe_run_mask.hpp"
+#include "anom_batch.hpp"
+#include "doe_result_cache.hpp"
+#include "doe_service.hpp"
+#include "doe_async.hpp"
+#include "response_surface_sensitivity.hpp"
+#include "doe_tolerance_sim.hpp"
+#include "doe_crossed_array.hpp"
+#include "doe_effect_screening.hpp"
+#include "response_surface_orthogonal.hpp"
+#include "response_surface_lsqr.hpp"
+#include "response_surface_penalized.hpp"
+#include "response_surface_mixed.hpp"
+#include "doe_rsm_designs.hpp"
+#include "doe_column_assignment.hpp"
+#include "doe_alias_analysis.hpp"
+#include "doe_power.hpp"
+#include "doe_adaptive.hpp"
 
 // Simple helper for approximate comparison
 static bool approx_equal(double a, double b, double tol = 1e-6) {
@@ -682,6 +708,2446 @@ void test_doe_full_analysis() {
     }
 }
 
+// -----------------------------------------------------------------------------
+// Test 7: D-optimal design from a constrained FactorLevels grid
+// Picks 14 runs for a 3-factor quadratic (10 terms) and checks the RS fit
+// recovers a known model exactly.
+// -----------------------------------------------------------------------------
+void test_d_optimal_design() {
+    std::cout << "[TEST] test_d_optimal_design\n";
+
+    std::vector<FactorLevels> levels(3);
+    levels[0].levels = {10.0, 20.0, 30.0};
+    levels[1].levels = {1.0, 2.0, 3.0};
+    levels[2].levels = {-1.0, 0.0, 1.0};
+
+    // Infeasible corner: high temperature with high pressure
+    auto feasible = [](const std::vector<double>& x) {
+        return !(x[0] > 25.0 && x[1] > 2.5);
+    };
+    CandidateSet cs = build_candidate_grid(levels, feasible);
+    assert(cs.size() == 24); // 27 grid points minus 3 infeasible
+
+    DOptimalOptions opt;
+    opt.runs     = 14;
+    opt.restarts = 6;
+    opt.seed     = 7;
+    OptimalDesignResult od = build_d_optimal_design(cs, opt);
+
+    assert((int)od.design.size() == opt.runs);
+    assert(od.level_table.runs == opt.runs);
+    assert(od.level_table.factors == 3);
+    for (const auto& x : od.design)
+        assert(feasible(x));
+    assert(std::isfinite(od.log_det));
+    std::cout << "  log_det = " << od.log_det
+              << ", D-efficiency = " << od.d_efficiency
+              << ", best restart = " << od.best_restart << "\n";
+
+    // Level table maps back to the same physical design
+    auto rebuilt = build_design_from_orthogonal_array(od.level_table, levels);
+    for (int r = 0; r < opt.runs; ++r)
+        for (int f = 0; f < 3; ++f)
+            assert(approx_equal(rebuilt[r][f], od.design[r][f]));
+
+    // Same result with a single thread (restart seeds are fixed)
+    DOptimalOptions opt1 = opt;
+    opt1.threads = 1;
+    OptimalDesignResult od1 = build_d_optimal_design(cs, opt1);
+    assert(od1.candidate_index == od.candidate_index);
+
+    // The design supports the full quadratic: exact recovery of a known model
+    auto true_model = [](const std::vector<double>& x) {
+        return 5.0 + 0.3 * x[0] - 2.0 * x[1] + 1.5 * x[2]
+             - 0.01 * x[0] * x[0] + 0.5 * x[1] * x[1] + 0.8 * x[2] * x[2]
+             + 0.05 * x[0] * x[1] - 0.02 * x[0] * x[2] + 0.4 * x[1] * x[2];
+    };
+    std::vector<double> y;
+    for (const auto& x : od.design) y.push_back(true_model(x));
+
+    ResponseSurfaceQuadratic rs;
+    bool ok = rs.fit(od.design, y);
+    assert(ok);
+    std::vector<double> x_test = {15.0, 2.5, 0.3};
+    assert(approx_equal(rs.predict(x_test), true_model(x_test), 1e-6));
+}
+
+// -----------------------------------------------------------------------------
+// Test 8: Space-filling samplers (LHS, Sobol, Halton) + chunked RS evaluation
+// -----------------------------------------------------------------------------
+void test_space_filling_samplers() {
+    std::cout << "[TEST] test_space_filling_samplers\n";
+
+    std::vector<FactorLevels> levels(3);
+    levels[0].levels = {100.0, 200.0, 300.0};
+    levels[1].levels = {1.0, 2.0, 3.0};
+    levels[2].levels = {-5.0, 0.0, 5.0};
+    auto ranges = factor_ranges(levels);
+    assert(approx_equal(ranges[0].lo, 100.0) && approx_equal(ranges[0].hi, 300.0));
+
+    // Latin hypercube: one point per stratum in every column
+    LatinHypercubeOptions lo;
+    lo.runs = 20;
+    lo.iterations = 3000;
+    LatinHypercubeResult lhs = latin_hypercube(ranges, lo);
+    assert(lhs.design.runs == 20 && lhs.design.factors == 3);
+    for (int j = 0; j < 3; ++j) {
+        std::vector<int> hits(lo.runs, 0);
+        for (int r = 0; r < lo.runs; ++r) {
+            double u = (lhs.design.at(r, j) - ranges[j].lo) / (ranges[j].hi - ranges[j].lo);
+            ++hits[std::min(lo.runs - 1, (int)(u * lo.runs))];
+        }
+        for (int h : hits) assert(h == 1);
+    }
+    std::cout << "  LHS min distance: " << lhs.min_distance_initial
+              << " -> " << lhs.min_distance
+              << " (" << lhs.accepted_swaps << " swaps)\n";
+
+    // Sobol: known leading points and dyadic stratification of 1024 points
+    SobolSequence sobol(8);
+    std::vector<double> u(1024 * 8);
+    sobol.next_block(u.data(), 1024);
+    assert(approx_equal(u[0 * 8 + 0], 0.0) && approx_equal(u[1 * 8 + 0], 0.5));
+    assert(approx_equal(u[2 * 8 + 0], 0.75) && approx_equal(u[2 * 8 + 1], 0.25));
+    assert(approx_equal(u[3 * 8 + 0], 0.25) && approx_equal(u[3 * 8 + 1], 0.75));
+    for (int d = 0; d < 8; ++d) {
+        std::vector<int> hits(1024, 0);
+        for (int r = 0; r < 1024; ++r) ++hits[(int)(u[r * 8 + d] * 1024)];
+        for (int h : hits) assert(h == 1);
+    }
+    // seek() agrees with sequential generation
+    SobolSequence sobol2(8);
+    sobol2.seek(777);
+    std::vector<double> p777(8);
+    sobol2.next_block(p777.data(), 1);
+    for (int d = 0; d < 8; ++d) assert(approx_equal(p777[d], u[777 * 8 + d], 0.0));
+
+    // Halton: plain values, and scrambling keeps the base-b stratification
+    HaltonSequence halton(2);
+    std::vector<double> h(4 * 2);
+    halton.next_block(h.data(), 4);
+    assert(approx_equal(h[1 * 2 + 0], 0.5) && approx_equal(h[1 * 2 + 1], 1.0 / 3.0));
+    assert(approx_equal(h[3 * 2 + 0], 0.75) && approx_equal(h[3 * 2 + 1], 1.0 / 9.0));
+
+    HaltonSequence scrambled(2, true, 99);
+    std::vector<double> hs(81 * 2);
+    scrambled.next_block(hs.data(), 81);
+    std::vector<int> hits3(81, 0);
+    for (int r = 0; r < 81; ++r) ++hits3[(int)(hs[r * 2 + 1] * 81 + 1e-9)]; // k/81 up to round-off
+    for (int c : hits3) assert(c == 1);
+
+    // Streaming: 200k Sobol points in 4096-row chunks through predict_batch
+    std::vector<std::vector<double>> grid;
+    std::vector<double> y;
+    auto model = [](const double* x) {
+        return 1.0 + 0.01 * x[0] - 2.0 * x[1] + 0.3 * x[2] + 0.5 * x[1] * x[1] + 0.02 * x[1] * x[2];
+    };
+    for (double a : levels[0].levels)
+        for (double b : levels[1].levels)
+            for (double c : levels[2].levels) {
+                grid.push_back({a, b, c});
+                y.push_back(model(grid.back().data()));
+            }
+    ResponseSurfaceQuadratic rs;
+    bool ok = rs.fit(grid, y);
+    assert(ok);
+
+    SobolSequence stream(3);
+    std::vector<double> pred;
+    long long seen = 0;
+    double max_err = 0.0;
+    generate_in_chunks(stream, ranges, 200000, 4096, [&](const DesignMatrix& chunk, long long first) {
+        assert(first == seen);
+        rs.predict_batch(chunk, pred);
+        for (int r = 0; r < chunk.runs; ++r) {
+            for (int j = 0; j < 3; ++j)
+                assert(chunk.at(r, j) >= ranges[j].lo && chunk.at(r, j) <= ranges[j].hi);
+            max_err = std::max(max_err, std::fabs(pred[r] - model(chunk.row(r))));
+        }
+        seen += chunk.runs;
+    });
+    assert(seen == 200000);
+    assert(max_err < 1e-8);
+    std::cout << "  streamed " << seen << " Sobol points, max |pred - true| = " << max_err << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 9: Polynomial response surfaces with runtime and compile-time layouts
+// -----------------------------------------------------------------------------
+void test_polynomial_response_surface() {
+    std::cout << "[TEST] test_polynomial_response_surface\n";
+
+    // Term sets
+    PolynomialTermSet cubic = make_total_degree_terms(2, 3);
+    assert(cubic.size() == 10);
+    assert(cubic.label(0) == "1");
+    assert(cubic.label(3) == "x0^2" && cubic.label(4) == "x0*x1");
+    assert(cubic.label(6) == "x0^3" && cubic.label(9) == "x1^3");
+
+    PolynomialTermSet top;
+    top.factors = 3;
+    top.add_term({2, 1, 0});
+    PolynomialTermSet hier = hierarchical_closure(top);
+    assert(hier.size() == 6); // 1, x0, x1, x0^2, x0*x1, x0^2*x1
+    assert(hier.label(5) == "x0^2*x1");
+
+    PolynomialTermSet reduced = make_linear_with_interactions(3, {{0, 2}});
+    assert(reduced.size() == 5 && reduced.label(4) == "x0*x2");
+
+    // Compile-time layouts match the runtime term order
+    PolynomialTermSet q3 = make_terms_from_layout<QuadraticLayout<3>>();
+    assert(q3.exponents == make_quadratic_terms(3).exponents);
+    assert((make_terms_from_layout<TotalDegreeLayout<2, 3>>().exponents == cubic.exponents));
+
+    double xq[3] = {0.3, -1.2, 2.0};
+    double phi_fixed[QuadraticLayout<3>::num_terms];
+    double phi_rs[QuadraticLayout<3>::num_terms];
+    FixedPolynomialExpansion<QuadraticLayout<3>>::expand(xq, phi_fixed);
+    ResponseSurfaceQuadratic::expand_terms(xq, 3, phi_rs);
+    for (int t = 0; t < QuadraticLayout<3>::num_terms; ++t)
+        assert(approx_equal(phi_fixed[t], phi_rs[t], 1e-12));
+
+    // Cubic model on a 6x6 grid: exact recovery with both implementations
+    auto true_model = [](double x0, double x1) {
+        return 1.0 + 2.0 * x0 - x1 + 0.5 * x0 * x0 + 0.25 * x0 * x1 - 0.75 * x1 * x1
+             + 0.1 * x0 * x0 * x0 - 0.2 * x0 * x0 * x1 + 0.3 * x0 * x1 * x1 + 0.05 * x1 * x1 * x1;
+    };
+    DesignMatrix X(36, 2);
+    std::vector<double> y;
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            int r = i * 6 + j;
+            X.at(r, 0) = -1.0 + 0.4 * i;
+            X.at(r, 1) = -1.0 + 0.4 * j;
+            y.push_back(true_model(X.at(r, 0), X.at(r, 1)));
+        }
+    }
+
+    PolynomialResponseSurface prs(cubic);
+    bool ok = prs.fit(X, y);
+    assert(ok && prs.rank() == 10);
+    const double expected[10] = {1.0, 2.0, -1.0, 0.5, 0.25, -0.75, 0.1, -0.2, 0.3, 0.05};
+    for (int t = 0; t < 10; ++t)
+        assert(approx_equal(prs.coefficients()[t], expected[t], 1e-9));
+
+    FixedPolynomialResponseSurface<TotalDegreeLayout<2, 3>> fixed;
+    ok = fixed.fit(X, y);
+    assert(ok);
+    for (int t = 0; t < 10; ++t)
+        assert(approx_equal(fixed.coefficients()[t], expected[t], 1e-9));
+
+    // Batched predict agrees with single-point predict
+    std::vector<double> yb, yf;
+    prs.predict_batch(X, yb);
+    fixed.predict_batch(X, yf);
+    for (int r = 0; r < X.runs; ++r) {
+        assert(approx_equal(yb[r], prs.predict({X.at(r, 0), X.at(r, 1)}), 1e-12));
+        assert(approx_equal(yf[r], y[r], 1e-9));
+    }
+    std::cout << "  cubic fit: rank = " << prs.rank()
+              << ", predict(0.15,-0.35) = " << prs.predict({0.15, -0.35}) << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 10: Stepwise / best-subset term selection
+// -----------------------------------------------------------------------------
+void test_term_selection() {
+    std::cout << "[TEST] test_term_selection\n";
+
+    // 3^3 full factorial, true model uses 5 of the 10 quadratic terms
+    DesignMatrix X(27, 3);
+    std::vector<double> y;
+    std::mt19937_64 rng(2024);
+    std::normal_distribution<double> noise(0.0, 0.05);
+    for (int r = 0; r < 27; ++r) {
+        X.at(r, 0) = r / 9 - 1.0;
+        X.at(r, 1) = (r / 3) % 3 - 1.0;
+        X.at(r, 2) = r % 3 - 1.0;
+        double x0 = X.at(r, 0), x1 = X.at(r, 1), x2 = X.at(r, 2);
+        y.push_back(2.0 + 1.5 * x0 - x1 + 0.8 * x0 * x0 + 0.6 * x0 * x2 + noise(rng));
+    }
+    PolynomialTermSet cand = make_quadratic_terms(3); // 1, x0..x2, x0^2..x2^2, x0x1, x0x2, x1x2
+
+    auto labels = [](const TermSelectionResult& r) {
+        std::vector<std::string> s;
+        for (int t = 0; t < r.terms.size(); ++t) s.push_back(r.terms.label(t));
+        return s;
+    };
+    const std::vector<std::string> hier_truth = {"1", "x0", "x1", "x2", "x0^2", "x0*x2"};
+    const std::vector<std::string> flat_truth = {"1", "x0", "x1", "x0^2", "x0*x2"};
+
+    // Stepwise (both directions), hierarchical: x0*x2 brings in x2
+    TermSelectionOptions opt;
+    opt.criterion = SelectionCriterion::BIC;
+    TermSelectionResult sw = stepwise_select(cand, X, y, opt);
+    assert(labels(sw) == hier_truth);
+    assert(approx_equal(sw.model.coefficients()[4], 0.8, 0.1));
+
+    // RSS tracked by the QR updates equals a direct refit
+    std::vector<double> fit;
+    sw.model.predict_batch(X, fit);
+    double rss = 0.0;
+    for (int r = 0; r < 27; ++r) rss += (y[r] - fit[r]) * (y[r] - fit[r]);
+    assert(approx_equal(sw.rss, rss, 1e-9));
+
+    opt.hierarchical = false;
+    TermSelectionResult flat = stepwise_select(cand, X, y, opt);
+    assert(labels(flat) == flat_truth);
+
+    opt.direction = StepwiseDirection::Backward;
+    TermSelectionResult back = stepwise_select(cand, X, y, opt);
+    assert(labels(back) == flat_truth);
+
+    // PRESS from rank-1 updates equals the leave-one-out definition
+    opt.direction = StepwiseDirection::Both;
+    opt.criterion = SelectionCriterion::PRESS;
+    TermSelectionResult pr = stepwise_select(cand, X, y, opt);
+    double press = 0.0;
+    for (int i = 0; i < 27; ++i) {
+        DesignMatrix Xi(26, 3);
+        std::vector<double> yi;
+        for (int r = 0, q = 0; r < 27; ++r) {
+            if (r == i) continue;
+            std::copy(X.row(r), X.row(r) + 3, Xi.row(q++));
+            yi.push_back(y[r]);
+        }
+        PolynomialResponseSurface loo(pr.terms);
+        loo.fit(Xi, yi);
+        double e = y[i] - loo.predict({X.at(i, 0), X.at(i, 1), X.at(i, 2)});
+        press += e * e;
+    }
+    assert(approx_equal(pr.criterion, press, 1e-8));
+
+    // Branch and bound agrees with exhaustive enumeration of all 2^9 subsets
+    opt.criterion = SelectionCriterion::BIC;
+    BestSubsetResult bs = best_subset_select(cand, X, y, opt);
+    assert(labels(bs.best) == flat_truth);
+    for (int s = 1; s <= 10; ++s) {
+        double brute = std::numeric_limits<double>::infinity();
+        for (int mask = 0; mask < (1 << 9); ++mask) {
+            PolynomialTermSet sub;
+            sub.factors = 3;
+            sub.add_term({0, 0, 0});
+            for (int t = 1; t < 10; ++t) {
+                if (mask & (1 << (t - 1)))
+                    sub.exponents.insert(sub.exponents.end(),
+                                         cand.exponents.begin() + t * 3, cand.exponents.begin() + t * 3 + 3);
+            }
+            if (sub.size() != s) continue;
+            PolynomialResponseSurface m(sub);
+            m.fit(X, y);
+            m.predict_batch(X, fit);
+            double r2 = 0.0;
+            for (int r = 0; r < 27; ++r) r2 += (y[r] - fit[r]) * (y[r] - fit[r]);
+            brute = std::min(brute, r2);
+        }
+        assert(approx_equal(bs.by_size[s].rss, brute, 1e-9));
+    }
+
+    std::cout << "  stepwise BIC: " << sw.terms.size() << " terms, RSS = " << sw.rss
+              << "; best subset visited " << bs.nodes << " of 512 nodes\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 11: Leave-one-out / k-fold cross-validation without refitting
+// -----------------------------------------------------------------------------
+void test_cross_validation() {
+    std::cout << "[TEST] test_cross_validation\n";
+
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    std::vector<FactorLevels> levels(oa.factors);
+    levels[0].levels = {0.0, 1.0};
+    for (int f = 1; f < oa.factors; ++f) levels[f].levels = {-1.0, 0.0, 1.0};
+    std::vector<int> rs_factors = {1, 2, 3};
+
+    auto design = build_design_from_orthogonal_array_for_factors(oa, levels, rs_factors);
+    std::vector<double> y;
+    std::mt19937_64 rng(7);
+    std::normal_distribution<double> noise(0.0, 0.1);
+    for (const auto& x : design)
+        y.push_back(3.0 + x[0] - 0.5 * x[1] + 0.7 * x[0] * x[0] + 0.4 * x[1] * x[2] + noise(rng));
+
+    // Explicit refits with one held-out set
+    auto refit_residuals = [&](const std::vector<int>& fold, int f) {
+        std::vector<std::vector<double>> dtr;
+        std::vector<double> ytr;
+        for (int r = 0; r < oa.runs; ++r) {
+            if (fold[r] == f) continue;
+            dtr.push_back(design[r]);
+            ytr.push_back(y[r]);
+        }
+        ResponseSurfaceQuadratic rs;
+        rs.fit(dtr, ytr);
+        std::vector<std::pair<int, double>> out;
+        for (int r = 0; r < oa.runs; ++r) {
+            if (fold[r] == f) out.push_back({r, y[r] - rs.predict(design[r])});
+        }
+        return out;
+    };
+
+    CrossValidationResult loo = loo_cross_validation_for_factors(oa, levels, rs_factors, y);
+    assert(loo.rank == 10 && loo.folds == 18);
+    double press = 0.0;
+    for (int i = 0; i < oa.runs; ++i) {
+        auto e = refit_residuals(loo.fold, i);
+        assert(e.size() == 1 && approx_equal(loo.cv_residuals[i], e[0].second, 1e-9));
+        press += e[0].second * e[0].second;
+    }
+    assert(approx_equal(loo.press, press, 1e-9));
+    assert(loo.q2 < loo.r2);
+
+    // k-fold via Gram downdating matches explicit per-fold refits
+    KFoldOptions kopt;
+    kopt.folds = 6;
+    CrossValidationResult kf = kfold_cross_validation_for_factors(oa, levels, rs_factors, y, kopt);
+    for (int f = 0; f < kopt.folds; ++f) {
+        for (auto [r, e] : refit_residuals(kf.fold, f))
+            assert(approx_equal(kf.cv_residuals[r], e, 1e-9));
+    }
+    assert(approx_equal(kf.rss, loo.rss, 1e-12));
+
+    // k = N without shuffling is leave-one-out
+    kopt.folds = oa.runs;
+    kopt.shuffle = false;
+    CrossValidationResult kn = kfold_cross_validation(design, y, kopt);
+    assert(approx_equal(kn.press, loo.press, 1e-9));
+
+    // Same machinery on an arbitrary term set
+    DesignMatrix X(oa.runs, 3);
+    for (int r = 0; r < oa.runs; ++r) std::copy(design[r].begin(), design[r].end(), X.row(r));
+    CrossValidationResult lin = loo_cross_validation(make_linear_with_interactions(3, {}), X, y);
+    assert(lin.rank == 4 && lin.press > loo.press);
+
+    std::cout << "  LOO: PRESS = " << loo.press << ", Q2 = " << loo.q2
+              << "; 6-fold PRESS = " << kf.press << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 12: Tracing recorder, Chrome trace export and summary
+// -----------------------------------------------------------------------------
+void test_trace() {
+    std::cout << "[TEST] test_trace\n";
+    doe_trace::reset();
+
+    {
+        doe_trace::ScopedSpan span("test_trace.outer");
+        doe_parallel::parallel_for(8, 4, [](int) {
+            doe_trace::ScopedSpan inner("test_trace.worker");
+            doe_trace::count("test_trace.items", 1);
+        });
+        doe_trace::counter("test_trace.level", 3.0);
+        doe_trace::counter("test_trace.level", 5.0);
+    }
+
+    auto spans = doe_trace::span_stats();
+    assert(spans["test_trace.outer"].count == 1);
+    assert(spans["test_trace.worker"].count == 8);
+    assert(spans["test_trace.outer"].total_us >= spans["test_trace.worker"].max_us);
+
+    auto counters = doe_trace::counter_stats();
+    assert(counters["test_trace.items"].sum == 8.0);
+    assert(counters["test_trace.level"].samples == 2 && counters["test_trace.level"].max == 5.0);
+
+    std::string json = doe_trace::chrome_trace_json();
+    assert(json.find("\"name\":\"test_trace.worker\",\"ph\":\"X\"") != std::string::npos);
+    assert(json.find("\"name\":\"test_trace.level\",\"ph\":\"C\"") != std::string::npos);
+    assert(json.find("test_trace.items") == std::string::npos); // summary-only count
+    assert(doe_trace::summary().find("test_trace.outer") != std::string::npos);
+
+    // Buffers of exited threads are reused: repeated parallel calls do not add buffers
+    const size_t buffers = doe_trace::Recorder::instance().buffer_count();
+    for (int rep = 0; rep < 20; ++rep)
+        doe_parallel::parallel_for(4, 4, [](int) { doe_trace::count("test_trace.reuse", 1); });
+    assert(doe_trace::Recorder::instance().buffer_count() <= std::max<size_t>(buffers, 4));
+    assert(doe_trace::counter_stats()["test_trace.reuse"].sum == 80.0);
+
+    // Runtime switch
+    doe_trace::Recorder::instance().set_enabled(false);
+    { doe_trace::ScopedSpan span("test_trace.disabled"); }
+    doe_trace::Recorder::instance().set_enabled(true);
+    assert(doe_trace::span_stats().count("test_trace.disabled") == 0);
+
+#if DOE_TRACE_ENABLED
+    // Pipeline instrumentation (only compiled in with DOE_TRACE_ENABLED=1)
+    doe_trace::reset();
+    const OrthogonalArray& oa = OA_L8_2_7();
+    std::vector<FactorLevels> levels(oa.factors);
+    for (auto& fl : levels) fl.levels = {-1.0, 1.0};
+    std::vector<double> y = {1, 2, 3, 4, 5, 6, 7, 9};
+    DoeFullAnalysis res = run_doe_full_analysis(oa, levels, {0, 1}, y);
+    res.factor_anoms[0].anom.render_svg();
+    spans = doe_trace::span_stats();
+    assert(spans["run_doe_full_analysis"].count == 1);
+    assert(spans["ResponseSurfaceQuadratic::fit"].count == 1);
+    assert(spans["Anom::fit"].count == oa.factors);
+    assert(spans["Anom::render_svg"].count == 1);
+    counters = doe_trace::counter_stats();
+    assert(counters["qr_rank"].last == 4.0);   // 1, x0, x1, x0*x1 (squares alias the constant)
+    assert(counters["quantile_calls"].sum >= oa.factors);
+    doe_trace::write_chrome_trace("test12_trace.json");
+    std::cout << doe_trace::summary();
+#endif
+
+    doe_trace::reset();
+    std::cout << "  recorder: spans and counters aggregated across 4 threads\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 13: Robust ANOM (median / Huber) and IRLS response surface
+// -----------------------------------------------------------------------------
+void test_robust_fitting() {
+    std::cout << "[TEST] test_robust_fitting\n";
+
+    // Shared median (ANOM centers and the IRLS scale): odd n, even n
+    std::vector<double> odd{5.0, 1.0, 3.0}, even{4.0, 1.0, 3.0, 2.0};
+    assert(Anom::median_in_place(odd) == 3.0 && Anom::median_of(even) == 2.5);
+
+    // ANOM: one bad reading in group A inflates the classic pooled s
+    auto run_anom = [](AnomEstimator est) {
+        AnomOptions opt;
+        opt.estimator = est;
+        Anom anom(opt);
+        anom.add_group("A", {10.1, 9.9, 10.0, 10.2, 9.8, 50.0});
+        anom.add_group("B", {10.0, 10.1, 9.9, 10.05, 9.95, 10.0});
+        anom.add_group("C", {11.0, 11.1, 10.9, 11.05, 10.95, 11.0});
+        anom.fit();
+        return anom;
+    };
+    Anom classic = run_anom(AnomEstimator::Mean);
+    Anom med     = run_anom(AnomEstimator::Median);
+    Anom hub     = run_anom(AnomEstimator::Huber);
+    assert(classic.s_within() > 5.0);
+    assert(!classic.results()[2].significant_high);
+    assert(med.s_within() < 0.3 && hub.s_within() < 0.3);
+    assert(approx_equal(med.results()[0].mean, 10.05, 1e-12));
+    assert(med.results()[2].significant_high && hub.results()[2].significant_high);
+    assert(std::fabs(hub.results()[0].mean - 10.0) < 0.2);
+
+    // IRLS: two gross outliers on a 6x6 grid
+    std::vector<std::vector<double>> design;
+    std::vector<double> y;
+    std::mt19937_64 rng(11);
+    std::normal_distribution<double> noise(0.0, 0.02);
+    for (int i = 0; i < 6; ++i) {
+        for (int j = 0; j < 6; ++j) {
+            double x0 = -1.0 + 0.4 * i, x1 = -1.0 + 0.4 * j;
+            design.push_back({x0, x1});
+            y.push_back(1.0 + 2.0 * x0 - x1 + 0.5 * x0 * x0 + 0.3 * x0 * x1 + noise(rng));
+        }
+    }
+    y[7]  += 20.0;
+    y[22] -= 15.0;
+    const double truth[6] = {1.0, 2.0, -1.0, 0.5, 0.0, 0.3};
+
+    ResponseSurfaceQuadratic ls, huber, bisq;
+    ls.fit(design, y);
+    RobustFitOptions ropt;
+    huber.fit_robust(design, y, ropt);
+    ropt.loss = RobustLoss::Bisquare;
+    bisq.fit_robust(design, y, ropt);
+
+    double err_ls = 0.0, err_h = 0.0, err_b = 0.0;
+    for (int t = 0; t < 6; ++t) {
+        err_ls = std::max(err_ls, std::fabs(ls.coefficients()[t] - truth[t]));
+        err_h  = std::max(err_h,  std::fabs(huber.coefficients()[t] - truth[t]));
+        err_b  = std::max(err_b,  std::fabs(bisq.coefficients()[t] - truth[t]));
+    }
+    assert(err_ls > 0.5);
+    assert(err_h < 0.03 && err_b < 0.03);
+    assert(bisq.weights()[7] == 0.0 && bisq.weights()[22] == 0.0);
+    assert(huber.weights()[7] < 0.05 && huber.weights()[0] > 0.5);
+    assert(ls.weights().size() == 0);
+
+    // Benchmark: per-iteration IRLS cost vs one least-squares QR
+    const int Nb = 20000, kb = 6;
+    std::vector<std::vector<double>> big(Nb, std::vector<double>(kb));
+    std::vector<double> yb(Nb);
+    std::uniform_real_distribution<double> unif(-1.0, 1.0);
+    for (int r = 0; r < Nb; ++r) {
+        for (int f = 0; f < kb; ++f) big[r][f] = unif(rng);
+        yb[r] = 1.0 + big[r][0] - 0.5 * big[r][1] * big[r][2] + noise(rng) + (r % 50 == 0 ? 5.0 : 0.0);
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    ResponseSurfaceQuadratic plain;
+    plain.fit(big, yb);
+    auto t1 = std::chrono::steady_clock::now();
+    ResponseSurfaceQuadratic robust;
+    robust.fit_robust(big, yb);
+    auto t2 = std::chrono::steady_clock::now();
+    double ms_ls  = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double ms_rob = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    assert(robust.iterations() > 0);
+
+    std::cout << "  LS max coef error = " << err_ls << ", Huber = " << err_h << ", bisquare = " << err_b << "\n";
+    std::cout << "  IRLS N=" << Nb << ", m=" << ResponseSurfaceQuadratic::num_terms(kb)
+              << ": LS fit " << ms_ls << " ms, robust " << ms_rob << " ms over "
+              << robust.iterations() << " iterations ("
+              << ms_rob / (robust.iterations() + 1) / ms_ls << " x LS fit per QR)\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 14: Failed runs (NaN / RunMask) in ANOM and response surface builders
+// -----------------------------------------------------------------------------
+void test_missing_runs() {
+    std::cout << "[TEST] test_missing_runs\n";
+
+    // RunMask basics on a large, sparsely failed array
+    RunMask big(100000);
+    big.reset(5);
+    big.reset(64);
+    big.reset(99999);
+    assert(big.count() == 99997 && !big.all());
+    long long sum = 0;
+    int visited = 0;
+    big.for_each([&](int r) { sum += r; ++visited; });
+    assert(visited == 99997 && sum == 99999LL * 100000 / 2 - 5 - 64 - 99999);
+
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    std::vector<FactorLevels> levels(oa.factors);
+    levels[0].levels = {0.0, 1.0};
+    for (int f = 1; f < oa.factors; ++f) levels[f].levels = {-1.0, 0.0, 1.0};
+    auto design = build_design_from_orthogonal_array_for_factors(oa, levels, {1, 2});
+
+    std::vector<double> y;
+    for (int r = 0; r < oa.runs; ++r)
+        y.push_back(5.0 + design[r][0] - 0.5 * design[r][1] + 0.3 * design[r][0] * design[r][0] + 0.01 * r);
+    std::vector<double> y_failed = y;
+    y_failed[3] = std::numeric_limits<double>::quiet_NaN();   // failed run
+    RunMask mask(oa.runs);
+    mask.reset(10);                                           // excluded by the engineer
+
+    // ANOM: same as grouping the surviving runs by hand (unequal n)
+    Anom a = build_anom_for_factor(oa, y_failed, 1, "B", AnomOptions{}, mask);
+    Anom manual;
+    for (int lev = 0; lev < 3; ++lev) {
+        std::vector<double> vals;
+        for (int r = 0; r < oa.runs; ++r) {
+            if (r == 3 || r == 10 || oa.at(r, 1) != lev) continue;
+            vals.push_back(y[r]);
+        }
+        manual.add_group("B_L" + std::to_string(lev + 1), vals);
+    }
+    manual.fit();
+    int total_n = 0;
+    for (int g = 0; g < 3; ++g) {
+        assert(a.results()[g].n == manual.results()[g].n);
+        assert(approx_equal(a.results()[g].mean, manual.results()[g].mean, 1e-12));
+        assert(approx_equal(a.results()[g].UDL, manual.results()[g].UDL, 1e-12));
+        total_n += a.results()[g].n;
+    }
+    assert(total_n == oa.runs - 2);
+
+    // RS: masked fit equals a fit on the compacted design
+    ResponseSurfaceQuadratic masked, compact;
+    assert(masked.fit(design, y_failed, mask));
+    std::vector<std::vector<double>> d2;
+    std::vector<double> y2;
+    for (int r = 0; r < oa.runs; ++r) {
+        if (r == 3 || r == 10) continue;
+        d2.push_back(design[r]);
+        y2.push_back(y[r]);
+    }
+    compact.fit(d2, y2);
+    for (int t = 0; t < ResponseSurfaceQuadratic::num_terms(2); ++t)
+        assert(approx_equal(masked.coefficients()[t], compact.coefficients()[t], 1e-10));
+
+    // Full pipeline no longer rejects a failed run
+    DoeFullAnalysis res = run_doe_full_analysis(oa, levels, {1, 2}, y_failed);
+    assert(res.factor_anoms.size() == (size_t)oa.factors);
+    assert(std::isfinite(res.rs_model.coefficients()[0]));
+
+    std::cout << "  " << (oa.runs - 2) << " of " << oa.runs << " runs used; B_L1 n = "
+              << a.results()[0].n << ", UDL = " << a.results()[0].UDL << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 15: Batched ANOM over many response channels (SoA output)
+// -----------------------------------------------------------------------------
+void test_anom_batch() {
+    std::cout << "[TEST] test_anom_batch\n";
+
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    const int R = 37;
+    Eigen::MatrixXd Y(oa.runs, R);
+    std::mt19937_64 rng(3);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    for (int r = 0; r < R; ++r) {
+        for (int i = 0; i < oa.runs; ++i)
+            Y(i, r) = 1000.0 + 0.5 * r * oa.at(i, 2) + noise(rng);   // large offset: tests conditioning
+    }
+
+    RunMask mask(oa.runs);
+    mask.reset(4);
+
+    for (bool bonf : {true, false}) {
+        AnomOptions opt;
+        opt.bonferroni = bonf;
+        for (const RunMask& m : {RunMask{}, mask}) {
+            AnomBatchResult b = build_anom_batch_for_factor(oa, 2, Y, opt, m, 4);
+            assert(b.groups == 3 && b.responses == R);
+            for (int r = 0; r < R; ++r) {
+                std::vector<double> y(Y.col(r).data(), Y.col(r).data() + oa.runs);
+                Anom ref = build_anom_for_factor(oa, y, 2, "C", opt, m);
+                assert(approx_equal(b.grand_mean[r], ref.grand_mean(), 1e-9));
+                assert(approx_equal(b.s_within[r], ref.s_within(), 1e-9));
+                for (int g = 0; g < b.groups; ++g) {
+                    const auto& rr = ref.results()[g];
+                    size_t k = b.index(g, r);
+                    assert(b.n[g] == rr.n);
+                    assert(approx_equal(b.mean[k], rr.mean, 1e-9));
+                    assert(approx_equal(b.UDL[k], rr.UDL, 1e-9));
+                    assert(approx_equal(b.LDL[k], rr.LDL, 1e-9));
+                    assert((b.significant_high[k] != 0) == rr.significant_high);
+                    assert((b.significant_low[k] != 0) == rr.significant_low);
+                }
+            }
+        }
+    }
+
+    // Masked runs holding NaN / Inf must not reach any group sum
+    {
+        RunMask bad(oa.runs);
+        bad.reset(0);
+        bad.reset(4);
+        Eigen::MatrixXd Yb = Y;
+        for (int r = 0; r < R; ++r) {
+            Yb(0, r) = std::numeric_limits<double>::quiet_NaN();
+            Yb(4, r) = (r % 2) ? std::numeric_limits<double>::infinity()
+                               : -std::numeric_limits<double>::infinity();
+        }
+        for (int threads : {1, 3}) {
+            AnomBatchResult b = build_anom_batch_for_factor(oa, 2, Yb, AnomOptions{}, bad, threads);
+            for (int r = 0; r < R; ++r) {
+                std::vector<double> y(Yb.col(r).data(), Yb.col(r).data() + oa.runs);
+                Anom ref = build_anom_for_factor(oa, y, 2, "C", AnomOptions{}, bad);
+                assert(std::isfinite(b.grand_mean[r]) && std::isfinite(b.s_within[r]));
+                assert(approx_equal(b.grand_mean[r], ref.grand_mean(), 1e-9));
+                assert(approx_equal(b.s_within[r], ref.s_within(), 1e-9));
+                for (int g = 0; g < b.groups; ++g) {
+                    assert(approx_equal(b.mean[b.index(g, r)], ref.results()[g].mean, 1e-9));
+                    assert(approx_equal(b.UDL[b.index(g, r)], ref.results()[g].UDL, 1e-9));
+                }
+            }
+        }
+    }
+
+    std::vector<AnomBatchResult> all = build_anom_batch_for_all_factors(oa, Y);
+    assert((int)all.size() == oa.factors && all[0].groups == 2);
+
+    int flagged = 0;
+    for (size_t k = 0; k < all[2].significant_high.size(); ++k) flagged += all[2].significant_high[k];
+    std::cout << "  kernel = " << anom_batch_detail::simd_path() << ", factor C: "
+              << flagged << " of " << R << " channels with a high level\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 16: Content-addressed result cache (memory LRU + on-disk tier)
+// -----------------------------------------------------------------------------
+void test_result_cache() {
+    std::cout << "[TEST] test_result_cache\n";
+
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    std::vector<FactorLevels> levels(oa.factors);
+    levels[0].levels = {0.0, 1.0};
+    for (int f = 1; f < oa.factors; ++f) levels[f].levels = {-1.0, 0.0, 1.0};
+    auto design = build_design_from_orthogonal_array_for_factors(oa, levels, {1, 2});
+    std::vector<double> y;
+    for (int r = 0; r < oa.runs; ++r)
+        y.push_back(3.0 + design[r][0] + 0.4 * design[r][1] * design[r][1] + 0.02 * (r % 5));
+    std::vector<std::string> names = {"A", "B", "C", "D", "E", "F", "G", "H"};
+
+    // Key covers every input
+    DoeCacheKey k0 = make_doe_cache_key(oa, levels, {1, 2}, y, names);
+    assert(k0 == make_doe_cache_key(oa, levels, {1, 2}, y, names));
+    std::vector<double> y2 = y;
+    y2[7] += 1e-12;
+    assert(!(k0 == make_doe_cache_key(oa, levels, {1, 2}, y2, names)));
+    assert(!(k0 == make_doe_cache_key(oa, levels, {1, 3}, y, names)));
+    auto levels2 = levels;
+    levels2[2].levels[2] = 1.5;
+    assert(!(k0 == make_doe_cache_key(oa, levels2, {1, 2}, y, names)));
+    AnomOptions robust;
+    robust.estimator = AnomEstimator::Huber;
+    assert(!(k0 == make_doe_cache_key(oa, levels, {1, 2}, y, names, robust)));
+    RunMask mask(oa.runs);
+    mask.reset(4);
+    assert(!(k0 == make_doe_cache_key(oa, levels, {1, 2}, y, names, AnomOptions{}, mask)));
+    assert(k0.hex().size() == 32);
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "doe_result_cache_test";
+    std::filesystem::remove_all(dir);
+    DoeCacheOptions copt;
+    copt.memory_capacity = 2;
+    copt.directory = dir.string();
+    DoeResultCache cache(copt);
+
+    DoeFullAnalysis fresh = run_doe_full_analysis(oa, levels, {1, 2}, y, names);
+    auto first = cache.get_or_compute(oa, levels, {1, 2}, y, names);
+    auto again = cache.get_or_compute(oa, levels, {1, 2}, y, names);
+    assert(first == again);
+    assert(cache.stats().misses == 1 && cache.stats().memory_hits == 1);
+    assert(std::filesystem::exists(cache.file_path(k0)));
+
+    // Disk tier after the memory tier is dropped: identical results
+    cache.clear_memory();
+    auto loaded = cache.get_or_compute(oa, levels, {1, 2}, y, names);
+    assert(cache.stats().disk_hits == 1 && cache.stats().misses == 1);
+    assert(loaded->rs_model.rank() == fresh.rs_model.rank());
+    assert((loaded->rs_model.coefficients() - fresh.rs_model.coefficients()).cwiseAbs().maxCoeff() == 0.0);
+    assert(loaded->rs_model.predict({0.5, -0.5}) == fresh.rs_model.predict({0.5, -0.5}));
+    assert(loaded->factor_anoms.size() == fresh.factor_anoms.size());
+    for (size_t f = 0; f < fresh.factor_anoms.size(); ++f) {
+        const Anom& a = loaded->factor_anoms[f].anom;
+        const Anom& b = fresh.factor_anoms[f].anom;
+        assert(loaded->factor_anoms[f].factor_name == fresh.factor_anoms[f].factor_name);
+        assert(a.grand_mean() == b.grand_mean() && a.s_within() == b.s_within());
+        assert(a.num_groups() == b.num_groups());
+        for (int g = 0; g < b.num_groups(); ++g) {
+            const auto& ra = a.results()[g];
+            const auto& rb = b.results()[g];
+            assert(ra.name == rb.name && ra.n == rb.n);
+            assert(ra.mean == rb.mean && ra.UDL == rb.UDL && ra.LDL == rb.LDL);
+            assert(ra.significant_high == rb.significant_high && ra.significant_low == rb.significant_low);
+            assert(a.group_values(g) == b.group_values(g));
+        }
+    }
+
+    // A corrupted file is ignored (recomputed), never returned
+    {
+        std::fstream fs(cache.file_path(k0), std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(64);
+        fs.put('\x7f');
+    }
+    assert(!load_doe_analysis(cache.file_path(k0), k0).has_value());
+
+    // LRU eviction in the memory tier
+    cache.get_or_compute(oa, levels, {1, 3}, y, names);
+    cache.get_or_compute(oa, levels, {2, 3}, y, names);
+    assert(cache.memory_size() == 2 && cache.stats().evictions == 1);
+
+    // Concurrent misses on one key (separate caches, shared directory) write separate
+    // temporary files; the survivor is a valid entry and nothing is left behind
+    std::vector<double> y3 = y;
+    y3[0] += 0.5;
+    DoeCacheKey k3 = make_doe_cache_key(oa, levels, {1, 2}, y3, names);
+    {
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t)
+            writers.emplace_back([&] {
+                DoeResultCache c(copt);
+                assert(c.get_or_compute(oa, levels, {1, 2}, y3, names)->rs_model.rank() == fresh.rs_model.rank());
+            });
+        for (auto& t : writers) t.join();
+    }
+    assert(load_doe_analysis(cache.file_path(k3), k3).has_value());
+
+    // A failed rename (a directory sits at the target path) leaves the result uncached
+    std::vector<double> y4 = y;
+    y4[1] += 0.5;
+    DoeCacheKey k4 = make_doe_cache_key(oa, levels, {1, 2}, y4, names);
+    std::filesystem::create_directories(std::filesystem::path(cache.file_path(k4)) / "blocker");
+    auto uncached = cache.get_or_compute(oa, levels, {1, 2}, y4, names);
+    assert(uncached && uncached->rs_model.rank() == fresh.rs_model.rank());
+    assert(cache.stats().write_errors == 1);
+    for (const auto& e : std::filesystem::directory_iterator(dir))
+        assert(e.path().string().find(".tmp") == std::string::npos);
+
+    std::filesystem::remove_all(dir);
+    std::cout << "  key = " << k0.hex() << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 17: Local analysis service (batching, worker pool, Unix socket, load generator)
+// -----------------------------------------------------------------------------
+void test_analysis_service() {
+    std::cout << "[TEST] test_analysis_service\n";
+
+    DoeLoadOptions lopt;
+    std::mt19937_64 rng(11);
+    DoeServiceRequest q = make_load_request(lopt, rng);
+    q.factor_names = {"A", "B", "C", "D", "E", "F", "G", "H"};
+
+    // Wire format round trip
+    DoeServiceRequest q2 = parse_request(format_request(q));
+    assert(q2.y == q.y && q2.rs_factors == q.rs_factors && q2.factor_names == q.factor_names);
+    assert(doe_service_detail::batch_key(q2) == doe_service_detail::batch_key(q));
+
+    // Requests submitted together share one batch; results match the in-process analysis
+    DoeServiceOptions sopt;
+    sopt.workers = 2;
+    sopt.batch_window_us = 200000;
+    sopt.latency_window = 4;
+    DoeAnalysisServer server(sopt);
+    std::vector<DoeServiceRequest> reqs;
+    std::vector<std::future<DoeServiceReply>> futures;
+    for (int i = 0; i < 6; ++i) {
+        reqs.push_back(make_load_request(lopt, rng));
+        futures.push_back(server.submit(reqs.back()));
+    }
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    for (int i = 0; i < 6; ++i) {
+        DoeServiceReply r = parse_reply(format_reply(futures[i].get()));
+        assert(r.ok && r.batch_size == 6);
+        DoeFullAnalysis ref = run_doe_full_analysis(oa, reqs[i].levels, reqs[i].rs_factors, reqs[i].y);
+        assert(r.rank == ref.rs_model.rank());
+        for (int t = 0; t < (int)r.beta.size(); ++t)
+            assert(approx_equal(r.beta[t], ref.rs_model.coefficients()(t), 1e-10));
+        assert(r.anom.size() == ref.factor_anoms.size());
+        for (size_t f = 0; f < r.anom.size(); ++f) {
+            const Anom& a = ref.factor_anoms[f].anom;
+            assert(r.anom[f].name == ref.factor_anoms[f].factor_name);
+            assert(r.anom[f].groups.size() == a.results().size());
+            for (size_t g = 0; g < a.results().size(); ++g) {
+                const auto& G = r.anom[f].groups[g];
+                assert(G.name == a.results()[g].name && G.n == a.results()[g].n);
+                assert(approx_equal(G.UDL, a.results()[g].UDL, 1e-9));
+                assert(G.significant_high == a.results()[g].significant_high);
+            }
+        }
+    }
+    assert(server.stats().batches == 1 && server.stats().requests == 6);
+    assert(server.stats().latency.count == 4);   // only the latest latency_window samples are kept
+
+    // A failed run is analysed on its own (per-request mask); bad input gives an error reply
+    DoeServiceRequest failed = reqs[0];
+    failed.y[3] = std::numeric_limits<double>::quiet_NaN();
+    DoeServiceReply rf = server.submit(failed).get();
+    assert(rf.ok && rf.batch_size == 1 && rf.anom[1].groups[0].n + rf.anom[1].groups[1].n + rf.anom[1].groups[2].n == 17);
+    assert(server.handle_line("oa=L99;rs=1;y=1").rfind("error;", 0) == 0);
+    server.stop();
+
+#if !defined(_WIN32)
+    // Socket front end driven by the bundled load generator
+    DoeServiceOptions nopt;
+    nopt.socket_path = (std::filesystem::temp_directory_path() / "doe_service_test.sock").string();
+    nopt.workers = 2;
+    nopt.batch_window_us = 1000;
+    DoeAnalysisServer net(nopt);
+    net.start();
+    lopt.socket_path = nopt.socket_path;
+    lopt.clients = 4;
+    lopt.requests_per_client = 25;
+    DoeLoadReport rep = run_doe_load_generator(lopt);
+    assert(rep.requests == 100 && rep.errors == 0);
+    assert(rep.mean_batch >= 1.0 && rep.latency.p50_us <= rep.latency.p99_us);
+    DoeServiceStats st = net.stats();
+    assert(st.requests == 100 && st.batches <= 100);
+    // Threads of closed connections are reaped on later accepts, not kept until stop()
+    lopt.requests_per_client = 5;
+    for (int round = 0; round < 3; ++round) run_doe_load_generator(lopt);
+    assert(net.connection_threads() <= 2 * static_cast<size_t>(lopt.clients));
+    net.stop();
+    assert(!std::filesystem::exists(nopt.socket_path));
+    std::cout << "  " << rep.requests << " requests, mean batch " << rep.mean_batch
+              << ", p50 " << rep.latency.p50_us << " us, p99 " << rep.latency.p99_us << " us\n";
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Test 18: Coroutine API (executors, awaitable steps, cancellation, progress)
+// -----------------------------------------------------------------------------
+static doe_async::Task<DoeFullAnalysis> async_pipeline_for_test(
+    doe_async::ThreadPoolExecutor& pool,
+    doe_async::RunLoopExecutor& loop,
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& levels,
+    std::vector<double> y,
+    std::thread::id& resumed_on)
+{
+    const std::vector<int> rs_factors = {1, 2};
+    auto design = co_await doe_async::async_build_design(pool, oa, levels, rs_factors);
+    ResponseSurfaceQuadratic rs = co_await doe_async::async_fit_response_surface(pool, design, y);
+    Anom b = co_await doe_async::async_anom_for_factor(pool, oa, y, 1, "B");
+    co_await doe_async::schedule_on(loop);          // back on the host thread
+    resumed_on = std::this_thread::get_id();
+    assert(rs.rank() == 6 && b.results().size() == 3);
+    co_return co_await doe_async::async_full_analysis(pool, oa, levels, rs_factors, y);
+}
+
+void test_async_api() {
+    std::cout << "[TEST] test_async_api\n";
+
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    std::vector<FactorLevels> levels(oa.factors);
+    levels[0].levels = {0.0, 1.0};
+    for (int f = 1; f < oa.factors; ++f) levels[f].levels = {-1.0, 0.0, 1.0};
+    auto design = build_design_from_orthogonal_array_for_factors(oa, levels, {1, 2});
+    auto response = [&](int s) {
+        std::vector<double> y;
+        for (int r = 0; r < oa.runs; ++r)
+            y.push_back(4.0 + design[r][0] - 0.3 * s * design[r][1] + 0.2 * design[r][0] * design[r][0] + 0.01 * ((r * 7 + s) % 5));
+        return y;
+    };
+    std::vector<double> y = response(1);
+    DoeFullAnalysis ref = run_doe_full_analysis(oa, levels, {1, 2}, y);
+
+    doe_async::ThreadPoolExecutor pool(3);
+    doe_async::RunLoopExecutor loop;
+
+    // Host event loop keeps running while the pipeline works on the pool
+    std::thread::id resumed_on;
+    auto fut = doe_async::start(async_pipeline_for_test(pool, loop, oa, levels, y, resumed_on));
+    int loop_turns = 0;
+    while (fut.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready) {
+        loop.run_one_wait(std::chrono::milliseconds(1));
+        ++loop_turns;
+    }
+    DoeFullAnalysis a = fut.get();
+    assert(resumed_on == std::this_thread::get_id() && loop_turns > 0);
+    assert((a.rs_model.coefficients() - ref.rs_model.coefficients()).cwiseAbs().maxCoeff() == 0.0);
+    for (size_t f = 0; f < ref.factor_anoms.size(); ++f)
+        assert(a.factor_anoms[f].anom.results()[0].UDL == ref.factor_anoms[f].anom.results()[0].UDL);
+
+    // Multi-response batch with progress
+    std::vector<std::vector<double>> Ys;
+    for (int s = 0; s < 24; ++s) Ys.push_back(response(s));
+    std::atomic<int> calls{0}, last{0};
+    auto batch = doe_async::sync_wait(doe_async::async_full_analysis_batch(
+        pool, oa, levels, {1, 2}, Ys, {}, AnomOptions{}, {},
+        [&](int done, int total) { ++calls; assert(total == 24); if (done == 24) last = done; }));
+    assert(batch.size() == 24 && calls == 24 && last == 24);
+    DoeFullAnalysis ref7 = run_doe_full_analysis(oa, levels, {1, 2}, Ys[7]);
+    assert((batch[7].rs_model.coefficients() - ref7.rs_model.coefficients()).cwiseAbs().maxCoeff() == 0.0);
+
+    // Inline executor: same result without threads
+    doe_async::InlineExecutor inl;
+    DoeFullAnalysis c = doe_async::sync_wait(doe_async::async_full_analysis(inl, oa, levels, {1, 2}, y));
+    assert((c.rs_model.coefficients() - ref.rs_model.coefficients()).cwiseAbs().maxCoeff() == 0.0);
+
+    // Cancellation: before start, and from a progress callback mid-batch
+    doe_async::CancellationToken token;
+    token.cancel();
+    bool cancelled = false;
+    try {
+        doe_async::sync_wait(doe_async::async_full_analysis(pool, oa, levels, {1, 2}, y, {}, AnomOptions{}, {}, token));
+    } catch (const doe_async::OperationCancelled&) { cancelled = true; }
+    assert(cancelled);
+
+    std::vector<std::vector<double>> many(400, y);
+    doe_async::CancellationToken mid;
+    std::atomic<int> finished{0};
+    cancelled = false;
+    try {
+        doe_async::sync_wait(doe_async::async_full_analysis_batch(
+            pool, oa, levels, {1, 2}, many, {}, AnomOptions{}, mid,
+            [&](int done, int) { ++finished; if (done == 5) mid.cancel(); }));
+    } catch (const doe_async::OperationCancelled&) { cancelled = true; }
+    assert(cancelled && finished < 400);
+
+    // A failing response stops its batch without cancelling the caller's token
+    doe_async::CancellationToken shared;
+    std::vector<std::vector<double>> bad_batch(50, y);
+    bad_batch[3].resize(5);
+    bool batch_failed = false;
+    try {
+        doe_async::sync_wait(doe_async::async_full_analysis_batch(
+            pool, oa, levels, {1, 2}, bad_batch, {}, AnomOptions{}, shared));
+    } catch (const std::runtime_error&) { batch_failed = true; }
+    assert(batch_failed && !shared.cancelled());
+
+    // Arguments are owned by the lazy task: temporaries may die before it runs
+    doe_async::Task<DoeFullAnalysis> later;
+    {
+        std::vector<FactorLevels> tmp_levels = levels;
+        OrthogonalArray tmp_oa = oa;
+        later = doe_async::async_full_analysis(pool, tmp_oa, tmp_levels, {1, 2}, y);
+        tmp_levels.assign(tmp_levels.size(), FactorLevels{{7.0, 8.0, 9.0}, {}});
+        tmp_oa.data.assign(tmp_oa.data.size(), 0);
+    }
+    DoeFullAnalysis d = doe_async::sync_wait(std::move(later));
+    assert((d.rs_model.coefficients() - ref.rs_model.coefficients()).cwiseAbs().maxCoeff() == 0.0);
+
+    // Awaiting an empty (moved-from) task throws instead of touching a null handle
+    bool empty_threw = false;
+    try {
+        doe_async::sync_wait(std::move(later));
+    } catch (const std::logic_error&) { empty_threw = true; }
+    assert(empty_threw);
+
+    // Errors propagate through co_await
+    bool failed = false;
+    try {
+        doe_async::sync_wait(doe_async::async_full_analysis(pool, oa, levels, {1, 2}, std::vector<double>(3, 1.0)));
+    } catch (const std::runtime_error&) { failed = true; }
+    assert(failed);
+
+    // Export
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "doe_async_export";
+    std::filesystem::remove_all(dir);
+    int exported = 0;
+    doe_async::sync_wait(doe_async::async_export_anom(pool, a.factor_anoms, dir.string(), {},
+                                                     [&](int done, int) { exported = done; }));
+    assert(exported == oa.factors);
+    assert(std::filesystem::exists(dir / "A.csv") && std::filesystem::exists(dir / "H.svg"));
+    std::filesystem::remove_all(dir);
+    std::cout << "  host loop turns while waiting: " << loop_turns
+              << ", cancelled batch finished " << finished << " of 400\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 19: Gradient / Hessian / batched value+gradient and Sobol indices
+// -----------------------------------------------------------------------------
+void test_rs_sensitivity() {
+    std::cout << "[TEST] test_rs_sensitivity\n";
+
+    const int k = 3;
+    Eigen::VectorXd beta(ResponseSurfaceQuadratic::num_terms(k));
+    beta << 2.0, 1.0, -0.5, 0.25,   0.8, 0.0, -0.3,   0.6, -0.2, 0.1;
+    ResponseSurfaceQuadratic rs;
+    rs.restore_fit(k, beta, static_cast<int>(beta.size()));
+
+    // Term positions agree with expand_terms
+    std::vector<double> phi(beta.size());
+    double e[3] = {0.0, 0.0, 0.0};
+    e[0] = 2.0; e[2] = 3.0;
+    ResponseSurfaceQuadratic::expand_terms(e, k, phi.data());
+    assert(phi[ResponseSurfaceQuadratic::linear_index(2)] == 3.0);
+    assert(phi[ResponseSurfaceQuadratic::squared_index(k, 0)] == 4.0);
+    assert(phi[ResponseSurfaceQuadratic::interaction_index(k, 2, 0)] == 6.0);
+    assert(phi[ResponseSurfaceQuadratic::interaction_index(k, 0, 1)] == 0.0);
+
+    // Gradient against central differences, Hessian against the gradient
+    std::vector<double> x = {0.3, -0.7, 0.5};
+    std::vector<double> g = rs.gradient(x);
+    Eigen::MatrixXd H = rs.hessian();
+    for (int i = 0; i < k; ++i) {
+        std::vector<double> xp = x, xm = x;
+        xp[i] += 1e-5; xm[i] -= 1e-5;
+        assert(approx_equal(g[i], (rs.predict(xp) - rs.predict(xm)) / 2e-5, 1e-7));
+        std::vector<double> gp = rs.gradient(xp), gm = rs.gradient(xm);
+        for (int j = 0; j < k; ++j)
+            assert(approx_equal(H(i, j), (gp[j] - gm[j]) / 2e-5, 1e-7));
+    }
+
+    // Batched value + gradient equals the single-point paths
+    std::mt19937_64 rng(5);
+    std::uniform_real_distribution<double> U(-1.0, 1.0);
+    DesignMatrix X;
+    X.runs = 1000; X.factors = k;
+    X.data.resize(static_cast<size_t>(X.runs) * k);
+    for (double& v : X.data) v = U(rng);
+    std::vector<double> vals, grads, ref;
+    rs.predict_with_gradient_batch(X, vals, grads);
+    rs.predict_batch(X, ref);
+    for (int r = 0; r < X.runs; ++r) {
+        assert(approx_equal(vals[r], ref[r], 1e-12));
+        std::vector<double> xr(X.data.begin() + r * k, X.data.begin() + (r + 1) * k);
+        std::vector<double> gr = rs.gradient(xr);
+        for (int i = 0; i < k; ++i) assert(approx_equal(grads[r * k + i], gr[i], 1e-12));
+    }
+
+    // Sobol indices: exact against full enumeration of a 3-level factorial
+    std::vector<double> lv = {-1.0, 0.0, 1.0};
+    std::vector<SensitivityInput> inputs(k, SensitivityInput::discrete(lv));
+    SobolIndices S = sobol_indices(rs, inputs);
+    double mean = 0.0, m2 = 0.0;
+    std::vector<std::vector<double>> cond(k, std::vector<double>(3, 0.0));
+    for (int a = 0; a < 3; ++a)
+        for (int b = 0; b < 3; ++b)
+            for (int c = 0; c < 3; ++c) {
+                double f = rs.predict({lv[a], lv[b], lv[c]});
+                mean += f / 27.0;
+                m2 += f * f / 27.0;
+                cond[0][a] += f / 9.0; cond[1][b] += f / 9.0; cond[2][c] += f / 9.0;
+            }
+    double var = m2 - mean * mean;
+    assert(approx_equal(S.mean, mean, 1e-12) && approx_equal(S.variance, var, 1e-12));
+    for (int i = 0; i < k; ++i) {
+        double vi = 0.0;
+        for (double cm : cond[i]) vi += (cm - mean) * (cm - mean) / 3.0;
+        assert(approx_equal(S.first_order[i], vi / var, 1e-12));
+        assert(S.total[i] >= S.first_order[i]);
+    }
+    double sum = 0.0;
+    for (int i = 0; i < k; ++i) sum += S.first_order[i];
+    assert(approx_equal(sum + S.second_order.sum() / 2.0, 1.0, 1e-12));
+
+    // Uniform inputs: variance against Monte Carlo
+    SobolIndices Su = sobol_indices_uniform(rs, {-1, -1, -1}, {1, 1, 1});
+    double mc_mean = 0.0, mc_m2 = 0.0;
+    const int M = 200000;
+    for (int s = 0; s < M; ++s) {
+        double f = rs.predict({U(rng), U(rng), U(rng)});
+        mc_mean += f / M;
+        mc_m2 += f * f / M;
+    }
+    assert(std::fabs(Su.variance - (mc_m2 - mc_mean * mc_mean)) < 0.02 * Su.variance);
+    assert(std::fabs(Su.mean - mc_mean) < 0.01);
+    std::cout << "  S = " << Su.first_order[0] << ", " << Su.first_order[1] << ", " << Su.first_order[2]
+              << "  ST = " << Su.total[0] << ", " << Su.total[1] << ", " << Su.total[2] << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 20: Monte Carlo tolerance simulation (KLL quantiles, Cpk, reproducibility)
+// -----------------------------------------------------------------------------
+void test_tolerance_simulation() {
+    std::cout << "[TEST] test_tolerance_simulation\n";
+
+    // KLL sketch: rank error well inside 1%, merge equals one stream
+    KllQuantileSketch a(512), b(512), whole(512);
+    std::mt19937_64 rng(3);
+    std::uniform_real_distribution<double> U(0.0, 1.0);
+    for (int i = 0; i < 500000; ++i) {
+        double v = U(rng);
+        (i % 2 ? a : b).update(v);
+        whole.update(v);
+    }
+    a.merge(b);
+    assert(a.count() == 500000 && a.retained() < 4000);
+    for (double q : {0.01, 0.1, 0.5, 0.9, 0.99}) {
+        assert(std::fabs(a.quantile(q) - q) < 0.01);
+        assert(std::fabs(whole.quantile(q) - q) < 0.01);
+        assert(std::fabs(a.rank(q) - q) < 0.01);
+    }
+
+    // y = 1 + 2 x1 + 0.5 x2^2 at x = (0, 0); x1 ~ N(0, 0.1), x2 ~ U(-0.1, 0.1)
+    Eigen::VectorXd beta(ResponseSurfaceQuadratic::num_terms(2));
+    beta << 1.0, 2.0, 0.0, 0.0, 0.5, 0.0;
+    ResponseSurfaceQuadratic rs;
+    rs.restore_fit(2, beta, 6);
+    std::vector<FactorTolerance> tol = {FactorTolerance::normal(0.0, 0.1), FactorTolerance::uniform(0.0, 0.1)};
+
+    ToleranceSimOptions opt;
+    opt.samples = 4000000;
+    opt.usl = 1.4;
+    opt.lsl = 0.4;
+    auto t0 = std::chrono::steady_clock::now();
+    ToleranceSimResult r = simulate_tolerance(rs, tol, opt);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double mean = 1.0 + 0.5 * 0.01 / 3.0;
+    assert(r.samples == opt.samples);
+    assert(std::fabs(r.mean - mean) < 5e-4 && std::fabs(r.sd - 0.2) < 1e-3);
+    assert(std::fabs(r.quantile(0.975) - (mean + 1.96 * 0.2)) < 0.01);
+    double p_above = 1.0 - stat_util::normal_cdf((1.4 - mean) / 0.2);
+    double p_below = stat_util::normal_cdf((0.4 - mean) / 0.2);
+    assert(std::fabs(r.defect_rate - (p_above + p_below)) < 1e-3);
+    assert(approx_equal(r.cpk, (1.4 - r.mean) / (3.0 * r.sd), 1e-12));
+    assert(std::fabs(r.cpk - 0.66) < 0.01 && std::fabs(r.cpk_percentile - r.cpk) < 0.05);
+
+    // Same numbers for any thread count (per-chunk streams, ordered merge)
+    ToleranceSimOptions one = opt;
+    one.threads = 1;
+    ToleranceSimResult r1 = simulate_tolerance(rs, tol, one);
+    assert(r1.mean == r.mean && r1.sd == r.sd && r1.below_lsl == r.below_lsl);
+    assert(r1.quantile(0.001) == r.quantile(0.001) && r1.quantile(0.5) == r.quantile(0.5));
+    ToleranceSimOptions four = opt;
+    four.threads = 4;
+    ToleranceSimResult r4 = simulate_tolerance(rs, tol, four);
+    assert(r4.mean == r.mean && r4.sd == r.sd && r4.above_usl == r.above_usl);
+    assert(r4.quantile(0.001) == r.quantile(0.001) && r4.quantile(0.99865) == r.quantile(0.99865));
+
+    // The default run is split into enough chunks to keep several threads busy
+    ToleranceSimResult rd = simulate_tolerance(rs, tol);
+    assert(rd.samples == 1000000 && rd.chunks >= 8);
+
+    // Truncated normal stays inside its bounds (rejection and inversion paths)
+    for (double hi : {0.05, -0.25}) {
+        std::vector<FactorTolerance> tt = {FactorTolerance::truncated_normal(0.0, 0.1, -0.3, hi),
+                                           FactorTolerance::normal(0.0, 0.0)};
+        ToleranceSimOptions o2;
+        o2.samples = 200000;
+        ToleranceSimResult rt = simulate_tolerance(rs, tt, o2);
+        assert(rt.min >= 1.0 - 0.6 - 1e-12 && rt.max <= 1.0 + 2.0 * hi + 1e-12);
+        assert(std::isnan(rt.cpk));
+    }
+
+    std::cout << "  " << opt.samples << " samples (" << r.chunks << " chunks) in " << secs << " s, Cpk " << r.cpk
+              << ", ppm " << r.ppm << ", q99.865 " << r.quantile(0.99865) << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 21: Crossed inner x outer arrays (S/N, ANOM, dual response surface)
+// -----------------------------------------------------------------------------
+void test_crossed_array() {
+    std::cout << "[TEST] test_crossed_array\n";
+
+    const OrthogonalArray& inner = OA_L18_2_1_3_7();
+    const OrthogonalArray& outer = OA_L4_2_3();
+    std::vector<FactorLevels> levels(inner.factors);
+    levels[0].levels = {0.0, 1.0};
+    for (int f = 1; f < inner.factors; ++f) levels[f].levels = {-1.0, 0.0, 1.0};
+    auto design = build_design_from_orthogonal_array_for_factors(inner, levels, {1, 2});
+
+    // Factor B moves the mean, factor C scales the noise effect
+    CrossedArrayExperiment exp(inner, outer);
+    assert(exp.runs() == 18 && exp.noise_conditions() == 4 && exp.responses().size() == 72);
+    for (int i = 0; i < exp.runs(); ++i) {
+        double b = design[i][0], c = design[i][1];
+        double spread = std::exp(0.4 * c);
+        for (int j = 0; j < outer.runs; ++j) {
+            double noise = (outer.at(j, 0) == 0 ? -1.0 : 1.0) + 0.5 * (outer.at(j, 1) == 0 ? -1.0 : 1.0);
+            exp.at(i, j) = 20.0 + 2.0 * b + spread * noise;
+        }
+    }
+
+    CrossedArrayStats s = exp.statistics();
+    for (int i = 0; i < exp.runs(); ++i) {
+        double m = 0.0, sq = 0.0, inv = 0.0;
+        for (int j = 0; j < 4; ++j) { m += exp.at(i, j) / 4; sq += exp.at(i, j) * exp.at(i, j) / 4; inv += 1.0 / (exp.at(i, j) * exp.at(i, j)) / 4; }
+        double v = 0.0;
+        for (int j = 0; j < 4; ++j) v += (exp.at(i, j) - m) * (exp.at(i, j) - m) / 3;
+        assert(s.n[i] == 4);
+        assert(approx_equal(s.mean[i], m, 1e-12) && approx_equal(s.variance[i], v, 1e-12));
+        assert(approx_equal(s.sn_larger[i], -10.0 * std::log10(inv), 1e-10));
+        assert(approx_equal(s.sn_smaller[i], -10.0 * std::log10(sq), 1e-10));
+        assert(approx_equal(s.sn_nominal[i], 10.0 * std::log10(m * m / v), 1e-10));
+        assert(approx_equal(s.sn_nominal_variance[i], -10.0 * std::log10(v), 1e-10));
+    }
+
+    // ANOM: B drives the mean, C drives the S/N (nominal-the-best variance form)
+    auto mean_anom = build_crossed_anom_for_all_factors(exp, CrossedResponse::Mean);
+    auto sn_anom = build_crossed_anom_for_all_factors(exp, CrossedResponse::SNNominalVariance);
+    assert(mean_anom[1].anom.results()[2].significant_high && mean_anom[1].anom.results()[0].significant_low);
+    assert(sn_anom[2].anom.results()[0].significant_high && sn_anom[2].anom.results()[2].significant_low);
+
+    // Dual response: ln variance = ln(var(noise)) + 0.8 c exactly
+    DualResponseModel dual = fit_dual_response(exp, levels, {1, 2});
+    assert(approx_equal(dual.predict_mean({0.5, 0.0}), 21.0, 1e-9));
+    double base = s.variance[0] / std::exp(0.8 * design[0][1]);
+    assert(approx_equal(dual.predict_variance({0.0, 1.0}), base * std::exp(0.8), 1e-8));
+
+    // A failed condition is left out of its run only
+    exp.at(5, 2) = std::numeric_limits<double>::quiet_NaN();
+    CrossedArrayStats s2 = exp.statistics();
+    assert(s2.n[5] == 3 && s2.n[4] == 4 && std::isfinite(s2.mean[5]));
+    assert(s2.mean[4] == s.mean[4]);
+    std::cout << "  SN_N2 run 1..3: " << s.sn_nominal_variance[0] << ", " << s.sn_nominal_variance[1]
+              << ", " << s.sn_nominal_variance[2] << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 22: FWHT effect estimation and Lenth screening on 2-level arrays
+// -----------------------------------------------------------------------------
+void test_effect_screening() {
+    std::cout << "[TEST] test_effect_screening\n";
+
+    // Transform matches the direct O(N^2) sum, row by row
+    {
+        const int n = 16, w = 3;
+        std::vector<double> x(n * w), ref(n * w, 0.0);
+        for (int i = 0; i < n * w; ++i) x[i] = std::sin(0.7 * i) + 0.1 * i;
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                for (int k = 0; k < w; ++k)
+                    ref[i * w + k] += ((std::popcount(unsigned(i & j)) & 1) ? -1.0 : 1.0) * x[j * w + k];
+        fwht_inplace(x.data(), n, w);
+        for (int i = 0; i < n * w; ++i) assert(approx_equal(x[i], ref[i], 1e-12));
+    }
+
+    // L8 in Taguchi column order: effects equal the level mean differences
+    const OrthogonalArray& L8 = OA_L8_2_7();
+    std::vector<double> y = {10.1, 12.3, 10.4, 12.0, 15.2, 17.6, 15.0, 17.1};
+    EffectScreeningResult s = screen_effects(L8, y);
+    assert(s.effects == 7 && s.responses == 1);
+    std::vector<double> e(7);
+    for (int f = 0; f < 7; ++f) {
+        double s0 = 0.0, s1 = 0.0;
+        for (int r = 0; r < 8; ++r) (L8.at(r, f) ? s1 : s0) += y[r];
+        e[f] = (s1 - s0) / 4.0;
+        assert(approx_equal(s.effect[f], e[f], 1e-12));
+    }
+    assert(approx_equal(s.grand_mean[0], std::accumulate(y.begin(), y.end(), 0.0) / 8.0, 1e-12));
+    // Lenth (1989) table for m = 7: t = 3.76 (ME) and 9.01 (SME)
+    assert(approx_equal(s.t_me, 3.764, 2e-3) && approx_equal(s.t_sme, 9.009, 2e-3));
+    std::vector<double> a(7);
+    for (int f = 0; f < 7; ++f) a[f] = std::fabs(e[f]);
+    std::sort(a.begin(), a.end());
+    double s0 = 1.5 * a[3];
+    std::vector<double> kept;
+    for (double v : a) if (v < 2.5 * s0) kept.push_back(v);
+    double pse = kept.size() % 2 ? 1.5 * kept[kept.size() / 2]
+                                 : 0.75 * (kept[kept.size() / 2 - 1] + kept[kept.size() / 2]);
+    assert(approx_equal(s.pse[0], pse, 1e-12));
+    for (int f = 0; f < 7; ++f)
+        assert(s.active[f] == ((f == 0 || f == 3) ? 1 : 0));   // A (+5) and D (+2) only
+    assert(s.rank[0] == 6 && s.rank[3] == 5);
+    assert(approx_equal(s.half_normal_q[6], stat_util::normal_quantile_approx(0.5 + 0.5 * 6.5 / 7), 1e-12));
+
+    // Saturated arrays: L8 columns are a permutation of make_two_level_oa(8)
+    OrthogonalArray Y8 = make_two_level_oa(8);
+    for (int f = 0; f < 7; ++f) {
+        bool found = false;
+        for (int c = 0; c < 7 && !found; ++c) {
+            bool same = true;
+            for (int r = 0; r < 8; ++r) same &= (L8.at(r, f) == Y8.at(r, c));
+            found = same;
+        }
+        assert(found);
+    }
+
+    // L256: 255 effects, 64 responses, 4 active effects per response
+    OrthogonalArray L256 = make_two_level_oa(256);
+    assert(L256.factors == 255);
+    const int R = 64;
+    const int act[4] = {0, 6, 77, 200};
+    Eigen::MatrixXd Y(256, R);
+    std::mt19937_64 rng(41);
+    std::normal_distribution<double> noise(0.0, 0.2);
+    for (int r = 0; r < R; ++r)
+        for (int i = 0; i < 256; ++i) {
+            double v = 50.0 + noise(rng);
+            for (int k = 0; k < 4; ++k) v += (L256.at(i, act[k]) ? 1.0 : -1.0) * (1.0 + 0.5 * k);
+            Y(i, r) = v;
+        }
+    auto t0 = std::chrono::steady_clock::now();
+    EffectScreeningResult b = screen_effects_batch(L256, Y, EffectScreeningOptions{}, 4);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    int false_sme = 0;
+    for (int r = 0; r < R; ++r) {
+        std::vector<double> col(Y.col(r).data(), Y.col(r).data() + 256);
+        EffectScreeningResult one = screen_effects(L256, col);
+        assert(one.pse[0] == b.pse[r]);
+        for (int f = 0; f < 255; ++f) {
+            assert(one.effect[f] == b.effect[b.index(f, r)]);
+            bool is_active = std::find(act, act + 4, f) != act + 4;
+            if (is_active) {
+                assert(b.active_sme[b.index(f, r)]);
+                assert(b.rank[b.index(f, r)] >= 251);
+            } else {
+                false_sme += b.active_sme[b.index(f, r)];
+            }
+        }
+        assert(approx_equal(b.effect[b.index(200, r)], 5.0, 0.1));
+    }
+    assert(false_sme < R / 5);   // SME: about 5% of responses with any false positive
+
+    // Arrays whose columns are not Walsh functions are rejected
+    bool threw = false;
+    try { screen_effects(OA_L9_3_4(), std::vector<double>(9, 1.0)); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+    std::cout << "  L256 x " << R << " responses screened in " << ms << " ms, PSE[0] = " << b.pse[0]
+              << ", SME false positives " << false_sme << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 23: Closed-form quadratic fit on balanced orthogonal arrays
+// -----------------------------------------------------------------------------
+static double max_coef_diff(const ResponseSurfaceQuadratic& a, const ResponseSurfaceQuadratic& b) {
+    return (a.coefficients() - b.coefficients()).cwiseAbs().maxCoeff();
+}
+
+void test_orthogonal_rs_fit() {
+    std::cout << "[TEST] test_orthogonal_rs_fit\n";
+
+    std::vector<FactorLevels> levels(8);
+    levels[0].levels = {0.0, 1.0};
+    for (int f = 1; f < 8; ++f) levels[f].levels = {1.0, 2.5, 4.0 + 0.5 * f};   // uneven spacing
+    auto response = [](const std::vector<double>& x) {
+        double v = 3.0;
+        for (size_t i = 0; i < x.size(); ++i) v += (0.7 - 0.2 * i) * x[i] + 0.15 * x[i] * x[i];
+        if (x.size() > 1) v += 0.3 * x[0] * x[1];
+        return v;
+    };
+
+    // Full factorial in the selected factors: everything orthogonal
+    const OrthogonalArray& L18 = OA_L18_2_1_3_7();
+    OrthogonalQuadraticPlan p2(L18, levels, {1, 2});
+    assert(p2.usable() && p2.fully_orthogonal());
+    // Three factors of L18: interactions partially aliased, solved by the Schur step
+    OrthogonalQuadraticPlan p3(L18, levels, {1, 2, 3});
+    assert(p3.usable() && !p3.fully_orthogonal());
+    // 2-level factor (x^2 aliased with the intercept) and too many terms are refused
+    assert(!OrthogonalQuadraticPlan(L18, levels, {0, 1}).usable());
+    assert(!OrthogonalQuadraticPlan(OA_L9_3_4(), levels, {0, 1, 2, 3}).usable());
+
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> noise(0.0, 0.3);
+    for (const std::vector<int>& idx : {std::vector<int>{1, 2}, std::vector<int>{1, 2, 3}}) {
+        auto design = build_design_from_orthogonal_array_for_factors(L18, levels, idx);
+        std::vector<double> y(L18.runs);
+        for (int r = 0; r < L18.runs; ++r) y[r] = response(design[r]) + noise(rng);
+        ResponseSurfaceQuadratic qr, fast;
+        assert(qr.fit(design, y));
+        OrthogonalQuadraticPlan plan(L18, levels, idx);
+        assert(plan.fit(y, fast));
+        assert(max_coef_diff(qr, fast) < 1e-9);
+        assert(fast.rank() == ResponseSurfaceQuadratic::num_terms((int)idx.size()));
+
+        // Failed run: falls back to the masked QR fit
+        y[4] = std::numeric_limits<double>::quiet_NaN();
+        ResponseSurfaceQuadratic qr_nan, via_oa;
+        assert(!plan.fit(y, fast));
+        assert(qr_nan.fit(design, y) && fit_response_surface_oa(via_oa, L18, levels, idx, y));
+        assert(max_coef_diff(qr_nan, via_oa) == 0.0);
+
+        // Prebuilt plan shared across responses: same fits as the per-call overload
+        ResponseSurfaceQuadratic shared;
+        assert(fit_response_surface_oa(shared, plan, L18, levels, idx, y));
+        assert(max_coef_diff(qr_nan, shared) == 0.0);
+        y[4] = response(design[4]);
+        assert(fit_response_surface_oa(shared, plan, L18, levels, idx, y));
+        assert(fit_response_surface_oa(via_oa, L18, levels, idx, y));
+        assert(max_coef_diff(via_oa, shared) == 0.0);
+        bool threw = false;
+        try { fit_response_surface_oa(shared, p2, L18, levels, {1, 2, 3}, y); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+
+    // Large balanced array: 3^7 full factorial, many responses
+    const int k = 7, N = 2187;
+    OrthogonalArray full;
+    full.runs = N;
+    full.factors = k;
+    full.levels = 3;
+    full.data.resize(static_cast<size_t>(N) * k);
+    for (int r = 0; r < N; ++r)
+        for (int f = 0, v = r; f < k; ++f, v /= 3) full.data[static_cast<size_t>(r) * k + f] = v % 3;
+    std::vector<int> idx = {0, 1, 2, 3, 4, 5, 6};
+    std::vector<FactorLevels> lv(levels.begin() + 1, levels.end());   // 3-level factors only
+    auto design = build_design_from_orthogonal_array_for_factors(full, lv, idx);
+    const int R = 20;
+    Eigen::MatrixXd Y(N, R);
+    for (int c = 0; c < R; ++c)
+        for (int r = 0; r < N; ++r) Y(r, c) = response(design[r]) + 0.1 * c * design[r][c % k] + noise(rng);
+
+    auto t0 = std::chrono::steady_clock::now();
+    OrthogonalQuadraticPlan plan(full, lv, idx);
+    Eigen::MatrixXd B = plan.solve_batch(Y);
+    auto t1 = std::chrono::steady_clock::now();
+    double worst = 0.0;
+    for (int c = 0; c < R; ++c) {
+        std::vector<double> y(Y.col(c).data(), Y.col(c).data() + N);
+        ResponseSurfaceQuadratic qr;
+        assert(qr.fit(design, y));
+        worst = std::max(worst, (qr.coefficients() - B.col(c)).cwiseAbs().maxCoeff());
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    assert(plan.fully_orthogonal());
+    assert(worst < 1e-9);
+    std::cout << "  3^7 x " << R << " responses: closed form "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms (plan included), QR "
+              << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms, max diff " << worst << "\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 24: Matrix-free LSQR fit of the quadratic model
+// -----------------------------------------------------------------------------
+void test_lsqr_fit() {
+    std::cout << "[TEST] test_lsqr_fit\n";
+
+    std::mt19937_64 rng(43);
+    std::uniform_real_distribution<double> unif(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.05);
+    auto make_problem = [&](int N, int k, DesignMatrix& X, std::vector<double>& y, Eigen::VectorXd& beta) {
+        const int m = ResponseSurfaceQuadratic::num_terms(k);
+        X = DesignMatrix(N, k);
+        for (double& v : X.data) v = unif(rng);
+        beta.resize(m);
+        for (int j = 0; j < m; ++j) beta(j) = unif(rng);
+        y.resize(N);
+        Eigen::VectorXd phi(m);
+        for (int r = 0; r < N; ++r) {
+            ResponseSurfaceQuadratic::expand_terms(X.row(r), k, phi.data());
+            y[r] = beta.dot(phi) + noise(rng);
+        }
+    };
+
+    // Implicit Phi / Phi^T agree with the explicit feature matrix
+    {
+        DesignMatrix X;
+        std::vector<double> y;
+        Eigen::VectorXd beta;
+        make_problem(300, 6, X, y, beta);
+        QuadraticFeatureOperator A(X, {}, 64, 3);
+        Eigen::MatrixXd Phi(300, A.cols());
+        Eigen::VectorXd phi(A.cols());
+        for (int r = 0; r < 300; ++r) {
+            ResponseSurfaceQuadratic::expand_terms(X.row(r), 6, phi.data());
+            Phi.row(r) = phi.transpose();
+        }
+        Eigen::VectorXd v = Eigen::VectorXd::Random(A.cols()), u = Eigen::VectorXd::Random(300), Av, Atu;
+        A.apply(v, Av);
+        A.apply_transpose(u, Atu);
+        assert((Av - Phi * v).cwiseAbs().maxCoeff() < 1e-12);
+        assert((Atu - Phi.transpose() * u).cwiseAbs().maxCoeff() < 1e-11);
+        assert((A.column_norms_squared() - Phi.colwise().squaredNorm().transpose()).cwiseAbs().maxCoeff() < 1e-10);
+    }
+
+    // Same solution as the QR fit, with failed runs skipped
+    {
+        DesignMatrix X;
+        std::vector<double> y;
+        Eigen::VectorXd beta;
+        make_problem(2000, 20, X, y, beta);
+        y[7] = std::numeric_limits<double>::quiet_NaN();
+        RunMask mask(2000);
+        mask.reset(11);
+        ResponseSurfaceQuadratic qr, it1, it4;
+        assert(qr.fit(X.to_rows(), y, mask));
+        LsqrOptions opt;
+        opt.threads = 1;
+        auto t0 = std::chrono::steady_clock::now();
+        LsqrReport r1 = fit_response_surface_lsqr(it1, X, y, opt, mask);
+        auto t1 = std::chrono::steady_clock::now();
+        opt.threads = 4;
+        LsqrReport r4 = fit_response_surface_lsqr(it4, X, y, opt, mask);
+        assert(r1.converged() && r4.converged());
+        assert((qr.coefficients() - it1.coefficients()).cwiseAbs().maxCoeff() < 1e-6);
+        assert((it1.coefficients() - it4.coefficients()).cwiseAbs().maxCoeff() < 1e-8);
+        assert((it1.coefficients() - beta).cwiseAbs().maxCoeff() < 0.1);
+        std::cout << "  k = 20 (m = " << it1.coefficients().size() << "): " << r1.iterations
+                  << " iterations, " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+                  << " ms, cond ~ " << r1.cond_estimate << "\n";
+    }
+
+    // Exact data: stops on a small residual
+    {
+        DesignMatrix X;
+        std::vector<double> y;
+        Eigen::VectorXd beta;
+        make_problem(400, 5, X, y, beta);
+        Eigen::VectorXd phi(beta.size());
+        for (int r = 0; r < 400; ++r) {
+            ResponseSurfaceQuadratic::expand_terms(X.row(r), 5, phi.data());
+            y[r] = beta.dot(phi);
+        }
+        ResponseSurfaceQuadratic rs;
+        LsqrReport rep = fit_response_surface_lsqr(rs, X, y);
+        assert(rep.stop == LsqrStop::ResidualSmall);
+        assert((rs.coefficients() - beta).cwiseAbs().maxCoeff() < 1e-7);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Test 25: Ridge / lasso / elastic net paths and CV-chosen lambda
+// -----------------------------------------------------------------------------
+void test_penalized_fit() {
+    std::cout << "[TEST] test_penalized_fit\n";
+
+    std::mt19937_64 rng(44);
+    std::uniform_real_distribution<double> unif(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.1);
+
+    // 10 factors: 66-term quadratic, sparse truth
+    const int N = 200, k = 10;
+    std::vector<std::vector<double>> design(N, std::vector<double>(k));
+    for (auto& row : design) for (double& v : row) v = unif(rng);
+    Eigen::MatrixXd Phi = cv_detail::quadratic_feature_matrix(design);
+    const int m = static_cast<int>(Phi.cols());
+    assert(m == 66);
+    Eigen::VectorXd truth = Eigen::VectorXd::Zero(m);
+    truth(0) = 5.0;
+    truth(ResponseSurfaceQuadratic::linear_index(0)) = 2.0;
+    truth(ResponseSurfaceQuadratic::linear_index(3)) = -1.5;
+    truth(ResponseSurfaceQuadratic::squared_index(k, 2)) = 1.0;
+    truth(ResponseSurfaceQuadratic::interaction_index(k, 1, 4)) = 0.8;
+    std::vector<double> y(N);
+    for (int r = 0; r < N; ++r) y[r] = Phi.row(r).dot(truth) + noise(rng);
+    Eigen::MatrixXd X = Phi.rightCols(m - 1);
+
+    // Lasso path: KKT conditions hold at every lambda (checked from scratch)
+    auto t0 = std::chrono::steady_clock::now();
+    PenalizedPath lasso = elastic_net_path(X, y);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; ++i) {
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
+        Eigen::VectorXd b = qr.solve(Eigen::Map<const Eigen::VectorXd>(y.data(), N));
+        assert(b.size() == m);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    assert(lasso.lambda.size() == 100 && lasso.nonzero.front() <= 1);
+    Eigen::VectorXd mu = X.colwise().mean().transpose();
+    Eigen::VectorXd sd(m - 1);
+    for (int j = 0; j < m - 1; ++j) sd(j) = std::sqrt((X.col(j).array() - mu(j)).square().mean());
+    // coordinate descent stops when G_jj delta^2 < tol var(y) (tol = 1e-7)
+    Eigen::Map<const Eigen::VectorXd> Ym(y.data(), N);
+    const double kkt_tol = 2.0 * std::sqrt(1e-7 * (Ym.array() - Ym.mean()).square().mean());
+    for (size_t l = 0; l < lasso.lambda.size(); l += 9) {
+        Eigen::VectorXd coef = lasso.coefficients.col(l);
+        Eigen::VectorXd res = Eigen::Map<const Eigen::VectorXd>(y.data(), N) - X * coef.tail(m - 1);
+        res.array() -= coef(0);
+        assert(std::fabs(res.mean()) < 1e-9);
+        double lam = lasso.lambda[l];
+        for (int j = 0; j < m - 1; ++j) {
+            double g = (X.col(j).array() - mu(j)).matrix().dot(res) / N / sd(j);   // standardized gradient
+            double bj = coef(1 + j) * sd(j);
+            if (bj == 0.0) assert(std::fabs(g) <= lam + kkt_tol);
+            else           assert(std::fabs(g - lam * (bj > 0 ? 1.0 : -1.0)) <= kkt_tol);
+        }
+        assert(approx_equal(lasso.rss[l], res.squaredNorm(), 1e-6 * (1.0 + res.squaredNorm())));
+    }
+
+    // Ridge: SVD path and augmented QR agree; elastic net sits in between
+    PenalizedFitOptions ropt;
+    ropt.alpha = 0.0;
+    ropt.lambdas = {1.0, 0.1, 0.01};
+    PenalizedPath ridge = elastic_net_path(X, y, ropt);
+    for (int l = 0; l < 3; ++l) {
+        Eigen::VectorXd b = fit_ridge(X, y, ropt.lambdas[l]);
+        assert((b - ridge.coefficients.col(l)).cwiseAbs().maxCoeff() < 1e-8);
+    }
+    PenalizedFitOptions eopt;
+    eopt.alpha = 0.5;
+    PenalizedPath enet = elastic_net_path(X, y, eopt);
+    assert(enet.nonzero.back() >= 5);
+
+    // CV-chosen lasso recovers the sparse truth
+    ResponseSurfaceQuadratic rs;
+    KFoldOptions cv;
+    cv.folds = 5;
+    PenalizedCvResult best = fit_response_surface_penalized(rs, design, y, PenalizedFitOptions{}, cv);
+    assert(best.best_1se <= best.best);
+    assert((rs.coefficients() - truth).cwiseAbs().maxCoeff() < 0.1);
+    assert(rs.rank() == 1 + best.path.nonzero[best.best]);
+
+    // Saturated L18 (45 terms, 18 runs): unique shrunken fit instead of a QR basic solution
+    const OrthogonalArray& L18 = OA_L18_2_1_3_7();
+    std::vector<FactorLevels> lv(8);
+    lv[0].levels = {-1.0, 1.0};
+    for (int f = 1; f < 8; ++f) lv[f].levels = {-1.0, 0.0, 1.0};
+    auto d18 = build_design_from_orthogonal_array(L18, lv);
+    std::vector<double> y18(18);
+    for (int r = 0; r < 18; ++r) y18[r] = 10.0 + 2.0 * d18[r][1] - 1.0 * d18[r][4] + 0.5 * d18[r][2] * d18[r][2] + 0.05 * noise(rng);
+    ResponseSurfaceQuadratic qr18, pen18;
+    assert(qr18.fit(d18, y18) && qr18.rank() < ResponseSurfaceQuadratic::num_terms(8));
+    cv.folds = 6;
+    fit_response_surface_penalized(pen18, d18, y18, PenalizedFitOptions{}, cv);
+    assert(approx_equal(pen18.coefficients()(ResponseSurfaceQuadratic::linear_index(1)), 2.0, 0.15));
+    assert(approx_equal(pen18.coefficients()(ResponseSurfaceQuadratic::linear_index(4)), -1.0, 0.15));
+
+    std::cout << "  100-lambda lasso path on 66 terms: "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms ("
+              << lasso.sweeps << " sweeps, " << lasso.gram_columns << " Gram columns), 100 QR fits: "
+              << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms; CV lambda "
+              << best.lambda_best() << " with " << best.path.nonzero[best.best] << " terms\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 26: Categorical and mixed factors
+// -----------------------------------------------------------------------------
+void test_mixed_factors() {
+    std::cout << "[TEST] test_mixed_factors\n";
+
+    std::mt19937_64 rng(45);
+    std::uniform_real_distribution<double> unif(-1.0, 1.0);
+
+    // 2 continuous + categorical (3 and 4 categories), noise-free truth
+    const int N = 200;
+    MixedDesign d;
+    d.continuous = DesignMatrix(N, 2);
+    d.categorical_factors = 2;
+    d.num_categories = {3, 4};
+    d.codes.resize(static_cast<size_t>(N) * 2);
+    const double lot[3] = {1.0, -0.5, 2.0};
+    const double tool[4] = {0.0, 0.3, -0.7, 1.1};
+    const double lot_slope[3] = {0.5, -1.0, 0.0};   // lot x x0
+    std::vector<double> y(N);
+    for (int r = 0; r < N; ++r) {
+        double x0 = unif(rng), x1 = unif(rng);
+        int a = r % 3, b = (r / 3) % 4;
+        d.continuous.at(r, 0) = x0;
+        d.continuous.at(r, 1) = x1;
+        d.codes[r * 2 + 0] = static_cast<std::uint16_t>(a);
+        d.codes[r * 2 + 1] = static_cast<std::uint16_t>(b);
+        y[r] = 3.0 + 1.5 * x0 - 2.0 * x1 + 0.8 * x0 * x0 + 0.4 * x0 * x1
+             + lot[a] + tool[b] + lot_slope[a] * x0;
+    }
+
+    MixedResponseSurface eff, dum;
+    MixedModelOptions opt;
+    assert(eff.fit(d, y, opt));
+    opt.coding = CategoricalCoding::Dummy;
+    assert(dum.fit(d, y, opt));
+    // 1 + 2 + 2 + 1 + (2 + 3) + (2 + 3) * 2
+    assert(eff.num_terms() == 21 && eff.rank() == 21);
+
+    std::vector<double> pe, pd;
+    eff.predict_batch(d, pe);
+    dum.predict_batch(d, pd);
+    for (int r = 0; r < N; ++r) {
+        assert(approx_equal(pe[r], y[r], 1e-9));
+        assert(approx_equal(pd[r], y[r], 1e-9));
+    }
+    std::vector<std::uint16_t> c01 = {1, 2};
+    assert(approx_equal(eff.predict({0.2, -0.4}, c01), dum.predict({0.2, -0.4}, c01), 1e-9));
+
+    // Effect coding sums to zero; category differences agree across codings
+    for (int q = 0; q < 2; ++q) {
+        std::vector<double> ee = eff.category_effects(q), ed = dum.category_effects(q);
+        double s = 0.0;
+        for (double v : ee) s += v;
+        assert(std::fabs(s) < 1e-9);
+        assert(ed[0] == 0.0);
+        for (size_t l = 1; l < ee.size(); ++l)
+            assert(approx_equal(ee[l] - ee[0], ed[l], 1e-9));
+    }
+    std::vector<double> etool = dum.category_effects(1);
+    for (int l = 0; l < 4; ++l) assert(approx_equal(etool[l], tool[l] - tool[0], 1e-9));
+
+    bool threw = false;
+    try { std::vector<std::uint16_t> bad = {3, 0}; eff.predict({0.0, 0.0}, bad); }
+    catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    // L18: supplier (factor 0) and lot (factor 4) categorical, factors 1, 2 continuous
+    const OrthogonalArray& oa = OA_L18_2_1_3_7();
+    std::vector<FactorLevels> levels(oa.factors, FactorLevels{{-1.0, 0.0, 1.0}, {}});
+    levels[0] = FactorLevels{{}, {"ACME", "Globex"}};
+    levels[4] = FactorLevels{{}, {"A", "B", "C"}};
+    MixedDesign md = build_mixed_design_from_orthogonal_array(oa, levels, {0, 1, 2, 4});
+    static_assert(sizeof(md.codes[0]) == 2, "category codes are 16-bit");
+    assert(md.runs() == 18 && md.continuous.factors == 2 && md.categorical_factors == 2);
+    assert((md.continuous_source == std::vector<int>{1, 2}));
+    assert((md.categorical_source == std::vector<int>{0, 4}));
+    assert((md.num_categories == std::vector<int>{2, 3}));
+    for (int r = 0; r < 18; ++r) {
+        assert(md.code_row(r)[0] == oa.at(r, 0) && md.code_row(r)[1] == oa.at(r, 4));
+        assert(md.continuous.at(r, 0) == oa.at(r, 1) - 1.0);
+        assert(md.continuous.at(r, 1) == oa.at(r, 2) - 1.0);
+    }
+
+    std::vector<double> y18(18);
+    const double supplier[2] = {0.4, -0.4}, lot3[3] = {0.2, -0.5, 0.3};
+    for (int r = 0; r < 18; ++r) {
+        const double* x = md.continuous.row(r);
+        y18[r] = 10.0 + x[0] - 0.5 * x[1] + 0.3 * x[0] * x[0] + 0.2 * x[0] * x[1]
+               + supplier[md.code_row(r)[0]] + lot3[md.code_row(r)[1]];
+    }
+    MixedModelOptions o18;
+    o18.categorical_interactions = false;
+    MixedResponseSurface rs18;
+    assert(rs18.fit(md, y18, o18));
+    assert(rs18.num_terms() == 9 && rs18.rank() == 9);
+    std::vector<double> es = rs18.category_effects(0), el = rs18.category_effects(1);
+    assert(approx_equal(es[0], 0.4, 1e-9) && approx_equal(es[1], -0.4, 1e-9));
+    for (int l = 0; l < 3; ++l) assert(approx_equal(el[l], lot3[l], 1e-9));
+
+    std::vector<std::string> names = rs18.term_names({"temp", "time"}, {levels[0].categories, levels[4].categories});
+    assert(names.size() == 9);
+    assert(names[3] == "temp^2" && names[5] == "temp*time");
+    assert(names[6] == "c0[ACME]" && names[8] == "c1[B]");
+
+    std::cout << "  effect/dummy coding agree, L18 mixed fit recovers supplier/lot effects\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 27: Central composite and Box-Behnken designs
+// -----------------------------------------------------------------------------
+void test_rsm_designs() {
+    std::cout << "[TEST] test_rsm_designs\n";
+
+    // Noise-free quadratic in k factors, recovered exactly by ResponseSurfaceQuadratic
+    auto check_recovery = [](const RsmDesign& d) {
+        const int k = d.design.factors;
+        const int m = ResponseSurfaceQuadratic::num_terms(k);
+        Eigen::VectorXd truth(m);
+        for (int j = 0; j < m; ++j) truth(j) = 0.1 * ((j * 7) % 11) - 0.4;
+        std::vector<double> y(d.design.runs), phi(m);
+        for (int r = 0; r < d.design.runs; ++r) {
+            ResponseSurfaceQuadratic::expand_terms(d.design.row(r), k, phi.data());
+            y[r] = Eigen::Map<Eigen::VectorXd>(phi.data(), m).dot(truth);
+        }
+        ResponseSurfaceQuadratic rs;
+        assert(rs.fit(d.design.to_rows(), y));
+        assert(rs.rank() == m);
+        assert((rs.coefficients() - truth).cwiseAbs().maxCoeff() < 1e-8);
+    };
+    // Block means of x_i and x_i x_j are zero and of x_i^2 equal across blocks
+    auto check_orthogonal_blocks = [](const RsmDesign& d) {
+        const int k = d.design.factors;
+        std::vector<double> sq0;
+        for (int b = 0; b < d.blocks; ++b) {
+            int n = 0;
+            std::vector<double> lin(k, 0.0), sq(k, 0.0), inter(k * k, 0.0);
+            for (int r = 0; r < d.design.runs; ++r) {
+                if (d.block[r] != b) continue;
+                ++n;
+                const double* x = d.design.row(r);
+                for (int i = 0; i < k; ++i) {
+                    lin[i] += x[i];
+                    sq[i] += x[i] * x[i];
+                    for (int j = i + 1; j < k; ++j) inter[i * k + j] += x[i] * x[j];
+                }
+            }
+            assert(n > 0);
+            for (int i = 0; i < k; ++i) {
+                assert(std::fabs(lin[i]) < 1e-12);
+                for (int j = i + 1; j < k; ++j) assert(std::fabs(inter[i * k + j]) < 1e-12);
+                sq[i] /= n;
+            }
+            if (b == 0) sq0 = sq;
+            for (int i = 0; i < k; ++i) assert(approx_equal(sq[i], sq0[i], 1e-12));
+        }
+    };
+
+    // Rotatable CCD, k = 3: 8 + 6 + 6 runs, alpha = 8^(1/4)
+    {
+        RsmDesign d = central_composite_design(3);
+        assert(d.design.runs == 20 && d.factorial_runs == 8 && d.axial_runs == 6 && d.center_runs == 6);
+        assert(approx_equal(d.alpha, std::pow(8.0, 0.25), 1e-12));
+        check_recovery(d);
+        // Prediction variance depends only on the distance from the center
+        Eigen::MatrixXd Phi = cv_detail::quadratic_feature_matrix(d.design.to_rows());
+        Eigen::MatrixXd XtXi = (Phi.transpose() * Phi).inverse();
+        auto pv = [&](std::vector<double> x) {
+            std::vector<double> phi(ResponseSurfaceQuadratic::num_terms(3));
+            ResponseSurfaceQuadratic::expand_terms(x.data(), 3, phi.data());
+            Eigen::Map<Eigen::VectorXd> p(phi.data(), phi.size());
+            return p.dot(XtXi * p);
+        };
+        const double rad = 1.3, c = rad / std::sqrt(3.0);
+        assert(approx_equal(pv({rad, 0, 0}), pv({c, -c, c}), 1e-10));
+        assert(approx_equal(pv({0, rad, 0}), pv({-c, c, c}), 1e-10));
+    }
+
+    // Face-centered: three levels only; orthogonal alpha: squared columns orthogonal
+    {
+        CentralCompositeOptions opt;
+        opt.alpha_type = CcdAlpha::FaceCentered;
+        RsmDesign d = central_composite_design(4, opt);
+        for (double v : d.design.data) assert(v == -1.0 || v == 0.0 || v == 1.0);
+        check_recovery(d);
+
+        opt.alpha_type = CcdAlpha::Orthogonal;
+        d = central_composite_design(4, opt);
+        const int N = d.design.runs;
+        for (int i = 0; i < 4; ++i)
+            for (int j = i + 1; j < 4; ++j) {
+                double si = 0, sj = 0, sij = 0;
+                for (int r = 0; r < N; ++r) {
+                    double a = d.design.at(r, i) * d.design.at(r, i), b = d.design.at(r, j) * d.design.at(r, j);
+                    si += a; sj += b; sij += a * b;
+                }
+                assert(std::fabs(sij - si * sj / N) < 1e-9);
+            }
+    }
+
+    // Resolution V fractional cores: 16, 32, 64, 64 runs for k = 5..8
+    {
+        const int expect[4] = {16, 32, 64, 64};
+        for (int k = 5; k <= 8; ++k) {
+            RsmDesign d = central_composite_design(k);
+            assert(d.factorial_runs == expect[k - 5]);
+            // core: intercept, main effects and 2FIs mutually orthogonal
+            std::vector<std::vector<double>> core;
+            for (int r = 0; r < d.factorial_runs; ++r) core.push_back({d.design.row(r), d.design.row(r) + k});
+            Eigen::MatrixXd P = cv_detail::quadratic_feature_matrix(core);
+            std::vector<int> keep{0};
+            for (int i = 0; i < k; ++i) keep.push_back(ResponseSurfaceQuadratic::linear_index(i));
+            for (int i = 0; i < k; ++i)
+                for (int j = i + 1; j < k; ++j) keep.push_back(ResponseSurfaceQuadratic::interaction_index(k, i, j));
+            Eigen::MatrixXd C(P.rows(), keep.size());
+            for (size_t t = 0; t < keep.size(); ++t) C.col(t) = P.col(keep[t]);
+            Eigen::MatrixXd G = C.transpose() * C;
+            assert((G - d.factorial_runs * Eigen::MatrixXd::Identity(G.rows(), G.cols())).cwiseAbs().maxCoeff() < 1e-12);
+            check_recovery(d);
+        }
+    }
+
+    // Blocked CCD: two factorial blocks + axial block, orthogonal blocking alpha
+    {
+        CentralCompositeOptions opt;
+        opt.blocked = true;
+        opt.factorial_blocks = 2;
+        opt.fractional = false;
+        opt.center_factorial = 2;
+        opt.center_axial = 2;
+        opt.alpha_type = CcdAlpha::OrthogonalBlocks;
+        RsmDesign d = central_composite_design(4, opt);
+        assert(d.blocks == 3 && d.design.runs == 16 + 4 + 8 + 2);
+        assert(approx_equal(d.alpha, 2.0, 1e-12));
+        check_orthogonal_blocks(d);
+        check_recovery(d);
+    }
+
+    // Box-Behnken: 12 / 24 / 40 edge runs for k = 3 / 4 / 5
+    {
+        for (int k = 3; k <= 5; ++k) {
+            RsmDesign d = box_behnken_design(k);
+            assert(d.factorial_runs == 2 * k * (k - 1) && d.design.runs == d.factorial_runs + 3);
+            for (int r = 0; r < d.factorial_runs; ++r) {
+                int nz = 0;
+                for (int j = 0; j < k; ++j) nz += d.design.at(r, j) != 0.0;
+                assert(nz == 2);
+            }
+            check_recovery(d);
+        }
+        // k = 4 blocked: 3 orthogonal blocks of 8 edge runs + 1 center each
+        BoxBehnkenOptions bo;
+        bo.blocked = true;
+        bo.center_points = 1;
+        RsmDesign d = box_behnken_design(4, bo);
+        assert(d.blocks == 3 && d.design.runs == 27);
+        check_orthogonal_blocks(d);
+        check_recovery(d);
+
+        // No center run: squared terms aliased with the intercept
+        bo = BoxBehnkenOptions{};
+        bo.center_points = 0;
+        d = box_behnken_design(3, bo);
+        ResponseSurfaceQuadratic rs;
+        assert(rs.fit(d.design.to_rows(), std::vector<double>(d.design.runs, 1.0)));
+        assert(rs.rank() == ResponseSurfaceQuadratic::num_terms(3) - 1);
+
+        // k = 6, 7: tabulated groups of three, 48 / 56 edge runs, two orthogonal blocks
+        for (int k = 6; k <= 7; ++k) {
+            d = box_behnken_design(k);
+            assert(d.factorial_runs == 8 * k && d.design.runs == d.factorial_runs + 3);
+            std::vector<int> appear(k, 0);
+            for (int r = 0; r < d.factorial_runs; ++r) {
+                int nz = 0;
+                for (int j = 0; j < k; ++j)
+                    if (d.design.at(r, j) != 0.0) { ++nz; ++appear[j]; }
+                assert(nz == 3);
+            }
+            assert(std::all_of(appear.begin(), appear.end(), [](int a) { return a == 24; }));
+            check_recovery(d);
+            bo = BoxBehnkenOptions{};
+            bo.blocked = true;
+            bo.center_points = 2;
+            d = box_behnken_design(k, bo);
+            assert(d.blocks == 2 && d.design.runs == 8 * k + 4);
+            check_orthogonal_blocks(d);
+            check_recovery(d);
+            // all_pairs keeps the pair construction
+            bo = BoxBehnkenOptions{};
+            bo.all_pairs = true;
+            assert(box_behnken_design(k, bo).factorial_runs == 2 * k * (k - 1));
+        }
+        // k >= 8: no table, the pair construction must be asked for
+        bool threw = false;
+        try { box_behnken_design(8); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+
+    // Coded -> physical units
+    {
+        RsmDesign d = central_composite_design(2, CentralCompositeOptions{CcdAlpha::FaceCentered});
+        decode_to_ranges(d.design, {{150.0, 190.0}, {1.0, 3.0}});
+        assert(d.design.at(0, 0) == 150.0 && d.design.at(0, 1) == 1.0);
+        assert(d.design.at(d.design.runs - 1, 0) == 170.0 && d.design.at(d.design.runs - 1, 1) == 2.0);
+    }
+
+    // Large k
+    auto t0 = std::chrono::steady_clock::now();
+    RsmDesign big = central_composite_design(50);
+    auto t1 = std::chrono::steady_clock::now();
+    BoxBehnkenOptions pairs;
+    pairs.all_pairs = true;
+    RsmDesign bbd = box_behnken_design(100, pairs);
+    auto t2 = std::chrono::steady_clock::now();
+    assert(big.core_columns.size() == 50 && bbd.design.runs == 4 * 4950 + 3);
+    std::cout << "  CCD k=50: " << big.design.runs << " runs (core 2^" << std::bit_width(static_cast<unsigned>(big.factorial_runs)) - 1
+              << ") in " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, BBD k=100: "
+              << bbd.design.runs << " runs in " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 28: Interaction tables and column assignment
+// -----------------------------------------------------------------------------
+void test_column_assignment() {
+    std::cout << "[TEST] test_column_assignment\n";
+
+    // Taguchi tables: L8 (1)x(2) = (3), (3)x(5) = (6); L9 (1)x(2) = (3),(4)
+    InteractionTable t8 = make_interaction_table(OA_L8_2_7());
+    assert(t8.at(0, 1) == std::vector<int>{2});
+    assert(t8.at(0, 3) == std::vector<int>{4});
+    assert(t8.at(1, 3) == std::vector<int>{5});
+    assert(t8.at(2, 4) == std::vector<int>{5});
+    assert(t8.at(2, 3) == std::vector<int>{6});
+    InteractionTable t9 = make_interaction_table(OA_L9_3_4());
+    std::vector<int> i01 = t9.at(0, 1);
+    std::sort(i01.begin(), i01.end());
+    assert((i01 == std::vector<int>{2, 3}));
+
+    // Generated arrays: 2-level XOR structure, 3-level pairs of distinct columns
+    OrthogonalArray l64 = make_two_level_oa(64);
+    InteractionTable t64 = make_interaction_table(l64);
+    for (int a = 0; a < 63; ++a)
+        for (int b = 0; b < 63; ++b)
+            if (a != b) assert(t64.at(a, b) == std::vector<int>{((a + 1) ^ (b + 1)) - 1});
+    OrthogonalArray l81 = make_three_level_oa(81);
+    assert(l81.runs == 81 && l81.factors == 40 && l81.levels == 3);
+    for (int c = 0; c < 40; ++c) {
+        int cnt[3] = {0, 0, 0};
+        for (int r = 0; r < 81; ++r) ++cnt[l81.at(r, c)];
+        assert(cnt[0] == 27 && cnt[1] == 27 && cnt[2] == 27);
+    }
+    InteractionTable t81 = make_interaction_table(l81);
+    for (int a = 0; a < 40; ++a)
+        for (int b = a + 1; b < 40; ++b) {
+            const auto& e = t81.at(a, b);
+            assert(e.size() == 2 && e[0] != e[1]);
+            for (int c : e) assert(c != a && c != b);
+        }
+
+    // L18: the 3-level interactions are spread, so none can be assigned
+    InteractionTable t18 = make_interaction_table(OA_L18_2_1_3_7());
+    assert(t18.levels[0] == 2 && t18.levels[1] == 3);
+    assert(t18.at(1, 2).empty() && t18.at(0, 1).empty());
+
+    // Classic L8 assignment: A, B, C with AxB and AxC
+    std::vector<AssignmentFactor> abc{{"A", 2}, {"B", 2}, {"C", 2}};
+    ColumnAssignment s8 = assign_columns(OA_L8_2_7(), abc, {{0, 1}, {0, 2}});
+    assert(s8.feasible);
+    assert((s8.factor_column == std::vector<int>{0, 1, 3}));
+    assert(s8.interaction_columns[0] == std::vector<int>{2} && s8.interaction_columns[1] == std::vector<int>{4});
+    assert(s8.column_use[2] == "AxB" && s8.column_use[4] == "AxC" && s8.column_use[6].empty());
+    assert(s8.confounding.empty());   // BxC is on the free column 6
+
+    // Four factors on L8 with AxB: CxD has to share a column
+    std::vector<AssignmentFactor> abcd{{"A", 2}, {"B", 2}, {"C", 2}, {"D", 2}};
+    ColumnAssignment s8b = assign_columns(OA_L8_2_7(), abcd, {{0, 1}});
+    assert(s8b.feasible && !s8b.confounding.empty());
+    for (const AliasEntry& e : s8b.confounding) {
+        assert(e.factor >= 0 || e.interaction >= 0);
+        assert(make_interaction_table(OA_L8_2_7()).at(s8b.factor_column[e.factor_a], s8b.factor_column[e.factor_b])[0] == e.column);
+    }
+    // AxB, AxC, AxD, BxC, BxD, CxD need 10 columns: infeasible on L8
+    std::vector<std::pair<int, int>> all4;
+    for (int a = 0; a < 4; ++a) for (int b = a + 1; b < 4; ++b) all4.emplace_back(a, b);
+    ColumnAssignment none = assign_columns(OA_L8_2_7(), abcd, all4);
+    assert(!none.feasible && !none.node_limit_hit);
+
+    // L64: 7 factors with all 21 interactions (resolution V); L81: 5 three-level
+    // factors with all 10 interactions (20 columns)
+    auto check = [](const OrthogonalArray& oa, const std::vector<std::pair<int, int>>& req,
+                    const ColumnAssignment& s) {
+        InteractionTable t = make_interaction_table(oa);
+        std::vector<int> used(oa.factors, 0);
+        for (int c : s.factor_column) ++used[c];
+        for (size_t i = 0; i < req.size(); ++i) {
+            assert(s.interaction_columns[i] == t.at(s.factor_column[req[i].first], s.factor_column[req[i].second]));
+            for (int c : s.interaction_columns[i]) ++used[c];
+        }
+        for (int u : used) assert(u <= 1);
+    };
+    std::vector<AssignmentFactor> seven, five;
+    std::vector<std::pair<int, int>> req7, req5;
+    for (int i = 0; i < 7; ++i) seven.push_back({std::string(1, char('A' + i)), 2});
+    for (int i = 0; i < 5; ++i) five.push_back({std::string(1, char('A' + i)), 3});
+    for (int a = 0; a < 7; ++a) for (int b = a + 1; b < 7; ++b) req7.emplace_back(a, b);
+    for (int a = 0; a < 5; ++a) for (int b = a + 1; b < 5; ++b) req5.emplace_back(a, b);
+
+    auto t0 = std::chrono::steady_clock::now();
+    ColumnAssignment s64 = assign_columns(l64, seven, req7);
+    auto t1 = std::chrono::steady_clock::now();
+    ColumnAssignment s81 = assign_columns(l81, five, req5);
+    auto t2 = std::chrono::steady_clock::now();
+    assert(s64.feasible && s81.feasible);
+    check(l64, req7, s64);
+    check(l81, req5, s81);
+    // L16 saturated by 5 factors + 10 interactions (2^(5-1), I = ABCDE)
+    std::vector<std::pair<int, int>> req16;
+    for (int a = 0; a < 5; ++a) for (int b = a + 1; b < 5; ++b) req16.emplace_back(a, b);
+    OrthogonalArray l16 = make_two_level_oa(16);
+    ColumnAssignment s16 = assign_columns(l16, {seven.begin(), seven.begin() + 5}, req16);
+    assert(s16.feasible);
+    check(l16, req16, s16);
+    ColumnAssignmentOptions one;
+    one.threads = 1;
+    assert(assign_columns(l64, seven, req7, one).factor_column == s64.factor_column);
+
+    const double ms64 = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    const double ms81 = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    assert(ms64 < 1000.0 && ms81 < 1000.0);
+    std::cout << "  L64 7 factors + 21 2FIs: " << ms64 << " ms (" << s64.nodes << " nodes), L81 5 factors + 10 2FIs: "
+              << ms81 << " ms (" << s81.nodes << " nodes)\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 29: Alias matrix and generalized word-length pattern
+// -----------------------------------------------------------------------------
+void test_alias_analysis() {
+    std::cout << "[TEST] test_alias_analysis\n";
+
+    // L8 with A, B, C on columns 1, 2, 3: 2^(3-1), every main effect aliased with a 2FI
+    {
+        AliasAnalysis a = alias_matrix(OA_L8_2_7(), {0, 1, 2}, main_effect_terms(3), interaction_terms(3, 2));
+        assert(a.rank == 4 && a.inestimable.empty());
+        assert(a.alias.rows() == 4 && a.alias.cols() == 3);
+        assert(a.alias.row(0).cwiseAbs().maxCoeff() < 1e-12);
+        for (int i = 1; i <= 3; ++i) {
+            int ones = 0;
+            for (int c = 0; c < 3; ++c) {
+                double v = std::fabs(a.alias(i, c));
+                assert(v < 1e-12 || std::fabs(v - 1.0) < 1e-12);
+                ones += v > 0.5;
+            }
+            assert(ones == 1);
+        }
+        // A with BC, B with AC, C with AB
+        assert(std::fabs(a.alias(1, 2)) > 0.5 && std::fabs(a.alias(3, 0)) > 0.5);
+    }
+
+    // Quadratic model on L8: squared terms are constant, so not estimable
+    {
+        AliasAnalysis a = alias_matrix(OA_L8_2_7(), {0, 1, 3}, quadratic_model_terms(3), interaction_terms(3, 3));
+        assert(a.rank == 7);
+        assert((a.inestimable == std::vector<int>{4, 5, 6}));
+        for (size_t i = 0; i < 3; ++i) {
+            assert(approx_equal(a.dependence(i, 0), 1.0, 1e-12));            // x_i^2 = 1
+            assert(a.dependence.row(i).tail(a.rank - 1).cwiseAbs().maxCoeff() < 1e-12);
+        }
+        std::vector<std::string> d = a.describe({"A", "B", "C"});
+        assert(d.size() == 10 && d[7] == "A^2 = + 1 1 (not estimable)");
+        // Same rank as the fit
+        std::vector<FactorLevels> lv(7, FactorLevels{{-1.0, 1.0}, {}});
+        ResponseSurfaceQuadratic rs;
+        rs.fit(build_design_from_orthogonal_array_for_factors(OA_L8_2_7(), lv, {0, 1, 3}), std::vector<double>(8, 1.0));
+        assert(rs.rank() == a.rank);
+    }
+
+    // L18 quadratic in 3 factors against cubic terms: matches the explicit formula
+    {
+        const OrthogonalArray& oa = OA_L18_2_1_3_7();
+        std::vector<FactorLevels> lv(oa.factors, FactorLevels{{100.0, 150.0, 200.0}, {}});
+        lv[0] = FactorLevels{{0.0, 1.0}, {}};
+        std::vector<ModelTerm> pot = interaction_terms(3, 3);
+        pot.push_back({{{0, 3}}});
+        pot.push_back({{{0, 2}, {1, 1}}});
+        AliasAnalysis a = alias_matrix(oa, {1, 2, 3}, quadratic_model_terms(3), pot, lv);
+        assert(a.rank == 10 && a.inestimable.empty());
+        auto design = build_design_from_orthogonal_array_for_factors(oa, lv, {1, 2, 3});
+        Eigen::MatrixXd X1 = cv_detail::quadratic_feature_matrix(design);
+        Eigen::MatrixXd X2(18, 3);
+        for (int r = 0; r < 18; ++r) {
+            const auto& x = design[r];
+            X2(r, 0) = x[0] * x[1] * x[2];
+            X2(r, 1) = x[0] * x[0] * x[0];
+            X2(r, 2) = x[0] * x[0] * x[1];
+        }
+        Eigen::MatrixXd A = (X1.transpose() * X1).ldlt().solve(X1.transpose() * X2);
+        assert((A - a.alias).cwiseAbs().maxCoeff() < 1e-6 * std::max(1.0, A.cwiseAbs().maxCoeff()));
+    }
+
+    // Word-length patterns
+    {
+        WordLengthPattern w8 = generalized_word_length_pattern(OA_L8_2_7());
+        const double expect8[8] = {1, 0, 0, 7, 7, 0, 0, 1};
+        for (int j = 0; j < 8; ++j) assert(approx_equal(w8.A[j], expect8[j], 1e-12));
+        assert(w8.resolution == 3);
+        WordLengthPattern ff = generalized_word_length_pattern(OA_L8_2_7(), {0, 1, 3});
+        assert(ff.resolution == 4 && ff.A[1] == 0.0 && ff.A[2] == 0.0 && ff.A[3] == 0.0);
+        WordLengthPattern half = generalized_word_length_pattern(OA_L8_2_7(), {0, 1, 3, 6});   // D = ABC
+        assert(half.resolution == 4 && approx_equal(half.A[4], 1.0, 1e-12));
+
+        WordLengthPattern w9 = generalized_word_length_pattern(OA_L9_3_4());
+        assert(w9.resolution == 3 && approx_equal(w9.A[3], 8.0, 1e-12) && std::fabs(w9.A[4]) < 1e-12);
+
+        WordLengthPattern w18 = generalized_word_length_pattern(OA_L18_2_1_3_7());
+        double total = 0.0;
+        for (double v : w18.A) total += v;
+        assert(approx_equal(total, 2.0 * std::pow(3.0, 7) / 18.0, 1e-9));
+        assert(w18.resolution == 3 && std::fabs(w18.A[1]) < 1e-12 && std::fabs(w18.A[2]) < 1e-12);
+
+        // Saturated L81: sum_j A_j = 3^40 / 81 exactly
+        WordLengthPattern w81 = generalized_word_length_pattern(make_three_level_oa(81));
+        total = 0.0;
+        for (double v : w81.A) total += v;
+        assert(approx_equal(total, std::pow(3.0, 36), 1e-12 * std::pow(3.0, 36)) && w81.resolution == 3);
+    }
+
+    // Rank all 6-column subsets of L16: minimum aberration 2^(6-2) has A3 = 0, A4 = 3
+    {
+        OrthogonalArray l16 = make_two_level_oa(16);
+        std::vector<std::vector<int>> sets;
+        std::vector<int> idx{0, 1, 2, 3, 4, 5};
+        for (;;) {
+            sets.push_back(idx);
+            int p = 5;
+            while (p >= 0 && idx[p] == 15 - 6 + p) --p;
+            if (p < 0) break;
+            ++idx[p];
+            for (int q = p + 1; q < 6; ++q) idx[q] = idx[q - 1] + 1;
+        }
+        assert(sets.size() == 5005);
+        std::vector<WordLengthPattern> wlp;
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<int> order = rank_by_aberration(l16, sets, 0, &wlp);
+        auto t1 = std::chrono::steady_clock::now();
+        const WordLengthPattern& best = wlp[order[0]];
+        assert(best.resolution == 4 && approx_equal(best.A[4], 3.0, 1e-12));
+        for (size_t i = 1; i < order.size(); ++i) assert(compare_aberration(wlp[order[i - 1]], wlp[order[i]]) <= 0);
+        std::cout << "  ranked 5005 L16 column sets in "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Test 30: ANOM power and run-count planning
+// -----------------------------------------------------------------------------
+void test_power_planning() {
+    std::cout << "[TEST] test_power_planning\n";
+
+    // Noncentral t: central case and large-df normal limit
+    for (double df : {3.0, 10.0, 40.0}) {
+        double t = stat_util::student_t_quantile(0.975, df);
+        assert(approx_equal(stat_util::noncentral_t_cdf(t, df, 0.0), 0.975, 1e-6));
+        assert(approx_equal(stat_util::noncentral_t_cdf(-t, df, 0.0), 0.025, 1e-6));
+    }
+    for (double d : {-1.0, 0.5, 2.0, 4.0})
+        assert(approx_equal(stat_util::noncentral_t_cdf(1.3, 1e7, d), stat_util::normal_cdf(1.3 - d), 1e-5));
+    // P(T <= 2; 5, 1) by numerical integration over the chi-square mixing density
+    {
+        const double df = 5.0, t = 2.0, d = 1.0;
+        double sum = 0.0;
+        const int steps = 20000;
+        for (int i = 0; i < steps; ++i) {
+            double u = (i + 0.5) * 40.0 / steps;   // chi-square(5) value
+            double dens = std::exp((df / 2 - 1) * std::log(u) - u / 2 - (df / 2) * std::log(2.0) - std::lgamma(df / 2));
+            sum += dens * stat_util::normal_cdf(t * std::sqrt(u / df) - d) * 40.0 / steps;
+        }
+        assert(approx_equal(stat_util::noncentral_t_cdf(t, df, d), sum, 1e-6));
+    }
+
+    // Analytical power agrees with Monte Carlo over the actual array
+    PowerScenario sc;
+    sc.factor = 0;
+    sc.shifted_level = 1;
+    sc.effect = 2.0;
+    sc.sigma = 1.0;
+    sc.replicates = 2;
+    PowerOptions mc;
+    mc.method = PowerMethod::MonteCarlo;
+    mc.simulations = 40000;
+    for (const OrthogonalArray* oa : {&OA_L8_2_7(), &OA_L9_3_4()}) {
+        PowerResult an = anom_power(*oa, sc);
+        PowerResult sim = anom_power(*oa, sc, mc);
+        assert(an.df == sim.df && an.df == oa->runs * 2 - (oa == &OA_L8_2_7() ? 2 : 3));
+        assert(std::fabs(an.power - sim.power) < 4.0 * sim.std_error + 1e-3);
+        assert(sim.power_any >= sim.power);
+    }
+    // Monte Carlo does not depend on the thread count
+    PowerOptions mc1 = mc;
+    mc1.threads = 1;
+    mc1.simulations = 5000;
+    PowerOptions mc4 = mc1;
+    mc4.threads = 4;
+    assert(anom_power(OA_L8_2_7(), sc, mc1).power == anom_power(OA_L8_2_7(), sc, mc4).power);
+
+    // Power grows with effect size and replicates; zero effect gives about alpha / a
+    sc.replicates = 1;
+    double prev = 0.0;
+    for (double e : {0.5, 1.0, 2.0, 4.0}) {
+        sc.effect = e;
+        double p = anom_power(OA_L8_2_7(), sc).power;
+        assert(p > prev);
+        prev = p;
+    }
+    sc.effect = 0.0;
+    double p0 = anom_power(OA_L8_2_7(), sc).power;
+    assert(p0 > 0.0 && p0 < 0.05);
+
+    // Plan: shift of 1 sigma with 90% power; L8 needs replicates, L16 fewer per run
+    sc.effect = 1.0;
+    OrthogonalArray l16 = make_two_level_oa(16);
+    std::vector<PowerPlanCandidate> cands{{"L4", &OA_L4_2_3(), 0, 1.0},
+                                          {"L8", &OA_L8_2_7(), 0, 1.0},
+                                          {"L16", &l16, 0, 1.0}};
+    auto t0 = std::chrono::steady_clock::now();
+    PowerPlan plan = plan_for_power(cands, sc, 0.9, 30);
+    auto t1 = std::chrono::steady_clock::now();
+    assert(plan.found && plan.evaluated.size() == 3);
+    for (const PowerPlanEntry& e : plan.evaluated) {
+        assert(e.replicates > 0 && e.power >= 0.9);
+        PowerScenario s = sc;
+        s.factor = cands[e.candidate].factor;
+        if (e.replicates > 1) {
+            s.replicates = e.replicates - 1;
+            assert(anom_power(*cands[e.candidate].oa, s).power < 0.9);
+        }
+        assert(plan.best.cost <= e.cost);
+    }
+    std::cout << "  1-sigma shift, 90% power: " << cands[plan.best.candidate].name << " x" << plan.best.replicates
+              << " (" << plan.best.cost << " runs, power " << plan.best.power << ") in "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+}
+
+// -----------------------------------------------------------------------------
+// Test 31: adaptive sequential design on a simulated process
+// -----------------------------------------------------------------------------
+void test_adaptive_design() {
+    std::cout << "[TEST] test_adaptive_design\n";
+
+    // Simulated process: quadratic yield with its optimum at an interior grid point
+    std::vector<FactorLevels> levels(3);
+    levels[0].levels = {100.0, 125.0, 150.0, 175.0, 200.0};   // temperature
+    levels[1].levels = {1.0, 2.0, 3.0, 4.0, 5.0};             // time
+    levels[2].levels = {-2.0, -1.0, 0.0, 1.0, 2.0};           // additive
+    auto truth = [](const std::vector<double>& x) {
+        double t = (x[0] - 175.0) / 50.0, h = x[1] - 2.0, a = x[2] - 1.0;
+        return 90.0 - 12.0 * t * t - 1.5 * h * h - 2.0 * a * a + 0.8 * t * h;
+    };
+    CandidateSet cs = build_candidate_grid(levels);
+    int best_c = 0;
+    for (int c = 1; c < cs.size(); ++c)
+        if (truth(cs.points[c]) > truth(cs.points[best_c])) best_c = c;
+    const double optimum = truth(cs.points[best_c]);
+
+    std::mt19937 gen(31);
+    std::normal_distribution<double> noise(0.0, 0.2);
+    auto run = [&](int c) { return truth(cs.points[c]) + noise(gen); };
+
+    // Start from a 10-run D-optimal design, then follow expected improvement
+    AdaptiveDesign ad(cs);
+    assert(ad.num_terms() == 10);
+    DOptimalOptions dopt;
+    dopt.runs = 10;
+    dopt.seed = 5;
+    for (int c : build_d_optimal_design(cs, dopt).candidate_index) ad.add_result(c, run(c));
+    while (ad.runs() < 27 && truth(cs.points[ad.history()[ad.best_run()]]) < optimum - 0.5) {
+        int c = ad.propose();
+        assert(c >= 0);
+        ad.add_result(c, run(c));
+    }
+    const int used = ad.runs();
+    assert(used <= 16);   // a full L27 would need 27 runs
+    int pred_best = 0;
+    for (int c = 1; c < cs.size(); ++c)
+        if (ad.predict(c) > ad.predict(pred_best)) pred_best = c;
+    assert(truth(cs.points[pred_best]) > optimum - 0.5);
+
+    // Incremental Givens fit matches a full QR refit of the same runs
+    ResponseSurfaceQuadratic rs;
+    assert(ad.surface(rs) && rs.rank() == 10);
+    for (int c = 0; c < cs.size(); ++c)
+        assert(approx_equal(ad.predict(c), rs.predict(cs.points[c]), 1e-4));
+    assert(ad.sigma2() > 0.0 && ad.prediction_sd(ad.history()[0]) < std::sqrt(ad.sigma2()));
+
+    // Batch proposals: distinct new candidates, independent of the thread count
+    AdaptiveOptions o1;
+    o1.threads = 1;
+    AdaptiveOptions o4 = o1;
+    o4.threads = 4;
+    AdaptiveDesign a1(cs, o1), a4(cs, o4);
+    for (int i = 0; i < 10; ++i) {
+        int c = ad.history()[i];
+        double y = ad.responses()[i];
+        a1.add_result(c, y);
+        a4.add_result(c, y);
+    }
+    std::vector<int> batch = a1.propose_batch(4);
+    assert(batch == a4.propose_batch(4));
+    std::vector<int> sorted = batch;
+    std::sort(sorted.begin(), sorted.end());
+    assert(std::unique(sorted.begin(), sorted.end()) == sorted.end() && sorted.front() >= 0);
+    for (int c : batch)
+        assert(std::find(ad.history().begin(), ad.history().begin() + 10, c) == ad.history().begin() + 10);
+
+    // Variance criteria build a model-supporting design from nothing
+    for (AcquisitionKind kind : {AcquisitionKind::DOptimal, AcquisitionKind::PredictionVariance}) {
+        AdaptiveOptions ov;
+        ov.acquisition = kind;
+        AdaptiveDesign av(cs, ov);
+        for (int c : av.propose_batch(10)) av.add_result(c, run(c));
+        ResponseSurfaceQuadratic rv;
+        assert(av.surface(rv) && rv.rank() == 10);
+    }
+
+    // Scoring cost on a 5^6 grid (m = 28)
+    std::vector<FactorLevels> big(6, FactorLevels{{-2.0, -1.0, 0.0, 1.0, 2.0}, {}});
+    AdaptiveDesign ab(build_candidate_grid(big));
+    for (int c : ab.propose_batch(30)) ab.add_result(c, 1.0 + 0.01 * c);
+    auto t0 = std::chrono::steady_clock::now();
+    int next = ab.propose();
+    auto t1 = std::chrono::steady_clock::now();
+    assert(next >= 0);
+    std::cout << "  optimum within 0.5 after " << used << " runs (L27: 27); "
+              << "EI over 15625 candidates in "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms\n";
+}
+
 // -----------------------------------------------------------------------------
 // Main: run all tests
 // -----------------------------------------------------------------------------
@@ -693,6 +3159,31 @@ int main() {
         test_build_anom_for_factor();
         test_response_surface_quadratic_fit();
         test_doe_full_analysis();
+        test_d_optimal_design();
+        test_space_filling_samplers();
+        test_polynomial_response_surface();
+        test_term_selection();
+        test_cross_validation();
+        test_trace();
+        test_robust_fitting();
+        test_missing_runs();
+        test_anom_batch();
+        test_result_cache();
+        test_analysis_service();
+        test_async_api();
+        test_rs_sensitivity();
+        test_tolerance_simulation();
+        test_crossed_array();
+        test_effect_screening();
+        test_orthogonal_rs_fit();
+        test_lsqr_fit();
+        test_penalized_fit();
+        test_mixed_factors();
+        test_rsm_designs();
+        test_column_assignment();
+        test_alias_analysis();
+        test_power_planning();
+        test_adaptive_design();
 
         std::cout << "\nAll tests finished without assertion failures.\n";
     }
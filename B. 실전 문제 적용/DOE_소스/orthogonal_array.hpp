@@ -3,6 +3,10 @@
 #include <stdexcept>
 #include <algorithm>
 #include <string>
+#include <bit>
+#include <cstdint>
+
+#include "doe_trace.hpp"
 
 // Basic orthogonal array structure
 struct OrthogonalArray
@@ -22,6 +26,50 @@ struct OrthogonalArray
 struct FactorLevels
 {
     std::vector<double> levels;   // e.g., 2-level: {low, high}, 3-level: {low, mid, high}
+    std::vector<std::string> categories;   // non-empty: categorical factor (supplier, lot, ...)
+
+    bool categorical() const { return !categories.empty(); }
+};
+
+// Contiguous numeric design matrix (same row-major layout as OrthogonalArray::data)
+struct DesignMatrix
+{
+    int runs    = 0;              // number of rows
+    int factors = 0;              // number of columns
+    std::vector<double> data;     // row-major: data[run * factors + factor]
+
+    DesignMatrix() = default;
+    DesignMatrix(int r, int k) : runs(r), factors(k), data(static_cast<size_t>(r) * k, 0.0) {}
+
+    double  at(int run, int factor) const { return data[static_cast<size_t>(run) * factors + factor]; }
+    double& at(int run, int factor)       { return data[static_cast<size_t>(run) * factors + factor]; }
+
+    const double* row(int run) const { return data.data() + static_cast<size_t>(run) * factors; }
+    double*       row(int run)       { return data.data() + static_cast<size_t>(run) * factors; }
+
+    // Nested-vector copy for APIs that take design[run][factor]
+    std::vector<std::vector<double>> to_rows() const
+    {
+        std::vector<std::vector<double>> out(runs);
+        for (int r = 0; r < runs; ++r)
+            out[r].assign(row(r), row(r) + factors);
+        return out;
+    }
+};
+
+// Mixed design: continuous factors as numeric columns, categorical factors as
+// compact category-index columns (no numeric stand-in levels)
+struct MixedDesign
+{
+    DesignMatrix continuous;                 // runs x kc
+    int categorical_factors = 0;             // kq
+    std::vector<std::uint16_t> codes;        // row-major: codes[run * kq + q] = category index
+    std::vector<int> num_categories;         // [q]
+    std::vector<int> continuous_source;      // OA factor of continuous column i
+    std::vector<int> categorical_source;     // OA factor of categorical column q
+
+    int runs() const { return continuous.runs; }
+    const std::uint16_t* code_row(int run) const { return codes.data() + static_cast<size_t>(run) * categorical_factors; }
 };
 
 // -----------------------------------------------------------------------------
@@ -132,6 +180,67 @@ inline const OrthogonalArray& OA_L18_2_1_3_7()
     return oa;
 }
 
+// -----------------------------------------------------------------------------
+// Saturated 2-level array L_N(2^(N-1)) for N a power of two (L4 ... L256 ...)
+// Columns in Yates order: column c - 1 is the parity of (run & c), so every
+// column is a Walsh function of the run index and the fast Walsh-Hadamard
+// transform gives all column contrasts at once (doe_effect_screening.hpp).
+// -----------------------------------------------------------------------------
+inline OrthogonalArray make_two_level_oa(int runs)
+{
+    if (runs < 4 || (runs & (runs - 1)) != 0)
+        throw std::runtime_error("make_two_level_oa: runs must be a power of two >= 4");
+    OrthogonalArray o;
+    o.runs    = runs;
+    o.factors = runs - 1;
+    o.levels  = 2;
+    o.data.resize(static_cast<size_t>(runs) * o.factors);
+    for (int r = 0; r < runs; ++r)
+        for (int c = 1; c < runs; ++c)
+            o.data[static_cast<size_t>(r) * o.factors + (c - 1)] = std::popcount(static_cast<unsigned>(r & c)) & 1;
+    return o;
+}
+
+// -----------------------------------------------------------------------------
+// Saturated 3-level array L_N(3^((N-1)/2)) for N = 3^p (L9, L27, L81, L243 ...)
+// Run r has base-3 digits x_0 .. x_{p-1}. Each column is a GF(3) vector v whose
+// highest nonzero digit is 1 (one per projective point), and its level is
+// sum_t v_t x_t mod 3. Columns are in increasing order of v.
+// -----------------------------------------------------------------------------
+inline OrthogonalArray make_three_level_oa(int runs)
+{
+    int p = 0;
+    for (int n = runs; n > 1 && n % 3 == 0; n /= 3) ++p;
+    int pow3 = 1;
+    for (int t = 0; t < p; ++t) pow3 *= 3;
+    if (p < 2 || pow3 != runs || runs > 59049)
+        throw std::runtime_error("make_three_level_oa: runs must be 3^p with 2 <= p <= 10");
+
+    std::vector<std::vector<int>> cols;            // digit vectors v
+    for (int v = 1; v < runs; ++v) {
+        std::vector<int> d(p);
+        int lead = 0;
+        for (int t = 0, n = v; t < p; ++t, n /= 3)
+            if ((d[t] = n % 3) != 0) lead = d[t];
+        if (lead == 1) cols.push_back(d);
+    }
+    OrthogonalArray o;
+    o.runs    = runs;
+    o.factors = static_cast<int>(cols.size());
+    o.levels  = 3;
+    o.data.resize(static_cast<size_t>(runs) * o.factors);
+    std::vector<int> x(p);
+    for (int r = 0; r < runs; ++r) {
+        for (int t = 0, n = r; t < p; ++t, n /= 3) x[t] = n % 3;
+        for (int c = 0; c < o.factors; ++c) {
+            int s = 0;
+            for (int t = 0; t < p; ++t) s += cols[c][t] * x[t];
+            o.data[static_cast<size_t>(r) * o.factors + c] = s % 3;
+        }
+    }
+    return o;
+}
+
 // -----------------------------------------------------------------------------
 // Build full design matrix using all factors
 // design[run][factor] = numeric level value
@@ -141,6 +250,7 @@ build_design_from_orthogonal_array(
     const OrthogonalArray& oa,
     const std::vector<FactorLevels>& factors)
 {
+    DOE_TRACE_SCOPE("build_design_from_orthogonal_array");
     if ((int)factors.size() < oa.factors)
         throw std::runtime_error("build_design_from_orthogonal_array: not enough FactorLevels");
 
@@ -156,6 +266,7 @@ build_design_from_orthogonal_array(
         }
     }
 
+    DOE_TRACE_COUNT("rows_scanned", oa.runs);
     return design;
 }
 
@@ -169,6 +280,7 @@ build_design_from_orthogonal_array_for_factors(
     const std::vector<FactorLevels>& all_levels,
     const std::vector<int>& factor_indices)
 {
+    DOE_TRACE_SCOPE("build_design_from_orthogonal_array_for_factors");
     if (factor_indices.empty())
         throw std::runtime_error("build_design_from_orthogonal_array_for_factors: no factor_indices");
 
@@ -193,5 +305,63 @@ build_design_from_orthogonal_array_for_factors(
         }
     }
 
+    DOE_TRACE_COUNT("rows_scanned", runs);
     return design;
 }
+
+// -----------------------------------------------------------------------------
+// Build a mixed design for specific factor indices. Factors whose FactorLevels
+// has categories become category-index columns; the others numeric columns.
+// Column order within each part follows factor_indices.
+// -----------------------------------------------------------------------------
+inline MixedDesign
+build_mixed_design_from_orthogonal_array(
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices)
+{
+    DOE_TRACE_SCOPE("build_mixed_design_from_orthogonal_array");
+    if (factor_indices.empty())
+        throw std::runtime_error("build_mixed_design_from_orthogonal_array: no factor_indices");
+
+    MixedDesign d;
+    for (int f : factor_indices) {
+        if (f < 0 || f >= oa.factors)
+            throw std::runtime_error("build_mixed_design_from_orthogonal_array: factor index out of OA range");
+        if (f >= (int)all_levels.size())
+            throw std::runtime_error("build_mixed_design_from_orthogonal_array: factor index out of level size");
+        if (all_levels[f].categorical()) {
+            if (all_levels[f].categories.size() > 65535)
+                throw std::runtime_error("build_mixed_design_from_orthogonal_array: too many categories");
+            d.categorical_source.push_back(f);
+            d.num_categories.push_back(static_cast<int>(all_levels[f].categories.size()));
+        } else {
+            d.continuous_source.push_back(f);
+        }
+    }
+    const int kc = static_cast<int>(d.continuous_source.size());
+    const int kq = static_cast<int>(d.categorical_source.size());
+    d.continuous = DesignMatrix(oa.runs, kc);
+    d.categorical_factors = kq;
+    d.codes.resize(static_cast<size_t>(oa.runs) * kq);
+
+    for (int r = 0; r < oa.runs; ++r) {
+        for (int i = 0; i < kc; ++i) {
+            int f = d.continuous_source[i];
+            int level_id = oa.at(r, f);
+            const auto& fl = all_levels[f];
+            if (level_id < 0 || level_id >= (int)fl.levels.size())
+                throw std::runtime_error("build_mixed_design_from_orthogonal_array: level index out of range");
+            d.continuous.at(r, i) = fl.levels[level_id];
+        }
+        for (int q = 0; q < kq; ++q) {
+            int level_id = oa.at(r, d.categorical_source[q]);
+            if (level_id < 0 || level_id >= d.num_categories[q])
+                throw std::runtime_error("build_mixed_design_from_orthogonal_array: category index out of range");
+            d.codes[static_cast<size_t>(r) * kq + q] = static_cast<std::uint16_t>(level_id);
+        }
+    }
+
+    DOE_TRACE_COUNT("rows_scanned", oa.runs);
+    return d;
+}
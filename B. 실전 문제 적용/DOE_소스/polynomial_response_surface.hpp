@@ -0,0 +1,527 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "doe_run_mask.hpp"
+
+// -----------------------------------------------------------------------------
+// Polynomial response surface with an arbitrary term set
+// A term is an exponent tuple (e_0, ..., e_{k-1}): phi = prod_f x_f^e_f.
+// Examples (k = 2): (0,0) -> 1, (1,0) -> x0, (2,0) -> x0^2, (1,1) -> x0*x1
+// -----------------------------------------------------------------------------
+
+namespace poly_detail {
+
+// Next composition of a fixed total degree in descending lexicographic order:
+// (d,0,..,0) -> ... -> (0,..,0,d). Returns false after the last one.
+constexpr bool next_composition(int* e, int k)
+{
+    if (k <= 1) return false;
+    int tail = e[k - 1];
+    e[k - 1] = 0;
+    int i = k - 2;
+    while (i >= 0 && e[i] == 0) --i;
+    if (i < 0) {
+        e[k - 1] = tail;
+        return false;
+    }
+    e[i] -= 1;
+    e[i + 1] = tail + 1;
+    return true;
+}
+
+constexpr int binomial(int n, int r)
+{
+    if (r < 0 || r > n) return 0;
+    long long v = 1;
+    for (int i = 1; i <= r; ++i)
+        v = v * (n - r + i) / i;
+    return static_cast<int>(v);
+}
+
+} // namespace poly_detail
+
+struct PolynomialTermSet {
+    int factors = 0;
+    std::vector<int> exponents;   // row-major: exponents[term * factors + factor]
+
+    int size() const { return factors == 0 ? 0 : static_cast<int>(exponents.size()) / factors; }
+    int exponent(int term, int factor) const { return exponents[static_cast<size_t>(term) * factors + factor]; }
+
+    int degree(int term) const {
+        int d = 0;
+        for (int f = 0; f < factors; ++f) d += exponent(term, f);
+        return d;
+    }
+
+    int max_exponent() const {
+        int d = 0;
+        for (int e : exponents) d = std::max(d, e);
+        return d;
+    }
+
+    // Index of an exponent tuple, or -1 if absent
+    int find(const int* e) const {
+        for (int t = 0; t < size(); ++t) {
+            if (std::equal(e, e + factors, exponents.begin() + static_cast<std::ptrdiff_t>(t) * factors))
+                return t;
+        }
+        return -1;
+    }
+
+    // Append a term; duplicates are ignored
+    void add_term(const std::vector<int>& e) {
+        if ((int)e.size() != factors)
+            throw std::runtime_error("PolynomialTermSet::add_term: dimension mismatch");
+        for (int v : e) {
+            if (v < 0)
+                throw std::runtime_error("PolynomialTermSet::add_term: negative exponent");
+        }
+        if (find(e.data()) >= 0) return;
+        exponents.insert(exponents.end(), e.begin(), e.end());
+    }
+
+    // "1", "x0", "x1^2", "x0*x2"
+    std::string label(int term) const {
+        std::string s;
+        for (int f = 0; f < factors; ++f) {
+            int e = exponent(term, f);
+            if (e == 0) continue;
+            if (!s.empty()) s += "*";
+            s += "x" + std::to_string(f);
+            if (e > 1) s += "^" + std::to_string(e);
+        }
+        return s.empty() ? "1" : s;
+    }
+};
+
+// Same order as ResponseSurfaceQuadratic: 1, x_i, x_i^2, x_i x_j (i<j)
+inline PolynomialTermSet make_quadratic_terms(int k)
+{
+    PolynomialTermSet ts;
+    ts.factors = k;
+    std::vector<int> e(k, 0);
+    ts.add_term(e);
+    for (int i = 0; i < k; ++i) { e.assign(k, 0); e[i] = 1; ts.add_term(e); }
+    for (int i = 0; i < k; ++i) { e.assign(k, 0); e[i] = 2; ts.add_term(e); }
+    for (int i = 0; i < k; ++i) {
+        for (int j = i + 1; j < k; ++j) {
+            e.assign(k, 0); e[i] = 1; e[j] = 1;
+            ts.add_term(e);
+        }
+    }
+    return ts;
+}
+
+// All monomials of total degree <= degree, graded (descending lex within a degree)
+inline PolynomialTermSet make_total_degree_terms(int k, int degree)
+{
+    if (k <= 0 || degree < 0)
+        throw std::runtime_error("make_total_degree_terms: invalid k/degree");
+    PolynomialTermSet ts;
+    ts.factors = k;
+    std::vector<int> e(k);
+    for (int d = 0; d <= degree; ++d) {
+        std::fill(e.begin(), e.end(), 0);
+        e[0] = d;
+        do {
+            ts.exponents.insert(ts.exponents.end(), e.begin(), e.end());
+        } while (poly_detail::next_composition(e.data(), k));
+    }
+    return ts;
+}
+
+// Constant + main effects + the listed two-factor interactions only
+inline PolynomialTermSet make_linear_with_interactions(
+    int k,
+    const std::vector<std::pair<int,int>>& interactions)
+{
+    PolynomialTermSet ts;
+    ts.factors = k;
+    std::vector<int> e(k, 0);
+    ts.add_term(e);
+    for (int i = 0; i < k; ++i) { e.assign(k, 0); e[i] = 1; ts.add_term(e); }
+    for (const auto& ij : interactions) {
+        if (ij.first < 0 || ij.first >= k || ij.second < 0 || ij.second >= k || ij.first == ij.second)
+            throw std::runtime_error("make_linear_with_interactions: invalid factor pair");
+        e.assign(k, 0); e[ij.first] = 1; e[ij.second] = 1;
+        ts.add_term(e);
+    }
+    return ts;
+}
+
+// Hierarchical (well-formulated) model: every divisor of every term is added.
+// e.g. {x0^2*x1} -> {1, x0, x1, x0^2, x0*x1, x0^2*x1}
+inline PolynomialTermSet hierarchical_closure(const PolynomialTermSet& terms)
+{
+    const int k = terms.factors;
+    PolynomialTermSet all = make_total_degree_terms(k, 0);
+    for (int t = 0; t < terms.size(); ++t) {
+        std::vector<int> top(terms.exponents.begin() + static_cast<std::ptrdiff_t>(t) * k,
+                             terms.exponents.begin() + static_cast<std::ptrdiff_t>(t + 1) * k);
+        // enumerate all tuples 0 <= e <= top
+        std::vector<int> e(k, 0);
+        for (;;) {
+            all.add_term(e);
+            int f = 0;
+            while (f < k && ++e[f] > top[f]) { e[f] = 0; ++f; }
+            if (f == k) break;
+        }
+    }
+
+    // graded order: sort by degree, then descending lex (stable w.r.t. make_total_degree_terms)
+    std::vector<int> order(all.size());
+    for (int t = 0; t < all.size(); ++t) order[t] = t;
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        int da = all.degree(a), db = all.degree(b);
+        if (da != db) return da < db;
+        for (int f = 0; f < k; ++f) {
+            if (all.exponent(a, f) != all.exponent(b, f))
+                return all.exponent(a, f) > all.exponent(b, f);
+        }
+        return false;
+    });
+    PolynomialTermSet out;
+    out.factors = k;
+    for (int t : order) {
+        out.exponents.insert(out.exponents.end(),
+                             all.exponents.begin() + static_cast<std::ptrdiff_t>(t) * k,
+                             all.exponents.begin() + static_cast<std::ptrdiff_t>(t + 1) * k);
+    }
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// Runtime term layout: feature expansion from a precomputed (factor, power) list.
+// Per row the powers x_f^p are tabulated once, then each term is a short product.
+// -----------------------------------------------------------------------------
+class PolynomialExpansion {
+public:
+    PolynomialExpansion() = default;
+
+    explicit PolynomialExpansion(const PolynomialTermSet& terms)
+        : k_(terms.factors), m_(terms.size()), max_pow_(terms.max_exponent())
+    {
+        offsets_.reserve(m_ + 1);
+        offsets_.push_back(0);
+        for (int t = 0; t < m_; ++t) {
+            for (int f = 0; f < k_; ++f) {
+                int e = terms.exponent(t, f);
+                if (e > 0) {
+                    factor_.push_back(f);
+                    power_.push_back(e);
+                }
+            }
+            offsets_.push_back(static_cast<int>(factor_.size()));
+        }
+    }
+
+    int num_factors() const { return k_; }
+    int num_terms()   const { return m_; }
+
+    // Size of the per-thread power table passed to expand()
+    int scratch_size() const { return k_ * (max_pow_ + 1); }
+
+    // phi[0..m) for one point x[0..k); scratch holds scratch_size() doubles
+    void expand(const double* x, double* phi, double* scratch) const {
+        const int P = max_pow_ + 1;
+        for (int f = 0; f < k_; ++f) {
+            double* pf = scratch + static_cast<size_t>(f) * P;
+            pf[0] = 1.0;
+            for (int p = 1; p < P; ++p) pf[p] = pf[p - 1] * x[f];
+        }
+        for (int t = 0; t < m_; ++t) {
+            double v = 1.0;
+            for (int q = offsets_[t]; q < offsets_[t + 1]; ++q)
+                v *= scratch[static_cast<size_t>(factor_[q]) * P + power_[q]];
+            phi[t] = v;
+        }
+    }
+
+private:
+    int k_ = 0;
+    int m_ = 0;
+    int max_pow_ = 0;
+    std::vector<int> offsets_;   // term t uses entries [offsets_[t], offsets_[t+1])
+    std::vector<int> factor_;
+    std::vector<int> power_;
+};
+
+// Feature matrix Phi (runs x terms) of a design
+inline Eigen::MatrixXd polynomial_feature_matrix(const PolynomialTermSet& terms, const DesignMatrix& X)
+{
+    if (X.factors != terms.factors)
+        throw std::runtime_error("polynomial_feature_matrix: dimension mismatch");
+    PolynomialExpansion ex(terms);
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Phi(X.runs, terms.size());
+    std::vector<double> scratch(ex.scratch_size());
+    for (int r = 0; r < X.runs; ++r)
+        ex.expand(X.row(r), Phi.row(r).data(), scratch.data());
+    return Phi;
+}
+
+// -----------------------------------------------------------------------------
+// PolynomialResponseSurface: same QR fit as ResponseSurfaceQuadratic, any term set
+// -----------------------------------------------------------------------------
+class PolynomialResponseSurface {
+public:
+    PolynomialResponseSurface() = default;
+    explicit PolynomialResponseSurface(PolynomialTermSet terms)
+        : terms_(std::move(terms)), expansion_(terms_) {}
+
+    // Runs with a NaN response or cleared in `mask` are skipped
+    bool fit(const DesignMatrix& design, const std::vector<double>& y, const RunMask& mask = RunMask{})
+    {
+        int N = design.runs;
+        if (N == 0 || (int)y.size() != N) return false;
+        if (design.factors != terms_.factors) return false;
+
+        RunMask active = effective_run_mask(y, mask);
+        const int used = active.empty() ? N : active.count();
+        if (used == 0) return false;
+
+        const int m = terms_.size();
+        Eigen::MatrixXd Phi(used, m);
+        Eigen::VectorXd Y(used);
+        Eigen::VectorXd phi(m);
+        std::vector<double> scratch(expansion_.scratch_size());
+        int q = 0;
+        auto add_row = [&](int r) {
+            expansion_.expand(design.row(r), phi.data(), scratch.data());
+            Phi.row(q) = phi.transpose();
+            Y(q) = y[r];
+            ++q;
+        };
+        if (active.empty()) {
+            for (int r = 0; r < N; ++r) add_row(r);
+        } else {
+            active.for_each(add_row);
+        }
+
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
+        rank_  = static_cast<int>(qr.rank());
+        beta_  = qr.solve(Y);
+        fitted_ = true;
+        return true;
+    }
+
+    bool fit(const std::vector<std::vector<double>>& design, const std::vector<double>& y,
+             const RunMask& mask = RunMask{})
+    {
+        if (design.empty()) return false;
+        DesignMatrix X(static_cast<int>(design.size()), static_cast<int>(design[0].size()));
+        for (int r = 0; r < X.runs; ++r) {
+            if ((int)design[r].size() != X.factors) return false;
+            std::copy(design[r].begin(), design[r].end(), X.row(r));
+        }
+        return fit(X, y, mask);
+    }
+
+    double predict(const std::vector<double>& x) const
+    {
+        ensure_fitted("predict");
+        if ((int)x.size() != terms_.factors)
+            throw std::runtime_error("PolynomialResponseSurface::predict: dimension mismatch");
+        double out = 0.0;
+        predict_rows(x.data(), 1, &out);
+        return out;
+    }
+
+    // Batched prediction over a row-major block, tiled so the feature tile stays in cache
+    void predict_batch(const DesignMatrix& X, std::vector<double>& out) const
+    {
+        ensure_fitted("predict_batch");
+        if (X.factors != terms_.factors)
+            throw std::runtime_error("PolynomialResponseSurface::predict_batch: dimension mismatch");
+        out.resize(X.runs);
+        predict_rows(X.data.data(), X.runs, out.data());
+    }
+
+    const PolynomialTermSet& terms() const { return terms_; }
+    const Eigen::VectorXd& coefficients() const { return beta_; }
+    int num_factors() const { return terms_.factors; }
+    int rank() const { return rank_; }
+
+private:
+    void ensure_fitted(const char* what) const {
+        if (!fitted_)
+            throw std::runtime_error(std::string("PolynomialResponseSurface::") + what + ": model not fitted yet");
+    }
+
+    void predict_rows(const double* x, int rows, double* out) const
+    {
+        constexpr int tile = 256;
+        const int m = terms_.size();
+        const int k = terms_.factors;
+        std::vector<double> scratch(expansion_.scratch_size());
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> T(std::min(rows, tile), m);
+        for (int r0 = 0; r0 < rows; r0 += tile) {
+            int n = std::min(tile, rows - r0);
+            for (int i = 0; i < n; ++i)
+                expansion_.expand(x + static_cast<size_t>(r0 + i) * k, T.row(i).data(), scratch.data());
+            Eigen::Map<Eigen::VectorXd>(out + r0, n).noalias() = T.topRows(n) * beta_;
+        }
+    }
+
+    PolynomialTermSet terms_;
+    PolynomialExpansion expansion_;
+    Eigen::VectorXd beta_;
+    int rank_ = 0;
+    bool fitted_ = false;
+};
+
+// -----------------------------------------------------------------------------
+// Compile-time term layouts
+// A layout type provides:
+//   static constexpr int factors, num_terms, max_exponent;
+//   static constexpr std::array<std::array<int, factors>, num_terms> exponents;
+// FixedPolynomialExpansion<Layout>::expand unrolls into straight-line products.
+// -----------------------------------------------------------------------------
+
+// Full quadratic, same term order as ResponseSurfaceQuadratic
+template <int K>
+struct QuadraticLayout {
+    static constexpr int factors = K;
+    static constexpr int num_terms = 1 + 2 * K + K * (K - 1) / 2;
+    static constexpr int max_exponent = 2;
+
+    static constexpr std::array<std::array<int, K>, num_terms> make() {
+        std::array<std::array<int, K>, num_terms> e{};
+        int t = 1;
+        for (int i = 0; i < K; ++i) e[t++][i] = 1;
+        for (int i = 0; i < K; ++i) e[t++][i] = 2;
+        for (int i = 0; i < K; ++i)
+            for (int j = i + 1; j < K; ++j) { e[t][i] = 1; e[t][j] = 1; ++t; }
+        return e;
+    }
+    static constexpr std::array<std::array<int, K>, num_terms> exponents = make();
+};
+
+// All monomials of total degree <= D (same order as make_total_degree_terms)
+template <int K, int D>
+struct TotalDegreeLayout {
+    static constexpr int factors = K;
+    static constexpr int num_terms = poly_detail::binomial(K + D, D);
+    static constexpr int max_exponent = D;
+
+    static constexpr std::array<std::array<int, K>, num_terms> make() {
+        std::array<std::array<int, K>, num_terms> e{};
+        int t = 0;
+        for (int d = 0; d <= D; ++d) {
+            std::array<int, K> c{};
+            c[0] = d;
+            do {
+                e[t++] = c;
+            } while (poly_detail::next_composition(c.data(), K));
+        }
+        return e;
+    }
+    static constexpr std::array<std::array<int, K>, num_terms> exponents = make();
+};
+
+// Runtime view of a compile-time layout (labels, term lookup, model selection)
+template <class Layout>
+inline PolynomialTermSet make_terms_from_layout()
+{
+    PolynomialTermSet ts;
+    ts.factors = Layout::factors;
+    for (const auto& e : Layout::exponents)
+        ts.exponents.insert(ts.exponents.end(), e.begin(), e.end());
+    return ts;
+}
+
+template <class Layout>
+struct FixedPolynomialExpansion {
+    static constexpr int K = Layout::factors;
+    static constexpr int M = Layout::num_terms;
+    static constexpr int P = Layout::max_exponent + 1;
+
+    static void expand(const double* x, double* phi) {
+        double pw[K][P];
+        for (int f = 0; f < K; ++f) {
+            pw[f][0] = 1.0;
+            for (int p = 1; p < P; ++p) pw[f][p] = pw[f][p - 1] * x[f];
+        }
+        expand_terms(pw, phi, std::make_integer_sequence<int, M>{});
+    }
+
+private:
+    template <int T, int F>
+    static double factor_power(const double (&pw)[K][P]) {
+        constexpr int e = Layout::exponents[T][F];
+        if constexpr (e == 0) return 1.0;
+        else return pw[F][e];
+    }
+
+    template <int T, int... F>
+    static double term_value(const double (&pw)[K][P], std::integer_sequence<int, F...>) {
+        return (factor_power<T, F>(pw) * ...);
+    }
+
+    template <int... T>
+    static void expand_terms(const double (&pw)[K][P], double* phi, std::integer_sequence<int, T...>) {
+        ((phi[T] = term_value<T>(pw, std::make_integer_sequence<int, K>{})), ...);
+    }
+};
+
+template <class Layout>
+class FixedPolynomialResponseSurface {
+public:
+    static constexpr int K = Layout::factors;
+    static constexpr int M = Layout::num_terms;
+    using Expansion = FixedPolynomialExpansion<Layout>;
+
+    bool fit(const DesignMatrix& design, const std::vector<double>& y)
+    {
+        int N = design.runs;
+        if (N == 0 || (int)y.size() != N || design.factors != K) return false;
+
+        Eigen::Matrix<double, Eigen::Dynamic, M, (M == 1 ? Eigen::ColMajor : Eigen::RowMajor)> Phi(N, M);
+        for (int r = 0; r < N; ++r)
+            Expansion::expand(design.row(r), Phi.row(r).data());
+        Eigen::Map<const Eigen::VectorXd> Y(y.data(), N);
+
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
+        rank_   = static_cast<int>(qr.rank());
+        beta_   = qr.solve(Y);
+        fitted_ = true;
+        return true;
+    }
+
+    double predict(const double* x) const
+    {
+        if (!fitted_)
+            throw std::runtime_error("FixedPolynomialResponseSurface::predict: model not fitted yet");
+        Eigen::Matrix<double, M, 1> phi;
+        Expansion::expand(x, phi.data());
+        return beta_.dot(phi);
+    }
+
+    void predict_batch(const DesignMatrix& X, std::vector<double>& out) const
+    {
+        if (!fitted_)
+            throw std::runtime_error("FixedPolynomialResponseSurface::predict_batch: model not fitted yet");
+        if (X.factors != K)
+            throw std::runtime_error("FixedPolynomialResponseSurface::predict_batch: dimension mismatch");
+        out.resize(X.runs);
+        Eigen::Matrix<double, M, 1> phi;
+        for (int r = 0; r < X.runs; ++r) {
+            Expansion::expand(X.row(r), phi.data());
+            out[r] = beta_.dot(phi);
+        }
+    }
+
+    const Eigen::Matrix<double, M, 1>& coefficients() const { return beta_; }
+    int rank() const { return rank_; }
+
+private:
+    Eigen::Matrix<double, M, 1> beta_ = Eigen::Matrix<double, M, 1>::Zero();
+    int rank_ = 0;
+    bool fitted_ = false;
+};
@@ -0,0 +1,277 @@
+#pragma once
+#include <vector>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_run_mask.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Matrix-free least squares for high-dimensional quadratic surfaces
+//
+// With k factors the model has m = 1 + 2k + k(k-1)/2 terms; at k = 150 and
+// N = 100k the explicit N x m Phi of ResponseSurfaceQuadratic::fit would take
+// about 9 GB. Here Phi is never formed: Phi v and Phi^T u are applied from the
+// raw design rows, a tile of rows at a time:
+//   Phi v   : u_r = v0 + x_r . v_lin + x_r^T V x_r,   V = diag(v_sq) + upper(v_ij)
+//             -> one (tile x k) * (k x k) product per tile
+//   Phi^T u : G = X_t^T diag(u_t) X_t (k x k) gives the squared (diagonal) and
+//             interaction (upper) entries, X_t^T u_t the linear ones
+// and LSQR (Paige & Saunders) runs on Phi D with Jacobi column scaling
+// D = diag(1 / ||phi_j||). Tiles are split over threads; Phi^T u accumulates one
+// k x k block per thread and reduces them in thread order.
+// Memory: the N x k design, O(N + m) solver vectors and O(threads * k^2) scratch.
+// -----------------------------------------------------------------------------
+
+struct LsqrOptions {
+    int max_iterations = 0;       // 0 = 2 m
+    double atol = 1e-10;          // stop when ||Phi^T r|| <= atol ||Phi|| ||r||
+    double btol = 1e-10;          // stop when ||r|| <= btol ||y|| + atol ||Phi|| ||beta||
+    double conlim = 1e10;         // stop when the condition estimate exceeds conlim
+    bool jacobi = true;           // unit column norms
+    int tile_rows = 256;
+    int threads = 1;              // <= 0: hardware concurrency
+};
+
+enum class LsqrStop { ZeroGradient, ResidualSmall, LeastSquares, IllConditioned, IterationLimit };
+
+struct LsqrReport {
+    LsqrStop stop = LsqrStop::IterationLimit;
+    int iterations = 0;
+    double residual_norm = 0.0;   // ||y - Phi beta||
+    double gradient_norm = 0.0;   // ||(Phi D)^T r||
+    double norm_estimate = 0.0;   // Frobenius estimate of ||Phi D||
+    double cond_estimate = 0.0;   // condition estimate of Phi D
+    bool converged() const { return stop != LsqrStop::IterationLimit && stop != LsqrStop::IllConditioned; }
+};
+
+// Implicit Phi over the rows of a design matrix (rows in `rows`, or all rows)
+class QuadraticFeatureOperator {
+public:
+    QuadraticFeatureOperator(const DesignMatrix& X, std::vector<int> rows = {}, int tile_rows = 256, int threads = 1)
+        : X_(X), rows_(std::move(rows)), tile_(std::max(1, tile_rows)), threads_(threads)
+    {
+        if (X.factors <= 0 || X.runs <= 0)
+            throw std::runtime_error("QuadraticFeatureOperator: empty design");
+        if (rows_.empty()) {
+            rows_.resize(X.runs);
+            for (int r = 0; r < X.runs; ++r) rows_[r] = r;
+        }
+        k_ = X.factors;
+        m_ = ResponseSurfaceQuadratic::num_terms(k_);
+        tiles_ = (static_cast<int>(rows_.size()) + tile_ - 1) / tile_;
+    }
+
+    int rows() const { return static_cast<int>(rows_.size()); }
+    int cols() const { return m_; }
+
+    // u = Phi v   (u has rows() entries)
+    void apply(const Eigen::VectorXd& v, Eigen::VectorXd& u) const {
+        DOE_TRACE_SCOPE("QuadraticFeatureOperator::apply");
+        const int k = k_;
+        Eigen::VectorXd vl = v.segment(1, k);
+        Eigen::MatrixXd V = Eigen::MatrixXd::Zero(k, k);
+        for (int i = 0; i < k; ++i) {
+            V(i, i) = v(ResponseSurfaceQuadratic::squared_index(k, i));
+            for (int j = i + 1; j < k; ++j)
+                V(i, j) = v(ResponseSurfaceQuadratic::interaction_index(k, i, j));
+        }
+        u.resize(rows());
+        doe_parallel::parallel_chunks(tiles_, threads_, [&](int, int t0, int t1) {
+            Eigen::MatrixXd Xt, W;
+            for (int t = t0; t < t1; ++t) {
+                const int begin = t * tile_;
+                const int n = gather(begin, Xt, false);
+                W.noalias() = Xt * V;
+                u.segment(begin, n) = (Xt * vl + Xt.cwiseProduct(W).rowwise().sum()).array() + v(0);
+            }
+        });
+    }
+
+    // v = Phi^T u   (v has cols() entries)
+    void apply_transpose(const Eigen::VectorXd& u, Eigen::VectorXd& v) const {
+        DOE_TRACE_SCOPE("QuadraticFeatureOperator::apply_transpose");
+        accumulate_transpose(&u, v, false);
+    }
+
+    // Squared column norms of Phi (diagonal of Phi^T Phi)
+    Eigen::VectorXd column_norms_squared() const {
+        Eigen::VectorXd v;
+        accumulate_transpose(nullptr, v, true);
+        return v;
+    }
+
+private:
+    // Copy rows [begin, begin + tile) into Xt (optionally squared); returns the row count
+    int gather(int begin, Eigen::MatrixXd& Xt, bool square) const {
+        const int n = std::min(tile_, rows() - begin);
+        Xt.resize(n, k_);
+        for (int t = 0; t < n; ++t) {
+            const double* x = X_.row(rows_[begin + t]);
+            for (int i = 0; i < k_; ++i) Xt(t, i) = square ? x[i] * x[i] : x[i];
+        }
+        return n;
+    }
+
+    // u == nullptr: u = 1 on the squared design, which yields the column norms
+    void accumulate_transpose(const Eigen::VectorXd* u, Eigen::VectorXd& v, bool square) const {
+        const int k = k_;
+        const int T = doe_parallel::resolve_threads(threads_, tiles_);
+        std::vector<Eigen::MatrixXd> G(T, Eigen::MatrixXd::Zero(k, k));
+        std::vector<Eigen::VectorXd> L(T, Eigen::VectorXd::Zero(k));
+        std::vector<double> S(T, 0.0);
+        doe_parallel::parallel_chunks(tiles_, T, [&](int c, int t0, int t1) {
+            Eigen::MatrixXd Xt;
+            Eigen::VectorXd ut;
+            for (int t = t0; t < t1; ++t) {
+                const int begin = t * tile_;
+                const int n = gather(begin, Xt, square);
+                if (u) ut = u->segment(begin, n);
+                else   ut.setOnes(n);
+                S[c] += ut.sum();
+                L[c].noalias() += Xt.transpose() * ut;
+                G[c].noalias() += Xt.transpose() * (Xt.array().colwise() * ut.array()).matrix();
+            }
+        });
+        for (int c = 1; c < T; ++c) { S[0] += S[c]; L[0] += L[c]; G[0] += G[c]; }
+
+        v.resize(m_);
+        v(0) = S[0];
+        for (int i = 0; i < k; ++i) {
+            v(ResponseSurfaceQuadratic::linear_index(i)) = L[0](i);
+            v(ResponseSurfaceQuadratic::squared_index(k, i)) = G[0](i, i);
+            for (int j = i + 1; j < k; ++j)
+                v(ResponseSurfaceQuadratic::interaction_index(k, i, j)) = G[0](i, j);
+        }
+        DOE_TRACE_COUNT("rows_scanned", rows());
+    }
+
+    const DesignMatrix& X_;
+    std::vector<int> rows_;
+    int tile_ = 256;
+    int threads_ = 1;
+    int k_ = 0, m_ = 0, tiles_ = 0;
+};
+
+// -----------------------------------------------------------------------------
+// LSQR for min ||Phi beta - y|| without forming Phi. Runs with a NaN response or
+// cleared in `mask` are skipped. On return rs holds the (natural-unit) fit; its
+// rank() reports m, since no factorization is made to measure it.
+// -----------------------------------------------------------------------------
+inline LsqrReport fit_response_surface_lsqr(
+    ResponseSurfaceQuadratic& rs,
+    const DesignMatrix& X,
+    const std::vector<double>& y,
+    const LsqrOptions& opt = LsqrOptions{},
+    const RunMask& mask = RunMask{})
+{
+    DOE_TRACE_SCOPE("fit_response_surface_lsqr");
+    if ((int)y.size() != X.runs)
+        throw std::runtime_error("fit_response_surface_lsqr: y size must match design runs");
+    RunMask active = effective_run_mask(y, mask);
+    std::vector<int> rows;
+    if (!active.empty()) {
+        rows.reserve(active.count());
+        active.for_each([&](int r) { rows.push_back(r); });
+        if (rows.empty())
+            throw std::runtime_error("fit_response_surface_lsqr: no active runs");
+    }
+    QuadraticFeatureOperator A(X, std::move(rows), opt.tile_rows, opt.threads);
+    const int n = A.rows();
+    const int m = A.cols();
+
+    Eigen::VectorXd d = Eigen::VectorXd::Ones(m);
+    if (opt.jacobi) {
+        Eigen::VectorXd c2 = A.column_norms_squared();
+        for (int j = 0; j < m; ++j) d(j) = c2(j) > 0.0 ? 1.0 / std::sqrt(c2(j)) : 0.0;
+    }
+    // (Phi D) z and (Phi D)^T u
+    Eigen::VectorXd tmp(m);
+    auto op = [&](const Eigen::VectorXd& z, Eigen::VectorXd& out) { tmp = d.cwiseProduct(z); A.apply(tmp, out); };
+    auto op_t = [&](const Eigen::VectorXd& u, Eigen::VectorXd& out) { A.apply_transpose(u, out); out.array() *= d.array(); };
+
+    Eigen::VectorXd u(n), v(m), w(m), z = Eigen::VectorXd::Zero(m), Av(n), Atu(m);
+    if (active.empty()) {
+        for (int r = 0; r < n; ++r) u(r) = y[r];
+    } else {
+        int q = 0;
+        active.for_each([&](int r) { u(q++) = y[r]; });
+    }
+
+    LsqrReport rep;
+    const int max_it = opt.max_iterations > 0 ? opt.max_iterations : 2 * m;
+    const double eps = std::numeric_limits<double>::epsilon();
+    double beta = u.norm();
+    const double bnorm = beta;
+    double alpha = 0.0;
+    if (beta > 0.0) {
+        u /= beta;
+        op_t(u, v);
+        alpha = v.norm();
+    } else {
+        v.setZero();
+    }
+    if (alpha > 0.0) v /= alpha;
+    w = v;
+    double rhobar = alpha, phibar = beta;
+    double anorm = 0.0, acond = 0.0, ddnorm = 0.0;
+    rep.residual_norm = beta;
+    rep.gradient_norm = alpha * beta;
+    if (rep.gradient_norm == 0.0) {
+        rep.stop = LsqrStop::ZeroGradient;
+    } else {
+        const double ctol = opt.conlim > 0.0 ? 1.0 / opt.conlim : 0.0;
+        for (int it = 1; it <= max_it; ++it) {
+            // Golub-Kahan bidiagonalization step
+            op(v, Av);
+            u = Av - alpha * u;
+            beta = u.norm();
+            if (beta > 0.0) u /= beta;
+            anorm = std::sqrt(anorm * anorm + alpha * alpha + beta * beta);
+            op_t(u, Atu);
+            v = Atu - beta * v;
+            alpha = v.norm();
+            if (alpha > 0.0) v /= alpha;
+
+            // plane rotation eliminating the subdiagonal beta
+            const double rho = std::hypot(rhobar, beta);
+            const double c = rhobar / rho, s = beta / rho;
+            const double theta = s * alpha;
+            rhobar = -c * alpha;
+            const double phi = c * phibar;
+            phibar = s * phibar;
+            const double tau = s * phi;
+
+            ddnorm += w.squaredNorm() / (rho * rho);
+            z += (phi / rho) * w;
+            w = v - (theta / rho) * w;
+
+            acond = anorm * std::sqrt(ddnorm);
+            rep.iterations = it;
+            rep.residual_norm = phibar;
+            rep.gradient_norm = alpha * std::fabs(tau);
+            rep.norm_estimate = anorm;
+            rep.cond_estimate = acond;
+
+            const double znorm = z.norm();
+            const double test1 = phibar / bnorm;
+            const double test2 = rep.gradient_norm / (anorm * phibar + eps);
+            const double test3 = 1.0 / (acond + eps);
+            const double rtol = opt.btol + opt.atol * anorm * znorm / bnorm;
+            if (test1 <= rtol)  { rep.stop = LsqrStop::ResidualSmall; break; }
+            if (test2 <= opt.atol) { rep.stop = LsqrStop::LeastSquares; break; }
+            if (test3 <= ctol)  { rep.stop = LsqrStop::IllConditioned; break; }
+        }
+    }
+    DOE_TRACE_COUNTER("lsqr_iterations", rep.iterations);
+
+    rs.restore_fit(X.factors, d.cwiseProduct(z), m);
+    return rep;
+}
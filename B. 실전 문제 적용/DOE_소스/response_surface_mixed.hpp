@@ -0,0 +1,228 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "doe_run_mask.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Response surface with continuous and categorical factors
+//
+// Terms, in coefficient order:
+//   1
+//   x_i                      continuous linear
+//   x_i^2                    continuous squared             (opt.squared)
+//   x_i x_j (i<j)            continuous interactions        (opt.continuous_interactions)
+//   c_q,a                    categorical main effects, L_q - 1 columns per factor
+//   c_q,a x_i                categorical x continuous       (opt.categorical_interactions)
+// Coding of category l of a factor with L categories (a = 0 .. L-2):
+//   Effect : c_a = [l == a], except the last category, which is -1 in every column.
+//            Effects are deviations from the average over categories (sum to zero).
+//   Dummy  : c_a = [l == a + 1]. Category 0 is the reference (effect 0).
+// Each row's coded entries are written straight into its row of the model matrix,
+// so no one-hot vectors are built. Categorical x categorical terms are not modelled.
+// -----------------------------------------------------------------------------
+
+enum class CategoricalCoding { Effect, Dummy };
+
+struct MixedModelOptions {
+    CategoricalCoding coding = CategoricalCoding::Effect;
+    bool squared = true;
+    bool continuous_interactions = true;
+    bool categorical_interactions = true;     // categorical x continuous
+};
+
+class MixedResponseSurface {
+public:
+    MixedResponseSurface() = default;
+
+    // Least squares by column-pivoted QR, as ResponseSurfaceQuadratic::fit.
+    // Runs with a NaN response or cleared in `mask` are skipped.
+    bool fit(const MixedDesign& d, const std::vector<double>& y,
+             const MixedModelOptions& opt = MixedModelOptions{},
+             const RunMask& mask = RunMask{})
+    {
+        DOE_TRACE_SCOPE("MixedResponseSurface::fit");
+        const int N = d.runs();
+        if (N == 0 || (int)y.size() != N) return false;
+        if ((int)d.num_categories.size() != d.categorical_factors ||
+            d.codes.size() != static_cast<size_t>(N) * d.categorical_factors)
+            throw std::runtime_error("MixedResponseSurface::fit: inconsistent MixedDesign");
+        layout(d, opt);
+
+        RunMask active = effective_run_mask(y, mask);
+        const int used = active.empty() ? N : active.count();
+        if (used == 0) return false;
+
+        // Terms are written in place with a column stride of `used` (no row copies)
+        Eigen::MatrixXd Phi(used, m_);
+        Eigen::VectorXd Y(used);
+        DOE_TRACE_COUNT("alloc_bytes", sizeof(double) * (static_cast<size_t>(used) * m_ + used));
+        DOE_TRACE_COUNT("rows_scanned", N);
+        int q = 0;
+        auto add_row = [&](int r) {
+            expand_terms(d.continuous.row(r), d.code_row(r), Phi.data() + q, used);
+            Y(q) = y[r];
+            ++q;
+        };
+        if (active.empty()) {
+            for (int r = 0; r < N; ++r) add_row(r);
+        } else {
+            active.for_each(add_row);
+        }
+
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
+        rank_ = static_cast<int>(qr.rank());
+        DOE_TRACE_COUNTER("qr_rank", rank_);
+        beta_ = qr.solve(Y);
+        fitted_ = true;
+        return true;
+    }
+
+    // x: kc continuous settings, codes: kq category indices
+    double predict(const double* x, const std::uint16_t* codes) const {
+        if (!fitted_)
+            throw std::runtime_error("MixedResponseSurface::predict: model not fitted yet");
+        for (int q = 0; q < kq_; ++q)
+            if (codes[q] >= L_[q])
+                throw std::runtime_error("MixedResponseSurface::predict: category index out of range");
+        std::vector<double> phi(m_);
+        expand_terms(x, codes, phi.data());
+        return beta_.dot(Eigen::Map<const Eigen::VectorXd>(phi.data(), m_));
+    }
+
+    double predict(const std::vector<double>& x, const std::vector<std::uint16_t>& codes) const {
+        if ((int)x.size() != kc_ || (int)codes.size() != kq_)
+            throw std::runtime_error("MixedResponseSurface::predict: dimension mismatch");
+        return predict(x.data(), codes.data());
+    }
+
+    // Every run of a mixed design; one scratch row for all runs
+    void predict_batch(const MixedDesign& d, std::vector<double>& out) const {
+        if (!fitted_)
+            throw std::runtime_error("MixedResponseSurface::predict_batch: model not fitted yet");
+        if (d.continuous.factors != kc_ || d.categorical_factors != kq_)
+            throw std::runtime_error("MixedResponseSurface::predict_batch: dimension mismatch");
+        Eigen::VectorXd phi(m_);
+        out.resize(d.runs());
+        for (int r = 0; r < d.runs(); ++r) {
+            expand_terms(d.continuous.row(r), d.code_row(r), phi.data());
+            out[r] = beta_.dot(phi);
+        }
+    }
+
+    // Effect of every category of factor q at x = 0 (main-effect coefficients only):
+    // effect coding sums to zero, dummy coding is 0 for the reference category
+    std::vector<double> category_effects(int q) const {
+        if (!fitted_ || q < 0 || q >= kq_)
+            throw std::runtime_error("MixedResponseSurface::category_effects: not fitted or bad factor");
+        std::vector<double> e(L_[q], 0.0);
+        const int base = cat_offset_[q];
+        for (int a = 0; a < L_[q] - 1; ++a) {
+            double b = beta_(base + a);
+            if (coding_ == CategoricalCoding::Effect) {
+                e[a] = b;
+                e[L_[q] - 1] -= b;
+            } else {
+                e[a + 1] = b;
+            }
+        }
+        return e;
+    }
+
+    // Fill phi[0], phi[stride], ... (num_terms() entries) for one run; stride = rows
+    // writes a row of a column-major model matrix in place
+    void expand_terms(const double* x, const std::uint16_t* codes, double* phi, Eigen::Index stride = 1) const {
+        Eigen::Index col = 0;
+        auto put = [&](double v) { phi[col++ * stride] = v; };
+        put(1.0);
+        for (int i = 0; i < kc_; ++i) put(x[i]);
+        if (squared_)
+            for (int i = 0; i < kc_; ++i) put(x[i] * x[i]);
+        if (cont_inter_)
+            for (int i = 0; i < kc_; ++i)
+                for (int j = i + 1; j < kc_; ++j) put(x[i] * x[j]);
+        // coded categorical columns
+        for (int q = 0; q < kq_; ++q) {
+            const int La = L_[q] - 1;
+            const int l = codes[q];
+            for (int a = 0; a < La; ++a) {
+                if (coding_ == CategoricalCoding::Effect) put(l == a ? 1.0 : (l == La ? -1.0 : 0.0));
+                else                                      put(l == a + 1 ? 1.0 : 0.0);
+            }
+        }
+        if (cat_inter_) {
+            const Eigen::Index cat_begin = col - cat_columns_;
+            for (Eigen::Index a = cat_begin; a < cat_begin + cat_columns_; ++a) {
+                const double c = phi[a * stride];
+                for (int i = 0; i < kc_; ++i) put(c * x[i]);
+            }
+        }
+    }
+
+    // Readable term names, e.g. "x0^2", "lot[B]", "lot[B]*x1"
+    std::vector<std::string> term_names(const std::vector<std::string>& continuous_names = {},
+                                        const std::vector<std::vector<std::string>>& category_names = {}) const {
+        auto xn = [&](int i) { return i < (int)continuous_names.size() ? continuous_names[i] : "x" + std::to_string(i); };
+        std::vector<std::string> cn;
+        for (int q = 0; q < kq_; ++q)
+            for (int a = 0; a < L_[q] - 1; ++a) {
+                int l = (coding_ == CategoricalCoding::Effect) ? a : a + 1;
+                std::string lab = (q < (int)category_names.size() && l < (int)category_names[q].size())
+                                ? category_names[q][l] : std::to_string(l);
+                cn.push_back("c" + std::to_string(q) + "[" + lab + "]");
+            }
+        std::vector<std::string> names{"1"};
+        for (int i = 0; i < kc_; ++i) names.push_back(xn(i));
+        if (squared_) for (int i = 0; i < kc_; ++i) names.push_back(xn(i) + "^2");
+        if (cont_inter_)
+            for (int i = 0; i < kc_; ++i)
+                for (int j = i + 1; j < kc_; ++j) names.push_back(xn(i) + "*" + xn(j));
+        for (const auto& c : cn) names.push_back(c);
+        if (cat_inter_)
+            for (const auto& c : cn)
+                for (int i = 0; i < kc_; ++i) names.push_back(c + "*" + xn(i));
+        return names;
+    }
+
+    int num_terms() const { return m_; }
+    int rank() const { return rank_; }
+    const Eigen::VectorXd& coefficients() const { return beta_; }
+    int category_offset(int q) const { return cat_offset_.at(q); }   // first main-effect column of factor q
+
+private:
+    void layout(const MixedDesign& d, const MixedModelOptions& opt) {
+        kc_ = d.continuous.factors;
+        kq_ = d.categorical_factors;
+        L_ = d.num_categories;
+        for (int L : L_)
+            if (L < 1)
+                throw std::runtime_error("MixedResponseSurface: categorical factor without categories");
+        coding_ = opt.coding;
+        squared_ = opt.squared;
+        cont_inter_ = opt.continuous_interactions;
+        cat_inter_ = opt.categorical_interactions;
+        int col = 1 + kc_ + (squared_ ? kc_ : 0) + (cont_inter_ ? kc_ * (kc_ - 1) / 2 : 0);
+        cat_offset_.resize(kq_);
+        cat_columns_ = 0;
+        for (int q = 0; q < kq_; ++q) {
+            cat_offset_[q] = col;
+            col += L_[q] - 1;
+            cat_columns_ += L_[q] - 1;
+        }
+        m_ = col + (cat_inter_ ? cat_columns_ * kc_ : 0);
+        fitted_ = false;
+    }
+
+    int kc_ = 0, kq_ = 0, m_ = 0, rank_ = 0, cat_columns_ = 0;
+    std::vector<int> L_, cat_offset_;
+    CategoricalCoding coding_ = CategoricalCoding::Effect;
+    bool squared_ = true, cont_inter_ = true, cat_inter_ = true;
+    bool fitted_ = false;
+    Eigen::VectorXd beta_;
+};
@@ -0,0 +1,296 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "response_surface_quadratic.hpp"
+#include "doe_run_mask.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Closed-form quadratic response surface on balanced orthogonal arrays
+//
+// Each factor is coded with orthogonal polynomials over its level values
+// (equal weights, since every level appears N / L times):
+//   P1(x) = x - mu,   P2(x) = x^2 + a1 x + a0   (orthogonal to 1 and P1)
+// In an array of strength 2 (every pair of columns balanced) the columns
+// 1, P1_i, P2_i are mutually orthogonal, so their coefficients are plain dot
+// products c = z . y / z . z. The interaction columns P1_i P1_j are orthogonal
+// too when the array is a full factorial in the selected factors (e.g. L9 with
+// 2 factors); otherwise (L18 with 3+ factors) they are only partially aliased
+// with other columns and are solved from a q x q Schur complement that is
+// factored once per plan (q = number of interactions).
+// Per response the cost is O(N m) dot products plus O(q m); the QR path is
+// O(N m^2). Coefficients are converted back to natural units and match
+// ResponseSurfaceQuadratic::fit (same least-squares solution, full rank only).
+// -----------------------------------------------------------------------------
+
+class OrthogonalQuadraticPlan {
+public:
+    OrthogonalQuadraticPlan(const OrthogonalArray& oa,
+                            const std::vector<FactorLevels>& all_levels,
+                            const std::vector<int>& factor_indices)
+    {
+        DOE_TRACE_SCOPE("OrthogonalQuadraticPlan");
+        if (factor_indices.empty())
+            throw std::runtime_error("OrthogonalQuadraticPlan: no factor_indices");
+        for (int f : factor_indices) {
+            if (f < 0 || f >= oa.factors)
+                throw std::runtime_error("OrthogonalQuadraticPlan: factor index out of OA range");
+            if (f >= (int)all_levels.size())
+                throw std::runtime_error("OrthogonalQuadraticPlan: factor index out of level size");
+        }
+        N_ = oa.runs;
+        k_ = static_cast<int>(factor_indices.size());
+        m_ = ResponseSurfaceQuadratic::num_terms(k_);
+        if (N_ < m_) { reason_ = "fewer runs than model terms"; return; }
+
+        // Per-factor level coding
+        const int p = 1 + 2 * k_;
+        mu_.resize(k_); a1_.resize(k_); a0_.resize(k_);
+        std::vector<std::vector<double>> p1(k_), p2(k_);
+        std::vector<int> L(k_);
+        for (int i = 0; i < k_; ++i) {
+            const int f = factor_indices[i];
+            const auto& vals = all_levels[f].levels;
+            std::vector<int> count;
+            for (int r = 0; r < N_; ++r) {
+                int l = oa.at(r, f);
+                if (l < 0 || l >= (int)vals.size())
+                    throw std::runtime_error("OrthogonalQuadraticPlan: level index out of range");
+                if (l >= (int)count.size()) count.resize(l + 1, 0);
+                ++count[l];
+            }
+            L[i] = static_cast<int>(count.size());
+            if (std::any_of(count.begin(), count.end(), [&](int c) { return c != count[0]; })) {
+                reason_ = "unbalanced factor column";
+                return;
+            }
+            double mu = 0.0, mq = 0.0;
+            for (int l = 0; l < L[i]; ++l) { mu += vals[l]; mq += vals[l] * vals[l]; }
+            mu /= L[i];
+            mq /= L[i];
+            double s11 = 0.0, sq1 = 0.0;
+            p1[i].resize(L[i]);
+            for (int l = 0; l < L[i]; ++l) {
+                p1[i][l] = vals[l] - mu;
+                s11 += p1[i][l] * p1[i][l];
+                sq1 += vals[l] * vals[l] * p1[i][l];
+            }
+            double spread = 0.0;
+            for (int l = 0; l < L[i]; ++l) spread = std::max(spread, std::fabs(p1[i][l]));
+            if (L[i] < 3 || !(s11 > 0.0)) { reason_ = "factor with fewer than 3 levels"; return; }
+            // P2 = x^2 - mq - (sq1 / s11) (x - mu)
+            const double c1 = sq1 / s11;
+            a1_[i] = -c1;
+            a0_[i] = c1 * mu - mq;
+            mu_[i] = mu;
+            double s22 = 0.0;
+            p2[i].resize(L[i]);
+            for (int l = 0; l < L[i]; ++l) {
+                p2[i][l] = vals[l] * vals[l] + a1_[i] * vals[l] + a0_[i];
+                s22 += p2[i][l] * p2[i][l];
+            }
+            if (!(s22 > 1e-12 * spread * spread * spread * spread * L[i])) {
+                reason_ = "repeated level values";
+                return;
+            }
+        }
+
+        // Strength 2: every pair of selected columns balanced -> main block diagonal
+        for (int i = 0; i < k_; ++i) {
+            for (int j = i + 1; j < k_; ++j) {
+                std::vector<int> cell(static_cast<size_t>(L[i]) * L[j], 0);
+                for (int r = 0; r < N_; ++r)
+                    ++cell[static_cast<size_t>(oa.at(r, factor_indices[i])) * L[j] + oa.at(r, factor_indices[j])];
+                if (std::any_of(cell.begin(), cell.end(), [&](int c) { return c != cell[0]; })) {
+                    reason_ = "columns not pairwise balanced";
+                    return;
+                }
+            }
+        }
+
+        // Coded model matrix Z = [1 | P1 | P2 | P1_i P1_j], same column order as expand_terms
+        Z_.resize(N_, m_);
+        for (int r = 0; r < N_; ++r) {
+            Z_(r, 0) = 1.0;
+            for (int i = 0; i < k_; ++i) {
+                int l = oa.at(r, factor_indices[i]);
+                Z_(r, 1 + i) = p1[i][l];
+                Z_(r, 1 + k_ + i) = p2[i][l];
+            }
+            int col = p;
+            for (int i = 0; i < k_; ++i)
+                for (int j = i + 1; j < k_; ++j)
+                    Z_(r, col++) = Z_(r, 1 + i) * Z_(r, 1 + j);
+        }
+        dinv_.resize(p);
+        for (int c = 0; c < p; ++c) dinv_(c) = 1.0 / Z_.col(c).squaredNorm();
+
+        const int q = m_ - p;
+        fully_orthogonal_ = true;
+        if (q > 0) {
+            auto M = Z_.leftCols(p);
+            auto I = Z_.rightCols(q);
+            B_.noalias() = M.transpose() * I;
+            Eigen::MatrixXd C = I.transpose() * I;
+            const double tol = 1e-10 * C.diagonal().maxCoeff();
+            Eigen::MatrixXd Coff = C;
+            Coff.diagonal().setZero();
+            fully_orthogonal_ = B_.cwiseAbs().maxCoeff() <= tol && Coff.cwiseAbs().maxCoeff() <= tol;
+            if (fully_orthogonal_) {
+                B_.setZero(p, q);
+                idiag_ = C.diagonal().cwiseInverse();
+            } else {
+                Eigen::MatrixXd S = C - B_.transpose() * dinv_.asDiagonal() * B_;
+                schur_.compute(S);
+                if (schur_.info() != Eigen::Success || !(schur_.rcond() > 1e-10)) {
+                    reason_ = "interactions aliased with other terms";
+                    return;
+                }
+            }
+        }
+        usable_ = true;
+    }
+
+    bool usable() const { return usable_; }
+    const std::string& reason() const { return reason_; }     // why the plan is not usable
+    bool fully_orthogonal() const { return usable_ && fully_orthogonal_; }
+    int runs() const { return N_; }
+    int num_factors() const { return k_; }
+
+    // Natural-unit coefficients (ResponseSurfaceQuadratic order) for one complete response
+    bool solve(const double* y, Eigen::VectorXd& beta) const {
+        if (!usable_) return false;
+        for (int r = 0; r < N_; ++r)
+            if (!std::isfinite(y[r])) return false;
+        Eigen::Map<const Eigen::VectorXd> Y(y, N_);
+        Eigen::VectorXd zy = Z_.transpose() * Y;
+        beta = to_natural(coded(zy));
+        DOE_TRACE_COUNT("rows_scanned", N_);
+        return true;
+    }
+
+    bool fit(const std::vector<double>& y, ResponseSurfaceQuadratic& rs) const {
+        if ((int)y.size() != N_) return false;
+        Eigen::VectorXd beta;
+        if (!solve(y.data(), beta)) return false;
+        rs.restore_fit(k_, beta, m_);
+        return true;
+    }
+
+    // Column r of the result holds the coefficients of response Y.col(r)
+    Eigen::MatrixXd solve_batch(const Eigen::MatrixXd& Y) const {
+        if (!usable_)
+            throw std::runtime_error("OrthogonalQuadraticPlan::solve_batch: plan not usable (" + reason_ + ")");
+        if (Y.rows() != N_)
+            throw std::runtime_error("OrthogonalQuadraticPlan::solve_batch: Y rows must match runs");
+        if (!Y.allFinite())
+            throw std::runtime_error("OrthogonalQuadraticPlan::solve_batch: responses must be complete");
+        Eigen::MatrixXd ZY = Z_.transpose() * Y;
+        Eigen::MatrixXd out(m_, Y.cols());
+        for (Eigen::Index r = 0; r < Y.cols(); ++r)
+            out.col(r) = to_natural(coded(ZY.col(r)));
+        DOE_TRACE_COUNT("rows_scanned", static_cast<double>(N_) * Y.cols());
+        return out;
+    }
+
+private:
+    // Coded coefficients from Z^T y
+    Eigen::VectorXd coded(const Eigen::VectorXd& zy) const {
+        const int p = 1 + 2 * k_;
+        const int q = m_ - p;
+        Eigen::VectorXd c(m_);
+        if (q == 0 || fully_orthogonal_) {
+            c.head(p) = dinv_.cwiseProduct(zy.head(p));
+            if (q > 0) c.tail(q) = idiag_.cwiseProduct(zy.tail(q));
+            return c;
+        }
+        // D cM + B cI = My,   B^T cM + C cI = Iy
+        Eigen::VectorXd dmy = dinv_.cwiseProduct(zy.head(p));
+        c.tail(q) = schur_.solve(zy.tail(q) - B_.transpose() * dmy);
+        c.head(p) = dmy - dinv_.cwiseProduct(B_ * c.tail(q));
+        return c;
+    }
+
+    // Expand P1 = x - mu, P2 = x^2 + a1 x + a0 and P1_i P1_j into natural terms
+    Eigen::VectorXd to_natural(const Eigen::VectorXd& c) const {
+        Eigen::VectorXd b = Eigen::VectorXd::Zero(m_);
+        b(0) = c(0);
+        for (int i = 0; i < k_; ++i) {
+            const double c1 = c(ResponseSurfaceQuadratic::linear_index(i));
+            const double c2 = c(ResponseSurfaceQuadratic::squared_index(k_, i));
+            b(0) += -c1 * mu_[i] + c2 * a0_[i];
+            b(ResponseSurfaceQuadratic::linear_index(i)) += c1 + c2 * a1_[i];
+            b(ResponseSurfaceQuadratic::squared_index(k_, i)) = c2;
+        }
+        for (int i = 0; i < k_; ++i) {
+            for (int j = i + 1; j < k_; ++j) {
+                const int t = ResponseSurfaceQuadratic::interaction_index(k_, i, j);
+                b(t) = c(t);
+                b(0) += c(t) * mu_[i] * mu_[j];
+                b(ResponseSurfaceQuadratic::linear_index(i)) -= c(t) * mu_[j];
+                b(ResponseSurfaceQuadratic::linear_index(j)) -= c(t) * mu_[i];
+            }
+        }
+        return b;
+    }
+
+    int N_ = 0, k_ = 0, m_ = 0;
+    bool usable_ = false;
+    bool fully_orthogonal_ = false;
+    std::string reason_;
+    std::vector<double> mu_, a1_, a0_;
+    Eigen::MatrixXd Z_;            // coded model matrix (N x m)
+    Eigen::VectorXd dinv_;         // 1 / z.z of the main-effect columns
+    Eigen::VectorXd idiag_;        // 1 / z.z of the interactions (fully orthogonal case)
+    Eigen::MatrixXd B_;            // main x interaction cross products
+    Eigen::LDLT<Eigen::MatrixXd> schur_;
+};
+
+// -----------------------------------------------------------------------------
+// Quadratic fit on OA factors: closed form when the plan applies and every run
+// is used, otherwise ResponseSurfaceQuadratic::fit on the design matrix.
+// plan must have been built from the same (oa, all_levels, factor_indices);
+// callers fitting many responses on one array build it once and pass it here.
+// -----------------------------------------------------------------------------
+inline bool fit_response_surface_oa(
+    ResponseSurfaceQuadratic& rs,
+    const OrthogonalQuadraticPlan& plan,
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices,
+    const std::vector<double>& y,
+    const RunMask& mask = RunMask{})
+{
+    DOE_TRACE_SCOPE("fit_response_surface_oa");
+    if (plan.runs() != oa.runs || plan.num_factors() != (int)factor_indices.size())
+        throw std::runtime_error("fit_response_surface_oa: plan does not match the array");
+    if ((mask.empty() || mask.count() == oa.runs) && plan.fit(y, rs)) return true;
+    auto design = build_design_from_orthogonal_array_for_factors(oa, all_levels, factor_indices);
+    return rs.fit(design, y, mask);
+}
+
+// Single response: builds the plan only when the closed form can be used
+// (every run kept and every response finite)
+inline bool fit_response_surface_oa(
+    ResponseSurfaceQuadratic& rs,
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices,
+    const std::vector<double>& y,
+    const RunMask& mask = RunMask{})
+{
+    const bool complete = (mask.empty() || mask.count() == oa.runs)
+        && std::all_of(y.begin(), y.end(), [](double v) { return std::isfinite(v); });
+    if (complete)
+        return fit_response_surface_oa(rs, OrthogonalQuadraticPlan(oa, all_levels, factor_indices),
+                                       oa, all_levels, factor_indices, y, mask);
+    DOE_TRACE_SCOPE("fit_response_surface_oa");
+    auto design = build_design_from_orthogonal_array_for_factors(oa, all_levels, factor_indices);
+    return rs.fit(design, y, mask);
+}
@@ -0,0 +1,388 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <random>
+#include <numeric>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "response_surface_quadratic.hpp"
+#include "response_surface_validation.hpp"
+#include "doe_parallel.hpp"
+#include "doe_trace.hpp"
+
+// -----------------------------------------------------------------------------
+// Penalized response surfaces: ridge, lasso and elastic net
+//
+// Saturated designs (e.g. 8 factors on L18: 45 quadratic terms, 18 runs) leave
+// ResponseSurfaceQuadratic::fit rank-deficient; its QR basic solution is one
+// arbitrary member of a whole family of interpolating fits. A penalty picks a
+// unique, stable one instead. With the intercept unpenalized and the features
+// centered and scaled to unit variance (x_j -> (x_j - mu_j) / s_j):
+//   min (1 / 2N) ||y - b0 - X b||^2 + lambda ( alpha ||b||_1 + (1 - alpha) / 2 ||b||^2 )
+// alpha = 0 (ridge) : one SVD X = U D V^T gives every lambda,
+//                     b = V diag(d / (d^2 + N lambda)) U^T y, and exact LOO residuals
+//                     (fit_ridge uses the augmented QR [X; sqrt(N lambda) I] instead)
+// alpha > 0         : covariance-updating coordinate descent over a decreasing
+//                     lambda path with warm starts. r_j = <x_j, y - X b> / N is kept
+//                     for every j; a coefficient change updates r with one cached
+//                     Gram column, computed when the term first becomes active.
+//                     Sequential strong rules (|r_j| < alpha (2 lambda - lambda_prev))
+//                     screen terms out, and a KKT check over the rest restores any
+//                     wrongly discarded ones.
+// Path: n_lambda values log-spaced from lambda_max = max_j |<x_j, yc>| / (N alpha),
+// the smallest lambda with every b_j = 0, down to lambda_min_ratio * lambda_max
+// (ridge starts at the alpha = 0.001 value, as glmnet). A lambda is converged when
+// no coordinate moves by more than tol * var(y) (G_jj delta_j^2) in a full sweep.
+// lambda is chosen by k-fold cross-validation on the same path: the minimum of the
+// mean CV error, or (one_se_rule) the largest lambda within one standard error.
+// Coefficients are returned in natural units, row 0 the intercept.
+// -----------------------------------------------------------------------------
+
+struct PenalizedFitOptions {
+    double alpha = 1.0;               // 1 = lasso, (0,1) = elastic net, 0 = ridge
+    int n_lambda = 100;
+    double lambda_min_ratio = 0.0;    // 0: 1e-4 if runs > terms, else 1e-2
+    std::vector<double> lambdas;      // explicit decreasing path (overrides the two above)
+    double tol = 1e-7;                // max G_jj delta_j^2 per sweep, relative to var(y)
+    int max_sweeps = 100000;          // per lambda
+    bool standardize = true;          // scale features to unit variance (always centered)
+};
+
+struct PenalizedPath {
+    double alpha = 1.0;
+    std::vector<double> lambda;       // decreasing
+    Eigen::MatrixXd coefficients;     // (p + 1) x L, natural units; row 0 = intercept
+    std::vector<int> nonzero;         // [l] nonzero feature coefficients
+    std::vector<double> rss;          // [l] training residual sum of squares
+    long long sweeps = 0;             // coordinate-descent sweeps over all lambdas
+    int gram_columns = 0;             // Gram columns computed (terms ever active)
+};
+
+struct PenalizedCvResult {
+    PenalizedPath path;               // fitted on all runs
+    int folds = 0;
+    std::vector<double> cv_mse;       // [l] mean squared cross-validated error
+    std::vector<double> cv_se;        // [l] standard error of cv_mse over folds
+    int best = 0;                     // argmin cv_mse
+    int best_1se = 0;                 // largest lambda with cv_mse <= min + se
+    double lambda_best() const { return path.lambda[best]; }
+    double lambda_1se() const { return path.lambda[best_1se]; }
+};
+
+namespace penalized_detail {
+
+// Centered, optionally scaled features; constant columns get scale 0 and are left out
+struct Standardized {
+    Eigen::MatrixXd Xs;               // N x p
+    Eigen::VectorXd mu, scale;        // x_s = (x - mu) * scale
+    Eigen::VectorXd yc;
+    double ymean = 0.0;
+    double yvar = 0.0;                // ||yc||^2 / N
+};
+
+inline Standardized standardize(const Eigen::MatrixXd& X, const Eigen::VectorXd& y, bool scale_to_unit)
+{
+    const Eigen::Index N = X.rows(), p = X.cols();
+    Standardized s;
+    s.mu = X.colwise().mean().transpose();
+    s.Xs = X.rowwise() - s.mu.transpose();
+    s.scale.resize(p);
+    for (Eigen::Index j = 0; j < p; ++j) {
+        double sd = std::sqrt(s.Xs.col(j).squaredNorm() / N);
+        double ref = 1.0 + std::fabs(s.mu(j));
+        if (!(sd > 1e-10 * ref)) s.scale(j) = 0.0;
+        else s.scale(j) = scale_to_unit ? 1.0 / sd : 1.0;
+        s.Xs.col(j) *= s.scale(j);
+    }
+    s.ymean = y.mean();
+    s.yc = y.array() - s.ymean;
+    s.yvar = s.yc.squaredNorm() / N;
+    return s;
+}
+
+// Standardized coefficients -> natural units (row 0 intercept)
+inline Eigen::VectorXd to_natural(const Standardized& s, const Eigen::VectorXd& b)
+{
+    const Eigen::Index p = b.size();
+    Eigen::VectorXd out(p + 1);
+    out.tail(p) = b.cwiseProduct(s.scale);
+    out(0) = s.ymean - out.tail(p).dot(s.mu);
+    return out;
+}
+
+inline std::vector<double> lambda_path(const PenalizedFitOptions& opt, double lambda_max, Eigen::Index N, Eigen::Index p)
+{
+    if (!opt.lambdas.empty()) {
+        for (size_t l = 1; l < opt.lambdas.size(); ++l)
+            if (!(opt.lambdas[l] < opt.lambdas[l - 1]))
+                throw std::runtime_error("elastic_net_path: lambdas must be strictly decreasing");
+        if (!(opt.lambdas.back() > 0.0))
+            throw std::runtime_error("elastic_net_path: lambdas must be positive");
+        return opt.lambdas;
+    }
+    if (opt.n_lambda < 1)
+        throw std::runtime_error("elastic_net_path: n_lambda must be >= 1");
+    double ratio = opt.lambda_min_ratio > 0.0 ? opt.lambda_min_ratio : (N > p ? 1e-4 : 1e-2);
+    if (!(lambda_max > 0.0)) lambda_max = 1.0;   // y constant: every fit is the mean
+    std::vector<double> lam(opt.n_lambda);
+    for (int l = 0; l < opt.n_lambda; ++l)
+        lam[l] = lambda_max * std::pow(ratio, opt.n_lambda == 1 ? 0.0 : double(l) / (opt.n_lambda - 1));
+    return lam;
+}
+
+inline PenalizedPath ridge_path(const Standardized& s, const PenalizedFitOptions& opt)
+{
+    const Eigen::Index N = s.Xs.rows(), p = s.Xs.cols();
+    Eigen::VectorXd c = s.Xs.transpose() * s.yc / double(N);
+    // as glmnet: the ridge path starts where lasso would be empty, at max|c| / 0.001
+    std::vector<double> lam = lambda_path(opt, c.cwiseAbs().maxCoeff() / 1e-3, N, p);
+    Eigen::BDCSVD<Eigen::MatrixXd> svd(s.Xs, Eigen::ComputeThinU | Eigen::ComputeThinV);
+    const Eigen::VectorXd& d = svd.singularValues();
+    Eigen::VectorXd uty = svd.matrixU().transpose() * s.yc;
+
+    PenalizedPath path;
+    path.alpha = 0.0;
+    path.lambda = lam;
+    path.coefficients.resize(p + 1, lam.size());
+    for (size_t l = 0; l < lam.size(); ++l) {
+        Eigen::VectorXd f = d.array() / (d.array().square() + N * lam[l]);
+        Eigen::VectorXd b = svd.matrixV() * f.cwiseProduct(uty);
+        path.coefficients.col(l) = to_natural(s, b);
+        path.nonzero.push_back(static_cast<int>((b.array() != 0.0).count()));
+        // residual: component of yc outside span(U) plus shrunk components
+        Eigen::VectorXd shrink = (N * lam[l]) / (d.array().square() + N * lam[l]);
+        path.rss.push_back(s.yc.squaredNorm() - uty.squaredNorm() + shrink.cwiseProduct(uty).squaredNorm());
+    }
+    return path;
+}
+
+inline double soft_threshold(double z, double t)
+{
+    return z > t ? z - t : (z < -t ? z + t : 0.0);
+}
+
+inline PenalizedPath coordinate_descent_path(const Standardized& s, const PenalizedFitOptions& opt)
+{
+    const Eigen::Index N = s.Xs.rows();
+    const int p = static_cast<int>(s.Xs.cols());
+    const double alpha = opt.alpha;
+    const Eigen::VectorXd c = s.Xs.transpose() * s.yc / double(N);
+    std::vector<double> lam = lambda_path(opt, c.cwiseAbs().maxCoeff() / alpha, N, p);
+
+    Eigen::VectorXd gdiag(p);
+    for (int j = 0; j < p; ++j) gdiag(j) = s.Xs.col(j).squaredNorm() / N;
+    Eigen::MatrixXd G(p, p);                 // column j valid once have_col[j]
+    std::vector<char> have_col(p, 0), strong(p, 0);
+    Eigen::VectorXd b = Eigen::VectorXd::Zero(p);
+    Eigen::VectorXd r = c;                   // <x_j, yc - Xs b> / N
+    const double tol = opt.tol * std::max(s.yvar, std::numeric_limits<double>::min());
+
+    PenalizedPath path;
+    path.alpha = alpha;
+    path.lambda = lam;
+    path.coefficients.resize(p + 1, lam.size());
+
+    auto update = [&](int j, double thresh, double ridge) {
+        if (gdiag(j) == 0.0) return 0.0;
+        double z = r(j) + gdiag(j) * b(j);
+        double bn = soft_threshold(z, thresh) / (gdiag(j) + ridge);
+        double delta = bn - b(j);
+        if (delta == 0.0) return 0.0;
+        if (!have_col[j]) {
+            G.col(j).noalias() = s.Xs.transpose() * s.Xs.col(j) / double(N);
+            have_col[j] = 1;
+            ++path.gram_columns;
+        }
+        r.noalias() -= delta * G.col(j);
+        b(j) = bn;
+        return gdiag(j) * delta * delta;
+    };
+
+    double lambda_prev = c.cwiseAbs().maxCoeff() / alpha;
+    std::vector<int> strong_set, active_set;
+    for (size_t l = 0; l < lam.size(); ++l) {
+        const double thresh = alpha * lam[l];
+        const double ridge = (1.0 - alpha) * lam[l];
+        // sequential strong rule, plus every term already in the model
+        strong_set.clear();
+        for (int j = 0; j < p; ++j) {
+            strong[j] = b(j) != 0.0 || std::fabs(r(j)) >= alpha * (2.0 * lam[l] - lambda_prev);
+            if (strong[j]) strong_set.push_back(j);
+        }
+        int sweeps = 0;
+        for (;;) {
+            // converge on the strong set (inner passes over the active terms only)
+            for (;;) {
+                double maxd = 0.0;
+                for (int j : strong_set) maxd = std::max(maxd, update(j, thresh, ridge));
+                ++sweeps;
+                if (maxd < tol || sweeps >= opt.max_sweeps) break;
+                active_set.clear();
+                for (int j : strong_set) if (b(j) != 0.0) active_set.push_back(j);
+                for (;;) {
+                    double md = 0.0;
+                    for (int j : active_set) md = std::max(md, update(j, thresh, ridge));
+                    ++sweeps;
+                    if (md < tol || sweeps >= opt.max_sweeps) break;
+                }
+            }
+            // KKT check over the screened-out terms
+            bool violated = false;
+            for (int j = 0; j < p; ++j) {
+                if (strong[j] || gdiag(j) == 0.0) continue;
+                if (std::fabs(r(j)) > thresh) {
+                    strong[j] = 1;
+                    strong_set.push_back(j);
+                    violated = true;
+                }
+            }
+            if (!violated || sweeps >= opt.max_sweeps) break;
+        }
+        path.sweeps += sweeps;
+        path.coefficients.col(l) = to_natural(s, b);
+        path.nonzero.push_back(static_cast<int>((b.array() != 0.0).count()));
+        // ||yc - Xs b||^2 = N (yvar - b.c - b.r), since G b = c - r
+        path.rss.push_back(std::max(0.0, N * (s.yvar - b.dot(c) - b.dot(r))));
+        lambda_prev = lam[l];
+    }
+    DOE_TRACE_COUNT("cd_sweeps", static_cast<double>(path.sweeps));
+    return path;
+}
+
+inline void check_inputs(const char* fn, const Eigen::MatrixXd& X, const std::vector<double>& y, const PenalizedFitOptions& opt)
+{
+    if (X.rows() < 2 || X.cols() < 1 || (Eigen::Index)y.size() != X.rows())
+        throw std::runtime_error(std::string(fn) + ": need y.size() == runs >= 2 and at least one term");
+    if (!(opt.alpha >= 0.0 && opt.alpha <= 1.0))
+        throw std::runtime_error(std::string(fn) + ": alpha must be in [0,1]");
+    for (double v : y)
+        if (!std::isfinite(v))
+            throw std::runtime_error(std::string(fn) + ": responses must be finite");
+}
+
+} // namespace penalized_detail
+
+// -----------------------------------------------------------------------------
+// Full path. X holds the features without the intercept column (N x p).
+// -----------------------------------------------------------------------------
+inline PenalizedPath elastic_net_path(const Eigen::MatrixXd& X,
+                                      const std::vector<double>& y,
+                                      const PenalizedFitOptions& opt = PenalizedFitOptions{})
+{
+    DOE_TRACE_SCOPE("elastic_net_path");
+    penalized_detail::check_inputs("elastic_net_path", X, y, opt);
+    Eigen::Map<const Eigen::VectorXd> Y(y.data(), static_cast<Eigen::Index>(y.size()));
+    auto s = penalized_detail::standardize(X, Y, opt.standardize);
+    return opt.alpha == 0.0 ? penalized_detail::ridge_path(s, opt)
+                            : penalized_detail::coordinate_descent_path(s, opt);
+}
+
+// Single ridge fit by least squares on the augmented system [Xs; sqrt(N lambda) I]
+inline Eigen::VectorXd fit_ridge(const Eigen::MatrixXd& X, const std::vector<double>& y,
+                                 double lambda, bool standardize = true)
+{
+    DOE_TRACE_SCOPE("fit_ridge");
+    penalized_detail::check_inputs("fit_ridge", X, y, PenalizedFitOptions{});
+    if (!(lambda >= 0.0))
+        throw std::runtime_error("fit_ridge: lambda must be >= 0");
+    Eigen::Map<const Eigen::VectorXd> Y(y.data(), static_cast<Eigen::Index>(y.size()));
+    auto s = penalized_detail::standardize(X, Y, standardize);
+    const Eigen::Index N = X.rows(), p = X.cols();
+    Eigen::MatrixXd A(N + p, p);
+    A.topRows(N) = s.Xs;
+    A.bottomRows(p) = std::sqrt(N * lambda) * Eigen::MatrixXd::Identity(p, p);
+    Eigen::VectorXd rhs = Eigen::VectorXd::Zero(N + p);
+    rhs.head(N) = s.yc;
+    Eigen::VectorXd b = Eigen::ColPivHouseholderQR<Eigen::MatrixXd>(A).solve(rhs);
+    return penalized_detail::to_natural(s, b);
+}
+
+// -----------------------------------------------------------------------------
+// Path on all runs, then k-fold CV on the same lambdas (folds in parallel)
+// -----------------------------------------------------------------------------
+inline PenalizedCvResult elastic_net_cv(const Eigen::MatrixXd& X,
+                                        const std::vector<double>& y,
+                                        const PenalizedFitOptions& opt = PenalizedFitOptions{},
+                                        const KFoldOptions& cv = KFoldOptions{})
+{
+    DOE_TRACE_SCOPE("elastic_net_cv");
+    penalized_detail::check_inputs("elastic_net_cv", X, y, opt);
+    const int N = static_cast<int>(X.rows());
+    if (cv.folds < 2 || cv.folds > N)
+        throw std::runtime_error("elastic_net_cv: folds must be in [2, runs]");
+
+    PenalizedCvResult out;
+    out.path = elastic_net_path(X, y, opt);
+    out.folds = cv.folds;
+    const int L = static_cast<int>(out.path.lambda.size());
+
+    std::vector<int> perm(N), fold(N);
+    std::iota(perm.begin(), perm.end(), 0);
+    if (cv.shuffle) {
+        std::mt19937_64 rng(cv.seed);
+        std::shuffle(perm.begin(), perm.end(), rng);
+    }
+    for (int i = 0; i < N; ++i) fold[perm[i]] = i % cv.folds;
+
+    PenalizedFitOptions fold_opt = opt;
+    fold_opt.lambdas = out.path.lambda;
+    Eigen::MatrixXd sse(cv.folds, L);            // per fold, per lambda
+    std::vector<int> fold_n(cv.folds, 0);
+    doe_parallel::parallel_for(cv.folds, cv.threads, [&](int f) {
+        std::vector<int> train, test;
+        for (int i = 0; i < N; ++i) (fold[i] == f ? test : train).push_back(i);
+        Eigen::MatrixXd Xt(train.size(), X.cols()), Xv(test.size(), X.cols());
+        std::vector<double> yt(train.size());
+        for (size_t q = 0; q < train.size(); ++q) { Xt.row(q) = X.row(train[q]); yt[q] = y[train[q]]; }
+        for (size_t q = 0; q < test.size(); ++q) Xv.row(q) = X.row(test[q]);
+        PenalizedPath pf = elastic_net_path(Xt, yt, fold_opt);
+        Eigen::MatrixXd pred = Xv * pf.coefficients.bottomRows(X.cols());
+        pred.rowwise() += pf.coefficients.row(0);
+        for (int l = 0; l < L; ++l) {
+            double e = 0.0;
+            for (size_t q = 0; q < test.size(); ++q) e += std::pow(y[test[q]] - pred(q, l), 2);
+            sse(f, l) = e;
+        }
+        fold_n[f] = static_cast<int>(test.size());
+    });
+
+    out.cv_mse.resize(L);
+    out.cv_se.resize(L);
+    for (int l = 0; l < L; ++l) {
+        out.cv_mse[l] = sse.col(l).sum() / N;
+        double m2 = 0.0;
+        for (int f = 0; f < cv.folds; ++f) m2 += std::pow(sse(f, l) / fold_n[f] - out.cv_mse[l], 2);
+        out.cv_se[l] = std::sqrt(m2 / (cv.folds - 1) / cv.folds);
+    }
+    out.best = static_cast<int>(std::min_element(out.cv_mse.begin(), out.cv_mse.end()) - out.cv_mse.begin());
+    out.best_1se = out.best;
+    for (int l = 0; l < out.best; ++l) {
+        if (out.cv_mse[l] <= out.cv_mse[out.best] + out.cv_se[out.best]) { out.best_1se = l; break; }
+    }
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// Quadratic model: CV-chosen penalized fit stored in rs (ResponseSurfaceQuadratic
+// term order). rs.rank() reports the number of nonzero terms, intercept included.
+// -----------------------------------------------------------------------------
+inline PenalizedCvResult fit_response_surface_penalized(
+    ResponseSurfaceQuadratic& rs,
+    const std::vector<std::vector<double>>& design,
+    const std::vector<double>& y,
+    const PenalizedFitOptions& opt = PenalizedFitOptions{},
+    const KFoldOptions& cv = KFoldOptions{},
+    bool one_se_rule = false)
+{
+    DOE_TRACE_SCOPE("fit_response_surface_penalized");
+    Eigen::MatrixXd Phi = cv_detail::quadratic_feature_matrix(design);
+    const int m = static_cast<int>(Phi.cols());
+    PenalizedCvResult res = elastic_net_cv(Phi.rightCols(m - 1), y, opt, cv);
+    const int l = one_se_rule ? res.best_1se : res.best;
+    rs.restore_fit(static_cast<int>(design[0].size()), res.path.coefficients.col(l), 1 + res.path.nonzero[l]);
+    return res;
+}
@@ -1,8 +1,29 @@
 #pragma once
 #include <vector>
 #include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include <utility>
 #include <Eigen/Dense>
 
+#include "orthogonal_array.hpp"
+#include "Anom_Utils.h"
+#include "doe_trace.hpp"
+#include "doe_run_mask.hpp"
+
+// Loss for ResponseSurfaceQuadratic::fit_robust
+// Huber    : w = min(1, c / |u|)          (bounded influence, keeps every run)
+// Bisquare : w = (1 - (u / c)^2)^2, |u|<c (gross outliers get zero weight)
+// u = residual / robust scale, scale = MAD(residuals) / 0.6745
+enum class RobustLoss { Huber, Bisquare };
+
+struct RobustFitOptions {
+    RobustLoss loss = RobustLoss::Huber;
+    double tuning = 0.0;          // c; 0 = 1.345 (Huber) or 4.685 (bisquare), 95% efficiency
+    int max_iterations = 50;
+    double tol = 1e-8;            // stop when max |delta beta| <= tol * (1 + max |beta|)
+};
+
 // Quadratic response surface:
 // y ≈ β0 + Σ β_i x_i + Σ β_ii x_i^2 + Σ β_ij x_i x_j (i<j)
 class ResponseSurfaceQuadratic {
@@ -11,9 +32,12 @@ public:
 
     // Fit using linear least squares with column-pivoted QR.
     // This is robust even if Phi^T Phi is singular (rank-deficient design).
+    // Runs with a NaN response or cleared in `mask` are skipped (design is not copied).
     bool fit(const std::vector<std::vector<double>>& design,
-             const std::vector<double>& y)
+             const std::vector<double>& y,
+             const RunMask& mask = RunMask{})
     {
+        DOE_TRACE_SCOPE("ResponseSurfaceQuadratic::fit");
         int N = static_cast<int>(design.size());
         if (N == 0) return false;
         if ((int)y.size() != N) return false;
@@ -24,50 +48,134 @@ public:
                 return false;
         }
 
-        int num_cross = k_ * (k_ - 1) / 2;
-        int m = 1 + k_ + k_ + num_cross; // 1 + linear + quadratic + interactions
-
-        Eigen::MatrixXd Phi(N, m);
-        Eigen::VectorXd Y(N);
-
-        for (int r = 0; r < N; ++r) {
-            const auto& x = design[r];
-            int col = 0;
+        int m = num_terms(k_); // 1 + linear + quadratic + interactions
 
-            // constant term
-            Phi(r, col++) = 1.0;
+        RunMask active = effective_run_mask(y, mask);
+        const int used = active.empty() ? N : active.count();
+        if (used == 0) return false;
 
-            // linear terms
-            for (int i = 0; i < k_; ++i)
-                Phi(r, col++) = x[i];
-
-            // squared terms
-            for (int i = 0; i < k_; ++i)
-                Phi(r, col++) = x[i] * x[i];
-
-            // interaction terms (i<j)
-            for (int i = 0; i < k_; ++i) {
-                for (int j = i + 1; j < k_; ++j) {
-                    Phi(r, col++) = x[i] * x[j];
-                }
-            }
+        Eigen::MatrixXd Phi(used, m);
+        Eigen::VectorXd Y(used);
+        Eigen::VectorXd phi(m);
+        DOE_TRACE_COUNT("alloc_bytes", sizeof(double) * (static_cast<size_t>(used) * m + used + m));
+        DOE_TRACE_COUNT("rows_scanned", N);
 
-            Y(r) = y[r];
+        int q = 0;
+        auto add_row = [&](int r) {
+            expand_terms(design[r].data(), k_, phi.data());
+            Phi.row(q) = phi.transpose();
+            Y(q) = y[r];
+            ++q;
+        };
+        if (active.empty()) {
+            for (int r = 0; r < N; ++r) add_row(r);
+        } else {
+            active.for_each(add_row);
         }
 
         // Column-pivoted QR for least squares: min ||Phi * beta - Y||
         Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
-        int rank = qr.rank();
+        rank_ = static_cast<int>(qr.rank());
+        DOE_TRACE_COUNTER("qr_rank", rank_);
 
-        if (rank < m) {
+        if (rank_ < m) {
             // Rank-deficient design: not all coefficients are uniquely identifiable.
             // We still compute a least-squares solution (minimum-norm in the QR sense).
-            // You can log or assert here if you want to detect aliasing.
+            // rank() reports it; response_surface_selection.hpp picks an estimable subset,
+            // response_surface_penalized.hpp shrinks all terms to a unique stable fit.
             // std::cerr << "Warning: ResponseSurfaceQuadratic: design is rank-deficient (rank="
             //           << rank << " < " << m << ")\n";
         }
 
         beta_ = qr.solve(Y); // works even if rank < m
+        weights_.resize(0);
+        iterations_ = 0;
+        fitted_ = true;
+        return true;
+    }
+
+    // Robust fit by iteratively reweighted least squares, started from the LS fit.
+    // Bisquare is not convex, so it starts from the converged Huber solution.
+    // Phi is built once; each iteration scales its rows by sqrt(w) into one
+    // preallocated work matrix and refactors it with the same QR object, so an
+    // iteration costs one weighted QR and nothing is reallocated.
+    bool fit_robust(const std::vector<std::vector<double>>& design,
+                    const std::vector<double>& y,
+                    const RobustFitOptions& opt = RobustFitOptions{})
+    {
+        DOE_TRACE_SCOPE("ResponseSurfaceQuadratic::fit_robust");
+        int N = static_cast<int>(design.size());
+        if (N == 0 || (int)y.size() != N) return false;
+        k_ = static_cast<int>(design[0].size());
+        for (int i = 1; i < N; ++i) {
+            if ((int)design[i].size() != k_)
+                return false;
+        }
+        const int m = num_terms(k_);
+        const double c_final = (opt.tuning > 0.0) ? opt.tuning
+                             : (opt.loss == RobustLoss::Huber ? 1.345 : 4.685);
+        RobustLoss loss = RobustLoss::Huber;
+        double c = (opt.loss == RobustLoss::Huber) ? c_final : 1.345;
+
+        Eigen::MatrixXd Phi(N, m), A(N, m);
+        Eigen::VectorXd Y(N), Ay(N), r(N), sw(N), beta_old(m), phi(m);
+        std::vector<double> dev(N);
+        for (int i = 0; i < N; ++i) {
+            expand_terms(design[i].data(), k_, phi.data());
+            Phi.row(i) = phi.transpose();
+            Y(i) = y[i];
+        }
+        DOE_TRACE_COUNT("alloc_bytes", sizeof(double) * (2 * static_cast<size_t>(N) * m + 5 * N + 2 * m));
+        DOE_TRACE_COUNT("rows_scanned", N);
+
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(N, m);
+        qr.compute(Phi);
+        beta_ = qr.solve(Y);
+        weights_.setOnes(N);
+        scale_ = 0.0;
+        iterations_ = 0;
+
+        for (int it = 0; it < opt.max_iterations; ++it) {
+            r = Y;
+            r.noalias() -= Phi * beta_;
+
+            // robust scale: MAD of the residuals
+            for (int i = 0; i < N; ++i) dev[i] = r(i);
+            double med = Anom::median_in_place(dev);
+            for (int i = 0; i < N; ++i) dev[i] = std::fabs(r(i) - med);
+            scale_ = Anom::median_in_place(dev) / 0.6745;
+            if (!(scale_ > 1e-12 * (1.0 + Y.cwiseAbs().maxCoeff())))
+                break;   // (near) exact fit: nothing to down-weight
+
+            for (int i = 0; i < N; ++i) {
+                double u = std::fabs(r(i)) / (c * scale_);
+                double w;
+                if (loss == RobustLoss::Huber)
+                    w = (u <= 1.0) ? 1.0 : 1.0 / u;
+                else
+                    w = (u < 1.0) ? (1.0 - u * u) * (1.0 - u * u) : 0.0;
+                weights_(i) = w;
+                sw(i) = std::sqrt(w);
+            }
+            A.noalias() = sw.asDiagonal() * Phi;
+            Ay = sw.cwiseProduct(Y);
+
+            qr.compute(A);
+            beta_old = beta_;
+            beta_ = qr.solve(Ay);
+            ++iterations_;
+
+            double step = (beta_ - beta_old).cwiseAbs().maxCoeff();
+            if (step <= opt.tol * (1.0 + beta_old.cwiseAbs().maxCoeff())) {
+                if (loss == opt.loss) break;
+                loss = opt.loss;       // Huber start converged: switch to bisquare
+                c = c_final;
+            }
+        }
+
+        rank_ = static_cast<int>(qr.rank());
+        DOE_TRACE_COUNTER("qr_rank", rank_);
+        DOE_TRACE_COUNTER("irls_iterations", iterations_);
         fitted_ = true;
         return true;
     }
@@ -79,38 +187,176 @@ public:
         if ((int)x.size() != k_)
             throw std::runtime_error("ResponseSurfaceQuadratic::predict: dimension mismatch");
 
-        int num_cross = k_ * (k_ - 1) / 2;
-        int m = 1 + k_ + k_ + num_cross;
+        Eigen::VectorXd phi(num_terms(k_));
+        expand_terms(x.data(), k_, phi.data());
+        return beta_.dot(phi);
+    }
 
-        Eigen::VectorXd phi(m);
-        int col = 0;
+    // Predict many points: x is row-major (rows x k), out has rows entries.
+    // Evaluates the terms in place; no per-point allocation.
+    void predict_batch(const double* x, int rows, double* out) const {
+        if (!fitted_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::predict_batch: model not fitted yet");
 
-        // constant term
-        phi(col++) = 1.0;
+        const double* b = beta_.data();
+        const int k = k_;
+        for (int r = 0; r < rows; ++r) {
+            const double* xr = x + static_cast<size_t>(r) * k;
+            double v = b[0];
+            int col = 1;
+            for (int i = 0; i < k; ++i)
+                v += b[col++] * xr[i];
+            for (int i = 0; i < k; ++i)
+                v += b[col++] * xr[i] * xr[i];
+            for (int i = 0; i < k; ++i) {
+                for (int j = i + 1; j < k; ++j)
+                    v += b[col++] * xr[i] * xr[j];
+            }
+            out[r] = v;
+        }
+    }
 
-        // linear terms
-        for (int i = 0; i < k_; ++i)
-            phi(col++) = x[i];
+    void predict_batch(const DesignMatrix& X, std::vector<double>& out) const {
+        if (X.factors != k_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::predict_batch: dimension mismatch");
+        out.resize(X.runs);
+        predict_batch(X.data.data(), X.runs, out.data());
+    }
 
-        // squared terms
-        for (int i = 0; i < k_; ++i)
-            phi(col++) = x[i] * x[i];
+    // Gradient at x: g_i = b_i + 2 b_ii x_i + sum_{j!=i} b_ij x_j
+    void gradient(const double* x, double* g) const {
+        if (!fitted_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::gradient: model not fitted yet");
+        value_and_gradient(x, g);
+    }
 
-        // interaction terms
+    std::vector<double> gradient(const std::vector<double>& x) const {
+        if ((int)x.size() != k_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::gradient: dimension mismatch");
+        std::vector<double> g(k_);
+        gradient(x.data(), g.data());
+        return g;
+    }
+
+    // Hessian (constant): H_ii = 2 b_ii, H_ij = H_ji = b_ij
+    Eigen::MatrixXd hessian() const {
+        if (!fitted_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::hessian: model not fitted yet");
+        Eigen::MatrixXd H(k_, k_);
         for (int i = 0; i < k_; ++i) {
-            for (int j = i + 1; j < k_; ++j) {
-                phi(col++) = x[i] * x[j];
-            }
+            H(i, i) = 2.0 * beta_(squared_index(k_, i));
+            for (int j = i + 1; j < k_; ++j)
+                H(i, j) = H(j, i) = beta_(interaction_index(k_, i, j));
         }
+        return H;
+    }
 
-        return beta_.dot(phi);
+    // Value and gradient of many points in one pass: x is row-major (rows x k),
+    // values has rows entries, grads is row-major (rows x k). Does not allocate.
+    void predict_with_gradient_batch(const double* x, int rows, double* values, double* grads) const {
+        if (!fitted_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::predict_with_gradient_batch: model not fitted yet");
+        const size_t k = static_cast<size_t>(k_);
+        for (int r = 0; r < rows; ++r)
+            values[r] = value_and_gradient(x + r * k, grads + r * k);
+    }
+
+    void predict_with_gradient_batch(const DesignMatrix& X, std::vector<double>& values,
+                                     std::vector<double>& grads) const {
+        if (X.factors != k_)
+            throw std::runtime_error("ResponseSurfaceQuadratic::predict_with_gradient_batch: dimension mismatch");
+        values.resize(X.runs);
+        grads.resize(static_cast<size_t>(X.runs) * k_);
+        predict_with_gradient_batch(X.data.data(), X.runs, values.data(), grads.data());
     }
 
     int num_factors() const { return k_; }
+
+    // Restore a fitted model from stored coefficients (e.g. doe_result_cache.hpp)
+    void restore_fit(int k, const Eigen::VectorXd& beta, int rank) {
+        if (k <= 0 || beta.size() != num_terms(k))
+            throw std::runtime_error("ResponseSurfaceQuadratic::restore_fit: coefficient count mismatch");
+        k_ = k;
+        beta_ = beta;
+        rank_ = rank;
+        weights_.resize(0);
+        iterations_ = 0;
+        scale_ = 0.0;
+        fitted_ = true;
+    }
+    int rank() const { return rank_; }       // numerical rank of Phi from the last fit
+
+    // fit_robust diagnostics: final IRLS weights per run (empty after fit()),
+    // robust residual scale and the number of reweighting iterations
+    const Eigen::VectorXd& weights() const { return weights_; }
+    double robust_scale() const { return scale_; }
+    int iterations() const { return iterations_; }
     const Eigen::VectorXd& coefficients() const { return beta_; }
 
+    // Number of model terms for k factors: 1 + k + k + k*(k-1)/2
+    static int num_terms(int k) { return 1 + 2 * k + k * (k - 1) / 2; }
+
+    // Position of each term in coefficients() / expand_terms
+    static int linear_index(int i) { return 1 + i; }
+    static int squared_index(int k, int i) { return 1 + k + i; }
+    static int interaction_index(int k, int i, int j) {
+        if (i > j) std::swap(i, j);
+        return 1 + 2 * k + i * (2 * k - i - 1) / 2 + (j - i - 1);
+    }
+
+    // Fill phi[0..num_terms(k)) with the basis vector of x[0..k).
+    // Order: constant, linear x_i, squared x_i^2, interactions x_i x_j (i<j).
+    static void expand_terms(const double* x, int k, double* phi) {
+        int col = 0;
+
+        // constant term
+        phi[col++] = 1.0;
+
+        // linear terms
+        for (int i = 0; i < k; ++i)
+            phi[col++] = x[i];
+
+        // squared terms
+        for (int i = 0; i < k; ++i)
+            phi[col++] = x[i] * x[i];
+
+        // interaction terms (i<j)
+        for (int i = 0; i < k; ++i) {
+            for (int j = i + 1; j < k; ++j) {
+                phi[col++] = x[i] * x[j];
+            }
+        }
+    }
+
 private:
+    // f(x), with the gradient written to g[0..k)
+    double value_and_gradient(const double* x, double* g) const {
+        const double* b = beta_.data();
+        const int k = k_;
+        double v = b[0];
+        for (int i = 0; i < k; ++i) {
+            double bl = b[1 + i];
+            double bq = b[1 + k + i];
+            v += (bl + bq * x[i]) * x[i];
+            g[i] = bl + 2.0 * bq * x[i];
+        }
+        int col = 1 + 2 * k;
+        for (int i = 0; i < k; ++i) {
+            for (int j = i + 1; j < k; ++j) {
+                double bij = b[col++];
+                v += bij * x[i] * x[j];
+                g[i] += bij * x[j];
+                g[j] += bij * x[i];
+            }
+        }
+        return v;
+    }
+
     int k_ = 0;
+    int rank_ = 0;
+    int iterations_ = 0;
+    double scale_ = 0.0;
+    Eigen::VectorXd weights_;
     bool fitted_ = false;
     Eigen::VectorXd beta_;
 };
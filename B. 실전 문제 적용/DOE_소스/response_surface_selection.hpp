@@ -0,0 +1,639 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "polynomial_response_surface.hpp"
+#include "doe_parallel.hpp"
+
+// -----------------------------------------------------------------------------
+// Term selection for polynomial response surfaces
+// A full quadratic in k factors has 1 + 2k + k(k-1)/2 terms; small OA designs
+// cannot estimate all of them. These routines pick a subset of a candidate
+// PolynomialTermSet by AIC / BIC / PRESS.
+//
+// All candidate models are scored from one QR factorization of [Phi | y]:
+//   - adding a term applies one Householder reflection
+//   - dropping a term re-triangularizes with Givens rotations
+//   - RSS / PRESS of every neighbouring model follow in closed form
+// -----------------------------------------------------------------------------
+
+enum class SelectionCriterion { AIC, BIC, PRESS };
+enum class StepwiseDirection { Forward, Backward, Both };
+
+struct TermSelectionOptions {
+    SelectionCriterion criterion = SelectionCriterion::BIC;
+    StepwiseDirection direction  = StepwiseDirection::Both;
+    bool hierarchical   = true;   // a term needs all of its divisors (x0*x1 needs x0, x1)
+    bool keep_intercept = true;   // never drop the constant term
+    int max_terms = 0;            // 0 = runs - 2
+    int max_steps = 200;          // stepwise only
+    int max_candidates = 20;      // best subset only: free terms searched exhaustively
+    int threads = 0;              // 0 = hardware concurrency
+    double alias_tol = 1e-8;      // relative residual norm below which a term is aliased
+};
+
+struct TermSelectionStep {
+    int term = -1;                // index into the candidate term set
+    bool added = true;
+    double rss = 0.0;
+    double criterion = 0.0;
+};
+
+struct TermSelectionResult {
+    std::vector<int> selected;            // candidate indices, ascending
+    PolynomialTermSet terms;              // selected terms (candidate order)
+    PolynomialResponseSurface model;      // fitted on the selected terms
+    double rss = 0.0;
+    double criterion = 0.0;
+    std::vector<TermSelectionStep> history;   // stepwise only
+};
+
+struct SubsetSummary {
+    std::vector<int> selected;            // best subset of this size (empty if none valid)
+    double rss = std::numeric_limits<double>::infinity();
+    double criterion = std::numeric_limits<double>::infinity();
+};
+
+struct BestSubsetResult {
+    TermSelectionResult best;
+    std::vector<SubsetSummary> by_size;   // index = number of terms
+    long long nodes = 0;                  // branch-and-bound nodes visited
+};
+
+namespace selection_detail {
+
+inline double criterion_value(SelectionCriterion c, double rss, int p, int N)
+{
+    double s = std::max(rss, std::numeric_limits<double>::min()) / N;
+    switch (c) {
+    case SelectionCriterion::AIC: return N * std::log(s) + 2.0 * p;
+    case SelectionCriterion::BIC: return N * std::log(s) + p * std::log(static_cast<double>(N));
+    default: break;
+    }
+    throw std::runtime_error("criterion_value: PRESS needs residuals and leverages");
+}
+
+inline double press_from(const Eigen::VectorXd& e, const Eigen::VectorXd& h)
+{
+    double s = 0.0;
+    for (Eigen::Index i = 0; i < e.size(); ++i) {
+        double d = 1.0 - h(i);
+        if (d <= 1e-10) return std::numeric_limits<double>::infinity();
+        s += (e(i) / d) * (e(i) / d);
+    }
+    return s;
+}
+
+// parents[j]: candidates t != j whose exponents divide term j
+inline std::vector<std::vector<int>> divisor_lists(const PolynomialTermSet& ts)
+{
+    const int m = ts.size();
+    std::vector<std::vector<int>> parents(m);
+    for (int j = 0; j < m; ++j) {
+        for (int t = 0; t < m; ++t) {
+            if (t == j) continue;
+            bool divides = true;
+            for (int f = 0; f < ts.factors && divides; ++f)
+                divides = ts.exponent(t, f) <= ts.exponent(j, f);
+            if (divides) parents[j].push_back(t);
+        }
+    }
+    return parents;
+}
+
+inline bool is_hierarchical(const std::vector<int>& subset,
+                            const std::vector<std::vector<int>>& parents,
+                            std::vector<char>& in)
+{
+    std::fill(in.begin(), in.end(), 0);
+    for (int t : subset) in[t] = 1;
+    for (int t : subset) {
+        for (int q : parents[t])
+            if (!in[q]) return false;
+    }
+    return true;
+}
+
+inline int find_intercept(const PolynomialTermSet& ts)
+{
+    std::vector<int> zero(ts.factors, 0);
+    return ts.find(zero.data());
+}
+
+// Rotate column `from` to position `to` (from <= to), then zero the subdiagonal of
+// rows [from, to] with Givens rotations. Columns before `from` are untouched.
+template <class Mat>
+inline void move_column_back_and_retriangularize(Mat& B, int from, int to)
+{
+    for (int q = from; q < to; ++q) B.col(q).swap(B.col(q + 1));
+    Eigen::JacobiRotation<double> G;
+    for (int q = from; q < to; ++q) {
+        G.makeGivens(B(q, q), B(q + 1, q));
+        auto blk = B.rightCols(B.cols() - q);
+        blk.applyOnTheLeft(q, q + 1, G.adjoint());
+        B(q + 1, q) = 0.0;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Updatable QR of [Phi | y | I_N]:  B = Q^T [Phi | y | I_N]
+// Columns [0, p) are the current model, upper triangular in rows [0, p).
+// The identity block (PRESS only) holds Q^T, giving residuals and leverages.
+// -----------------------------------------------------------------------------
+class QRSubsetEngine {
+public:
+    QRSubsetEngine(const Eigen::MatrixXd& Phi, const Eigen::VectorXd& y, bool track_q)
+        : N_(static_cast<int>(Phi.rows())), m_(static_cast<int>(Phi.cols())), track_q_(track_q)
+    {
+        B_.resize(N_, m_ + 1 + (track_q_ ? N_ : 0));
+        B_.leftCols(m_) = Phi;
+        B_.col(m_) = y;
+        if (track_q_) B_.rightCols(N_).setIdentity();
+        order_.resize(m_);
+        pos_.resize(m_);
+        for (int j = 0; j < m_; ++j) order_[j] = pos_[j] = j;
+        norm2_.resize(m_);
+        for (int j = 0; j < m_; ++j) norm2_[j] = Phi.col(j).squaredNorm();
+        work_.resize(B_.cols());
+    }
+
+    int runs() const { return N_; }
+    int size() const { return p_; }
+    int term_at(int pos) const { return order_[pos]; }
+    int position(int term) const { return pos_[term]; }
+    bool selected(int term) const { return pos_[term] < p_; }
+    double rss() const { return B_.col(m_).tail(N_ - p_).squaredNorm(); }
+
+    // Residual norm^2 of a free term after projecting out the current model
+    double residual_norm2(int term) const { return B_.col(pos_[term]).tail(N_ - p_).squaredNorm(); }
+    bool aliased(int term, double tol) const {
+        return residual_norm2(term) <= tol * tol * std::max(norm2_[term], std::numeric_limits<double>::min());
+    }
+
+    // RSS after adding a free term
+    double rss_after_add(int term) const {
+        auto w = B_.col(pos_[term]).tail(N_ - p_);
+        auto z = B_.col(m_).tail(N_ - p_);
+        double ww = w.squaredNorm();
+        if (ww <= 0.0) return rss();
+        double wz = w.dot(z);
+        return rss() - wz * wz / ww;
+    }
+
+    void add(int term) {
+        int j = pos_[term];
+        if (j < p_) return;
+        swap_columns(j, p_);
+        const int n = N_ - p_;
+        if (n > 1) {
+            Eigen::VectorXd ess(n - 1);
+            double tau = 0.0, beta = 0.0;
+            B_.col(p_).tail(n).makeHouseholder(ess, tau, beta);
+            const int rest = static_cast<int>(B_.cols()) - p_ - 1;
+            B_.block(p_, p_ + 1, n, rest).applyHouseholderOnTheLeft(ess, tau, work_.data());
+            B_(p_, p_) = beta;
+            B_.col(p_).tail(n - 1).setZero();
+        }
+        ++p_;
+    }
+
+    void drop(int term) {
+        int i = pos_[term];
+        if (i >= p_) return;
+        move_column_back_and_retriangularize(B_, i, p_ - 1);
+        std::rotate(order_.begin() + i, order_.begin() + i + 1, order_.begin() + p_);
+        for (int q = i; q < p_; ++q) pos_[order_[q]] = q;
+        --p_;
+    }
+
+    // R^-T of the current model (lower triangular p x p)
+    Eigen::MatrixXd r_inverse_transpose() const {
+        Eigen::MatrixXd W = Eigen::MatrixXd::Identity(p_, p_);
+        B_.topLeftCorner(p_, p_).triangularView<Eigen::Upper>().transpose().solveInPlace(W);
+        return W;
+    }
+
+    // RSS after dropping the selected term at position i, given W = R^-T
+    double rss_after_drop(int i, const Eigen::MatrixXd& W) const {
+        auto s = W.col(i);
+        double g = s.dot(B_.col(m_).head(p_));
+        return rss() + g * g / s.squaredNorm();
+    }
+
+    // ---- PRESS (track_q only) ----
+    Eigen::MatrixXd q_matrix() const { return B_.rightCols(N_).transpose(); }
+
+    void residuals_and_leverages(const Eigen::MatrixXd& Q, Eigen::VectorXd& e, Eigen::VectorXd& h) const {
+        e.noalias() = Q.rightCols(N_ - p_) * B_.col(m_).tail(N_ - p_);
+        h = Q.leftCols(p_).rowwise().squaredNorm();
+    }
+
+    double press_after_add(int term, const Eigen::MatrixXd& Q,
+                           const Eigen::VectorXd& e, const Eigen::VectorXd& h) const {
+        auto w = B_.col(pos_[term]).tail(N_ - p_);
+        double nw = w.norm();
+        Eigen::VectorXd u = Q.rightCols(N_ - p_) * (w / nw);
+        double g = w.dot(B_.col(m_).tail(N_ - p_)) / nw;
+        return press_from(e - g * u, h + u.cwiseAbs2());
+    }
+
+    double press_after_drop(int i, const Eigen::MatrixXd& W, const Eigen::MatrixXd& Q,
+                            const Eigen::VectorXd& e, const Eigen::VectorXd& h) const {
+        Eigen::VectorXd s = W.col(i) / W.col(i).norm();
+        Eigen::VectorXd u = Q.leftCols(p_) * s;
+        double g = s.dot(B_.col(m_).head(p_));
+        return press_from(e + g * u, h - u.cwiseAbs2());
+    }
+
+    double press() const {
+        Eigen::MatrixXd Q = q_matrix();
+        Eigen::VectorXd e, h;
+        residuals_and_leverages(Q, e, h);
+        return press_from(e, h);
+    }
+
+    // [R | Q^T y] of the current model, for drop-only searches
+    Eigen::MatrixXd triangular_factor() const {
+        Eigen::MatrixXd T(p_, p_ + 1);
+        T.leftCols(p_) = B_.topLeftCorner(p_, p_).triangularView<Eigen::Upper>();
+        T.col(p_) = B_.col(m_).head(p_);
+        return T;
+    }
+
+private:
+    void swap_columns(int a, int b) {
+        if (a == b) return;
+        B_.col(a).swap(B_.col(b));
+        std::swap(order_[a], order_[b]);
+        pos_[order_[a]] = a;
+        pos_[order_[b]] = b;
+    }
+
+    int N_ = 0;
+    int m_ = 0;
+    int p_ = 0;
+    bool track_q_ = false;
+    Eigen::MatrixXd B_;
+    std::vector<int> order_;   // order_[position] = term
+    std::vector<int> pos_;     // pos_[term] = position
+    std::vector<double> norm2_;
+    Eigen::VectorXd work_;
+};
+
+inline TermSelectionResult finish_selection(const PolynomialTermSet& candidates,
+                                            const DesignMatrix& X,
+                                            const std::vector<double>& y,
+                                            std::vector<int> selected)
+{
+    std::sort(selected.begin(), selected.end());
+    TermSelectionResult res;
+    res.selected = selected;
+    res.terms.factors = candidates.factors;
+    for (int t : selected) {
+        auto first = candidates.exponents.begin() + static_cast<std::ptrdiff_t>(t) * candidates.factors;
+        res.terms.exponents.insert(res.terms.exponents.end(), first, first + candidates.factors);
+    }
+    res.model = PolynomialResponseSurface(res.terms);
+    res.model.fit(X, y);
+    return res;
+}
+
+inline void check_selection_inputs(const char* fn, const PolynomialTermSet& candidates,
+                                   const DesignMatrix& X, const std::vector<double>& y)
+{
+    if (candidates.size() == 0)
+        throw std::runtime_error(std::string(fn) + ": empty candidate term set");
+    if (X.factors != candidates.factors)
+        throw std::runtime_error(std::string(fn) + ": dimension mismatch");
+    if (X.runs < 3 || (int)y.size() != X.runs)
+        throw std::runtime_error(std::string(fn) + ": need y.size() == runs >= 3");
+}
+
+} // namespace selection_detail
+
+// -----------------------------------------------------------------------------
+// Stepwise selection
+// Forward / Both start from the intercept (if kept), Backward from all candidates.
+// Each step scores every admissible add and drop in parallel and applies the one
+// that lowers the criterion most (ties: lowest term index).
+// With hierarchical = true, adding a term also adds its missing divisors, and a
+// term cannot be dropped while a selected term contains it.
+// -----------------------------------------------------------------------------
+inline TermSelectionResult stepwise_select(const PolynomialTermSet& candidates,
+                                           const DesignMatrix& X,
+                                           const std::vector<double>& y,
+                                           const TermSelectionOptions& opt = {})
+{
+    using namespace selection_detail;
+    check_selection_inputs("stepwise_select", candidates, X, y);
+
+    const int N = X.runs;
+    const int m = candidates.size();
+    const int max_terms = std::min(m, opt.max_terms > 0 ? opt.max_terms : N - 2);
+    const bool use_press = (opt.criterion == SelectionCriterion::PRESS);
+    const auto parents = divisor_lists(candidates);
+    const int intercept = opt.keep_intercept ? find_intercept(candidates) : -1;
+
+    Eigen::MatrixXd Phi = polynomial_feature_matrix(candidates, X);
+    Eigen::Map<const Eigen::VectorXd> Y(y.data(), N);
+    QRSubsetEngine eng(Phi, Y, use_press);
+
+    auto score = [&](const QRSubsetEngine& e) {
+        return use_press ? e.press() : criterion_value(opt.criterion, e.rss(), e.size(), N);
+    };
+
+    TermSelectionResult out;
+    if (opt.direction == StepwiseDirection::Backward) {
+        for (int t = 0; t < m; ++t) {
+            if (eng.aliased(t, opt.alias_tol))
+                throw std::runtime_error("stepwise_select: backward elimination needs a full-rank candidate model");
+            eng.add(t);
+        }
+        if (eng.size() > N - 1)
+            throw std::runtime_error("stepwise_select: backward elimination needs runs > number of candidates");
+    } else if (intercept >= 0) {
+        eng.add(intercept);
+    }
+    double current = score(eng);
+
+    // Terms (missing divisors first, then the term itself) that adding `t` brings in
+    auto bundle_for = [&](int t) {
+        std::vector<int> b;
+        if (opt.hierarchical) {
+            for (int q : parents[t])
+                if (!eng.selected(q)) b.push_back(q);
+            std::sort(b.begin(), b.end(), [&](int a, int c) {
+                return candidates.degree(a) < candidates.degree(c) || (candidates.degree(a) == candidates.degree(c) && a < c);
+            });
+        }
+        b.push_back(t);
+        return b;
+    };
+
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> add_score(m), drop_score(m);
+
+    for (int step = 0; step < opt.max_steps; ++step) {
+        bool changed = false;
+
+        // ---- best add ----
+        if (opt.direction != StepwiseDirection::Backward) {
+            Eigen::MatrixXd Q;
+            Eigen::VectorXd e, h;
+            if (use_press) {
+                Q = eng.q_matrix();
+                eng.residuals_and_leverages(Q, e, h);
+            }
+            doe_parallel::parallel_for(m, opt.threads, [&](int t) {
+                add_score[t] = inf;
+                if (eng.selected(t)) return;
+                std::vector<int> b = bundle_for(t);
+                if (eng.size() + (int)b.size() > max_terms) return;
+                if (b.size() == 1) {
+                    if (eng.aliased(t, opt.alias_tol)) return;
+                    add_score[t] = use_press
+                        ? eng.press_after_add(t, Q, e, h)
+                        : criterion_value(opt.criterion, eng.rss_after_add(t), eng.size() + 1, N);
+                    return;
+                }
+                QRSubsetEngine trial = eng;
+                for (int q : b) {
+                    if (trial.aliased(q, opt.alias_tol)) return;
+                    trial.add(q);
+                }
+                add_score[t] = score(trial);
+            });
+
+            int best = -1;
+            for (int t = 0; t < m; ++t) {
+                if (add_score[t] < current - 1e-12 && (best < 0 || add_score[t] < add_score[best]))
+                    best = t;
+            }
+            if (best >= 0) {
+                for (int q : bundle_for(best)) {
+                    eng.add(q);
+                    out.history.push_back({q, true, eng.rss(), 0.0});
+                }
+                current = add_score[best];
+                out.history.back().criterion = current;
+                changed = true;
+            }
+        }
+
+        // ---- drops (repeat while they improve) ----
+        if (opt.direction != StepwiseDirection::Forward) {
+            for (;;) {
+                const int p = eng.size();
+                if (p == 0) break;
+                Eigen::MatrixXd W = eng.r_inverse_transpose();
+                Eigen::MatrixXd Q;
+                Eigen::VectorXd e, h;
+                if (use_press) {
+                    Q = eng.q_matrix();
+                    eng.residuals_and_leverages(Q, e, h);
+                }
+                doe_parallel::parallel_for(p, opt.threads, [&](int i) {
+                    int t = eng.term_at(i);
+                    drop_score[t] = inf;
+                    if (t == intercept) return;
+                    if (!out.history.empty() && out.history.back().added && out.history.back().term == t
+                        && opt.direction == StepwiseDirection::Both) return;
+                    if (opt.hierarchical) {
+                        for (int q = 0; q < p; ++q) {
+                            const auto& pq = parents[eng.term_at(q)];
+                            if (std::find(pq.begin(), pq.end(), t) != pq.end()) return;
+                        }
+                    }
+                    drop_score[t] = use_press
+                        ? eng.press_after_drop(i, W, Q, e, h)
+                        : criterion_value(opt.criterion, eng.rss_after_drop(i, W), p - 1, N);
+                });
+
+                int best = -1;
+                for (int i = 0; i < p; ++i) {
+                    int t = eng.term_at(i);
+                    if (drop_score[t] < current - 1e-12 && (best < 0 || drop_score[t] < drop_score[best] ||
+                        (drop_score[t] == drop_score[best] && t < best)))
+                        best = t;
+                }
+                if (best < 0) break;
+                eng.drop(best);
+                current = drop_score[best];
+                out.history.push_back({best, false, eng.rss(), current});
+                changed = true;
+            }
+        }
+
+        if (!changed) break;
+    }
+
+    std::vector<int> selected;
+    for (int i = 0; i < eng.size(); ++i) selected.push_back(eng.term_at(i));
+    TermSelectionResult res = finish_selection(candidates, X, y, selected);
+    res.rss = eng.rss();
+    res.criterion = current;
+    res.history = std::move(out.history);
+    return res;
+}
+
+// -----------------------------------------------------------------------------
+// Best-subset search by branch and bound
+// Starts from the QR of the full candidate model and visits subsets by dropping
+// terms (Givens updates on the small triangular factor only). A node's RSS is a
+// lower bound for every subset below it, so a subtree is pruned once it cannot
+// beat the best subset of any reachable size. The first-level subtrees run in
+// parallel with their own incumbents and are merged in a fixed order.
+// For each size the minimum-RSS subset is kept; AIC / BIC then pick the size,
+// PRESS is evaluated on those per-size winners.
+// -----------------------------------------------------------------------------
+inline BestSubsetResult best_subset_select(const PolynomialTermSet& candidates,
+                                           const DesignMatrix& X,
+                                           const std::vector<double>& y,
+                                           const TermSelectionOptions& opt = {})
+{
+    using namespace selection_detail;
+    check_selection_inputs("best_subset_select", candidates, X, y);
+
+    const int N = X.runs;
+    const int m = candidates.size();
+    const int max_terms = std::min(m, opt.max_terms > 0 ? opt.max_terms : N - 2);
+    const auto parents = divisor_lists(candidates);
+    const int intercept = opt.keep_intercept ? find_intercept(candidates) : -1;
+    const int forced = (intercept >= 0) ? 1 : 0;
+
+    if (m - forced > opt.max_candidates)
+        throw std::runtime_error("best_subset_select: too many candidate terms ("
+                                 + std::to_string(m - forced) + " > max_candidates); use stepwise_select");
+    if (m > N - 1)
+        throw std::runtime_error("best_subset_select: needs runs > number of candidate terms");
+
+    Eigen::MatrixXd Phi = polynomial_feature_matrix(candidates, X);
+    Eigen::Map<const Eigen::VectorXd> Y(y.data(), N);
+    QRSubsetEngine eng(Phi, Y, false);
+    if (intercept >= 0) eng.add(intercept);
+    for (int t = 0; t < m; ++t) {
+        if (t == intercept) continue;
+        if (eng.aliased(t, opt.alias_tol))
+            throw std::runtime_error("best_subset_select: candidate model is rank deficient");
+        eng.add(t);
+    }
+
+    struct Node {
+        Eigen::MatrixXd T;        // [R | Q^T y], p x (p + 1)
+        std::vector<int> cols;    // term at each position
+        int fixed = 0;            // positions [0, fixed) stay in every descendant
+        double rss = 0.0;
+    };
+    struct Incumbents {
+        std::vector<double> rss;
+        std::vector<std::vector<int>> subset;
+        long long nodes = 0;
+    };
+
+    auto drop_child = [](const Node& parent, int pos) {
+        Node c;
+        const int p = static_cast<int>(parent.cols.size());
+        Eigen::MatrixXd T = parent.T;
+        move_column_back_and_retriangularize(T, pos, p - 1);
+        double g = T(p - 1, p);
+        c.T.resize(p - 1, p);
+        c.T.leftCols(p - 1) = T.topLeftCorner(p - 1, p - 1);
+        c.T.col(p - 1) = T.col(p).head(p - 1);
+        c.cols = parent.cols;
+        c.cols.erase(c.cols.begin() + pos);
+        c.fixed = pos;
+        c.rss = parent.rss + g * g;
+        return c;
+    };
+
+    std::vector<char> mark_proto(m, 0);
+    auto visit = [&](auto&& self, const Node& node, Incumbents& inc, std::vector<char>& mark) -> void {
+        ++inc.nodes;
+        const int p = static_cast<int>(node.cols.size());
+        if (p <= max_terms && node.rss < inc.rss[p] &&
+            (!opt.hierarchical || is_hierarchical(node.cols, parents, mark))) {
+            inc.rss[p] = node.rss;
+            inc.subset[p] = node.cols;
+        }
+        bool promising = false;
+        for (int s = std::max(node.fixed, 1); s < p && !promising; ++s)
+            promising = node.rss < inc.rss[s];
+        if (!promising) return;
+        for (int pos = node.fixed; pos < p; ++pos)
+            self(self, drop_child(node, pos), inc, mark);
+    };
+
+    Node root;
+    root.T = eng.triangular_factor();
+    for (int i = 0; i < m; ++i) root.cols.push_back(eng.term_at(i));
+    root.fixed = forced;
+    root.rss = eng.rss();
+
+    auto fresh = [&]() {
+        Incumbents inc;
+        inc.rss.assign(m + 1, std::numeric_limits<double>::infinity());
+        inc.subset.assign(m + 1, {});
+        return inc;
+    };
+
+    // root itself, then each first-level subtree as its own task
+    Incumbents merged = fresh();
+    {
+        std::vector<char> mark(mark_proto);
+        ++merged.nodes;
+        if (m <= max_terms && (!opt.hierarchical || is_hierarchical(root.cols, parents, mark))) {
+            merged.rss[m] = root.rss;
+            merged.subset[m] = root.cols;
+        }
+    }
+    const int tasks = m - forced;
+    std::vector<Incumbents> local(tasks);
+    doe_parallel::parallel_for(tasks, opt.threads, [&](int j) {
+        local[j] = fresh();
+        std::vector<char> mark(mark_proto);
+        visit(visit, drop_child(root, forced + j), local[j], mark);
+    });
+    for (int j = 0; j < tasks; ++j) {
+        merged.nodes += local[j].nodes;
+        for (int s = 0; s <= m; ++s) {
+            if (local[j].rss[s] < merged.rss[s]) {
+                merged.rss[s] = local[j].rss[s];
+                merged.subset[s] = local[j].subset[s];
+            }
+        }
+    }
+
+    BestSubsetResult out;
+    out.nodes = merged.nodes;
+    out.by_size.resize(m + 1);
+    int best_size = -1;
+    for (int s = 0; s <= m; ++s) {
+        if (merged.subset[s].empty()) continue;
+        SubsetSummary& sum = out.by_size[s];
+        sum.selected = merged.subset[s];
+        std::sort(sum.selected.begin(), sum.selected.end());
+        sum.rss = merged.rss[s];
+        if (opt.criterion == SelectionCriterion::PRESS) {
+            QRSubsetEngine sub(Phi, Y, true);
+            for (int t : sum.selected) sub.add(t);
+            sum.criterion = sub.press();
+        } else {
+            sum.criterion = criterion_value(opt.criterion, sum.rss, s, N);
+        }
+        if (best_size < 0 || sum.criterion < out.by_size[best_size].criterion)
+            best_size = s;
+    }
+    if (best_size < 0)
+        throw std::runtime_error("best_subset_select: no admissible subset");
+
+    out.best = finish_selection(candidates, X, y, out.by_size[best_size].selected);
+    out.best.rss = out.by_size[best_size].rss;
+    out.best.criterion = out.by_size[best_size].criterion;
+    return out;
+}
@@ -0,0 +1,267 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <random>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#include "orthogonal_array.hpp"
+#include "response_surface_quadratic.hpp"
+#include "polynomial_response_surface.hpp"
+#include "doe_parallel.hpp"
+
+// -----------------------------------------------------------------------------
+// Cross-validation of least-squares response surfaces without refitting
+//
+// One column-pivoted QR of Phi gives the whitened basis Z = Phi P R^-1 (N x r,
+// Z^T Z = I, r = numerical rank). Then
+//   leverage   h_i = ||Z_i||^2
+//   LOO        e_(i) = e_i / (1 - h_i)
+//   k-fold     removing fold F downdates Z^T Z = I to G_F = I - Z_F^T Z_F, so
+//              b_(F) = G_F^-1 (Z^T y - Z_F^T y_F),  yhat_F = Z_F b_(F)
+// Cost: one fit plus O(n_F r^2 + r^3) per fold, instead of N (or k) refits.
+// Rank-deficient designs use the same basic solution as ColPivHouseholderQR::solve.
+// -----------------------------------------------------------------------------
+
+struct CrossValidationResult {
+    int runs = 0;
+    int rank = 0;                      // numerical rank of Phi
+    int folds = 0;                     // N for leave-one-out
+    double rss = 0.0;                  // training residual sum of squares
+    double press = 0.0;                // sum of squared cross-validated residuals
+    double r2 = 0.0;                   // 1 - RSS / SST
+    double q2 = 0.0;                   // 1 - PRESS / SST (predictive R^2)
+    double rmse_cv = 0.0;              // sqrt(PRESS / N)
+    std::vector<double> residuals;     // training residuals y - yhat
+    std::vector<double> cv_residuals;  // y_i - yhat_(-fold(i))
+    std::vector<double> leverage;      // hat diagonal h_ii
+    std::vector<int> fold;             // fold of each run (leave-one-out: run index)
+};
+
+struct KFoldOptions {
+    int folds = 5;
+    bool shuffle = true;               // false: run i goes to fold i % folds
+    std::uint64_t seed = 12345;
+    int threads = 0;                   // 0 = hardware concurrency
+};
+
+namespace cv_detail {
+
+// Quadratic feature matrix in ResponseSurfaceQuadratic term order
+inline Eigen::MatrixXd quadratic_feature_matrix(const std::vector<std::vector<double>>& design)
+{
+    if (design.empty())
+        throw std::runtime_error("quadratic_feature_matrix: empty design");
+    const int N = static_cast<int>(design.size());
+    const int k = static_cast<int>(design[0].size());
+    const int m = ResponseSurfaceQuadratic::num_terms(k);
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Phi(N, m);
+    for (int r = 0; r < N; ++r) {
+        if ((int)design[r].size() != k)
+            throw std::runtime_error("quadratic_feature_matrix: dimension mismatch");
+        ResponseSurfaceQuadratic::expand_terms(design[r].data(), k, Phi.row(r).data());
+    }
+    return Phi;
+}
+
+struct WhitenedFit {
+    Eigen::MatrixXd Z;       // N x r, orthonormal columns
+    Eigen::VectorXd c;       // Z^T y
+    Eigen::VectorXd e;       // y - Z c
+    int rank = 0;
+};
+
+inline WhitenedFit whiten(const Eigen::MatrixXd& Phi, const Eigen::VectorXd& y)
+{
+    Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(Phi);
+    WhitenedFit w;
+    w.rank = static_cast<int>(qr.rank());
+    const int r = w.rank;
+    Eigen::MatrixXd PhiP = Phi * qr.colsPermutation();
+    w.Z = qr.matrixR().topLeftCorner(r, r).triangularView<Eigen::Upper>()
+              .solve<Eigen::OnTheRight>(PhiP.leftCols(r));
+    w.c.noalias() = w.Z.transpose() * y;
+    w.e = y;
+    w.e.noalias() -= w.Z * w.c;
+    return w;
+}
+
+inline void summarize(const Eigen::VectorXd& y, const WhitenedFit& w, CrossValidationResult& out)
+{
+    const int N = static_cast<int>(y.size());
+    double mean = y.mean();
+    double sst = (y.array() - mean).square().sum();
+    out.runs = N;
+    out.rank = w.rank;
+    out.rss = w.e.squaredNorm();
+    out.residuals.assign(w.e.data(), w.e.data() + N);
+    out.press = 0.0;
+    for (double v : out.cv_residuals) out.press += v * v;
+    out.r2 = (sst > 0.0) ? 1.0 - out.rss / sst : 0.0;
+    out.q2 = (sst > 0.0) ? 1.0 - out.press / sst : 0.0;
+    out.rmse_cv = std::sqrt(out.press / N);
+}
+
+inline void check_inputs(const char* fn, const Eigen::MatrixXd& Phi, const std::vector<double>& y)
+{
+    if (Phi.rows() == 0 || (Eigen::Index)y.size() != Phi.rows())
+        throw std::runtime_error(std::string(fn) + ": need y.size() == runs > 0");
+}
+
+} // namespace cv_detail
+
+// -----------------------------------------------------------------------------
+// Leave-one-out from the hat diagonal. Runs with h_ii = 1 (the model interpolates
+// them) have an infinite LOO residual, so PRESS is infinite for saturated designs.
+// -----------------------------------------------------------------------------
+inline CrossValidationResult loo_cross_validation(const Eigen::MatrixXd& Phi, const std::vector<double>& y)
+{
+    cv_detail::check_inputs("loo_cross_validation", Phi, y);
+    Eigen::Map<const Eigen::VectorXd> Y(y.data(), static_cast<Eigen::Index>(y.size()));
+    cv_detail::WhitenedFit w = cv_detail::whiten(Phi, Y);
+
+    const int N = static_cast<int>(y.size());
+    CrossValidationResult out;
+    out.folds = N;
+    out.leverage.resize(N);
+    out.cv_residuals.resize(N);
+    out.fold.resize(N);
+    for (int i = 0; i < N; ++i) {
+        double h = w.Z.row(i).squaredNorm();
+        double d = 1.0 - h;
+        out.leverage[i] = h;
+        out.cv_residuals[i] = (d > 1e-10) ? w.e(i) / d : std::numeric_limits<double>::infinity();
+        out.fold[i] = i;
+    }
+    cv_detail::summarize(Y, w, out);
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// k-fold by downdating the whitened Gram matrix. Folds are solved in parallel.
+// Throws if removing a fold leaves the model inestimable (G_F not positive definite).
+// -----------------------------------------------------------------------------
+inline CrossValidationResult kfold_cross_validation(const Eigen::MatrixXd& Phi,
+                                                    const std::vector<double>& y,
+                                                    const KFoldOptions& opt = {})
+{
+    cv_detail::check_inputs("kfold_cross_validation", Phi, y);
+    const int N = static_cast<int>(y.size());
+    if (opt.folds < 2 || opt.folds > N)
+        throw std::runtime_error("kfold_cross_validation: folds must be in [2, runs]");
+
+    Eigen::Map<const Eigen::VectorXd> Y(y.data(), N);
+    cv_detail::WhitenedFit w = cv_detail::whiten(Phi, Y);
+    const int r = w.rank;
+
+    CrossValidationResult out;
+    out.folds = opt.folds;
+    out.fold.resize(N);
+    std::vector<int> perm(N);
+    std::iota(perm.begin(), perm.end(), 0);
+    if (opt.shuffle) {
+        std::mt19937_64 rng(opt.seed);
+        std::shuffle(perm.begin(), perm.end(), rng);
+    }
+    std::vector<std::vector<int>> members(opt.folds);
+    for (int i = 0; i < N; ++i) {
+        int f = i % opt.folds;
+        out.fold[perm[i]] = f;
+        members[f].push_back(perm[i]);
+    }
+
+    out.leverage.resize(N);
+    for (int i = 0; i < N; ++i) out.leverage[i] = w.Z.row(i).squaredNorm();
+    out.cv_residuals.assign(N, 0.0);
+
+    std::vector<char> singular(opt.folds, 0);
+    doe_parallel::parallel_for(opt.folds, opt.threads, [&](int f) {
+        const auto& rows = members[f];
+        const int n = static_cast<int>(rows.size());
+        Eigen::MatrixXd ZF(n, r);
+        Eigen::VectorXd yF(n);
+        for (int q = 0; q < n; ++q) {
+            ZF.row(q) = w.Z.row(rows[q]);
+            yF(q) = Y(rows[q]);
+        }
+        Eigen::MatrixXd G = Eigen::MatrixXd::Identity(r, r);
+        G.selfadjointView<Eigen::Lower>().rankUpdate(ZF.transpose(), -1.0);
+        Eigen::LLT<Eigen::MatrixXd> llt(G.selfadjointView<Eigen::Lower>());
+        if (llt.info() != Eigen::Success || llt.matrixLLT().diagonal().minCoeff() <= 1e-7) {
+            singular[f] = 1;
+            return;
+        }
+        Eigen::VectorXd b = llt.solve(w.c - ZF.transpose() * yF);
+        Eigen::VectorXd res = yF - ZF * b;
+        for (int q = 0; q < n; ++q) out.cv_residuals[rows[q]] = res(q);
+    });
+    for (int f = 0; f < opt.folds; ++f) {
+        if (singular[f])
+            throw std::runtime_error("kfold_cross_validation: model not estimable without fold "
+                                     + std::to_string(f));
+    }
+
+    cv_detail::summarize(Y, w, out);
+    return out;
+}
+
+// ---- quadratic model (ResponseSurfaceQuadratic term order) ----
+inline CrossValidationResult loo_cross_validation(const std::vector<std::vector<double>>& design,
+                                                  const std::vector<double>& y)
+{
+    return loo_cross_validation(cv_detail::quadratic_feature_matrix(design), y);
+}
+
+inline CrossValidationResult kfold_cross_validation(const std::vector<std::vector<double>>& design,
+                                                    const std::vector<double>& y,
+                                                    const KFoldOptions& opt = {})
+{
+    return kfold_cross_validation(cv_detail::quadratic_feature_matrix(design), y, opt);
+}
+
+// ---- arbitrary polynomial terms ----
+inline CrossValidationResult loo_cross_validation(const PolynomialTermSet& terms,
+                                                  const DesignMatrix& X,
+                                                  const std::vector<double>& y)
+{
+    return loo_cross_validation(polynomial_feature_matrix(terms, X), y);
+}
+
+inline CrossValidationResult kfold_cross_validation(const PolynomialTermSet& terms,
+                                                    const DesignMatrix& X,
+                                                    const std::vector<double>& y,
+                                                    const KFoldOptions& opt = {})
+{
+    return kfold_cross_validation(polynomial_feature_matrix(terms, X), y, opt);
+}
+
+// ---- quadratic model on selected OA factors (same design as run_doe_full_analysis) ----
+inline CrossValidationResult loo_cross_validation_for_factors(
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices,
+    const std::vector<double>& y)
+{
+    if ((int)y.size() != oa.runs)
+        throw std::runtime_error("loo_cross_validation_for_factors: y size must match oa.runs");
+    return loo_cross_validation(
+        build_design_from_orthogonal_array_for_factors(oa, all_levels, factor_indices), y);
+}
+
+inline CrossValidationResult kfold_cross_validation_for_factors(
+    const OrthogonalArray& oa,
+    const std::vector<FactorLevels>& all_levels,
+    const std::vector<int>& factor_indices,
+    const std::vector<double>& y,
+    const KFoldOptions& opt = {})
+{
+    if ((int)y.size() != oa.runs)
+        throw std::runtime_error("kfold_cross_validation_for_factors: y size must match oa.runs");
+    return kfold_cross_validation(
+        build_design_from_orthogonal_array_for_factors(oa, all_levels, factor_indices), y, opt);
+}